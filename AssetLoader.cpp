@@ -0,0 +1,378 @@
+#include "AssetLoader.h"
+#include "Profiler.h"
+#include "TextureCooker.h"
+#include "DDSTextureLoader.h"
+#include <wincodec.h>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+
+using namespace Microsoft::WRL;
+
+bool AssetLoader::UseCookedTextures = true;
+
+// Milliseconds since the given time
+static double MsSince(std::chrono::high_resolution_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// Just the file name, for logging
+static std::string FileName(const std::string& path)
+{
+	size_t slash = path.find_last_of("/\\");
+	return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+static std::string FileName(const std::wstring& path)
+{
+	size_t slash = path.find_last_of(L"/\\");
+	std::wstring name = slash == std::wstring::npos ? path : path.substr(slash + 1);
+	std::string narrow;
+	for (wchar_t c : name)
+		narrow += (char)c;
+	return narrow;
+}
+
+AssetLoader::AssetLoader(
+	ComPtr<ID3D11Device> device,
+	ComPtr<ID3D11DeviceContext> context,
+	std::shared_ptr<MeshRegistry> meshRegistry,
+	unsigned int threadCount)
+{
+	this->device = device;
+	this->context = context;
+	this->meshRegistry = meshRegistry;
+	workers = std::make_unique<ThreadPool>(threadCount);
+}
+
+AssetLoader::~AssetLoader()
+{
+}
+
+// --------------------------------------------------------
+// Starts decoding an image on a worker thread
+//
+// path    - Full path to any WIC supported image
+// texture - Where to put the finished SRV (must outlive Finish())
+// cooked  - Load it from its cooked DDS, rather than as RGBA8
+// maxSize - Skip the cooked levels bigger than this (0 for none),
+//           to be streamed in later (see TextureStreamer)
+// --------------------------------------------------------
+void AssetLoader::QueueTexture(const std::wstring& path, ComPtr<ID3D11ShaderResourceView>& texture, bool cooked, unsigned int maxSize)
+{
+	assets.push_back(std::make_unique<PendingAsset>());
+	PendingAsset* asset = assets.back().get();
+	asset->Name = FileName(path);
+	asset->TexturePath = path;
+	asset->Cooked = cooked;
+	asset->MaxSize = maxSize;
+	asset->TextureDestination = std::addressof(texture); // ComPtr overloads operator&
+
+	workers->Enqueue([this, asset]()
+	{
+		ProfileScope profile("Read texture");
+		auto start = std::chrono::high_resolution_clock::now();
+		asset->Succeeded = ReadTexture(asset);
+		asset->ReadMs = MsSince(start);
+		asset->WorkerThread = GetCurrentThreadId();
+		MarkReady(asset);
+	});
+}
+
+// --------------------------------------------------------
+// Starts packing single channel maps into one ORM texture
+// on a worker thread (see TextureCooker::FindORMSources)
+// --------------------------------------------------------
+void AssetLoader::QueuePackedTexture(const ORMSources& sources, ComPtr<ID3D11ShaderResourceView>& texture, bool cooked, unsigned int maxSize)
+{
+	std::string name = FileName(TextureCooker::GetPackedPath(sources));
+
+	assets.push_back(std::make_unique<PendingAsset>());
+	PendingAsset* asset = assets.back().get();
+	asset->Name = name.substr(0, name.find(".cooked.dds"));
+	asset->PackedSources = sources;
+	asset->Cooked = cooked;
+	asset->MaxSize = maxSize;
+	asset->TextureDestination = std::addressof(texture);
+
+	workers->Enqueue([this, asset]()
+	{
+		ProfileScope profile("Read texture");
+		auto start = std::chrono::high_resolution_clock::now();
+		asset->Succeeded = ReadTexture(asset);
+		asset->ReadMs = MsSince(start);
+		asset->WorkerThread = GetCurrentThreadId();
+		MarkReady(asset);
+	});
+}
+
+// --------------------------------------------------------
+// Starts reading a mesh (or its cache) on a worker thread
+//
+// path - Full path to the .obj file
+// mesh - Where to put the finished mesh (must outlive Finish())
+// --------------------------------------------------------
+void AssetLoader::QueueMesh(const std::string& path, std::shared_ptr<Mesh>& mesh)
+{
+	// Already queued?  Just hand out the same mesh when it's done
+	auto existing = queuedMeshes.find(path);
+	if (existing != queuedMeshes.end())
+	{
+		existing->second->MeshDestinations.push_back(&mesh);
+		return;
+	}
+
+	assets.push_back(std::make_unique<PendingAsset>());
+	PendingAsset* asset = assets.back().get();
+	asset->Name = FileName(path);
+	asset->IsMesh = true;
+	asset->MeshPath = path;
+	asset->MeshDestinations.push_back(&mesh);
+	queuedMeshes[path] = asset;
+
+	workers->Enqueue([this, asset]()
+	{
+		ProfileScope profile("Read mesh");
+		auto start = std::chrono::high_resolution_clock::now();
+		asset->Succeeded = Mesh::LoadSource(asset->MeshPath.c_str(), asset->Geometry);
+		asset->ReadMs = MsSince(start);
+		asset->WorkerThread = GetCurrentThreadId();
+		MarkReady(asset);
+	});
+}
+
+// --------------------------------------------------------
+// Creates the GPU resources for every queued asset, in the
+// order their CPU work finishes, then logs how long each took
+// --------------------------------------------------------
+void AssetLoader::Finish()
+{
+	ProfileScope profile("Load assets");
+	auto start = std::chrono::high_resolution_clock::now();
+
+	for (size_t created = 0; created < assets.size(); created++)
+	{
+		// Wait for the next asset to be ready
+		PendingAsset* asset;
+		{
+			std::unique_lock<std::mutex> lock(readyMutex);
+			assetReady.wait(lock, [this]() { return !readyAssets.empty(); });
+			asset = readyAssets.front();
+			readyAssets.pop();
+		}
+
+		ProfileScope createProfile(asset->IsMesh ? "Create mesh" : "Create texture");
+		auto createStart = std::chrono::high_resolution_clock::now();
+		if (asset->IsMesh)
+			CreateMesh(asset);
+		else
+			CreateTexture(asset);
+		asset->CreateMs = MsSince(createStart);
+	}
+
+	double totalMs = MsSince(start);
+
+#if defined(DEBUG) || defined(_DEBUG)
+	printf("\n--- Asset loading (%u worker threads) ---\n", workers->GetThreadCount());
+	double serialMs = 0;
+	for (auto& asset : assets)
+	{
+		printf("  read %8.3f ms   create %7.3f ms   thread %5lu   %s%s%s\n",
+			asset->ReadMs, asset->CreateMs, asset->WorkerThread, asset->Name.c_str(),
+			asset->IsMesh ? "" : asset->TextureNote, asset->Succeeded ? "" : "  (FAILED)");
+		serialMs += asset->ReadMs + asset->CreateMs;
+	}
+	printf("Loaded %zu assets in %.3f ms (%.3f ms if loaded one at a time)\n", assets.size(), totalMs, serialMs);
+#endif
+
+	// Free the CPU copies now that everything is on the GPU
+	assets.clear();
+	queuedMeshes.clear();
+}
+
+// --------------------------------------------------------
+// Called on a worker thread once an asset's CPU work is done
+// --------------------------------------------------------
+void AssetLoader::MarkReady(PendingAsset* asset)
+{
+	{
+		std::lock_guard<std::mutex> lock(readyMutex);
+		readyAssets.push(asset);
+	}
+	assetReady.notify_one();
+}
+
+// --------------------------------------------------------
+// Called on a worker thread to get a texture's CPU data:
+// its cooked DDS if that's up to date, or else the decoded
+// (or packed) image, cooked and saved for next time
+// --------------------------------------------------------
+bool AssetLoader::ReadTexture(PendingAsset* asset)
+{
+	bool packed = asset->TexturePath.empty();
+	auto load = [asset, packed]()
+	{
+		return packed ?
+			TextureCooker::LoadORM(asset->PackedSources, asset->Texture) :
+			DecodeImage(asset->TexturePath, asset->Texture);
+	};
+
+	if (!UseCookedTextures || !asset->Cooked)
+		return load();
+
+	// The source's hash tells us if the cooked file is stale
+	unsigned long long sourceHash;
+	if (packed ?
+		!TextureCooker::HashORM(asset->PackedSources, sourceHash) :
+		!TextureCooker::HashSource(asset->TexturePath, sourceHash))
+		return false;
+
+	std::wstring cookedPath = packed ? TextureCooker::GetPackedPath(asset->PackedSources) : TextureCooker::GetCookedPath(asset->TexturePath);
+	std::unique_ptr<MappedFile> cookedFile = std::make_unique<MappedFile>(cookedPath.c_str());
+	if (TextureCooker::IsUpToDate(cookedFile->GetData(), cookedFile->GetSize(), sourceHash))
+	{
+		asset->CookedFile = std::move(cookedFile);
+		asset->TextureNote = "  (cooked)";
+		return true;
+	}
+	cookedFile.reset();
+
+	if (!load())
+		return false;
+
+	// Every worker is busy with its own asset, so this cooks on just this one
+	TextureKind kind = packed ? TextureKind::Packed : TextureCooker::KindFromName(asset->TexturePath);
+	TextureCooker::Cook(asset->Texture, kind, MipFilter::Kaiser, sourceHash, asset->CookedTexture);
+	TextureCooker::Write(cookedPath, asset->CookedTexture);
+	asset->Texture = TextureData();
+	asset->TextureNote = "  (cooked just now)";
+	return true;
+}
+
+// --------------------------------------------------------
+// Creates a cooked texture straight from its DDS data, or
+// uploads decoded pixels and generates the mip chain, the
+// same way CreateWICTextureFromFile does when given a context
+// --------------------------------------------------------
+void AssetLoader::CreateTexture(PendingAsset* asset)
+{
+	if (!asset->Succeeded)
+		return;
+
+	if (asset->CookedFile || !asset->CookedTexture.empty())
+	{
+		const unsigned char* data = asset->CookedFile ? asset->CookedFile->GetData() : asset->CookedTexture.data();
+		size_t size = asset->CookedFile ? asset->CookedFile->GetSize() : asset->CookedTexture.size();
+		// Only a cooked file on disk can have the rest of its levels streamed in later
+		if (asset->MaxSize == 0 || !asset->CookedFile)
+		{
+			asset->Succeeded = SUCCEEDED(DirectX::CreateDDSTextureFromMemory(device.Get(), data, size, 0, asset->TextureDestination->ReleaseAndGetAddressOf()));
+			return;
+		}
+
+		CookedLayout layout;
+		asset->Succeeded =
+			TextureCooker::ReadLayout(data, size, layout) &&
+			CreateCookedTexture(device.Get(), data, size, TextureCooker::GetFirstMip(layout, asset->MaxSize), *asset->TextureDestination);
+		return;
+	}
+
+	D3D11_TEXTURE2D_DESC desc = {};
+	desc.Width = asset->Texture.Width;
+	desc.Height = asset->Texture.Height;
+	desc.MipLevels = 0; // Full chain
+	desc.ArraySize = 1;
+	desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET;
+	desc.MiscFlags = D3D11_RESOURCE_MISC_GENERATE_MIPS;
+
+	ComPtr<ID3D11Texture2D> texture;
+	if (FAILED(device->CreateTexture2D(&desc, 0, texture.GetAddressOf())))
+	{
+		asset->Succeeded = false;
+		return;
+	}
+
+	context->UpdateSubresource(texture.Get(), 0, 0, asset->Texture.Pixels.data(), asset->Texture.Width * 4, 0);
+	device->CreateShaderResourceView(texture.Get(), 0, asset->TextureDestination->ReleaseAndGetAddressOf());
+	context->GenerateMips(asset->TextureDestination->Get());
+}
+
+bool AssetLoader::CreateCookedTexture(ID3D11Device* device, const unsigned char* dds, size_t size, unsigned int firstMip,
+	ComPtr<ID3D11ShaderResourceView>& texture)
+{
+	CookedLayout layout;
+	if (!TextureCooker::ReadLayout(dds, size, layout) || !TextureCooker::IsBlockAligned(layout, firstMip))
+		return false;
+
+	std::vector<D3D11_SUBRESOURCE_DATA> levels(layout.MipCount - firstMip);
+	for (unsigned int mip = firstMip; mip < layout.MipCount; mip++)
+	{
+		unsigned int width = layout.Width >> mip ? layout.Width >> mip : 1;
+		levels[mip - firstMip].pSysMem = dds + layout.Offsets[mip];
+		levels[mip - firstMip].SysMemPitch = ((width + 3) / 4) * layout.BlockSize;
+	}
+
+	D3D11_TEXTURE2D_DESC desc = {};
+	desc.Width = layout.Width >> firstMip;
+	desc.Height = layout.Height >> firstMip;
+	desc.MipLevels = layout.MipCount - firstMip;
+	desc.ArraySize = 1;
+	desc.Format = (DXGI_FORMAT)layout.Format;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_IMMUTABLE;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+	ComPtr<ID3D11Texture2D> created;
+	ComPtr<ID3D11ShaderResourceView> view;
+	if (FAILED(device->CreateTexture2D(&desc, levels.data(), created.GetAddressOf())) ||
+		FAILED(device->CreateShaderResourceView(created.Get(), 0, view.GetAddressOf())))
+		return false;
+
+	texture = view;
+	return true;
+}
+
+void AssetLoader::CreateMesh(PendingAsset* asset)
+{
+	std::shared_ptr<Mesh> mesh = meshRegistry->Add(asset->MeshPath, std::make_shared<Mesh>(asset->Geometry, device));
+	for (std::shared_ptr<Mesh>* destination : asset->MeshDestinations)
+		*destination = mesh;
+}
+
+// --------------------------------------------------------
+// Decodes an image file into tightly packed RGBA8 pixels
+// using WIC (each call initializes COM for its thread)
+// --------------------------------------------------------
+bool AssetLoader::DecodeImage(const std::wstring& path, TextureData& texture)
+{
+	HRESULT comResult = CoInitializeEx(0, COINIT_MULTITHREADED);
+
+	bool success = false;
+	{
+		ComPtr<IWICImagingFactory> factory;
+		ComPtr<IWICBitmapDecoder> decoder;
+		ComPtr<IWICBitmapFrameDecode> frame;
+		ComPtr<IWICFormatConverter> converter;
+
+		if (SUCCEEDED(CoCreateInstance(CLSID_WICImagingFactory, 0, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(factory.GetAddressOf()))) &&
+			SUCCEEDED(factory->CreateDecoderFromFilename(path.c_str(), 0, GENERIC_READ, WICDecodeMetadataCacheOnDemand, decoder.GetAddressOf())) &&
+			SUCCEEDED(decoder->GetFrame(0, frame.GetAddressOf())) &&
+			SUCCEEDED(factory->CreateFormatConverter(converter.GetAddressOf())) &&
+			SUCCEEDED(converter->Initialize(frame.Get(), GUID_WICPixelFormat32bppRGBA, WICBitmapDitherTypeNone, 0, 0.0, WICBitmapPaletteTypeCustom)) &&
+			SUCCEEDED(converter->GetSize(&texture.Width, &texture.Height)))
+		{
+			texture.Pixels.resize((size_t)texture.Width * texture.Height * 4);
+			success = SUCCEEDED(converter->CopyPixels(0, texture.Width * 4, (UINT)texture.Pixels.size(), texture.Pixels.data()));
+		}
+	}
+
+	// Only balance the init if it worked (it fails if COM was already set up differently)
+	if (SUCCEEDED(comResult))
+		CoUninitialize();
+
+	return success;
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Mesh.h"
+#include "MeshRegistry.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+#include "TextureCooker.h"
+
+// --------------------------------------------------------
+// Decoded RGBA8 pixels of an image, ready for upload
+// --------------------------------------------------------
+struct TextureData
+{
+	unsigned int Width = 0;
+	unsigned int Height = 0;
+	std::vector<unsigned char> Pixels;
+};
+
+// --------------------------------------------------------
+// Loads startup assets in parallel
+//
+// - Queue...() starts reading/decoding the file on a worker
+//   thread right away
+// - Textures load from their cooked, block compressed DDS
+//   (see TextureCooker) when it's up to date. Otherwise
+//   the worker cooks and saves it first.
+// - Finish() must be called on the thread that owns the
+//   device context; it creates each GPU resource as soon
+//   as its CPU data is ready, fills in the destinations
+//   given when queueing, and logs per-asset timings
+// - Meshes are added to the mesh registry, and queueing
+//   the same mesh twice only loads it once
+// --------------------------------------------------------
+class AssetLoader
+{
+public:
+	AssetLoader(
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		std::shared_ptr<MeshRegistry> meshRegistry,
+		unsigned int threadCount = 0);
+	~AssetLoader();
+
+	void QueueTexture(const std::wstring& path, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& texture, bool cooked = true, unsigned int maxSize = 0);
+	void QueuePackedTexture(const ORMSources& sources, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& texture, bool cooked = true, unsigned int maxSize = 0);
+	void QueueMesh(const std::string& path, std::shared_ptr<Mesh>& mesh);
+
+	void Finish();
+
+	// Decodes any WIC supported image into RGBA8 pixels - safe to call from any thread
+	static bool DecodeImage(const std::wstring& path, TextureData& texture);
+
+	// Creates a texture from a cooked DDS's levels, from firstMip down. Only
+	// uses the device (which is free threaded), so it's safe on any thread.
+	static bool CreateCookedTexture(ID3D11Device* device, const unsigned char* dds, size_t size, unsigned int firstMip,
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& texture);
+
+	// Off, every texture is decoded and uploaded as RGBA8 with GPU generated
+	// mips, as textures queued with cooked = false are
+	static bool UseCookedTextures;
+
+private:
+	// One queued file and everything it turns into
+	struct PendingAsset
+	{
+		std::string Name;
+		bool IsMesh = false;
+		bool Succeeded = false;
+		bool Cooked = true;
+		unsigned int MaxSize = 0;						// Largest cooked top level to create, 0 for all
+
+		std::wstring TexturePath;
+		ORMSources PackedSources;						// Set instead of the path for ORM textures
+		TextureData Texture;
+		std::unique_ptr<MappedFile> CookedFile;			// An up to date cooked DDS...
+		std::vector<unsigned char> CookedTexture;		// ...or one cooked just now
+		const char* TextureNote = "";
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>* TextureDestination = 0;
+
+		std::string MeshPath;
+		MeshSource Geometry;
+		std::vector<std::shared_ptr<Mesh>*> MeshDestinations;
+
+		// Timings for the log
+		double ReadMs = 0;
+		double CreateMs = 0;
+		unsigned long WorkerThread = 0;
+	};
+
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	std::shared_ptr<MeshRegistry> meshRegistry;
+
+	std::vector<std::unique_ptr<PendingAsset>> assets;
+	std::unordered_map<std::string, PendingAsset*> queuedMeshes;
+
+	// Assets whose CPU work is done, waiting for Finish()
+	std::mutex readyMutex;
+	std::condition_variable assetReady;
+	std::queue<PendingAsset*> readyAssets;
+
+	// Declared last so the workers are joined before anything they use is destroyed
+	std::unique_ptr<ThreadPool> workers;
+
+	void MarkReady(PendingAsset* asset);
+	bool ReadTexture(PendingAsset* asset);
+	void CreateTexture(PendingAsset* asset);
+	void CreateMesh(PendingAsset* asset);
+};
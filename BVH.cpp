@@ -0,0 +1,798 @@
+#include "BVH.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <numeric>
+
+using namespace DirectX;
+
+// Leaves are split until they hold at most this many objects
+static const unsigned int MaxLeafSize = 4;
+
+// Buckets per axis when looking for the best split
+static const int BinCount = 8;
+
+// How much a subtree's box may grow, by surface area, before it's rebuilt
+static const float RebuildRatio = 1.5f;
+
+// Parent markers for the root and for abandoned nodes
+static const unsigned int NoNode = 0xFFFFFFFF;
+static const unsigned int DeadNode = 0xFFFFFFFE;
+
+// Plain compares, which compile to single instructions where
+// fminf and fmaxf have to handle NaNs and are often calls
+static inline float MinFloat(float a, float b) { return a < b ? a : b; }
+static inline float MaxFloat(float a, float b) { return a > b ? a : b; }
+
+// Bucket a centroid falls in, with the top edge going in the last bucket
+static int BinIndex(float centroid, float low, float scale)
+{
+	int bin = (int)((centroid - low) * scale);
+	return bin < BinCount - 1 ? bin : BinCount - 1;
+}
+
+static float SurfaceArea(const XMFLOAT3& boundsMin, const XMFLOAT3& boundsMax)
+{
+	float x = boundsMax.x - boundsMin.x;
+	float y = boundsMax.y - boundsMin.y;
+	float z = boundsMax.z - boundsMin.z;
+	if (x < 0.0f || y < 0.0f || z < 0.0f)
+		return 0.0f;
+	return 2.0f * (x * y + y * z + z * x);
+}
+
+static void Grow(XMFLOAT3& boundsMin, XMFLOAT3& boundsMax, const XMFLOAT3& otherMin, const XMFLOAT3& otherMax)
+{
+	boundsMin.x = MinFloat(boundsMin.x, otherMin.x);
+	boundsMin.y = MinFloat(boundsMin.y, otherMin.y);
+	boundsMin.z = MinFloat(boundsMin.z, otherMin.z);
+	boundsMax.x = MaxFloat(boundsMax.x, otherMax.x);
+	boundsMax.y = MaxFloat(boundsMax.y, otherMax.y);
+	boundsMax.z = MaxFloat(boundsMax.z, otherMax.z);
+}
+
+// --------------------------------------------------------
+// Where a box sits against a plane: -1 entirely behind
+// it, 1 entirely in front of it, 0 across it
+// --------------------------------------------------------
+static int ClassifyBox(const XMFLOAT4& plane, const XMFLOAT3& boundsMin, const XMFLOAT3& boundsMax)
+{
+	float centerX = (boundsMin.x + boundsMax.x) * 0.5f;
+	float centerY = (boundsMin.y + boundsMax.y) * 0.5f;
+	float centerZ = (boundsMin.z + boundsMax.z) * 0.5f;
+	float distance = plane.x * centerX + plane.y * centerY + plane.z * centerZ + plane.w;
+	float reach =
+		fabsf(plane.x) * (boundsMax.x - centerX) +
+		fabsf(plane.y) * (boundsMax.y - centerY) +
+		fabsf(plane.z) * (boundsMax.z - centerZ);
+
+	if (distance < -reach)
+		return -1;
+	if (distance >= reach)
+		return 1;
+	return 0;
+}
+
+// --------------------------------------------------------
+// Slab test. Returns how far along the ray it enters the
+// box, or FLT_MAX if it misses or enters past maxDistance.
+// --------------------------------------------------------
+static float RayBoxDistance(const XMFLOAT3& origin, const XMFLOAT3& inverseDirection,
+	const XMFLOAT3& boundsMin, const XMFLOAT3& boundsMax, float maxDistance)
+{
+	float x1 = (boundsMin.x - origin.x) * inverseDirection.x;
+	float x2 = (boundsMax.x - origin.x) * inverseDirection.x;
+	float y1 = (boundsMin.y - origin.y) * inverseDirection.y;
+	float y2 = (boundsMax.y - origin.y) * inverseDirection.y;
+	float z1 = (boundsMin.z - origin.z) * inverseDirection.z;
+	float z2 = (boundsMax.z - origin.z) * inverseDirection.z;
+
+	float enter = MaxFloat(MaxFloat(MinFloat(x1, x2), MinFloat(y1, y2)), MaxFloat(MinFloat(z1, z2), 0.0f));
+	float exit = MinFloat(MinFloat(MaxFloat(x1, x2), MaxFloat(y1, y2)), MaxFloat(z1, z2));
+	return exit >= enter && enter < maxDistance ? enter : FLT_MAX;
+}
+
+static float SphereBoxDistanceSq(const XMFLOAT3& center, const XMFLOAT3& boundsMin, const XMFLOAT3& boundsMax)
+{
+	float x = center.x - MaxFloat(boundsMin.x, MinFloat(center.x, boundsMax.x));
+	float y = center.y - MaxFloat(boundsMin.y, MinFloat(center.y, boundsMax.y));
+	float z = center.z - MaxFloat(boundsMin.z, MinFloat(center.z, boundsMax.z));
+	return x * x + y * y + z * z;
+}
+
+BVH::BVH()
+{
+	nodes = 0;
+	nodeCount = 0;
+	deadNodes = 0;
+	needsRebuild = true;
+}
+
+void BVH::Clear()
+{
+	objects.clear();
+	objectDirty.clear();
+	dirtyObjects.clear();
+	needsRebuild = true;
+}
+
+unsigned int BVH::Add(XMFLOAT3 boundsMin, XMFLOAT3 boundsMax)
+{
+	ObjectBounds bounds = { boundsMin, boundsMax };
+	objects.push_back(bounds);
+	objectDirty.push_back(false);
+	needsRebuild = true;
+	return (unsigned int)objects.size() - 1;
+}
+
+void BVH::SetBounds(unsigned int object, XMFLOAT3 boundsMin, XMFLOAT3 boundsMax)
+{
+	ObjectBounds& bounds = objects[object];
+	if (bounds.Min.x == boundsMin.x && bounds.Min.y == boundsMin.y && bounds.Min.z == boundsMin.z &&
+		bounds.Max.x == boundsMax.x && bounds.Max.y == boundsMax.y && bounds.Max.z == boundsMax.z)
+		return;
+
+	bounds.Min = boundsMin;
+	bounds.Max = boundsMax;
+	if (!objectDirty[object])
+	{
+		objectDirty[object] = true;
+		dirtyObjects.push_back(object);
+	}
+}
+
+// --------------------------------------------------------
+// Refits the boxes above every moved object, stopping on
+// each path once a box stops changing, then rebuilds the
+// subtrees that have grown too loose
+// --------------------------------------------------------
+void BVH::Update()
+{
+	if (needsRebuild)
+	{
+		Rebuild();
+		return;
+	}
+	if (dirtyObjects.empty())
+		return;
+
+	degradedNodes.clear();
+	auto checkDegraded = [&](unsigned int node)
+	{
+		float area = SurfaceArea(nodes[node].BoundsMin, nodes[node].BoundsMax);
+		if (nodes[node].Count == 0 && area > 0.0f && area > nodeInfo[node].BuildArea * RebuildRatio)
+			degradedNodes.push_back(node);
+	};
+
+	if (dirtyObjects.size() * 8 > objects.size())
+	{
+		// With this much moving, one sweep of the whole array is cheaper.
+		// Children always sit after their parents, so backwards works.
+		for (unsigned int node = nodeCount; node-- > 0; )
+		{
+			if (nodeInfo[node].Parent == DeadNode)
+				continue;
+			RefitNode(node);
+			checkDegraded(node);
+		}
+	}
+	else
+	{
+		for (unsigned int object : dirtyObjects)
+		{
+			unsigned int node = objectLeaves[object];
+			while (node != NoNode && RefitNode(node))
+			{
+				checkDegraded(node);
+				node = nodeInfo[node].Parent;
+			}
+		}
+	}
+
+	for (unsigned int object : dirtyObjects)
+		objectDirty[object] = false;
+	dirtyObjects.clear();
+
+	RebuildDegraded();
+}
+
+// --------------------------------------------------------
+// Builds the tree over every object from scratch, which
+// also drops any nodes abandoned by subtree rebuilds
+// --------------------------------------------------------
+void BVH::Rebuild()
+{
+	unsigned int count = (unsigned int)objects.size();
+
+	// A tree over n objects never needs more than 2n nodes
+	nodePairs.resize(count + 1);
+	nodeInfo.resize(nodePairs.size() * 2);
+	nodes = &nodePairs[0].Nodes[0];
+	nodeCount = 2;
+	deadNodes = 0;
+
+	objectIndices.resize(count);
+	std::iota(objectIndices.begin(), objectIndices.end(), 0);
+	objectLeaves.resize(count);
+
+	NodeInfo root = { NoNode, 0, count, 0.0f };
+	NodeInfo unused = { DeadNode, 0, 0, 0.0f };
+	nodeInfo[0] = root;
+	nodeInfo[1] = unused;
+	BuildSubtree(0);
+
+	for (unsigned int object : dirtyObjects)
+		objectDirty[object] = false;
+	dirtyObjects.clear();
+	needsRebuild = false;
+	stats.FullRebuilds++;
+}
+
+// --------------------------------------------------------
+// Frustum culling. Each node carries down which planes it
+// still crosses; once it's inside all of them, its whole
+// range of objects goes straight into the results.
+// --------------------------------------------------------
+void BVH::QueryFrustum(const XMFLOAT4 planes[6], std::vector<unsigned int>& results)
+{
+	results.clear();
+	if (objects.empty() || needsRebuild)
+		return;
+
+	// Entries are pairs of node and plane mask
+	stack.clear();
+	stack.push_back(0);
+	stack.push_back(0x3F);
+	while (!stack.empty())
+	{
+		unsigned int mask = stack.back();
+		stack.pop_back();
+		unsigned int index = stack.back();
+		stack.pop_back();
+
+		const BVHNode& node = nodes[index];
+		stats.NodesVisited++;
+
+		bool outside = false;
+		for (int p = 0; p < 6 && !outside; p++)
+		{
+			if (!(mask & (1 << p)))
+				continue;
+			int side = ClassifyBox(planes[p], node.BoundsMin, node.BoundsMax);
+			if (side < 0)
+				outside = true;
+			else if (side > 0)
+				mask &= ~(1 << p);
+		}
+
+		if (outside)
+			continue;
+
+		if (mask == 0)
+		{
+			AddRange(index, results);
+		}
+		else if (node.Count > 0)
+		{
+			for (unsigned int i = node.LeftFirst; i < node.LeftFirst + node.Count; i++)
+			{
+				const ObjectBounds& bounds = objects[objectIndices[i]];
+				bool inside = true;
+				for (int p = 0; p < 6 && inside; p++)
+					inside = !(mask & (1 << p)) || ClassifyBox(planes[p], bounds.Min, bounds.Max) >= 0;
+				if (inside)
+					results.push_back(objectIndices[i]);
+			}
+		}
+		else
+		{
+			stack.push_back(node.LeftFirst);
+			stack.push_back(mask);
+			stack.push_back(node.LeftFirst + 1);
+			stack.push_back(mask);
+		}
+	}
+}
+
+void BVH::QueryBox(XMFLOAT3 boundsMin, XMFLOAT3 boundsMax, std::vector<unsigned int>& results)
+{
+	results.clear();
+	if (objects.empty() || needsRebuild)
+		return;
+
+	auto overlaps = [&](const XMFLOAT3& otherMin, const XMFLOAT3& otherMax)
+	{
+		return
+			otherMin.x <= boundsMax.x && otherMax.x >= boundsMin.x &&
+			otherMin.y <= boundsMax.y && otherMax.y >= boundsMin.y &&
+			otherMin.z <= boundsMax.z && otherMax.z >= boundsMin.z;
+	};
+
+	stack.clear();
+	stack.push_back(0);
+	while (!stack.empty())
+	{
+		unsigned int index = stack.back();
+		stack.pop_back();
+
+		const BVHNode& node = nodes[index];
+		stats.NodesVisited++;
+		if (!overlaps(node.BoundsMin, node.BoundsMax))
+			continue;
+
+		bool contained =
+			node.BoundsMin.x >= boundsMin.x && node.BoundsMax.x <= boundsMax.x &&
+			node.BoundsMin.y >= boundsMin.y && node.BoundsMax.y <= boundsMax.y &&
+			node.BoundsMin.z >= boundsMin.z && node.BoundsMax.z <= boundsMax.z;
+
+		if (contained)
+		{
+			AddRange(index, results);
+		}
+		else if (node.Count > 0)
+		{
+			for (unsigned int i = node.LeftFirst; i < node.LeftFirst + node.Count; i++)
+			{
+				const ObjectBounds& bounds = objects[objectIndices[i]];
+				if (overlaps(bounds.Min, bounds.Max))
+					results.push_back(objectIndices[i]);
+			}
+		}
+		else
+		{
+			stack.push_back(node.LeftFirst);
+			stack.push_back(node.LeftFirst + 1);
+		}
+	}
+}
+
+void BVH::QuerySphere(XMFLOAT3 center, float radius, std::vector<unsigned int>& results)
+{
+	results.clear();
+	if (objects.empty() || needsRebuild)
+		return;
+
+	float radiusSq = radius * radius;
+	stack.clear();
+	stack.push_back(0);
+	while (!stack.empty())
+	{
+		unsigned int index = stack.back();
+		stack.pop_back();
+
+		const BVHNode& node = nodes[index];
+		stats.NodesVisited++;
+		if (SphereBoxDistanceSq(center, node.BoundsMin, node.BoundsMax) > radiusSq)
+			continue;
+
+		// The corner furthest from the center decides if the whole box is inside
+		float x = MaxFloat(fabsf(center.x - node.BoundsMin.x), fabsf(center.x - node.BoundsMax.x));
+		float y = MaxFloat(fabsf(center.y - node.BoundsMin.y), fabsf(center.y - node.BoundsMax.y));
+		float z = MaxFloat(fabsf(center.z - node.BoundsMin.z), fabsf(center.z - node.BoundsMax.z));
+
+		if (x * x + y * y + z * z <= radiusSq)
+		{
+			AddRange(index, results);
+		}
+		else if (node.Count > 0)
+		{
+			for (unsigned int i = node.LeftFirst; i < node.LeftFirst + node.Count; i++)
+			{
+				const ObjectBounds& bounds = objects[objectIndices[i]];
+				if (SphereBoxDistanceSq(center, bounds.Min, bounds.Max) <= radiusSq)
+					results.push_back(objectIndices[i]);
+			}
+		}
+		else
+		{
+			stack.push_back(node.LeftFirst);
+			stack.push_back(node.LeftFirst + 1);
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Visits the nearer child first and skips any node that
+// starts further away than the closest hit so far
+// --------------------------------------------------------
+bool BVH::Raycast(XMFLOAT3 origin, XMFLOAT3 direction, float maxDistance, unsigned int& hitObject, float& hitDistance)
+{
+	if (objects.empty() || needsRebuild)
+		return false;
+
+	XMFLOAT3 inverseDirection(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+	float closest = maxDistance;
+	bool hit = false;
+
+	if (RayBoxDistance(origin, inverseDirection, nodes[0].BoundsMin, nodes[0].BoundsMax, closest) == FLT_MAX)
+		return false;
+
+	stack.clear();
+	stack.push_back(0);
+	while (!stack.empty())
+	{
+		unsigned int index = stack.back();
+		stack.pop_back();
+
+		const BVHNode& node = nodes[index];
+		stats.NodesVisited++;
+
+		// The box may have been entered before a closer hit was found
+		if (RayBoxDistance(origin, inverseDirection, node.BoundsMin, node.BoundsMax, closest) == FLT_MAX)
+			continue;
+
+		if (node.Count > 0)
+		{
+			for (unsigned int i = node.LeftFirst; i < node.LeftFirst + node.Count; i++)
+			{
+				const ObjectBounds& bounds = objects[objectIndices[i]];
+				float distance = RayBoxDistance(origin, inverseDirection, bounds.Min, bounds.Max, closest);
+				if (distance < closest)
+				{
+					closest = distance;
+					hitObject = objectIndices[i];
+					hit = true;
+				}
+			}
+			continue;
+		}
+
+		unsigned int nearChild = node.LeftFirst;
+		unsigned int farChild = node.LeftFirst + 1;
+		float nearDistance = RayBoxDistance(origin, inverseDirection, nodes[nearChild].BoundsMin, nodes[nearChild].BoundsMax, closest);
+		float farDistance = RayBoxDistance(origin, inverseDirection, nodes[farChild].BoundsMin, nodes[farChild].BoundsMax, closest);
+		if (farDistance < nearDistance)
+		{
+			std::swap(nearChild, farChild);
+			std::swap(nearDistance, farDistance);
+		}
+
+		// Pushed far first, so the near child comes off the stack first
+		if (farDistance != FLT_MAX)
+			stack.push_back(farChild);
+		if (nearDistance != FLT_MAX)
+			stack.push_back(nearChild);
+	}
+
+	if (hit)
+		hitDistance = closest;
+	return hit;
+}
+
+size_t BVH::GetObjectCount() { return objects.size(); }
+size_t BVH::GetNodeCount() { return nodeCount > 0 ? nodeCount - deadNodes - 1 : 0; }
+
+// --------------------------------------------------------
+// Sum of every node's area (weighted by object count for
+// leaves) over the root's area: the expected number of
+// boxes a random ray through the root has to test
+// --------------------------------------------------------
+float BVH::GetCost()
+{
+	if (objects.empty() || needsRebuild)
+		return 0.0f;
+
+	float rootArea = SurfaceArea(nodes[0].BoundsMin, nodes[0].BoundsMax);
+	if (rootArea <= 0.0f)
+		return 0.0f;
+
+	float cost = 0.0f;
+	stack.clear();
+	stack.push_back(0);
+	while (!stack.empty())
+	{
+		const BVHNode& node = nodes[stack.back()];
+		stack.pop_back();
+
+		float area = SurfaceArea(node.BoundsMin, node.BoundsMax);
+		if (node.Count > 0)
+		{
+			cost += area * node.Count;
+			continue;
+		}
+		cost += area;
+		stack.push_back(node.LeftFirst);
+		stack.push_back(node.LeftFirst + 1);
+	}
+	return cost / rootArea;
+}
+
+BVHStats& BVH::GetStats() { return stats; }
+void BVH::ResetStats() { stats = BVHStats(); }
+
+// --------------------------------------------------------
+// Each row of the matrix is where one local axis ends up,
+// so the world box reaches as far along each world axis
+// as the rows' absolute values times the local extents
+// --------------------------------------------------------
+void BVH::TransformBounds(XMFLOAT3 boundsMin, XMFLOAT3 boundsMax, const XMFLOAT4X4& world, XMFLOAT3& worldMin, XMFLOAT3& worldMax)
+{
+	XMFLOAT3 center((boundsMin.x + boundsMax.x) * 0.5f, (boundsMin.y + boundsMax.y) * 0.5f, (boundsMin.z + boundsMax.z) * 0.5f);
+	XMFLOAT3 extent(boundsMax.x - center.x, boundsMax.y - center.y, boundsMax.z - center.z);
+
+	const float(*m)[4] = world.m;
+	float worldCenter[3];
+	float worldExtent[3];
+	for (int c = 0; c < 3; c++)
+	{
+		worldCenter[c] = center.x * m[0][c] + center.y * m[1][c] + center.z * m[2][c] + m[3][c];
+		worldExtent[c] = fabsf(m[0][c]) * extent.x + fabsf(m[1][c]) * extent.y + fabsf(m[2][c]) * extent.z;
+	}
+
+	worldMin = XMFLOAT3(worldCenter[0] - worldExtent[0], worldCenter[1] - worldExtent[1], worldCenter[2] - worldExtent[2]);
+	worldMax = XMFLOAT3(worldCenter[0] + worldExtent[0], worldCenter[1] + worldExtent[1], worldCenter[2] + worldExtent[2]);
+}
+
+// --------------------------------------------------------
+// Hands out the next two nodes, growing the array if needed.
+// Pointers into the array don't survive this.
+// --------------------------------------------------------
+unsigned int BVH::AllocatePair()
+{
+	if (nodeCount + 2 > nodePairs.size() * 2)
+	{
+		nodePairs.resize(nodePairs.size() * 2);
+		nodeInfo.resize(nodePairs.size() * 2);
+		nodes = &nodePairs[0].Nodes[0];
+	}
+
+	unsigned int first = nodeCount;
+	nodeCount += 2;
+	return first;
+}
+
+// --------------------------------------------------------
+// Builds the subtree under a node from the range of
+// objects recorded in its info, splitting until leaves
+// are small enough
+// --------------------------------------------------------
+void BVH::BuildSubtree(unsigned int root)
+{
+	unsigned int rootFirst = nodeInfo[root].First;
+	unsigned int rootEnd = rootFirst + nodeInfo[root].Count;
+	buildItems.resize(objectIndices.size());
+	for (unsigned int i = rootFirst; i < rootEnd; i++)
+	{
+		BuildItem item = { objects[objectIndices[i]], objectIndices[i] };
+		buildItems[i] = item;
+	}
+
+	stack.clear();
+	stack.push_back(root);
+	while (!stack.empty())
+	{
+		unsigned int index = stack.back();
+		stack.pop_back();
+
+		unsigned int first = nodeInfo[index].First;
+		unsigned int count = nodeInfo[index].Count;
+
+		// Bounds of the objects, and of their centers for splitting
+		XMFLOAT3 boundsMin(FLT_MAX, FLT_MAX, FLT_MAX);
+		XMFLOAT3 boundsMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		XMFLOAT3 centroidMin = boundsMin;
+		XMFLOAT3 centroidMax = boundsMax;
+		for (unsigned int i = first; i < first + count; i++)
+		{
+			const ObjectBounds& bounds = buildItems[i].Bounds;
+			XMFLOAT3 centroid(
+				(bounds.Min.x + bounds.Max.x) * 0.5f,
+				(bounds.Min.y + bounds.Max.y) * 0.5f,
+				(bounds.Min.z + bounds.Max.z) * 0.5f);
+			Grow(boundsMin, boundsMax, bounds.Min, bounds.Max);
+			Grow(centroidMin, centroidMax, centroid, centroid);
+		}
+		nodes[index].BoundsMin = boundsMin;
+		nodes[index].BoundsMax = boundsMax;
+		nodeInfo[index].BuildArea = SurfaceArea(boundsMin, boundsMax);
+
+		if (count <= MaxLeafSize)
+		{
+			nodes[index].LeftFirst = first;
+			nodes[index].Count = count;
+			for (unsigned int i = first; i < first + count; i++)
+				objectLeaves[buildItems[i].Object] = index;
+			continue;
+		}
+
+		// Objects with the same center can't be told apart, so just halve them
+		unsigned int split = 0;
+		if (!FindSplit(first, count, centroidMin, centroidMax, split))
+			split = first + count / 2;
+
+		unsigned int left = AllocatePair();
+		nodes[index].LeftFirst = left;
+		nodes[index].Count = 0;
+
+		NodeInfo leftInfo = { index, first, split - first, 0.0f };
+		NodeInfo rightInfo = { index, split, first + count - split, 0.0f };
+		nodeInfo[left] = leftInfo;
+		nodeInfo[left + 1] = rightInfo;
+
+		stack.push_back(left + 1);
+		stack.push_back(left);
+	}
+
+	for (unsigned int i = rootFirst; i < rootEnd; i++)
+		objectIndices[i] = buildItems[i].Object;
+}
+
+// --------------------------------------------------------
+// Buckets the objects' centers along each axis and picks
+// the bucket boundary with the lowest surface area cost,
+// then partitions the objects around it
+// --------------------------------------------------------
+bool BVH::FindSplit(unsigned int first, unsigned int count, XMFLOAT3 centroidMin, XMFLOAT3 centroidMax, unsigned int& split)
+{
+	struct Bin
+	{
+		XMFLOAT3 Min;
+		XMFLOAT3 Max;
+		unsigned int Count;
+	};
+
+	const float* lows = &centroidMin.x;
+	const float* highs = &centroidMax.x;
+
+	float bestCost = FLT_MAX;
+	int bestAxis = -1;
+	int bestBin = 0;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		if (highs[axis] <= lows[axis])
+			continue;
+		float scale = BinCount / (highs[axis] - lows[axis]);
+
+		Bin bins[BinCount];
+		for (Bin& bin : bins)
+		{
+			bin.Min = XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+			bin.Max = XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+			bin.Count = 0;
+		}
+
+		for (unsigned int i = first; i < first + count; i++)
+		{
+			const ObjectBounds& bounds = buildItems[i].Bounds;
+			float centroid = ((&bounds.Min.x)[axis] + (&bounds.Max.x)[axis]) * 0.5f;
+			int b = BinIndex(centroid, lows[axis], scale);
+			Grow(bins[b].Min, bins[b].Max, bounds.Min, bounds.Max);
+			bins[b].Count++;
+		}
+
+		// Sweep in from both ends to get each side's area and count
+		float leftCost[BinCount - 1];
+		XMFLOAT3 sideMin(FLT_MAX, FLT_MAX, FLT_MAX);
+		XMFLOAT3 sideMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		unsigned int sideCount = 0;
+		for (int b = 0; b < BinCount - 1; b++)
+		{
+			Grow(sideMin, sideMax, bins[b].Min, bins[b].Max);
+			sideCount += bins[b].Count;
+			leftCost[b] = sideCount > 0 ? SurfaceArea(sideMin, sideMax) * sideCount : FLT_MAX;
+		}
+
+		sideMin = XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+		sideMax = XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		sideCount = 0;
+		for (int b = BinCount - 1; b > 0; b--)
+		{
+			Grow(sideMin, sideMax, bins[b].Min, bins[b].Max);
+			sideCount += bins[b].Count;
+			if (sideCount == 0 || leftCost[b - 1] == FLT_MAX)
+				continue;
+
+			float cost = leftCost[b - 1] + SurfaceArea(sideMin, sideMax) * sideCount;
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestBin = b;
+			}
+		}
+	}
+
+	if (bestAxis < 0)
+		return false;
+
+	// Everything in a bucket before the best boundary goes left
+	float low = lows[bestAxis];
+	float scale = BinCount / (highs[bestAxis] - low);
+	auto middle = std::partition(buildItems.begin() + first, buildItems.begin() + first + count, [&](const BuildItem& item)
+	{
+		const ObjectBounds& bounds = item.Bounds;
+		float centroid = ((&bounds.Min.x)[bestAxis] + (&bounds.Max.x)[bestAxis]) * 0.5f;
+		return BinIndex(centroid, low, scale) < bestBin;
+	});
+
+	split = (unsigned int)(middle - buildItems.begin());
+	return split > first && split < first + count;
+}
+
+// --------------------------------------------------------
+// Recalculates a node's box from its objects or children,
+// returning whether it changed
+// --------------------------------------------------------
+bool BVH::RefitNode(unsigned int index)
+{
+	BVHNode& node = nodes[index];
+	XMFLOAT3 boundsMin(FLT_MAX, FLT_MAX, FLT_MAX);
+	XMFLOAT3 boundsMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+	if (node.Count > 0)
+	{
+		for (unsigned int i = node.LeftFirst; i < node.LeftFirst + node.Count; i++)
+			Grow(boundsMin, boundsMax, objects[objectIndices[i]].Min, objects[objectIndices[i]].Max);
+	}
+	else
+	{
+		Grow(boundsMin, boundsMax, nodes[node.LeftFirst].BoundsMin, nodes[node.LeftFirst].BoundsMax);
+		Grow(boundsMin, boundsMax, nodes[node.LeftFirst + 1].BoundsMin, nodes[node.LeftFirst + 1].BoundsMax);
+	}
+	stats.RefitNodes++;
+
+	bool changed =
+		boundsMin.x != node.BoundsMin.x || boundsMin.y != node.BoundsMin.y || boundsMin.z != node.BoundsMin.z ||
+		boundsMax.x != node.BoundsMax.x || boundsMax.y != node.BoundsMax.y || boundsMax.z != node.BoundsMax.z;
+	node.BoundsMin = boundsMin;
+	node.BoundsMax = boundsMax;
+	return changed;
+}
+
+// --------------------------------------------------------
+// Rebuilds each subtree that grew too loose while being
+// refit. Parents sit before their children, so in index
+// order the outermost subtrees go first, and anything
+// inside them is already abandoned when it comes up.
+// --------------------------------------------------------
+void BVH::RebuildDegraded()
+{
+	if (degradedNodes.empty())
+		return;
+
+	std::sort(degradedNodes.begin(), degradedNodes.end());
+	degradedNodes.erase(std::unique(degradedNodes.begin(), degradedNodes.end()), degradedNodes.end());
+
+	for (unsigned int index : degradedNodes)
+	{
+		if (nodeInfo[index].Parent == DeadNode)
+			continue;
+		if (index == 0)
+		{
+			Rebuild();
+			return;
+		}
+
+		// Abandon the nodes under it, which the rebuild replaces
+		stack.clear();
+		stack.push_back(nodes[index].LeftFirst);
+		while (!stack.empty())
+		{
+			unsigned int pair = stack.back();
+			stack.pop_back();
+			for (unsigned int child = pair; child < pair + 2; child++)
+			{
+				nodeInfo[child].Parent = DeadNode;
+				deadNodes++;
+				if (nodes[child].Count == 0)
+					stack.push_back(nodes[child].LeftFirst);
+			}
+		}
+
+		BuildSubtree(index);
+		stats.SubtreeRebuilds++;
+	}
+
+	if (deadNodes * 2 > nodeCount)
+		Rebuild();
+}
+
+// --------------------------------------------------------
+// Adds every object under a node, which is one range of
+// the object list
+// --------------------------------------------------------
+void BVH::AddRange(unsigned int node, std::vector<unsigned int>& results)
+{
+	const NodeInfo& info = nodeInfo[node];
+	results.insert(results.end(), objectIndices.begin() + info.First, objectIndices.begin() + info.First + info.Count);
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <vector>
+
+// One node of the tree, two to a cache line
+struct BVHNode
+{
+	DirectX::XMFLOAT3 BoundsMin;
+	unsigned int LeftFirst;		// Inner nodes: the first of the two children. Leaves: the first object entry
+	DirectX::XMFLOAT3 BoundsMax;
+	unsigned int Count;			// Objects in a leaf, 0 for inner nodes
+};
+
+// Work done by a tree since the last reset
+struct BVHStats
+{
+	unsigned int RefitNodes = 0;
+	unsigned int SubtreeRebuilds = 0;
+	unsigned int FullRebuilds = 0;
+	unsigned int NodesVisited = 0;
+};
+
+// --------------------------------------------------------
+// A bounding volume hierarchy over world space boxes, for
+// culling, picking and range queries in logarithmic time
+//
+// - Nodes live in one flat array, aligned so each pair of
+//   siblings fills exactly one 64 byte cache line. The
+//   root is node 0; node 1 is unused to keep pairs aligned
+// - Built top-down with a binned surface area heuristic.
+//   Every subtree's objects are one contiguous range of
+//   the object list, so whole subtrees that are inside a
+//   query are collected without visiting their nodes
+// - Moving objects only marks them; Update() refits their
+//   leaves and the nodes above, then rebuilds any subtree
+//   whose box has grown well past its size when built.
+//   Rebuilt subtrees get new nodes at the end of the
+//   array, and once half the array is abandoned nodes the
+//   whole tree is rebuilt
+// - Objects are numbered in the order they're added
+// --------------------------------------------------------
+class BVH
+{
+public:
+	BVH();
+
+	// Removes every object
+	void Clear();
+
+	// Adds an object, returning its number. The tree is rebuilt on the next Update().
+	unsigned int Add(DirectX::XMFLOAT3 boundsMin, DirectX::XMFLOAT3 boundsMax);
+
+	// Moves an object, if its bounds really changed
+	void SetBounds(unsigned int object, DirectX::XMFLOAT3 boundsMin, DirectX::XMFLOAT3 boundsMax);
+
+	// Brings the tree up to date with every Add() and SetBounds() since the last update
+	void Update();
+
+	// Builds the whole tree from scratch
+	void Rebuild();
+
+	// Queries fill results with the numbers of every object found, in no particular order
+	void QueryFrustum(const DirectX::XMFLOAT4 planes[6], std::vector<unsigned int>& results);
+	void QueryBox(DirectX::XMFLOAT3 boundsMin, DirectX::XMFLOAT3 boundsMax, std::vector<unsigned int>& results);
+	void QuerySphere(DirectX::XMFLOAT3 center, float radius, std::vector<unsigned int>& results);
+
+	// Finds the nearest object whose box the ray enters within maxDistance.
+	// The direction doesn't need to be normalized; distances are in its units.
+	bool Raycast(DirectX::XMFLOAT3 origin, DirectX::XMFLOAT3 direction, float maxDistance, unsigned int& hitObject, float& hitDistance);
+
+	size_t GetObjectCount();
+	size_t GetNodeCount();
+
+	// Surface area heuristic cost of the tree, relative to the root box; lower is better
+	float GetCost();
+
+	BVHStats& GetStats();
+	void ResetStats();
+
+	// The world space box around a local box moved by a world matrix
+	static void TransformBounds(DirectX::XMFLOAT3 boundsMin, DirectX::XMFLOAT3 boundsMax, const DirectX::XMFLOAT4X4& world,
+		DirectX::XMFLOAT3& worldMin, DirectX::XMFLOAT3& worldMax);
+
+private:
+	struct alignas(64) NodePair
+	{
+		BVHNode Nodes[2];
+	};
+
+	// What rebuilding and refitting need to know about a node,
+	// kept apart from the nodes so queries don't load it
+	struct NodeInfo
+	{
+		unsigned int Parent;		// NoNode for the root, DeadNode once abandoned
+		unsigned int First;			// The subtree's range in the object list
+		unsigned int Count;
+		float BuildArea;			// Surface area when the subtree was built
+	};
+
+	struct ObjectBounds
+	{
+		DirectX::XMFLOAT3 Min;
+		DirectX::XMFLOAT3 Max;
+	};
+
+	// An object's bounds copied next to its number, so building
+	// walks and partitions one array instead of jumping around
+	struct BuildItem
+	{
+		ObjectBounds Bounds;
+		unsigned int Object;
+	};
+
+	std::vector<NodePair> nodePairs;
+	std::vector<NodeInfo> nodeInfo;
+	BVHNode* nodes;
+	unsigned int nodeCount;
+	unsigned int deadNodes;
+
+	std::vector<ObjectBounds> objects;
+	std::vector<unsigned int> objectIndices;	// Object numbers, in leaf order
+	std::vector<unsigned int> objectLeaves;		// Leaf holding each object
+	std::vector<unsigned int> dirtyObjects;
+	std::vector<bool> objectDirty;
+	bool needsRebuild;
+
+	// Scratch space, kept to avoid allocating every update and query
+	std::vector<unsigned int> stack;
+	std::vector<unsigned int> degradedNodes;
+	std::vector<BuildItem> buildItems;
+
+	BVHStats stats;
+
+	unsigned int AllocatePair();
+	void BuildSubtree(unsigned int root);
+	bool FindSplit(unsigned int first, unsigned int count, DirectX::XMFLOAT3 centroidMin, DirectX::XMFLOAT3 centroidMax, unsigned int& split);
+	bool RefitNode(unsigned int node);
+	void RebuildDegraded();
+	void AddRange(unsigned int node, std::vector<unsigned int>& results);
+};
@@ -0,0 +1,1370 @@
+#include "Benchmarks.h"
+#include "ObjLoader.h"
+#include "Mesh.h"
+#include "Transform.h"
+#include "TransformSystem.h"
+#include "ThreadPool.h"
+#include "RenderQueue.h"
+#include "SimpleShader.h"
+#include "FrustumCuller.h"
+#include "BVH.h"
+#include "Profiler.h"
+#include "AssetLoader.h"
+#include "TextureCooker.h"
+#include "TextureCache.h"
+#include "TextureStreamer.h"
+#include "MappedFile.h"
+
+#include <DirectXMath.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cfloat>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <thread>
+#include <unordered_map>
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// Runs the given function several times and returns the
+// average time of a single run in milliseconds
+// --------------------------------------------------------
+template <typename Func>
+static double AverageMs(int iterations, Func func)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < iterations; i++)
+		func();
+	auto end = std::chrono::high_resolution_clock::now();
+
+	return std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+}
+
+// --------------------------------------------------------
+// The previous OBJ loader (getline into a 100 character
+// buffer + sscanf_s per line, with vertex welding), kept
+// here as a baseline to compare the fast parser against
+// --------------------------------------------------------
+static bool LoadObjLegacy(const char* objFile, MeshData& meshData)
+{
+	std::ifstream obj(objFile);
+	if (!obj.is_open())
+		return false;
+
+	std::vector<XMFLOAT3> positions;
+	std::vector<XMFLOAT3> normals;
+	std::vector<XMFLOAT2> uvs;
+	std::unordered_map<ObjVertexKey, unsigned int, ObjVertexKeyHash> vertexLookup;
+	meshData.Vertices.clear();
+	meshData.Indices.clear();
+	char chars[100];
+
+	auto weldVertex = [&](unsigned int p, unsigned int t, unsigned int n)
+	{
+		ObjVertexKey key = { p, t, n };
+		auto existing = vertexLookup.find(key);
+		if (existing != vertexLookup.end())
+			return existing->second;
+
+		Vertex v = {};
+		v.Position = positions[p - 1];
+		v.UV = uvs[t - 1];
+		v.Normal = normals[n - 1];
+		v.UV.y = 1.0f - v.UV.y;
+		v.Position.z *= -1.0f;
+		v.Normal.z *= -1.0f;
+
+		unsigned int index = (unsigned int)meshData.Vertices.size();
+		meshData.Vertices.push_back(v);
+		vertexLookup.insert({ key, index });
+		return index;
+	};
+
+	while (obj.good())
+	{
+		obj.getline(chars, 100);
+
+		if (chars[0] == 'v' && chars[1] == 'n')
+		{
+			XMFLOAT3 norm;
+			sscanf_s(chars, "vn %f %f %f", &norm.x, &norm.y, &norm.z);
+			normals.push_back(norm);
+		}
+		else if (chars[0] == 'v' && chars[1] == 't')
+		{
+			XMFLOAT2 uv;
+			sscanf_s(chars, "vt %f %f", &uv.x, &uv.y);
+			uvs.push_back(uv);
+		}
+		else if (chars[0] == 'v')
+		{
+			XMFLOAT3 pos;
+			sscanf_s(chars, "v %f %f %f", &pos.x, &pos.y, &pos.z);
+			positions.push_back(pos);
+		}
+		else if (chars[0] == 'f')
+		{
+			unsigned int i[12];
+			int numbersRead = sscanf_s(
+				chars,
+				"f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d",
+				&i[0], &i[1], &i[2],
+				&i[3], &i[4], &i[5],
+				&i[6], &i[7], &i[8],
+				&i[9], &i[10], &i[11]);
+
+			unsigned int v1 = weldVertex(i[0], i[1], i[2]);
+			unsigned int v2 = weldVertex(i[3], i[4], i[5]);
+			unsigned int v3 = weldVertex(i[6], i[7], i[8]);
+			meshData.Indices.push_back(v1);
+			meshData.Indices.push_back(v3);
+			meshData.Indices.push_back(v2);
+
+			if (numbersRead == 12)
+			{
+				unsigned int v4 = weldVertex(i[9], i[10], i[11]);
+				meshData.Indices.push_back(v1);
+				meshData.Indices.push_back(v4);
+				meshData.Indices.push_back(v3);
+			}
+		}
+	}
+
+	return !meshData.Vertices.empty();
+}
+
+// --------------------------------------------------------
+// Compares the fast OBJ parser against the old loader
+// on the larger bundled models
+//
+// modelFolder - Path to Assets/Models, ending in a slash
+// --------------------------------------------------------
+void Benchmarks::ObjLoading(std::string modelFolder)
+{
+	const char* models[] = { "helix.obj", "torus.obj" };
+	const int iterations = 20;
+
+	printf("\n--- OBJ loading (%d iterations each) ---\n", iterations);
+	for (const char* model : models)
+	{
+		std::string path = modelFolder + model;
+		MeshData legacyData;
+		MeshData fastData;
+
+		double legacyMs = AverageMs(iterations, [&]() { LoadObjLegacy(path.c_str(), legacyData); });
+		double fastMs = AverageMs(iterations, [&]() { ObjLoader::Load(path.c_str(), fastData); });
+
+		printf("%-10s getline+sscanf_s: %7.3f ms   fast parser: %7.3f ms   (%.1fx)   verts %zu/%zu\n",
+			model, legacyMs, fastMs, legacyMs / fastMs,
+			legacyData.Vertices.size(), fastData.Vertices.size());
+	}
+}
+
+// --------------------------------------------------------
+// Compares full mesh loads (parse, tangents and upload)
+// against loads from the memory mapped binary cache
+//
+// modelFolder - Path to Assets/Models, ending in a slash
+// device      - Used to create the vertex and index buffers
+// --------------------------------------------------------
+void Benchmarks::MeshLoading(std::string modelFolder, Microsoft::WRL::ComPtr<ID3D11Device> device)
+{
+	const char* models[] = { "cube.obj", "cylinder.obj", "helix.obj", "sphere.obj", "torus.obj" };
+	const int iterations = 20;
+	bool useCache = Mesh::UseBinaryCache;
+
+	printf("\n--- Mesh loading (%d iterations each) ---\n", iterations);
+	double totalObjMs = 0;
+	double totalCacheMs = 0;
+	for (const char* model : models)
+	{
+		std::string path = modelFolder + model;
+
+		Mesh::UseBinaryCache = false;
+		double objMs = AverageMs(iterations, [&]() { Mesh mesh(path.c_str(), device); });
+
+		// Make sure the cache is written before timing cached loads
+		Mesh::UseBinaryCache = true;
+		{ Mesh warmup(path.c_str(), device); }
+		double cacheMs = AverageMs(iterations, [&]() { Mesh mesh(path.c_str(), device); });
+
+		printf("%-13s .obj: %7.3f ms   .meshcache: %7.3f ms   (%.1fx)\n",
+			model, objMs, cacheMs, objMs / cacheMs);
+		totalObjMs += objMs;
+		totalCacheMs += cacheMs;
+	}
+	printf("%-13s .obj: %7.3f ms   .meshcache: %7.3f ms   (%.1fx)\n",
+		"All", totalObjMs, totalCacheMs, totalObjMs / totalCacheMs);
+
+	Mesh::UseBinaryCache = useCache;
+}
+
+// --------------------------------------------------------
+// Fills an image with smooth shapes plus a little noise,
+// like a typical texture, for the given kind of data
+// --------------------------------------------------------
+static void MakeTestImage(TextureKind kind, unsigned int size, TextureData& image)
+{
+	image.Width = size;
+	image.Height = size;
+	image.Pixels.resize((size_t)size * size * 4);
+
+	uint32_t seed = 12345;
+	for (unsigned int y = 0; y < size; y++)
+	{
+		for (unsigned int x = 0; x < size; x++)
+		{
+			seed = seed * 1664525 + 1013904223;
+			float noise = ((seed >> 16) & 255) / 255.0f - 0.5f;
+			float u = (float)x / size * 6.2831853f;
+			float v = (float)y / size * 6.2831853f;
+			unsigned char* pixel = &image.Pixels[((size_t)y * size + x) * 4];
+
+			if (kind == TextureKind::Normal)
+			{
+				// The slopes of a bumpy height field
+				float dx = cosf(u * 3.0f) * sinf(v * 2.0f) * 0.5f + noise * 0.05f;
+				float dy = sinf(u * 3.0f) * cosf(v * 2.0f) * 0.5f + noise * 0.05f;
+				float length = sqrtf(dx * dx + dy * dy + 1.0f);
+				pixel[0] = (unsigned char)((dx / length * 0.5f + 0.5f) * 255.0f + 0.5f);
+				pixel[1] = (unsigned char)((dy / length * 0.5f + 0.5f) * 255.0f + 0.5f);
+				pixel[2] = (unsigned char)((1.0f / length * 0.5f + 0.5f) * 255.0f + 0.5f);
+			}
+			else
+			{
+				for (int c = 0; c < 3; c++)
+				{
+					float value = 0.5f + 0.3f * sinf(u * (c + 1) + v * 2.0f) + 0.15f * cosf(v * (3 - c)) + noise * 0.06f;
+					value = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+					pixel[c] = (unsigned char)(value * 255.0f + 0.5f);
+				}
+				if (kind == TextureKind::Single)
+					pixel[1] = pixel[2] = pixel[0];
+			}
+			pixel[3] = 255;
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Cooks a synthetic image of each kind, timing each step,
+// and decodes the top level to check the compressed result
+// is close to the original
+// --------------------------------------------------------
+void Benchmarks::TextureCooking()
+{
+	const unsigned int size = 1024;
+	const int iterations = 3;
+	const TextureKind kinds[] = { TextureKind::Color, TextureKind::Normal, TextureKind::Single };
+	const char* formats[] = { "BC7", "BC5", "BC4" };
+	const double minimumPSNR[] = { 38.0, 38.0, 38.0 };
+
+	ThreadPool pool;
+	printf("\n--- Texture cooking (%ux%u, %d iterations) ---\n", size, size, iterations);
+	for (int k = 0; k < 3; k++)
+	{
+		TextureData image;
+		MakeTestImage(kinds[k], size, image);
+
+		std::vector<TextureData> mips;
+		double boxMs = AverageMs(iterations, [&]() { TextureCooker::BuildMips(image, kinds[k], MipFilter::Box, mips); });
+		double kaiserMs = AverageMs(iterations, [&]() { TextureCooker::BuildMips(image, kinds[k], MipFilter::Kaiser, mips); });
+
+		std::vector<unsigned char> blocks;
+		double serialMs = AverageMs(iterations, [&]() { TextureCooker::Compress(mips[0], kinds[k], blocks); });
+		double parallelMs = AverageMs(iterations, [&]() { TextureCooker::Compress(mips[0], kinds[k], blocks, &pool); });
+
+		// Peak signal to noise ratio of the channels each format keeps
+		const TextureData& original = mips[0];
+		int channels = kinds[k] == TextureKind::Color ? 3 : (kinds[k] == TextureKind::Normal ? 2 : 1);
+		unsigned int blocksWide = size / 4;
+		size_t blockSize = kinds[k] == TextureKind::Single ? 8 : 16;
+		double squaredError = 0.0;
+		for (size_t b = 0; b < blocks.size() / blockSize; b++)
+		{
+			unsigned char decoded[64];
+			unsigned char red[16];
+			unsigned char green[16];
+			const unsigned char* block = &blocks[b * blockSize];
+			if (kinds[k] == TextureKind::Color)
+				TextureCooker::DecodeBC7(block, decoded);
+			else
+				TextureCooker::DecodeBC4(block, red);
+			if (kinds[k] == TextureKind::Normal)
+				TextureCooker::DecodeBC4(block + 8, green);
+
+			for (int i = 0; i < 16; i++)
+			{
+				unsigned int x = (unsigned int)(b % blocksWide) * 4 + (i & 3);
+				unsigned int y = (unsigned int)(b / blocksWide) * 4 + (i >> 2);
+				const unsigned char* pixel = &original.Pixels[((size_t)y * size + x) * 4];
+				for (int c = 0; c < channels; c++)
+				{
+					int value = kinds[k] == TextureKind::Color ? decoded[i * 4 + c] : (c == 0 ? red[i] : green[i]);
+					squaredError += (double)(value - pixel[c]) * (value - pixel[c]);
+				}
+			}
+		}
+		double meanError = squaredError / ((double)size * size * channels);
+		double psnr = meanError > 0.0 ? 10.0 * log10(255.0 * 255.0 / meanError) : 99.0;
+
+		size_t rgbaBytes = 0;
+		size_t cookedBytes = 0;
+		for (TextureData& level : mips)
+		{
+			rgbaBytes += (size_t)level.Width * level.Height * 4;
+			cookedBytes += (size_t)((level.Width + 3) / 4) * ((level.Height + 3) / 4) * blockSize;
+		}
+
+		printf("%s: mips box %6.1f ms, Kaiser %6.1f ms   compress %7.1f ms, %u threads %7.1f ms (%.1fx)   %5.1f dB, %.0fx smaller   %s\n",
+			formats[k], boxMs, kaiserMs, serialMs, pool.GetThreadCount(), parallelMs, serialMs / parallelMs,
+			psnr, (double)rgbaBytes / cookedBytes, psnr >= minimumPSNR[k] ? "PASS" : "FAIL");
+	}
+}
+
+void Benchmarks::TextureLoading(std::wstring textureFolder, Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+{
+	std::vector<std::wstring> paths;
+	TextureCooker::FindImages(textureFolder, paths);
+	bool useCooked = AssetLoader::UseCookedTextures;
+
+	// Make sure every cooked file is there before timing cooked loads
+	TextureCooker::CookFolder(textureFolder, MipFilter::Kaiser, false);
+
+	printf("\n--- Texture loading (%zu textures) ---\n", paths.size());
+	double pngMs = 0.0;
+	size_t pngBytes = 0;
+	double ddsMs = 0.0;
+	size_t ddsBytes = 0;
+
+	// .png, cooked .dds, then only the levels a streamed texture starts with
+	for (int mode = 0; mode < 3; mode++)
+	{
+		AssetLoader::UseCookedTextures = mode > 0;
+		unsigned int maxSize = mode == 2 ? TextureStreamer::StartSize : 0;
+		std::vector<Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> textures(paths.size());
+
+		auto start = std::chrono::high_resolution_clock::now();
+		{
+			AssetLoader loader(device, context, std::shared_ptr<MeshRegistry>());
+			for (size_t i = 0; i < paths.size(); i++)
+				loader.QueueTexture(paths[i], textures[i], true, maxSize);
+			loader.Finish();
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+		double ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+		size_t bytes = 0;
+		for (auto& texture : textures)
+			bytes += TextureCache::GetTextureBytes(texture.Get());
+
+		if (mode == 0)
+		{
+			pngMs = ms;
+			pngBytes = bytes;
+			printf(".png:     %8.1f ms, %7.2f MB of video memory\n", ms, bytes / (1024.0 * 1024.0));
+		}
+		else if (mode == 1)
+		{
+			ddsMs = ms;
+			ddsBytes = bytes;
+			printf(".dds:     %8.1f ms, %7.2f MB of video memory   (%.1fx faster, %.1fx smaller)\n",
+				ms, bytes / (1024.0 * 1024.0), pngMs / ms, (double)pngBytes / bytes);
+		}
+		else
+		{
+			printf("streamed: %8.1f ms, %7.2f MB of video memory   (%.1fx faster, %.1fx smaller than the full .dds, <= %u texels to start)\n",
+				ms, bytes / (1024.0 * 1024.0), ddsMs / ms, (double)ddsBytes / bytes, maxSize);
+		}
+	}
+
+	AssetLoader::UseCookedTextures = useCooked;
+}
+
+// --------------------------------------------------------
+// PSNR of one channel of a cooked BC4 or BC7 file's top
+// level against the red channel of its source, or -1 if
+// the two aren't the same size (sources padded to whole
+// blocks can't be compared pixel for pixel)
+// --------------------------------------------------------
+static double CookedPSNR(const std::wstring& cookedFile, int channel, const TextureData& source)
+{
+	const size_t headerSize = 4 + 124 + 20;
+	MappedFile file(cookedFile.c_str());
+	if (!file.IsValid() || file.GetSize() < headerSize)
+		return -1.0;
+
+	unsigned int height;
+	unsigned int width;
+	unsigned int format;
+	memcpy(&height, file.GetData() + 4 + 8, 4);
+	memcpy(&width, file.GetData() + 4 + 12, 4);
+	memcpy(&format, file.GetData() + 4 + 124, 4);
+	bool bc7 = format == DXGI_FORMAT_BC7_UNORM;
+	size_t blockSize = bc7 ? 16 : 8;
+	if (width != source.Width || height != source.Height ||
+		file.GetSize() < headerSize + (size_t)(width / 4) * (height / 4) * blockSize)
+		return -1.0;
+
+	double squaredError = 0.0;
+	unsigned char rgba[64];
+	unsigned char values[16];
+	for (unsigned int by = 0; by < height / 4; by++)
+	{
+		for (unsigned int bx = 0; bx < width / 4; bx++)
+		{
+			const unsigned char* block = file.GetData() + headerSize + ((size_t)by * (width / 4) + bx) * blockSize;
+			if (bc7)
+				TextureCooker::DecodeBC7(block, rgba);
+			else
+				TextureCooker::DecodeBC4(block, values);
+
+			for (int i = 0; i < 16; i++)
+			{
+				int value = bc7 ? rgba[i * 4 + channel] : values[i];
+				int original = source.Pixels[(((size_t)by * 4 + (i >> 2)) * width + bx * 4 + (i & 3)) * 4];
+				squaredError += (double)(value - original) * (value - original);
+			}
+		}
+	}
+
+	double meanError = squaredError / ((double)width * height);
+	return meanError > 0.0 ? 10.0 * log10(255.0 * 255.0 / meanError) : 99.0;
+}
+
+static size_t FileSize(const std::wstring& path)
+{
+	MappedFile file(path.c_str());
+	return file.IsValid() ? file.GetSize() : 0;
+}
+
+void Benchmarks::PackedTextures(std::wstring textureFolder)
+{
+	std::vector<std::wstring> paths;
+	TextureCooker::FindImages(textureFolder, paths);
+
+	// Compare the files the game actually loads
+	TextureCooker::CookFolder(textureFolder, MipFilter::Kaiser, false);
+
+	printf("\n--- Packed ORM textures (BC4 maps vs one BC7) ---\n");
+	size_t separateTotal = 0;
+	size_t packedTotal = 0;
+	unsigned int materials = 0;
+	for (std::wstring& path : paths)
+	{
+		if (TextureCooker::KindFromName(path) != TextureKind::Single)
+			continue;
+		ORMSources sources = TextureCooker::FindORMSources(path);
+		if (sources.Metalness.empty())
+			continue;
+
+		std::wstring packedPath = TextureCooker::GetPackedPath(sources);
+		size_t separate =
+			FileSize(TextureCooker::GetCookedPath(sources.Roughness)) +
+			FileSize(TextureCooker::GetCookedPath(sources.Metalness)) +
+			(sources.Occlusion.empty() ? 0 : FileSize(TextureCooker::GetCookedPath(sources.Occlusion)));
+		size_t packed = FileSize(packedPath);
+		unsigned int maps = sources.Occlusion.empty() ? 2 : 3;
+
+		TextureData roughness;
+		TextureData metalness;
+		AssetLoader::DecodeImage(sources.Roughness, roughness);
+		AssetLoader::DecodeImage(sources.Metalness, metalness);
+		double roughnessBC4 = CookedPSNR(TextureCooker::GetCookedPath(sources.Roughness), 0, roughness);
+		double roughnessBC7 = CookedPSNR(packedPath, 1, roughness);
+		double metalnessBC4 = CookedPSNR(TextureCooker::GetCookedPath(sources.Metalness), 0, metalness);
+		double metalnessBC7 = CookedPSNR(packedPath, 2, metalness);
+
+		std::string name;
+		for (wchar_t c : packedPath.substr(packedPath.find_last_of(L"/\\") + 1))
+			name += (char)c;
+		name = name.substr(0, name.find(".cooked.dds"));
+
+		printf("%-14s %u maps -> 1   %6.2f MB -> %5.2f MB", name.c_str(), maps, separate / (1024.0 * 1024.0), packed / (1024.0 * 1024.0));
+		if (roughnessBC4 >= 0.0 && roughnessBC7 >= 0.0 && metalnessBC4 >= 0.0 && metalnessBC7 >= 0.0)
+			printf("   roughness %5.1f -> %5.1f dB, metalness %5.1f -> %5.1f dB\n", roughnessBC4, roughnessBC7, metalnessBC4, metalnessBC7);
+		else
+			printf("   (sizes differ, not compared)\n");
+
+		separateTotal += separate;
+		packedTotal += packed;
+		materials++;
+	}
+
+	if (materials > 0)
+	{
+		printf("%u materials: %u SRVs and %u fetches for roughness/metalness became %u, %.2f MB became %.2f MB\n",
+			materials, materials * 2, materials * 2, materials, separateTotal / (1024.0 * 1024.0), packedTotal / (1024.0 * 1024.0));
+	}
+}
+
+// --------------------------------------------------------
+// The original scalar tangent generator (one triangle at a
+// time, no handedness), kept as the reference output for
+// the SIMD version
+// --------------------------------------------------------
+static void CalculateTangentsScalar(const std::vector<Vertex>& verts, const std::vector<unsigned int>& indices, std::vector<XMFLOAT3>& tangents)
+{
+	// Reset tangents
+	tangents.assign(verts.size(), XMFLOAT3(0, 0, 0));
+
+	// Calculate tangents one whole triangle at a time
+	for (size_t i = 0; i < indices.size();)
+	{
+		// Grab indices and vertices of first triangle
+		unsigned int i1 = indices[i++];
+		unsigned int i2 = indices[i++];
+		unsigned int i3 = indices[i++];
+		const Vertex* v1 = &verts[i1];
+		const Vertex* v2 = &verts[i2];
+		const Vertex* v3 = &verts[i3];
+
+		// Calculate vectors relative to triangle positions
+		float x1 = v2->Position.x - v1->Position.x;
+		float y1 = v2->Position.y - v1->Position.y;
+		float z1 = v2->Position.z - v1->Position.z;
+
+		float x2 = v3->Position.x - v1->Position.x;
+		float y2 = v3->Position.y - v1->Position.y;
+		float z2 = v3->Position.z - v1->Position.z;
+
+		// Do the same for vectors relative to triangle uv's
+		float s1 = v2->UV.x - v1->UV.x;
+		float t1 = v2->UV.y - v1->UV.y;
+
+		float s2 = v3->UV.x - v1->UV.x;
+		float t2 = v3->UV.y - v1->UV.y;
+
+		// Create vectors for tangent calculation
+		float r = 1.0f / (s1 * t2 - s2 * t1);
+
+		float tx = (t2 * x1 - t1 * x2) * r;
+		float ty = (t2 * y1 - t1 * y2) * r;
+		float tz = (t2 * z1 - t1 * z2) * r;
+
+		// Adjust tangents of each vert of the triangle
+		for (unsigned int v : { i1, i2, i3 })
+		{
+			tangents[v].x += tx;
+			tangents[v].y += ty;
+			tangents[v].z += tz;
+		}
+	}
+
+	// Ensure all of the tangents are orthogonal to the normals
+	for (size_t i = 0; i < verts.size(); i++)
+	{
+		// Grab the two vectors
+		XMVECTOR normal = XMLoadFloat3(&verts[i].Normal);
+		XMVECTOR tangent = XMLoadFloat3(&tangents[i]);
+
+		// Use Gram-Schmidt orthonormalize to ensure
+		// the normal and tangent are exactly 90 degrees apart
+		tangent = XMVector3Normalize(
+			XMVectorSubtract(tangent, XMVectorMultiply(normal, XMVector3Dot(normal, tangent))));
+
+		// Store the tangent
+		XMStoreFloat3(&tangents[i], tangent);
+	}
+}
+
+// --------------------------------------------------------
+// Checks the SIMD tangents against the scalar reference on
+// every bundled model, then times both
+//
+// modelFolder - Path to Assets/Models, ending in a slash
+// --------------------------------------------------------
+void Benchmarks::Tangents(std::string modelFolder)
+{
+	const char* models[] = { "cube.obj", "cylinder.obj", "helix.obj", "quad.obj", "quad_double_sided.obj", "sphere.obj", "torus.obj" };
+	const float tolerance = 0.0001f;
+	const int iterations = 50;
+
+	printf("\n--- Tangent generation vs. scalar reference (tolerance %g) ---\n", tolerance);
+	MeshData helix;
+	for (const char* model : models)
+	{
+		MeshData meshData;
+		if (!ObjLoader::Load((modelFolder + model).c_str(), meshData))
+		{
+			printf("%-22s FAILED to load\n", model);
+			continue;
+		}
+
+		std::vector<XMFLOAT3> reference;
+		CalculateTangentsScalar(meshData.Vertices, meshData.Indices, reference);
+		Mesh::CalculateTangents(meshData.Vertices.data(), (int)meshData.Vertices.size(), meshData.Indices.data(), (int)meshData.Indices.size());
+
+		// Compare every tangent, and count the mirrored ones
+		float maxError = 0.0f;
+		int mirrored = 0;
+		for (size_t i = 0; i < reference.size(); i++)
+		{
+			const XMFLOAT4& t = meshData.Vertices[i].Tangent;
+			float error = fabsf(t.x - reference[i].x);
+			error = fmaxf(error, fabsf(t.y - reference[i].y));
+			error = fmaxf(error, fabsf(t.z - reference[i].z));
+			maxError = fmaxf(maxError, error);
+			if (t.w < 0) mirrored++;
+		}
+
+		// Time both versions on the same data
+		double scalarMs = AverageMs(iterations, [&]() { CalculateTangentsScalar(meshData.Vertices, meshData.Indices, reference); });
+		double simdMs = AverageMs(iterations, [&]() {
+			Mesh::CalculateTangents(meshData.Vertices.data(), (int)meshData.Vertices.size(), meshData.Indices.data(), (int)meshData.Indices.size(), 1); });
+
+		printf("%-22s %s  max error %.2e  mirrored %4d/%-5zu  scalar %7.3f ms  SIMD %7.3f ms  (%.1fx)\n",
+			model, maxError <= tolerance ? "PASS" : "FAIL", maxError, mirrored, reference.size(),
+			scalarMs, simdMs, scalarMs / simdMs);
+
+		if (strcmp(model, "helix.obj") == 0)
+			helix = meshData;
+	}
+
+	// Tile the helix into one very large mesh to see how the threaded split scales
+	const int copies = 64;
+	MeshData large;
+	for (int c = 0; c < copies; c++)
+	{
+		unsigned int offset = (unsigned int)large.Vertices.size();
+		large.Vertices.insert(large.Vertices.end(), helix.Vertices.begin(), helix.Vertices.end());
+		for (unsigned int index : helix.Indices)
+			large.Indices.push_back(index + offset);
+	}
+
+	Vertex* verts = large.Vertices.data();
+	int numVerts = (int)large.Vertices.size();
+	const unsigned int* indices = large.Indices.data();
+	int numIndices = (int)large.Indices.size();
+	unsigned int threads = std::thread::hardware_concurrency();
+
+	std::vector<XMFLOAT3> reference;
+	double scalarMs = AverageMs(5, [&]() { CalculateTangentsScalar(large.Vertices, large.Indices, reference); });
+	double simdMs = AverageMs(5, [&]() { Mesh::CalculateTangents(verts, numVerts, indices, numIndices, 1); });
+	double threadedMs = AverageMs(5, [&]() { Mesh::CalculateTangents(verts, numVerts, indices, numIndices, threads); });
+
+	printf("%d x helix (%d tris)  scalar %8.3f ms  SIMD %8.3f ms  SIMD + %u threads %8.3f ms\n",
+		copies, numIndices / 3, scalarMs, simdMs, threads, threadedMs);
+}
+
+// --------------------------------------------------------
+// Moves a large number of objects every "frame" and grabs
+// their matrices, first with one Transform per object and
+// then with the TransformSystem, checking that both give
+// the same matrices
+// --------------------------------------------------------
+void Benchmarks::Transforms()
+{
+	const unsigned int count = 50000;
+	const int iterations = 20;
+	const float tolerance = 0.0001f;
+
+	std::vector<Transform> transforms(count);
+	TransformSystem transformSystem;
+	for (unsigned int i = 0; i < count; i++)
+		transformSystem.Create();
+
+	// The same per-object changes for both versions
+	auto moveObject = [](auto& transform, unsigned int i, float time)
+	{
+		transform.SetPosition((float)(i % 256), sinf(time + i), (float)(i / 256));
+		transform.SetRotation(time * 0.5f + i, time + i * 0.25f, time * 0.1f);
+		transform.SetScale(1.0f + (i % 3), 1.0f, 1.0f + (i % 5) * 0.5f);
+	};
+
+	float time = 0.0f;
+	double transformMs = AverageMs(iterations, [&]()
+	{
+		time += 0.016f;
+		for (unsigned int i = 0; i < count; i++)
+		{
+			moveObject(transforms[i], i, time);
+			transforms[i].GetWorldMatrix();
+			transforms[i].GetWorldInverseTransposeMatrix();
+		}
+	});
+
+	time = 0.0f;
+	double systemMs = AverageMs(iterations, [&]()
+	{
+		time += 0.016f;
+		for (unsigned int i = 0; i < count; i++)
+		{
+			TransformHandle handle(&transformSystem, i);
+			moveObject(handle, i, time);
+		}
+		transformSystem.UpdateMatrices();
+	});
+
+	ThreadPool threadPool;
+	time = 0.0f;
+	double threadedMs = AverageMs(iterations, [&]()
+	{
+		time += 0.016f;
+		for (unsigned int i = 0; i < count; i++)
+		{
+			TransformHandle handle(&transformSystem, i);
+			moveObject(handle, i, time);
+		}
+		transformSystem.UpdateMatrices(&threadPool);
+	});
+
+	// Both versions have now seen the same final frame
+	float maxError = 0.0f;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		XMFLOAT4X4 expected[2] = { transforms[i].GetWorldMatrix(), transforms[i].GetWorldInverseTransposeMatrix() };
+		XMFLOAT4X4 actual[2] = { transformSystem.GetWorldMatrix(i), transformSystem.GetWorldInverseTransposeMatrix(i) };
+		for (int m = 0; m < 2; m++)
+		{
+			for (int e = 0; e < 16; e++)
+			{
+				float a = (&expected[m]._11)[e];
+				float b = (&actual[m]._11)[e];
+				maxError = fmaxf(maxError, fabsf(a - b) / fmaxf(1.0f, fabsf(a)));
+			}
+		}
+	}
+
+	printf("\n--- Transforms (%u objects moving every frame, %d frames) ---\n", count, iterations);
+	printf("%s  max error %.2e\n", maxError <= tolerance ? "PASS" : "FAIL", maxError);
+	printf("Transform per object %8.3f ms   TransformSystem %8.3f ms (%.1fx)   + %u pool threads %8.3f ms (%.1fx)\n",
+		transformMs, systemMs, transformMs / systemMs,
+		threadPool.GetThreadCount(), threadedMs, transformMs / threadedMs);
+}
+
+// --------------------------------------------------------
+// Times building inverse-transpose matrices for a batch of
+// TRS world matrices with a general inverse, the closed
+// form, and the uniform scale shortcut, checking that each
+// transforms normals in the same direction
+// --------------------------------------------------------
+void Benchmarks::InverseTranspose()
+{
+	const int count = 100000;
+	const int iterations = 20;
+	const float tolerance = 0.0001f;
+
+	// Deterministic spread of positions, rotations and scales
+	std::vector<XMFLOAT4X4> worlds(count);
+	std::vector<XMFLOAT4X4> uniformWorlds(count);
+	std::vector<XMFLOAT3> scales(count);
+	std::vector<XMFLOAT3> uniformScales(count);
+	for (int i = 0; i < count; i++)
+	{
+		scales[i] = XMFLOAT3(0.5f + (i % 7), 1.0f + (i % 3) * 0.25f, 2.0f - (i % 5) * 0.3f);
+		uniformScales[i] = XMFLOAT3(scales[i].x, scales[i].x, scales[i].x);
+
+		XMMATRIX rotTrans =
+			XMMatrixRotationRollPitchYaw(i * 0.37f, i * 0.11f, i * 0.05f) *
+			XMMatrixTranslation((float)(i % 100), (float)(i % 37) - 18.0f, (float)(i / 100));
+		XMStoreFloat4x4(&worlds[i], XMMatrixScaling(scales[i].x, scales[i].y, scales[i].z) * rotTrans);
+		XMStoreFloat4x4(&uniformWorlds[i], XMMatrixScaling(scales[i].x, scales[i].x, scales[i].x) * rotTrans);
+	}
+
+	std::vector<XMFLOAT4X4> general(count);
+	std::vector<XMFLOAT4X4> closedForm(count);
+	std::vector<XMFLOAT4X4> uniform(count);
+	double generalMs = AverageMs(iterations, [&]()
+	{
+		for (int i = 0; i < count; i++)
+			XMStoreFloat4x4(&general[i], Transform::InverseTranspose(XMLoadFloat4x4(&worlds[i]), 0));
+	});
+	double closedFormMs = AverageMs(iterations, [&]()
+	{
+		for (int i = 0; i < count; i++)
+			XMStoreFloat4x4(&closedForm[i], Transform::InverseTranspose(XMLoadFloat4x4(&worlds[i]), &scales[i]));
+	});
+	double uniformMs = AverageMs(iterations, [&]()
+	{
+		for (int i = 0; i < count; i++)
+			XMStoreFloat4x4(&uniform[i], Transform::InverseTranspose(XMLoadFloat4x4(&uniformWorlds[i]), &uniformScales[i]));
+	});
+
+	// Normals must come out pointing the same way (the shaders normalize them)
+	XMVECTOR normals[3] = { XMVectorSet(1, 0, 0, 0), XMVectorSet(0, 1, 0, 0), XMVector3Normalize(XMVectorSet(1, 2, 3, 0)) };
+	float closedFormError = 0.0f;
+	float uniformError = 0.0f;
+	for (int i = 0; i < count; i++)
+	{
+		XMMATRIX uniformGeneral = Transform::InverseTranspose(XMLoadFloat4x4(&uniformWorlds[i]), 0);
+		for (XMVECTOR n : normals)
+		{
+			XMVECTOR expected = XMVector3Normalize(XMVector3TransformNormal(n, XMLoadFloat4x4(&general[i])));
+			XMVECTOR actual = XMVector3Normalize(XMVector3TransformNormal(n, XMLoadFloat4x4(&closedForm[i])));
+			closedFormError = fmaxf(closedFormError, XMVectorGetX(XMVector3Length(XMVectorSubtract(expected, actual))));
+
+			expected = XMVector3Normalize(XMVector3TransformNormal(n, uniformGeneral));
+			actual = XMVector3Normalize(XMVector3TransformNormal(n, XMLoadFloat4x4(&uniform[i])));
+			uniformError = fmaxf(uniformError, XMVectorGetX(XMVector3Length(XMVectorSubtract(expected, actual))));
+		}
+	}
+
+	printf("\n--- Inverse-transpose (%d TRS matrices, %d iterations) ---\n", count, iterations);
+	printf("General inverse   %7.1f ns per transform\n", generalMs * 1e6 / count);
+	printf("Closed form       %7.1f ns per transform (%.1fx)   %s  max normal error %.2e\n",
+		closedFormMs * 1e6 / count, generalMs / closedFormMs, closedFormError <= tolerance ? "PASS" : "FAIL", closedFormError);
+	printf("Uniform scale     %7.1f ns per transform (%.1fx)   %s  max normal error %.2e\n",
+		uniformMs * 1e6 / count, generalMs / uniformMs, uniformError <= tolerance ? "PASS" : "FAIL", uniformError);
+}
+
+// --------------------------------------------------------
+// Builds a forest of deep hierarchies (a long chain per
+// tree, with a few leaves hanging off every link) and
+// times updates as more or fewer of its nodes change,
+// checking the results against multiplying the matrices
+// of separate Transforms up each chain
+// --------------------------------------------------------
+void Benchmarks::TransformHierarchy()
+{
+	const unsigned int trees = 250;
+	const unsigned int depth = 40;
+	const unsigned int leavesPerLink = 4;
+	const int iterations = 20;
+	const float tolerance = 0.0001f;
+
+	TransformSystem transformSystem;
+	std::vector<Transform> reference;
+	std::vector<unsigned int> roots;
+	std::vector<unsigned int> leaves;
+	for (unsigned int t = 0; t < trees; t++)
+	{
+		unsigned int parent = transformSystem.Create();
+		roots.push_back(parent);
+		for (unsigned int d = 0; d < depth; d++)
+		{
+			unsigned int link = transformSystem.Create();
+			transformSystem.SetParent(link, parent);
+			transformSystem.SetPosition(link, 0, 1.0f, 0);
+			transformSystem.SetRotation(link, 0.05f, 0, 0.02f);
+			transformSystem.SetScale(link, 1.0f, 0.98f, 1.01f);
+
+			for (unsigned int l = 0; l < leavesPerLink; l++)
+			{
+				unsigned int leaf = transformSystem.Create();
+				transformSystem.SetParent(leaf, link);
+				transformSystem.SetPosition(leaf, 0.5f, 0, (float)l);
+				leaves.push_back(leaf);
+			}
+			parent = link;
+		}
+	}
+	unsigned int count = transformSystem.GetCount();
+	transformSystem.UpdateMatrices();
+
+	// Moves a fraction of the roots or leaves, then updates
+	float time = 0.0f;
+	auto runFrames = [&](const std::vector<unsigned int>& nodes, unsigned int every)
+	{
+		return AverageMs(iterations, [&]()
+		{
+			time += 0.016f;
+			for (size_t i = (size_t)(time * 1000) % every; i < nodes.size(); i += every)
+				transformSystem.SetRotation(nodes[i], 0, time + i, 0);
+			transformSystem.UpdateMatrices();
+		});
+	};
+
+	double allRootsMs = runFrames(roots, 1);
+	double someRootsMs = runFrames(roots, 100);
+	double oneRootMs = runFrames(roots, trees);
+	double leavesMs = runFrames(leaves, 1);
+
+	// Rebuild every world matrix the slow way: local matrices multiplied up each chain
+	for (unsigned int i = 0; i < count; i++)
+	{
+		XMFLOAT3 position = transformSystem.GetPosition(i);
+		XMFLOAT3 rotation = transformSystem.GetRotation(i);
+		XMFLOAT3 scale = transformSystem.GetScale(i);
+		reference.push_back(Transform());
+		reference[i].SetPosition(position.x, position.y, position.z);
+		reference[i].SetRotation(rotation.x, rotation.y, rotation.z);
+		reference[i].SetScale(scale.x, scale.y, scale.z);
+	}
+
+	float maxError = 0.0f;
+	float maxNormalError = 0.0f;
+	XMVECTOR normal = XMVector3Normalize(XMVectorSet(1, 2, 3, 0));
+	for (unsigned int i = 0; i < count; i++)
+	{
+		XMFLOAT4X4 local = reference[i].GetWorldMatrix();
+		XMMATRIX expected = XMLoadFloat4x4(&local);
+		for (unsigned int p = transformSystem.GetParent(i); p != TransformSystem::NoParent; p = transformSystem.GetParent(p))
+		{
+			XMFLOAT4X4 parentLocal = reference[p].GetWorldMatrix();
+			expected = XMMatrixMultiply(expected, XMLoadFloat4x4(&parentLocal));
+		}
+
+		XMFLOAT4X4 expectedWorld;
+		XMStoreFloat4x4(&expectedWorld, expected);
+		XMFLOAT4X4 actualWorld = transformSystem.GetWorldMatrix(i);
+		for (int e = 0; e < 16; e++)
+		{
+			float a = (&expectedWorld._11)[e];
+			float b = (&actualWorld._11)[e];
+			maxError = fmaxf(maxError, fabsf(a - b) / fmaxf(1.0f, fabsf(a)));
+		}
+
+		XMFLOAT4X4 actualInverseTranspose = transformSystem.GetWorldInverseTransposeMatrix(i);
+		XMVECTOR expectedNormal = XMVector3Normalize(XMVector3TransformNormal(normal, Transform::InverseTranspose(expected, 0)));
+		XMVECTOR actualNormal = XMVector3Normalize(XMVector3TransformNormal(normal, XMLoadFloat4x4(&actualInverseTranspose)));
+		maxNormalError = fmaxf(maxNormalError, XMVectorGetX(XMVector3Length(XMVectorSubtract(expectedNormal, actualNormal))));
+	}
+
+	printf("\n--- Transform hierarchy (%u trees, %u deep, %u nodes, %d frames) ---\n", trees, depth, count, iterations);
+	printf("%s  max error %.2e   max normal error %.2e\n",
+		maxError <= tolerance && maxNormalError <= tolerance ? "PASS" : "FAIL", maxError, maxNormalError);
+	printf("Every root moving  %8.3f ms\n", allRootsMs);
+	printf("1%% of roots moving %8.3f ms\n", someRootsMs);
+	printf("One root moving    %8.3f ms\n", oneRootMs);
+	printf("Every leaf moving  %8.3f ms\n", leavesMs);
+}
+
+// --------------------------------------------------------
+// Sorts packets with keys shaped like a real frame's (a
+// few passes and shaders, more materials and meshes, and
+// random depths) with both sorts, checking they agree
+// --------------------------------------------------------
+void Benchmarks::RenderQueueSort()
+{
+	const int iterations = 20;
+	const size_t counts[] = { 50, 1000, 10000, 100000 };
+
+	printf("\n--- Render queue sort (%d iterations) ---\n", iterations);
+	for (size_t count : counts)
+	{
+		// Deterministic pseudo-random keys
+		std::vector<DrawPacket> unsorted(count);
+		uint32_t seed = 12345;
+		for (size_t i = 0; i < count; i++)
+		{
+			seed = seed * 1664525 + 1013904223;
+			uint64_t pass = (seed >> 8) % 3;
+			uint64_t shader = (seed >> 12) % 8;
+			uint64_t material = (seed >> 16) % 200;
+			seed = seed * 1664525 + 1013904223;
+			uint64_t mesh = (seed >> 8) % 500;
+			uint64_t depth = seed >> 16;
+			unsorted[i].Key = (pass << 60) | (shader << 48) | (material << 32) | (mesh << 16) | depth;
+			unsorted[i].Entity = 0;
+		}
+
+		std::vector<DrawPacket> stdSorted;
+		double stdMs = AverageMs(iterations, [&]()
+		{
+			stdSorted = unsorted;
+			std::sort(stdSorted.begin(), stdSorted.end(),
+				[](const DrawPacket& a, const DrawPacket& b) { return a.Key < b.Key; });
+		});
+
+		std::vector<DrawPacket> radixSorted;
+		std::vector<DrawPacket> scratch;
+		double radixMs = AverageMs(iterations, [&]()
+		{
+			radixSorted = unsorted;
+			RenderQueue::RadixSort(radixSorted, scratch);
+		});
+
+		bool match = true;
+		for (size_t i = 0; i < count; i++)
+			match = match && stdSorted[i].Key == radixSorted[i].Key;
+
+		printf("%6zu packets: std::sort %8.3f ms, radix sort %8.3f ms (%.1fx)   %s\n",
+			count, stdMs, radixMs, stdMs / radixMs, match ? "PASS" : "FAIL");
+	}
+}
+
+// --------------------------------------------------------
+// Scatters boxes of random sizes around a camera and culls
+// them one at a time, then with the SIMD culler, checking
+// both keep the same boxes
+// --------------------------------------------------------
+void Benchmarks::FrustumCulling()
+{
+	const int iterations = 20;
+	const size_t counts[] = { 1000, 10000, 100000 };
+
+	XMFLOAT4X4 view;
+	XMFLOAT4X4 projection;
+	XMStoreFloat4x4(&view, XMMatrixLookToLH(XMVectorSet(0, 0, -100, 0), XMVectorSet(0, 0, 1, 0), XMVectorSet(0, 1, 0, 0)));
+	XMStoreFloat4x4(&projection, XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, 150.0f));
+
+	XMFLOAT4 planes[6];
+	FrustumCuller::ExtractPlanes(XMMatrixMultiply(XMLoadFloat4x4(&view), XMLoadFloat4x4(&projection)), planes);
+
+	printf("\n--- Frustum culling (%d iterations) ---\n", iterations);
+	for (size_t count : counts)
+	{
+		// Deterministic pseudo-random unit cubes, scaled and moved
+		uint32_t seed = 12345;
+		auto random = [&seed]()
+		{
+			seed = seed * 1664525 + 1013904223;
+			return (seed >> 8) / 16777216.0f;
+		};
+
+		FrustumCuller culler;
+		std::vector<XMFLOAT3> centers(count);
+		std::vector<float> extents(count);
+		std::vector<float> radii(count);
+		XMFLOAT3 boundsMin(-0.5f, -0.5f, -0.5f);
+		XMFLOAT3 boundsMax(0.5f, 0.5f, 0.5f);
+		float cubeRadius = sqrtf(0.75f);
+		for (size_t i = 0; i < count; i++)
+		{
+			float scale = 0.5f + random() * 2.0f;
+			centers[i] = XMFLOAT3(random() * 200.0f - 100.0f, random() * 200.0f - 100.0f, random() * 200.0f - 100.0f);
+			extents[i] = 0.5f * scale;
+			radii[i] = cubeRadius * scale;
+
+			XMFLOAT4X4 world;
+			XMStoreFloat4x4(&world, XMMatrixMultiply(XMMatrixScaling(scale, scale, scale), XMMatrixTranslation(centers[i].x, centers[i].y, centers[i].z)));
+			culler.Add(boundsMin, boundsMax, cubeRadius, world);
+		}
+
+		std::vector<unsigned int> scalarVisible;
+		double scalarMs = AverageMs(iterations, [&]()
+		{
+			scalarVisible.clear();
+			for (size_t i = 0; i < count; i++)
+			{
+				bool inside = true;
+				for (int p = 0; p < 6 && inside; p++)
+				{
+					const XMFLOAT4& plane = planes[p];
+					float distance = plane.x * centers[i].x + plane.y * centers[i].y + plane.z * centers[i].z + plane.w;
+					float boxReach = (fabsf(plane.x) + fabsf(plane.y) + fabsf(plane.z)) * extents[i];
+					inside = distance >= -fminf(radii[i], boxReach);
+				}
+				if (inside)
+					scalarVisible.push_back((unsigned int)i);
+			}
+		});
+
+		std::vector<unsigned int> simdVisible;
+		double simdMs = AverageMs(iterations, [&]()
+		{
+			culler.Cull(view, projection, simdVisible);
+		});
+
+		printf("%7zu objects (%6zu visible): one at a time %8.3f ms, four at a time %8.3f ms (%.1fx)   %s\n",
+			count, simdVisible.size(), scalarMs, simdMs, scalarMs / simdMs, scalarVisible == simdVisible ? "PASS" : "FAIL");
+	}
+}
+
+// --------------------------------------------------------
+// Scatters boxes at the same density for every scene size,
+// then runs each kind of query through the BVH and as a
+// linear scan over every box, checking they agree
+// --------------------------------------------------------
+void Benchmarks::BVHQueries()
+{
+	const size_t counts[] = { 100, 1000, 10000, 100000, 1000000 };
+	const int queryCount = 100;
+
+	// Plain compares for the linear scans, as the tree uses
+	auto smaller = [](float a, float b) { return a < b ? a : b; };
+	auto larger = [](float a, float b) { return a > b ? a : b; };
+
+	printf("\n--- BVH queries (times per query; refit moves 1%% of objects) ---\n");
+	printf("%8s %9s %9s | %9s %9s | %9s %9s | %9s %9s | %s\n",
+		"objects", "build", "refit", "frustum", "linear", "ray", "linear", "sphere", "linear", "");
+	for (size_t count : counts)
+	{
+		uint32_t seed = 12345;
+		auto random = [&seed]()
+		{
+			seed = seed * 1664525 + 1013904223;
+			return (seed >> 8) / 16777216.0f;
+		};
+
+		// About one box per 64 cubic units
+		float size = cbrtf((float)count * 64.0f);
+		std::vector<XMFLOAT3> boxMins(count);
+		std::vector<XMFLOAT3> boxMaxs(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			XMFLOAT3 center(random() * size, random() * size, random() * size);
+			float extent = 0.25f + random();
+			boxMins[i] = XMFLOAT3(center.x - extent, center.y - extent, center.z - extent);
+			boxMaxs[i] = XMFLOAT3(center.x + extent, center.y + extent, center.z + extent);
+		}
+
+		BVH bvh;
+		double buildMs = AverageMs(1, [&]()
+		{
+			bvh.Clear();
+			for (size_t i = 0; i < count; i++)
+				bvh.Add(boxMins[i], boxMaxs[i]);
+			bvh.Update();
+		});
+
+		double refitMs = AverageMs(1, [&]()
+		{
+			for (size_t i = 0; i < count; i += 100)
+			{
+				float offset = random() - 0.5f;
+				boxMins[i].x += offset;
+				boxMaxs[i].x += offset;
+				bvh.SetBounds((unsigned int)i, boxMins[i], boxMaxs[i]);
+			}
+			bvh.Update();
+		});
+
+		bool match = true;
+
+		// A camera on the edge of the scene looking into it
+		XMFLOAT4 planes[6];
+		XMMATRIX view = XMMatrixLookToLH(XMVectorSet(size * 0.5f, size * 0.5f, -1.0f, 0), XMVectorSet(0, 0, 1, 0), XMVectorSet(0, 1, 0, 0));
+		XMMATRIX projection = XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, size * 0.5f);
+		FrustumCuller::ExtractPlanes(XMMatrixMultiply(view, projection), planes);
+
+		std::vector<unsigned int> bvhVisible;
+		double frustumMs = AverageMs(queryCount, [&]() { bvh.QueryFrustum(planes, bvhVisible); });
+
+		std::vector<unsigned int> linearVisible;
+		double linearFrustumMs = AverageMs(queryCount / 10, [&]()
+		{
+			linearVisible.clear();
+			for (size_t i = 0; i < count; i++)
+			{
+				bool inside = true;
+				for (int p = 0; p < 6 && inside; p++)
+				{
+					const XMFLOAT4& plane = planes[p];
+					float x = plane.x >= 0.0f ? boxMaxs[i].x : boxMins[i].x;
+					float y = plane.y >= 0.0f ? boxMaxs[i].y : boxMins[i].y;
+					float z = plane.z >= 0.0f ? boxMaxs[i].z : boxMins[i].z;
+					inside = plane.x * x + plane.y * y + plane.z * z + plane.w >= 0.0f;
+				}
+				if (inside)
+					linearVisible.push_back((unsigned int)i);
+			}
+		});
+		std::sort(bvhVisible.begin(), bvhVisible.end());
+		match = match && bvhVisible == linearVisible;
+
+		// Rays from the camera into the scene
+		std::vector<XMFLOAT3> rayOrigins(queryCount);
+		std::vector<XMFLOAT3> rayDirections(queryCount);
+		for (int r = 0; r < queryCount; r++)
+		{
+			rayOrigins[r] = XMFLOAT3(size * 0.5f, size * 0.5f, -1.0f);
+			rayDirections[r] = XMFLOAT3(random() - 0.5f, random() - 0.5f, 1.0f);
+		}
+
+		std::vector<unsigned int> bvhHits(queryCount);
+		std::vector<float> bvhDistances(queryCount);
+		double rayMs = AverageMs(1, [&]()
+		{
+			for (int r = 0; r < queryCount; r++)
+			{
+				bvhHits[r] = 0xFFFFFFFF;
+				bvh.Raycast(rayOrigins[r], rayDirections[r], FLT_MAX, bvhHits[r], bvhDistances[r]);
+			}
+		}) / queryCount;
+
+		std::vector<unsigned int> linearHits(queryCount);
+		double linearRayMs = AverageMs(1, [&]()
+		{
+			for (int r = 0; r < queryCount; r++)
+			{
+				const XMFLOAT3& o = rayOrigins[r];
+				XMFLOAT3 inverse(1.0f / rayDirections[r].x, 1.0f / rayDirections[r].y, 1.0f / rayDirections[r].z);
+				float closest = FLT_MAX;
+				linearHits[r] = 0xFFFFFFFF;
+				for (size_t i = 0; i < count; i++)
+				{
+					float x1 = (boxMins[i].x - o.x) * inverse.x, x2 = (boxMaxs[i].x - o.x) * inverse.x;
+					float y1 = (boxMins[i].y - o.y) * inverse.y, y2 = (boxMaxs[i].y - o.y) * inverse.y;
+					float z1 = (boxMins[i].z - o.z) * inverse.z, z2 = (boxMaxs[i].z - o.z) * inverse.z;
+					float enter = larger(larger(smaller(x1, x2), smaller(y1, y2)), larger(smaller(z1, z2), 0.0f));
+					float exit = smaller(smaller(larger(x1, x2), larger(y1, y2)), larger(z1, z2));
+					if (exit >= enter && enter < closest)
+					{
+						closest = enter;
+						linearHits[r] = (unsigned int)i;
+					}
+				}
+			}
+		}) / queryCount;
+		match = match && bvhHits == linearHits;
+
+		// Spheres around random boxes
+		std::vector<unsigned int> bvhFound;
+		size_t bvhFoundTotal = 0;
+		double sphereMs = AverageMs(1, [&]()
+		{
+			for (int q = 0; q < queryCount; q++)
+			{
+				const XMFLOAT3& center = boxMins[(q * 7919) % count];
+				bvh.QuerySphere(center, 5.0f, bvhFound);
+				bvhFoundTotal += bvhFound.size();
+			}
+		}) / queryCount;
+
+		size_t linearFoundTotal = 0;
+		double linearSphereMs = AverageMs(1, [&]()
+		{
+			for (int q = 0; q < queryCount; q++)
+			{
+				const XMFLOAT3& center = boxMins[(q * 7919) % count];
+				for (size_t i = 0; i < count; i++)
+				{
+					float x = center.x - larger(boxMins[i].x, smaller(center.x, boxMaxs[i].x));
+					float y = center.y - larger(boxMins[i].y, smaller(center.y, boxMaxs[i].y));
+					float z = center.z - larger(boxMins[i].z, smaller(center.z, boxMaxs[i].z));
+					if (x * x + y * y + z * z <= 25.0f)
+						linearFoundTotal++;
+				}
+			}
+		}) / queryCount;
+		match = match && bvhFoundTotal == linearFoundTotal;
+
+		printf("%8zu %7.3fms %7.3fms | %7.4fms %7.4fms | %7.4fms %7.4fms | %7.4fms %7.4fms | %s\n",
+			count, buildMs, refitMs, frustumMs, linearFrustumMs, rayMs, linearRayMs, sphereMs, linearSphereMs, match ? "PASS" : "FAIL");
+	}
+}
+
+// --------------------------------------------------------
+// Records empty scopes in batches that fit a thread's
+// buffer, first on this thread alone and then on several
+// workers at once, draining them after every batch as
+// the end of each frame would
+// --------------------------------------------------------
+void Benchmarks::ProfilerOverhead()
+{
+	const int batches = 200;
+	const int batchSize = 4096;
+	Profiler& profiler = Profiler::GetInstance();
+	profiler.EndFrame();
+	unsigned int droppedBefore = profiler.GetDroppedEvents();
+
+	printf("\n--- Profiler overhead (%d batches of %d scopes) ---\n", batches, batchSize);
+
+	double recordMs = 0.0;
+	for (int b = 0; b < batches; b++)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < batchSize; i++)
+		{
+			ProfileScope profile("Benchmark scope");
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+		recordMs += std::chrono::duration<double, std::milli>(end - start).count();
+
+		profiler.EndFrame();
+	}
+	printf("1 thread:  %6.1f ns per scope\n", recordMs * 1000000.0 / ((double)batches * batchSize));
+
+	// Each worker records a batch a frame, and this thread
+	// drains them once every worker is done with the frame
+	unsigned int threadCount = std::thread::hardware_concurrency();
+	threadCount = threadCount > 2 ? threadCount - 1 : 1;
+	std::vector<std::thread> threads;
+	std::vector<double> threadMs(threadCount);
+	std::atomic<unsigned int> batchesDone(0);
+	std::atomic<int> frame(0);
+	for (unsigned int t = 0; t < threadCount; t++)
+	{
+		threads.push_back(std::thread([&, t]()
+		{
+			for (int b = 0; b < batches; b++)
+			{
+				while (frame.load() < b)
+					std::this_thread::yield();
+
+				auto start = std::chrono::high_resolution_clock::now();
+				for (int i = 0; i < batchSize; i++)
+				{
+					ProfileScope profile("Benchmark scope");
+				}
+				auto end = std::chrono::high_resolution_clock::now();
+				threadMs[t] += std::chrono::duration<double, std::milli>(end - start).count();
+				batchesDone++;
+			}
+		}));
+	}
+	for (int b = 0; b < batches; b++)
+	{
+		while (batchesDone.load() < threadCount * (b + 1))
+			std::this_thread::yield();
+		profiler.EndFrame();
+		frame++;
+	}
+	for (std::thread& thread : threads)
+		thread.join();
+
+	double totalMs = 0.0;
+	for (double ms : threadMs)
+		totalMs += ms;
+	printf("%u threads: %6.1f ns per scope, %u events dropped\n",
+		threadCount,
+		totalMs * 1000000.0 / ((double)threadCount * batches * batchSize),
+		profiler.GetDroppedEvents() - droppedBefore);
+
+	profiler.ResetStats();
+}
+
+// --------------------------------------------------------
+// Sets the main vertex shader's matrices the way a draw
+// does, by name and then by handle, checking both leave
+// the same bytes in the constant buffers
+// --------------------------------------------------------
+void Benchmarks::ShaderVariables(std::wstring vertexShaderFile, Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+{
+	const int iterations = 20;
+	const int draws = 100000;
+
+	SimpleVertexShader vs(device, context, vertexShaderFile.c_str());
+	if (!vs.IsShaderValid())
+		return;
+
+	const char* names[] = { "world", "worldInvTranspose", "view", "projection", "lightView", "lightProj" };
+	const int variableCount = sizeof(names) / sizeof(names[0]);
+	SimpleShaderVariableHandle handles[variableCount];
+	for (int v = 0; v < variableCount; v++)
+		handles[v] = vs.GetVariableHandle(names[v]);
+
+	// A different matrix per draw, so nothing can be hoisted out of the loop
+	std::vector<XMFLOAT4X4> matrices(256);
+	for (size_t i = 0; i < matrices.size(); i++)
+		XMStoreFloat4x4(&matrices[i], XMMatrixTranslation((float)i, (float)i * 2.0f, (float)i * 3.0f));
+
+	double nameMs = AverageMs(iterations, [&]()
+	{
+		for (int d = 0; d < draws; d++)
+			for (int v = 0; v < variableCount; v++)
+				vs.SetMatrix4x4(names[v], matrices[(d + v) & 255]);
+	});
+	std::vector<std::vector<unsigned char>> nameBuffers;
+	for (unsigned int b = 0; b < vs.GetBufferCount(); b++)
+	{
+		const SimpleConstantBuffer* cb = vs.GetBufferInfo(b);
+		nameBuffers.emplace_back(cb->LocalDataBuffer, cb->LocalDataBuffer + cb->Size);
+		memset(cb->LocalDataBuffer, 0, cb->Size);
+	}
+
+	double handleMs = AverageMs(iterations, [&]()
+	{
+		for (int d = 0; d < draws; d++)
+			for (int v = 0; v < variableCount; v++)
+				vs.SetMatrix4x4(handles[v], matrices[(d + v) & 255]);
+	});
+	bool match = true;
+	for (unsigned int b = 0; b < vs.GetBufferCount(); b++)
+	{
+		const SimpleConstantBuffer* cb = vs.GetBufferInfo(b);
+		match = match && memcmp(cb->LocalDataBuffer, nameBuffers[b].data(), cb->Size) == 0;
+	}
+
+	int sets = draws * variableCount;
+	printf("\n--- Shader variable setters (%d matrices, %d iterations) ---\n", sets, iterations);
+	printf("By name     %6.1f ns per set\n", nameMs * 1e6 / sets);
+	printf("By handle   %6.1f ns per set (%.1fx)   %s\n",
+		handleMs * 1e6 / sets, nameMs / handleMs, match ? "PASS" : "FAIL");
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <string>
+#include <d3d11.h>
+#include <wrl/client.h>
+
+// --------------------------------------------------------
+// Micro-benchmarks for the engine's CPU-side code paths
+//
+// - Results are printed to the console window
+// - Only run when RUN_BENCHMARKS is defined (see Game::Init)
+// --------------------------------------------------------
+class Benchmarks
+{
+public:
+	// Compares the fast OBJ parser against the old getline + sscanf_s loader
+	static void ObjLoading(std::string modelFolder);
+
+	// Times mip generation with each filter and block compression on one
+	// thread and on many, and checks each format's quality, on synthetic
+	// color, normal and single channel images
+	static void TextureCooking();
+
+	// Compares loading every texture in a folder from PNG (decode, upload,
+	// GPU mips) against its cooked DDS, in time and video memory, and
+	// against loading just the levels a streamed texture starts with
+	static void TextureLoading(std::wstring textureFolder, Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+
+	// Compares each material's cooked roughness and metalness maps against
+	// its packed ORM texture: bindings, size and how close each channel stays
+	static void PackedTextures(std::wstring textureFolder);
+
+	// Compares the SIMD tangent generator against the original scalar
+	// version, for speed and (on every bundled model) for matching output
+	static void Tangents(std::string modelFolder);
+
+	// Compares loading meshes from .obj files against the binary mesh cache
+	static void MeshLoading(std::string modelFolder, Microsoft::WRL::ComPtr<ID3D11Device> device);
+
+	// Compares per-object Transforms against the bulk TransformSystem
+	// when every object moves each frame
+	static void Transforms();
+
+	// Times hierarchy updates when all, some or very few nodes change
+	static void TransformHierarchy();
+
+	// Compares the closed form TRS inverse-transpose against a general inverse
+	static void InverseTranspose();
+
+	// Compares the render queue's radix sort against std::sort on draw packets
+	static void RenderQueueSort();
+
+	// Compares culling bounds one at a time against four at a time with SIMD
+	static void FrustumCulling();
+
+	// Times building and refitting a BVH, and compares its frustum, ray and
+	// sphere queries against linear scans, from 100 to 1M objects
+	static void BVHQueries();
+
+	// Times recording profiler scopes from one thread, then from several
+	// at once, draining them between batches as each frame would
+	static void ProfilerOverhead();
+
+	// Compares setting shader variables by name against pre-resolved handles
+	static void ShaderVariables(std::wstring vertexShaderFile, Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <DirectXMath.h>
+#include "Light.h"
 
 struct VertexShaderExternalData
 {
@@ -8,4 +9,74 @@ struct VertexShaderExternalData
 	DirectX::XMFLOAT4X4 worldMatrix;
 	DirectX::XMFLOAT4X4 viewMatrix;
 	DirectX::XMFLOAT4X4 projectionMatrix;
+};
+
+// Registers of the shared constant buffers in ConstantBuffers.hlsli,
+// which every shader declares and the application binds for all of them
+const unsigned int PerFrameSlot = 0;
+const unsigned int PerPassSlot = 1;
+const unsigned int PerMaterialSlot = 2;
+const unsigned int PerObjectSlot = 3;
+
+// Matches the PerFrame cbuffer
+struct PerFrameData
+{
+	DirectX::XMFLOAT3 cameraPosition;
+	float framePadding0;
+	DirectX::XMFLOAT3 ambientLight;
+	float framePadding1;
+	Light dirLight1;
+	Light dirLight2;
+	Light dirLight3;
+	Light pointLight1;
+	Light pointLight2;
+};
+
+// Matches the PerPass cbuffer
+struct PerPassData
+{
+	DirectX::XMFLOAT4X4 view;
+	DirectX::XMFLOAT4X4 projection;
+	DirectX::XMFLOAT4X4 lightView;
+	DirectX::XMFLOAT4X4 lightProj;
+};
+
+// Matches the PerMaterial cbuffer
+struct PerMaterialData
+{
+	DirectX::XMFLOAT4 colorTint;
+	float roughness;
+	float uvScale;
+	DirectX::XMFLOAT2 uvOffset;
+	unsigned int materialIndex;
+	DirectX::XMFLOAT3 materialPadding;
+};
+
+// Matches the PerObject cbuffer
+struct PerObjectData
+{
+	DirectX::XMFLOAT4X4 world;
+	DirectX::XMFLOAT4X4 worldInvTranspose;
+};
+
+// One instance in the instance buffer, matching the _PER_INSTANCE
+// inputs of VertexShaderInputInstanced
+struct InstanceData
+{
+	DirectX::XMFLOAT4X4 world;
+	DirectX::XMFLOAT4X4 worldInvTranspose;
+	unsigned int materialIndex;			// Into its material array, if it has one
+};
+
+// Matches ArrayMaterial in PixelShader.hlsl, one per material in a MaterialArray
+struct MaterialArrayData
+{
+	DirectX::XMFLOAT4 colorTint;
+	float roughness;
+	float uvScale;
+	DirectX::XMFLOAT2 uvOffset;
+	unsigned int albedoSlice;
+	unsigned int normalSlice;
+	unsigned int ormSlice;
+	unsigned int padding;
 };
\ No newline at end of file
@@ -84,3 +84,4 @@ void Camera::UpdateProjectionMatrix(float aspectRatio)
 Transform* Camera::GetTransform(){ return &transform;}
 DirectX::XMFLOAT4X4 Camera::GetViewMatrix(){ return viewMatrix;}
 DirectX::XMFLOAT4X4 Camera::GetProjectionMatrix(){ return projectionMatrix; }
+float Camera::GetFarPlane(){ return farPlane; }
@@ -18,6 +18,7 @@ public:
 	Transform* GetTransform();
 	DirectX::XMFLOAT4X4 GetViewMatrix();
 	DirectX::XMFLOAT4X4 GetProjectionMatrix();
+	float GetFarPlane();
 
 private:
 	// Camera matrices
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <cstring>
+#include "SimpleShader.h"
+
+// --------------------------------------------------------
+// A constant buffer owned by the application rather than
+// by a shader, holding one struct from BufferStructs.h
+//
+// - Bound at a fixed register for the vertex and pixel
+//   stages, which shaders leave alone (see
+//   ISimpleShader::ExternalBufferSlots)
+// - Update() only uploads when the data differs from the
+//   last upload, with Map(WRITE_DISCARD), and adds to the
+//   same upload stats as ISimpleShader
+// --------------------------------------------------------
+template <typename T>
+class ConstantBuffer
+{
+public:
+	ConstantBuffer(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, unsigned int slot)
+	{
+		this->context = context;
+		this->slot = slot;
+		this->uploaded = false;
+		memset(&data, 0, sizeof(T));
+
+		D3D11_BUFFER_DESC desc = {};
+		desc.Usage = D3D11_USAGE_DYNAMIC;
+		desc.ByteWidth = (sizeof(T) + 15) / 16 * 16;
+		desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+		desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		device->CreateBuffer(&desc, 0, buffer.GetAddressOf());
+	}
+
+	// Uploads the data, unless it's what the buffer already holds
+	void Update(const T& newData)
+	{
+		if (uploaded && memcmp(&data, &newData, sizeof(T)) == 0)
+		{
+			ISimpleShader::SkippedUploads++;
+			return;
+		}
+
+		D3D11_MAPPED_SUBRESOURCE mapped = {};
+		if (FAILED(context->Map(buffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+			return;
+		memcpy(mapped.pData, &newData, sizeof(T));
+		context->Unmap(buffer.Get(), 0);
+
+		data = newData;
+		uploaded = true;
+		ISimpleShader::UploadedBytes += sizeof(T);
+		ISimpleShader::ChangedBytes += sizeof(T);
+	}
+
+	// Binds the buffer to its register in the vertex and pixel shader stages
+	void Bind()
+	{
+		context->VSSetConstantBuffers(slot, 1, buffer.GetAddressOf());
+		context->PSSetConstantBuffers(slot, 1, buffer.GetAddressOf());
+	}
+
+	Microsoft::WRL::ComPtr<ID3D11Buffer> GetBuffer() { return buffer; }
+	unsigned int GetSlot() { return slot; }
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> buffer;
+	unsigned int slot;
+
+	// Copy of the last upload, to skip unchanged ones
+	T data;
+	bool uploaded;
+};
@@ -0,0 +1,62 @@
+#ifndef __GGP_CONSTANT_BUFFERS__
+#define __GGP_CONSTANT_BUFFERS__
+
+// Constant buffers shared by every shader, split by how often they
+// change. The C++ side (see BufferStructs.h) owns one buffer of each
+// and binds it at the same register for every shader.
+
+// Struct for all types of lights
+struct Light
+{
+	int Type;
+	float3 Direction;
+	float Range;
+	float3 Position;
+	float Intensity;
+	float3 Color;
+	float SpotFalloff;
+	float3 Padding;
+};
+
+// Uploaded once per frame
+cbuffer PerFrame : register(b0)
+{
+	float3 cameraPosition;
+	float framePadding0;
+	float3 ambientLight;
+	float framePadding1;
+	Light dirLight1;
+	Light dirLight2;
+	Light dirLight3;
+	Light pointLight1;
+	Light pointLight2;
+}
+
+// Uploaded at the start of each pass (the shadow pass renders from the light)
+cbuffer PerPass : register(b1)
+{
+	matrix view;
+	matrix projection;
+	matrix lightView;
+	matrix lightProj;
+}
+
+// Uploaded when the material changes
+cbuffer PerMaterial : register(b2)
+{
+	float4 colorTint;
+	float roughness;
+	float uvScale;
+	float2 uvOffset;
+	uint materialIndex;			// Into a material array's buffer, for draws that aren't instanced
+	float3 materialPadding;
+}
+
+// Uploaded per draw, or replaced by a static entity's baked buffer
+cbuffer PerObject : register(b3)
+{
+	matrix world;
+	matrix worldInvTranspose;
+}
+
+#endif
@@ -1,10 +1,5 @@
 #include "ShaderIncludes.hlsli"
 
-cbuffer ExternalData : register(b0)
-{
-	float4 colorTint;
-}
-
 // --------------------------------------------------------
 // The entry point (main method) for our pixel shader
 // 
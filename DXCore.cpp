@@ -1,5 +1,6 @@
 #include "DXCore.h"
 #include "Input.h"
+#include "Profiler.h"
 
 #include <WindowsX.h>
 #include <sstream>
@@ -53,6 +54,12 @@ DXCore::DXCore(
 	
 	this->fpsFrameCount = 0;
 	this->fpsTimeElapsed = 0.0f;
+	this->deviceMode = DeviceMode::Hardware;
+	this->frameLimit = 0;
+	this->drawMsTotal = 0.0;
+	this->drawMsMin = 0.0;
+	this->drawMsMax = 0.0;
+	this->recordedFrames = 0;
 	this->currentTime = 0;
 	this->deltaTime = 0;
 	this->startTime = 0;
@@ -62,6 +69,9 @@ DXCore::DXCore(
 	__int64 perfFreq;
 	QueryPerformanceFrequency((LARGE_INTEGER*)&perfFreq);
 	perfCounterSeconds = 1.0 / (double)perfFreq;
+
+	// Creates the profiler before any worker threads can use it
+	Profiler::GetInstance().SetThreadName("Main");
 }
 
 // --------------------------------------------------------
@@ -78,6 +88,23 @@ DXCore::~DXCore()
 	delete& Input::GetInstance();
 }
 
+// --------------------------------------------------------
+// Chooses how InitDirectX() sets up the device. Headless
+// runs print their report to the console that started
+// them, or wherever their output is redirected.
+// --------------------------------------------------------
+void DXCore::SetDeviceMode(DeviceMode mode, unsigned int frameLimit)
+{
+	this->deviceMode = mode;
+	this->frameLimit = frameLimit;
+
+	if (mode == DeviceMode::Headless && GetStdHandle(STD_OUTPUT_HANDLE) == 0 && AttachConsole(ATTACH_PARENT_PROCESS))
+	{
+		FILE* stream;
+		freopen_s(&stream, "CONOUT$", "w", stdout);
+	}
+}
+
 // --------------------------------------------------------
 // Created the actual window for our application
 // --------------------------------------------------------
@@ -149,7 +176,9 @@ HRESULT DXCore::InitWindow()
 
 	// The window exists but is not visible yet
 	// We need to tell Windows to show it, and how to show it
-	ShowWindow(hWnd, SW_SHOW);
+	// (headless runs only need it for input and messages)
+	if (deviceMode != DeviceMode::Headless)
+		ShowWindow(hWnd, SW_SHOW);
 
 	// Initialize the input manager now that we definitely have a window
 	Input::GetInstance().Initialize(hWnd);
@@ -177,51 +206,83 @@ HRESULT DXCore::InitDirectX()
 	deviceFlags |= D3D11_CREATE_DEVICE_DEBUG;
 #endif
 
-	// Create a description of how our swap
-	// chain should work
-	DXGI_SWAP_CHAIN_DESC swapDesc = {};
-	swapDesc.BufferCount = 2;
-	swapDesc.BufferDesc.Width = width;
-	swapDesc.BufferDesc.Height = height;
-	swapDesc.BufferDesc.RefreshRate.Numerator = 60;
-	swapDesc.BufferDesc.RefreshRate.Denominator = 1;
-	swapDesc.BufferDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-	swapDesc.BufferDesc.ScanlineOrdering = DXGI_MODE_SCANLINE_ORDER_UNSPECIFIED;
-	swapDesc.BufferDesc.Scaling = DXGI_MODE_SCALING_UNSPECIFIED;
-	swapDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
-	swapDesc.Flags = 0;
-	swapDesc.OutputWindow = hWnd;
-	swapDesc.SampleDesc.Count = 1;
-	swapDesc.SampleDesc.Quality = 0;
-	swapDesc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
-	swapDesc.Windowed = true;
-
 	// Result variable for below function calls
 	HRESULT hr = S_OK;
-
-	// Attempt to initialize DirectX
-	hr = D3D11CreateDeviceAndSwapChain(
-		0,							// Video adapter (physical GPU) to use, or null for default
-		D3D_DRIVER_TYPE_HARDWARE,	// We want to use the hardware (GPU)
-		0,							// Used when doing software rendering
-		deviceFlags,				// Any special options
-		0,							// Optional array of possible verisons we want as fallbacks
-		0,							// The number of fallbacks in the above param
-		D3D11_SDK_VERSION,			// Current version of the SDK
-		&swapDesc,					// Address of swap chain options
-		swapChain.GetAddressOf(),	// Pointer to our Swap Chain pointer
-		device.GetAddressOf(),		// Pointer to our Device pointer
-		&dxFeatureLevel,			// This will hold the actual feature level the app will use
-		context.GetAddressOf());	// Pointer to our Device Context pointer
-	if (FAILED(hr)) return hr;
-
-	// The above function created the back buffer render target
-	// for us, but we need a reference to it
 	ID3D11Texture2D* backBufferTexture = 0;
-	swapChain->GetBuffer(
-		0,
-		__uuidof(ID3D11Texture2D),
-		(void**)&backBufferTexture);
+
+	if (deviceMode == DeviceMode::Headless)
+	{
+		// Nothing will be presented, so skip the swap chain and use WARP,
+		// which every machine has, just to create resources. The back
+		// buffer is an ordinary texture of the same size.
+		hr = D3D11CreateDevice(
+			0,
+			D3D_DRIVER_TYPE_WARP,
+			0,
+			deviceFlags,
+			0,
+			0,
+			D3D11_SDK_VERSION,
+			device.GetAddressOf(),
+			&dxFeatureLevel,
+			context.GetAddressOf());
+		if (FAILED(hr)) return hr;
+
+		D3D11_TEXTURE2D_DESC backBufferDesc = {};
+		backBufferDesc.Width				= width;
+		backBufferDesc.Height				= height;
+		backBufferDesc.MipLevels			= 1;
+		backBufferDesc.ArraySize			= 1;
+		backBufferDesc.Format				= DXGI_FORMAT_R8G8B8A8_UNORM;
+		backBufferDesc.Usage				= D3D11_USAGE_DEFAULT;
+		backBufferDesc.BindFlags			= D3D11_BIND_RENDER_TARGET;
+		backBufferDesc.SampleDesc.Count		= 1;
+		device->CreateTexture2D(&backBufferDesc, 0, &backBufferTexture);
+	}
+	else
+	{
+		// Create a description of how our swap
+		// chain should work
+		DXGI_SWAP_CHAIN_DESC swapDesc = {};
+		swapDesc.BufferCount = 2;
+		swapDesc.BufferDesc.Width = width;
+		swapDesc.BufferDesc.Height = height;
+		swapDesc.BufferDesc.RefreshRate.Numerator = 60;
+		swapDesc.BufferDesc.RefreshRate.Denominator = 1;
+		swapDesc.BufferDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+		swapDesc.BufferDesc.ScanlineOrdering = DXGI_MODE_SCANLINE_ORDER_UNSPECIFIED;
+		swapDesc.BufferDesc.Scaling = DXGI_MODE_SCALING_UNSPECIFIED;
+		swapDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
+		swapDesc.Flags = 0;
+		swapDesc.OutputWindow = hWnd;
+		swapDesc.SampleDesc.Count = 1;
+		swapDesc.SampleDesc.Quality = 0;
+		swapDesc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
+		swapDesc.Windowed = true;
+
+		// Attempt to initialize DirectX
+		hr = D3D11CreateDeviceAndSwapChain(
+			0,							// Video adapter (physical GPU) to use, or null for default
+			D3D_DRIVER_TYPE_HARDWARE,	// We want to use the hardware (GPU)
+			0,							// Used when doing software rendering
+			deviceFlags,				// Any special options
+			0,							// Optional array of possible verisons we want as fallbacks
+			0,							// The number of fallbacks in the above param
+			D3D11_SDK_VERSION,			// Current version of the SDK
+			&swapDesc,					// Address of swap chain options
+			swapChain.GetAddressOf(),	// Pointer to our Swap Chain pointer
+			device.GetAddressOf(),		// Pointer to our Device pointer
+			&dxFeatureLevel,			// This will hold the actual feature level the app will use
+			context.GetAddressOf());	// Pointer to our Device Context pointer
+		if (FAILED(hr)) return hr;
+
+		// The above function created the back buffer render target
+		// for us, but we need a reference to it
+		swapChain->GetBuffer(
+			0,
+			__uuidof(ID3D11Texture2D),
+			(void**)&backBufferTexture);
+	}
 
 	// Now that we have the texture, create a render target view
 	// for the back buffer so we can render into it.  Then release
@@ -262,6 +323,14 @@ HRESULT DXCore::InitDirectX()
 		depthBufferTexture->Release();
 	}
 
+	// From here on, every call can go through the recorder,
+	// which passes them along unless the run is headless
+	if (deviceMode != DeviceMode::Hardware)
+	{
+		recorder.Attach(new RecordingContext(device, deviceMode == DeviceMode::Recording ? context : 0));
+		context = recorder;
+	}
+
 	// Bind the views to the pipeline, so rendering properly 
 	// uses their underlying textures
 	context->OMSetRenderTargets(
@@ -384,6 +453,10 @@ HRESULT DXCore::Run()
 	// Give subclass a chance to initialize
 	Init();
 
+	// Loading isn't part of any frame
+	if (recorder)
+		recorder->ResetTotalStats();
+
 	// Our overall game and message loop
 	MSG msg = {};
 	while (msg.message != WM_QUIT)
@@ -398,17 +471,50 @@ HRESULT DXCore::Run()
 		}
 		else
 		{
-			// Update timer and title bar (if necessary)
-			UpdateTimer();
-			if(titleBarStats)
-				UpdateTitleBarStats();
+			// Update timer and title bar (if necessary). Headless
+			// runs take fixed steps, so every run does the same work.
+			if (deviceMode == DeviceMode::Headless)
+			{
+				deltaTime = 1.0f / 60.0f;
+				totalTime += deltaTime;
+			}
+			else
+			{
+				UpdateTimer();
+				if (titleBarStats)
+					UpdateTitleBarStats();
+			}
 
 			// Update the input manager
 			Input::GetInstance().Update();
 
 			// The game loop
-			Update(deltaTime, totalTime);
-			Draw(deltaTime, totalTime);
+			if (recorder)
+				recorder->BeginFrame();
+
+			__int64 drawStart;
+			__int64 drawEnd;
+			{
+				ProfileScope profile("Frame");
+				Update(deltaTime, totalTime);
+
+				QueryPerformanceCounter((LARGE_INTEGER*)&drawStart);
+				Draw(deltaTime, totalTime);
+				QueryPerformanceCounter((LARGE_INTEGER*)&drawEnd);
+			}
+			Profiler::GetInstance().EndFrame();
+
+			if (recorder)
+			{
+				double drawMs = (drawEnd - drawStart) * perfCounterSeconds * 1000.0;
+				drawMsTotal += drawMs;
+				drawMsMin = recordedFrames == 0 || drawMs < drawMsMin ? drawMs : drawMsMin;
+				drawMsMax = recordedFrames == 0 || drawMs > drawMsMax ? drawMs : drawMsMax;
+				recordedFrames++;
+
+				if (deviceMode == DeviceMode::Headless && recordedFrames == frameLimit)
+					Quit();
+			}
 
 			// Frame is over, notify the input manager
 			Input::GetInstance().EndOfFrame();
@@ -417,6 +523,9 @@ HRESULT DXCore::Run()
 
 	// We'll end up here once we get a WM_QUIT message,
 	// which usually comes from the user closing the window
+	if (recorder)
+		ReportRecording();
+
 	return (HRESULT)msg.wParam;
 }
 
@@ -502,6 +611,46 @@ void DXCore::UpdateTitleBarStats()
 	fpsTimeElapsed += 1.0f;
 }
 
+// --------------------------------------------------------
+// Prints per frame averages of everything the recorder
+// saw, and writes the last frame's calls to CommandLog.txt
+// next to the executable
+// --------------------------------------------------------
+void DXCore::ReportRecording()
+{
+	if (recordedFrames == 0)
+		return;
+
+	const RecordingStats& stats = recorder->GetTotalStats();
+	double frames = recordedFrames;
+	printf("\n--- Recorded %u frames (%s) ---\n", recordedFrames, recorder->IsForwarding() ? "forwarded to the GPU" : "null device");
+	printf("Draw() CPU time: %.3f ms average, %.3f ms min, %.3f ms max\n",
+		drawMsTotal / frames, drawMsMin, drawMsMax);
+	printf("Per frame: %.1f calls, %.1f binds (%.1f redundant), %.1f draws (%.1f instances, %.0f vertices or indices), %.1f dispatches\n",
+		stats.Commands / frames,
+		stats.Binds / frames,
+		stats.RedundantBinds / frames,
+		stats.Draws / frames,
+		stats.Instances / frames,
+		stats.Elements / frames,
+		stats.Dispatches / frames);
+	printf("           %.1f uploads (%.1f KB), %.1f clears, %.1f copies\n",
+		stats.Uploads / frames,
+		stats.UploadBytes / frames / 1024.0,
+		stats.Clears / frames,
+		stats.Copies / frames);
+
+	std::string logPath = GetFullPathTo("CommandLog.txt");
+	FILE* file = 0;
+	if (fopen_s(&file, logPath.c_str(), "w") == 0)
+	{
+		recorder->WriteLog(file);
+		fclose(file);
+		printf("Last frame's calls written to %s\n", logPath.c_str());
+	}
+	fflush(stdout);
+}
+
 // --------------------------------------------------------
 // Allocates a console window we can print to for debugging
 // 
@@ -663,6 +812,10 @@ LRESULT DXCore::ProcessMessage(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lPara
 		if (wParam == SIZE_MINIMIZED)
 			return 0;
 		
+		// Headless back buffers stay the size they started at
+		if (deviceMode == DeviceMode::Headless)
+			return 0;
+
 		// Save the new client area dimensions.
 		width = LOWORD(lParam);
 		height = HIWORD(lParam);
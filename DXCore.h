@@ -4,11 +4,20 @@
 #include <d3d11.h>
 #include <string>
 #include <wrl/client.h> // Used for ComPtr - a smart pointer for COM objects
+#include "RecordingContext.h"
 
 // We can include the correct library files here
 // instead of in Visual Studio settings if we want
 #pragma comment(lib, "d3d11.lib")
 
+// How the device is created, and whether its calls are recorded
+enum class DeviceMode
+{
+	Hardware,	// The GPU, drawing to the window
+	Recording,	// The GPU, with every context call recorded on the way
+	Headless	// No visible window and nothing drawn: calls are only recorded
+};
+
 class DXCore
 {
 public:
@@ -32,6 +41,10 @@ public:
 	// Internal method for message handling
 	LRESULT ProcessMessage(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam);
 
+	// Must be called before InitWindow(). Headless runs stop after
+	// frameLimit frames (at a fixed 60 fps timestep) and print a report.
+	void SetDeviceMode(DeviceMode mode, unsigned int frameLimit = 0);
+
 	// Initialization and game-loop related methods
 	HRESULT InitWindow();
 	HRESULT InitDirectX();
@@ -67,6 +80,12 @@ protected:
 	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> backBufferRTV;
 	Microsoft::WRL::ComPtr<ID3D11DepthStencilView> depthStencilView;
 
+	// Set when recording, in which case it's also the context above.
+	// Headless runs have no swap chain, and render to an offscreen back buffer.
+	DeviceMode deviceMode;
+	unsigned int frameLimit;
+	Microsoft::WRL::ComPtr<RecordingContext> recorder;
+
 	// Helper function for allocating a console window
 	void CreateConsoleWindow(int bufferLines, int bufferColumns, int windowLines, int windowColumns);
 
@@ -91,7 +110,14 @@ private:
 	int fpsFrameCount;
 	float fpsTimeElapsed;
 
+	// Per-frame CPU cost of Draw() while recording
+	double drawMsTotal;
+	double drawMsMin;
+	double drawMsMax;
+	unsigned int recordedFrames;
+
 	void UpdateTimer();			// Updates the timer for this frame
 	void UpdateTitleBarStats();	// Puts debug info in the title bar
+	void ReportRecording();		// Prints what the recorded frames submitted
 };
 
@@ -0,0 +1,169 @@
+#include "FrustumCuller.h"
+#include <cmath>
+#include <cstdint>
+
+using namespace DirectX;
+
+FrustumCuller::FrustumCuller()
+{
+	count = 0;
+}
+
+void FrustumCuller::Clear()
+{
+	count = 0;
+	centerX.clear();
+	centerY.clear();
+	centerZ.clear();
+	radius.clear();
+	extentX.clear();
+	extentY.clear();
+	extentZ.clear();
+}
+
+// --------------------------------------------------------
+// Moves an object's local bounds into world space. The
+// box stays axis aligned by growing to hold the rotated
+// one, and the sphere grows by the largest axis scale.
+// --------------------------------------------------------
+unsigned int FrustumCuller::Add(XMFLOAT3 boundsMin, XMFLOAT3 boundsMax, float sphereRadius, const XMFLOAT4X4& world)
+{
+	XMFLOAT3 center(
+		(boundsMin.x + boundsMax.x) * 0.5f,
+		(boundsMin.y + boundsMax.y) * 0.5f,
+		(boundsMin.z + boundsMax.z) * 0.5f);
+	XMFLOAT3 extent(
+		(boundsMax.x - boundsMin.x) * 0.5f,
+		(boundsMax.y - boundsMin.y) * 0.5f,
+		(boundsMax.z - boundsMin.z) * 0.5f);
+
+	XMFLOAT3 worldCenter;
+	XMStoreFloat3(&worldCenter, XMVector3Transform(XMLoadFloat3(&center), XMLoadFloat4x4(&world)));
+
+	// Each row of the matrix is where one local axis ends up
+	const float(*m)[4] = world.m;
+	float worldExtent[3];
+	for (int c = 0; c < 3; c++)
+	{
+		worldExtent[c] =
+			fabsf(m[0][c]) * extent.x +
+			fabsf(m[1][c]) * extent.y +
+			fabsf(m[2][c]) * extent.z;
+	}
+
+	float maxScaleSq = 0.0f;
+	for (int r = 0; r < 3; r++)
+	{
+		float scaleSq = m[r][0] * m[r][0] + m[r][1] * m[r][1] + m[r][2] * m[r][2];
+		if (scaleSq > maxScaleSq)
+			maxScaleSq = scaleSq;
+	}
+
+	// Fill the padding on the way in, so culling always reads whole groups of four
+	if (count % 4 == 0)
+	{
+		size_t padded = count + 4;
+		centerX.resize(padded, 0.0f);
+		centerY.resize(padded, 0.0f);
+		centerZ.resize(padded, 0.0f);
+		radius.resize(padded, 0.0f);
+		extentX.resize(padded, 0.0f);
+		extentY.resize(padded, 0.0f);
+		extentZ.resize(padded, 0.0f);
+	}
+
+	centerX[count] = worldCenter.x;
+	centerY[count] = worldCenter.y;
+	centerZ[count] = worldCenter.z;
+	radius[count] = sphereRadius * sqrtf(maxScaleSq);
+	extentX[count] = worldExtent[0];
+	extentY[count] = worldExtent[1];
+	extentZ[count] = worldExtent[2];
+	return (unsigned int)count++;
+}
+
+// --------------------------------------------------------
+// Tests four objects per iteration, one per SIMD lane. An
+// object is culled when it's entirely behind any plane:
+// when its center is further behind than its sphere's
+// radius, or than its box reaches towards the plane.
+// --------------------------------------------------------
+void FrustumCuller::Cull(const XMFLOAT4X4& view, const XMFLOAT4X4& projection, std::vector<unsigned int>& visible)
+{
+	visible.clear();
+
+	XMFLOAT4 planes[6];
+	ExtractPlanes(XMMatrixMultiply(XMLoadFloat4x4(&view), XMLoadFloat4x4(&projection)), planes);
+
+	// Each plane component splatted across a register, plus the
+	// absolute values of the normal for the box test
+	XMVECTOR px[6], py[6], pz[6], pw[6];
+	XMVECTOR ax[6], ay[6], az[6];
+	for (int p = 0; p < 6; p++)
+	{
+		px[p] = XMVectorReplicate(planes[p].x);
+		py[p] = XMVectorReplicate(planes[p].y);
+		pz[p] = XMVectorReplicate(planes[p].z);
+		pw[p] = XMVectorReplicate(planes[p].w);
+		ax[p] = XMVectorAbs(px[p]);
+		ay[p] = XMVectorAbs(py[p]);
+		az[p] = XMVectorAbs(pz[p]);
+	}
+
+	for (size_t i = 0; i < count; i += 4)
+	{
+		XMVECTOR cx = XMLoadFloat4((const XMFLOAT4*)&centerX[i]);
+		XMVECTOR cy = XMLoadFloat4((const XMFLOAT4*)&centerY[i]);
+		XMVECTOR cz = XMLoadFloat4((const XMFLOAT4*)&centerZ[i]);
+		XMVECTOR r = XMLoadFloat4((const XMFLOAT4*)&radius[i]);
+		XMVECTOR ex = XMLoadFloat4((const XMFLOAT4*)&extentX[i]);
+		XMVECTOR ey = XMLoadFloat4((const XMFLOAT4*)&extentY[i]);
+		XMVECTOR ez = XMLoadFloat4((const XMFLOAT4*)&extentZ[i]);
+
+		XMVECTOR outside = XMVectorFalseInt();
+		for (int p = 0; p < 6; p++)
+		{
+			// Signed distance from the plane to each center
+			XMVECTOR distance = XMVectorMultiplyAdd(px[p], cx, XMVectorMultiplyAdd(py[p], cy, XMVectorMultiplyAdd(pz[p], cz, pw[p])));
+
+			// How far each box reaches towards the plane
+			XMVECTOR boxReach = XMVectorMultiplyAdd(ax[p], ex, XMVectorMultiplyAdd(ay[p], ey, XMVectorMultiply(az[p], ez)));
+
+			XMVECTOR reach = XMVectorMin(r, boxReach);
+			outside = XMVectorOrInt(outside, XMVectorLess(distance, XMVectorNegate(reach)));
+		}
+
+		uint32_t lanes[4];
+		XMStoreInt4(lanes, outside);
+		for (size_t k = 0; k < 4 && i + k < count; k++)
+		{
+			if (lanes[k] == 0)
+				visible.push_back((unsigned int)(i + k));
+		}
+	}
+}
+
+size_t FrustumCuller::GetObjectCount() { return count; }
+
+// --------------------------------------------------------
+// Pulls the planes out of the combined matrix (Gribb and
+// Hartmann). With row vectors, clip = v * M, so each plane
+// is a sum of M's columns; D3D's clip z runs from 0 to w.
+// --------------------------------------------------------
+void FrustumCuller::ExtractPlanes(FXMMATRIX viewProjection, XMFLOAT4 planes[6])
+{
+	XMMATRIX columns = XMMatrixTranspose(viewProjection);
+
+	XMVECTOR clipPlanes[6] =
+	{
+		XMVectorAdd(columns.r[3], columns.r[0]),		// Left
+		XMVectorSubtract(columns.r[3], columns.r[0]),	// Right
+		XMVectorAdd(columns.r[3], columns.r[1]),		// Bottom
+		XMVectorSubtract(columns.r[3], columns.r[1]),	// Top
+		columns.r[2],									// Near
+		XMVectorSubtract(columns.r[3], columns.r[2])	// Far
+	};
+
+	for (int p = 0; p < 6; p++)
+		XMStoreFloat4(&planes[p], XMPlaneNormalize(clipPlanes[p]));
+}
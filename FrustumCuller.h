@@ -0,0 +1,50 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <vector>
+
+// --------------------------------------------------------
+// Rejects objects outside a view frustum on the CPU
+//
+// - Objects are added once per frame with their mesh's
+//   local bounds and their world matrix, and stored as
+//   world space bounds a component per array, so four
+//   objects fill one SIMD register
+// - Each object's bounding sphere and box share a center;
+//   against each plane, whichever reaches less far decides
+// - One set of bounds can be culled against any number of
+//   frusta (the camera, the shadow map's light, ...)
+// --------------------------------------------------------
+class FrustumCuller
+{
+public:
+	FrustumCuller();
+
+	// Forgets every object
+	void Clear();
+
+	// Adds an object, returning its index in the visible lists
+	unsigned int Add(DirectX::XMFLOAT3 boundsMin, DirectX::XMFLOAT3 boundsMax, float sphereRadius, const DirectX::XMFLOAT4X4& world);
+
+	// Fills visible with the indices of the objects inside the
+	// frustum of the given view and projection
+	void Cull(const DirectX::XMFLOAT4X4& view, const DirectX::XMFLOAT4X4& projection, std::vector<unsigned int>& visible);
+
+	size_t GetObjectCount();
+
+	// The six planes (left, right, bottom, top, near, far) of a
+	// view-projection matrix, normalized, facing inwards
+	static void ExtractPlanes(DirectX::FXMMATRIX viewProjection, DirectX::XMFLOAT4 planes[6]);
+
+private:
+	size_t count;
+
+	// World space bounds, padded to a multiple of four
+	std::vector<float> centerX;
+	std::vector<float> centerY;
+	std::vector<float> centerZ;
+	std::vector<float> radius;
+	std::vector<float> extentX;
+	std::vector<float> extentY;
+	std::vector<float> extentZ;
+};
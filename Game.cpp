@@ -3,6 +3,12 @@
 #include "Input.h"
 #include "WICTextureLoader.h"
 #include "DDSTextureLoader.h"
+#include "Benchmarks.h"
+#include "AssetLoader.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <chrono>
 
 // Needed for a helper function to read compiled shader files from the hard drive
 #pragma comment(lib, "d3dcompiler.lib")
@@ -26,7 +32,9 @@ Game::Game(HINSTANCE hInstance)
 		1280,			   // Width of the window's client area
 		720,			   // Height of the window's client area
 		true),			   // Show extra stats (fps) in title bar?
-	vsync(false)
+	vsync(false),
+	statsFrameCount(0),
+	statsStartTime(0.0f)
 {
 #if defined(DEBUG) || defined(_DEBUG)
 	// Do we want a console window?  Probably only in debug mode
@@ -36,6 +44,16 @@ Game::Game(HINSTANCE hInstance)
 
 	// camera creation
 	camera = std::make_shared<Camera>(0.0f, 0.0f, -20.0f, (float)width / height, XM_PIDIV4, 0.01f, 1000.0f);
+	renderQueue = std::make_shared<RenderQueue>();
+	sceneBVH = std::make_shared<BVH>();
+
+	// The passes that make up a frame, in the order they run
+	framePasses = {
+		{ "Shadow", &Game::RenderShadowMap },
+		{ "Opaque", &Game::RenderOpaque },
+		{ "Sky", &Game::RenderSky },
+		{ "Post", &Game::RenderPost }
+	};
 }
 
 // --------------------------------------------------------
@@ -61,6 +79,15 @@ void Game::Init()
 	// Helper methods for loading shaders, creating some basic
 	// geometry to draw and some simple camera matrices.
 	//  - You'll be expanding and/or replacing these later
+	// Shaders get the frequency-based constant buffers (ConstantBuffers.hlsli)
+	// from the application, so they mustn't bind their own copies
+	ISimpleShader::ExternalBufferSlots =
+		(1 << PerFrameSlot) | (1 << PerPassSlot) | (1 << PerMaterialSlot) | (1 << PerObjectSlot);
+	perFrameBuffer = std::make_shared<ConstantBuffer<PerFrameData>>(device, context, PerFrameSlot);
+	perPassBuffer = std::make_shared<ConstantBuffer<PerPassData>>(device, context, PerPassSlot);
+	perMaterialBuffer = std::make_shared<ConstantBuffer<PerMaterialData>>(device, context, PerMaterialSlot);
+	perObjectBuffer = std::make_shared<ConstantBuffer<PerObjectData>>(device, context, PerObjectSlot);
+
 	LoadShaders();
 	CreateBasicGeometry();
 	
@@ -113,6 +140,24 @@ void Game::Init()
 
 	// Set up resources for shadow map
 	MakeShadowMapResources();
+
+#if defined(RUN_BENCHMARKS)
+	// Time the CPU-side code paths and print the results to the console
+	Benchmarks::ObjLoading(GetFullPathTo("../../Assets/Models/"));
+	Benchmarks::Tangents(GetFullPathTo("../../Assets/Models/"));
+	Benchmarks::MeshLoading(GetFullPathTo("../../Assets/Models/"), device);
+	Benchmarks::Transforms();
+	Benchmarks::TransformHierarchy();
+	Benchmarks::InverseTranspose();
+	Benchmarks::RenderQueueSort();
+	Benchmarks::FrustumCulling();
+	Benchmarks::BVHQueries();
+	Benchmarks::ProfilerOverhead();
+	Benchmarks::TextureCooking();
+	Benchmarks::TextureLoading(GetFullPathTo_Wide(L"../../Assets/Textures/PBR/"), device, context);
+	Benchmarks::PackedTextures(GetFullPathTo_Wide(L"../../Assets/Textures/PBR/"));
+	Benchmarks::ShaderVariables(GetFullPathTo_Wide(L"VertexShader.cso"), device, context);
+#endif
 }
 
 // --------------------------------------------------------
@@ -127,9 +172,13 @@ void Game::LoadShaders()
 {
 	// Load simple shaders
 	vertexShader = std::make_shared<SimpleVertexShader>(device, context, GetFullPathTo_Wide(L"VertexShader.cso").c_str());
+	vertexShaderInstanced = std::make_shared<SimpleVertexShader>(device, context, GetFullPathTo_Wide(L"VertexShaderInstanced.cso").c_str());
 	pixelShader = std::make_shared<SimplePixelShader>(device, context, GetFullPathTo_Wide(L"PixelShader.cso").c_str());
+	pixelShaderORM = std::make_shared<SimplePixelShader>(device, context, GetFullPathTo_Wide(L"PixelShaderORM.cso").c_str());
+	pixelShaderArray = std::make_shared<SimplePixelShader>(device, context, GetFullPathTo_Wide(L"PixelShaderArray.cso").c_str());
 	myShader = std::make_shared<SimplePixelShader>(device, context, GetFullPathTo_Wide(L"CustomPS.cso").c_str());
 	shadowVertexShader = std::make_shared<SimpleVertexShader>(device, context, GetFullPathTo_Wide(L"ShadowVertexShader.cso").c_str());
+	shadowVertexShaderInstanced = std::make_shared<SimpleVertexShader>(device, context, GetFullPathTo_Wide(L"ShadowVertexShaderInstanced.cso").c_str());
 	skyVertexShader = std::make_shared<SimpleVertexShader>(device, context, GetFullPathTo_Wide(L"SkyVertexShader.cso").c_str());
 	skyPixelShader = std::make_shared<SimplePixelShader>(device, context, GetFullPathTo_Wide(L"SkyPixelShader.cso").c_str());
 }
@@ -239,55 +288,43 @@ void Game::CreateBasicGeometry()
 	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/rock_normals.png").c_str(), nullptr, normal3.GetAddressOf());
 	*/
 
-	// Load in PBR textures
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/ground_albedo.png").c_str(), nullptr, albedo1.GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/ground_normals.png").c_str(), nullptr, normals1.GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/ground_roughness.png").c_str(), nullptr, roughness1.GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/ground_metal.png").c_str(), nullptr, metalness1.GetAddressOf());
-
-	//CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/rock_albedo.png").c_str(), nullptr, albedo2.GetAddressOf());
-	//CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/rock_normals.png").c_str(), nullptr, normals2.GetAddressOf());
-	//CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/rock_roughness.png").c_str(), nullptr, roughness2.GetAddressOf());
-	//CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/rock_metal.png").c_str(), nullptr, metalness2.GetAddressOf());
-
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/bronze_albedo.png").c_str(), nullptr, albedo2.GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/bronze_normals.png").c_str(), nullptr, normals2.GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/bronze_roughness.png").c_str(), nullptr, roughness2.GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/bronze_metal.png").c_str(), nullptr, metalness2.GetAddressOf());
-
-	//CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/cobblestone_albedo.png").c_str(), nullptr, albedo2.GetAddressOf());
-	//CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/cobblestone_normals.png").c_str(), nullptr, normals2.GetAddressOf());
-	//CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/cobblestone_roughness.png").c_str(), nullptr, roughness2.GetAddressOf());
-	//CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/cobblestone_metal.png").c_str(), nullptr, metalness2.GetAddressOf());
+	// Load in meshes
+	// - Files are read on worker threads, while this thread
+	//   creates the GPU resources as each one finishes
+	meshRegistry = std::make_shared<MeshRegistry>(device);
+	AssetLoader loader(device, context, meshRegistry);
 
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/floor_albedo.png").c_str(), nullptr, albedo3.GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/floor_normals.png").c_str(), nullptr, normals3.GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/floor_roughness.png").c_str(), nullptr, roughness3.GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/floor_metal.png").c_str(), nullptr, metalness3.GetAddressOf());
-
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/paint_albedo.png").c_str(), nullptr, albedo4.GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/paint_normals.png").c_str(), nullptr, normals4.GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/paint_roughness.png").c_str(), nullptr, roughness4.GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/paint_metal.png").c_str(), nullptr, metalness4.GetAddressOf());
+	// Creates meshes from 3D object
+	// - The registry keeps one copy of each file, so all five spheres share one set of buffers
+	std::shared_ptr<Mesh> cube;
+	std::shared_ptr<Mesh> sphere;
+	loader.QueueMesh(GetFullPathTo("../../Assets/Models/cube.obj"), cube);
+	loader.QueueMesh(GetFullPathTo("../../Assets/Models/sphere.obj"), sphere);
 
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/rough_albedo.png").c_str(), nullptr, albedo5.GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/rough_normals.png").c_str(), nullptr, normals5.GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/rough_roughness.png").c_str(), nullptr, roughness5.GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/rough_metal.png").c_str(), nullptr, metalness5.GetAddressOf());
+	// Wait for everything queued above
+	loader.Finish();
 
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/scratched_albedo.png").c_str(), nullptr, albedo6.GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/scratched_normals.png").c_str(), nullptr, normals6.GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/scratched_roughness.png").c_str(), nullptr, roughness6.GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/PBR/scratched_metal.png").c_str(), nullptr, metalness6.GetAddressOf());
+	meshes.push_back(cube);
+	for (int i = 0; i < 5; i++)
+	{
+		meshes.push_back(sphere);
+	}
 
+#if defined(DEBUG) || defined(_DEBUG)
+	meshRegistry->ReportMemory();
+#endif
 
 	// Create materials
-	materials.push_back(std::make_shared<Material>(XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f), vertexShader, pixelShader, 0.15f, 1.0f, XMFLOAT2(0.0f, 0.0f)));
-	materials.push_back(std::make_shared<Material>(XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f), vertexShader, pixelShader, 0.15f, 1.0f, XMFLOAT2(0.0f, 0.0f)));
-	materials.push_back(std::make_shared<Material>(XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f), vertexShader, pixelShader, 0.15f, 1.0f, XMFLOAT2(0.0f, 0.0f)));
-	materials.push_back(std::make_shared<Material>(XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f), vertexShader, pixelShader, 0.15f, 1.0f, XMFLOAT2(0.0f, 0.0f)));
-	materials.push_back(std::make_shared<Material>(XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f), vertexShader, pixelShader, 0.15f, 1.0f, XMFLOAT2(0.0f, 0.0f)));
-	materials.push_back(std::make_shared<Material>(XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f), vertexShader, pixelShader, 0.15f, 1.0f, XMFLOAT2(0.0f, 0.0f)));
+	materials.push_back(std::make_shared<Material>(XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f), vertexShader, pixelShaderORM, 0.15f, 1.0f, XMFLOAT2(0.0f, 0.0f)));
+	materials.push_back(std::make_shared<Material>(XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f), vertexShader, pixelShaderORM, 0.15f, 1.0f, XMFLOAT2(0.0f, 0.0f)));
+	materials.push_back(std::make_shared<Material>(XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f), vertexShader, pixelShaderORM, 0.15f, 1.0f, XMFLOAT2(0.0f, 0.0f)));
+	materials.push_back(std::make_shared<Material>(XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f), vertexShader, pixelShaderORM, 0.15f, 1.0f, XMFLOAT2(0.0f, 0.0f)));
+	materials.push_back(std::make_shared<Material>(XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f), vertexShader, pixelShaderORM, 0.15f, 1.0f, XMFLOAT2(0.0f, 0.0f)));
+	materials.push_back(std::make_shared<Material>(XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f), vertexShader, pixelShaderORM, 0.15f, 1.0f, XMFLOAT2(0.0f, 0.0f)));
+
+	// Any of them can be drawn instanced
+	for (auto& material : materials)
+		material->SetInstancedVertexShader(vertexShaderInstanced);
 
 #pragma region Add textures
 		/*
@@ -313,57 +350,8 @@ void Game::CreateBasicGeometry()
 		*/
 #pragma endregion
 
-	// PBR Textures
-	materials[0]->AddTextureSRV("AlbedoTexture", albedo1);
-	materials[0]->AddTextureSRV("NormalMap", normals1);
-	materials[0]->AddTextureSRV("RoughnessMap", roughness1);
-	materials[0]->AddTextureSRV("MetalnessMap", metalness1);
-	materials[0]->AddSampler("BasicSampler", samplerState);
-
-	materials[1]->AddTextureSRV("AlbedoTexture", albedo2);
-	materials[1]->AddTextureSRV("NormalMap", normals2);
-	materials[1]->AddTextureSRV("RoughnessMap", roughness2);
-	materials[1]->AddTextureSRV("MetalnessMap", metalness2);
-	materials[1]->AddSampler("BasicSampler", samplerState);
-
-	materials[2]->AddTextureSRV("AlbedoTexture", albedo3);
-	materials[2]->AddTextureSRV("NormalMap", normals3);
-	materials[2]->AddTextureSRV("RoughnessMap", roughness3);
-	materials[2]->AddTextureSRV("MetalnessMap", metalness3);
-	materials[2]->AddSampler("BasicSampler", samplerState);
-
-	materials[3]->AddTextureSRV("AlbedoTexture", albedo4);
-	materials[3]->AddTextureSRV("NormalMap", normals4);
-	materials[3]->AddTextureSRV("RoughnessMap", roughness4);
-	materials[3]->AddTextureSRV("MetalnessMap", metalness4);
-	materials[3]->AddSampler("BasicSampler", samplerState);
-
-	materials[4]->AddTextureSRV("AlbedoTexture", albedo5);
-	materials[4]->AddTextureSRV("NormalMap", normals5);
-	materials[4]->AddTextureSRV("RoughnessMap", roughness5);
-	materials[4]->AddTextureSRV("MetalnessMap", metalness5);
-	materials[4]->AddSampler("BasicSampler", samplerState);
-
-	materials[5]->AddTextureSRV("AlbedoTexture", albedo6);
-	materials[5]->AddTextureSRV("NormalMap", normals6);
-	materials[5]->AddTextureSRV("RoughnessMap", roughness6);
-	materials[5]->AddTextureSRV("MetalnessMap", metalness6);
-	materials[5]->AddSampler("BasicSampler", samplerState);
-
-	// Creates meshes from 3D object
-	std::shared_ptr<Mesh> cube = std::make_shared<Mesh>(GetFullPathTo("../../Assets/Models/cube.obj").c_str(), device);
-	meshes.push_back(cube);
-	std::shared_ptr<Mesh> sphere = std::make_shared<Mesh>(GetFullPathTo("../../Assets/Models/sphere.obj").c_str(), device);
-	meshes.push_back(sphere);
-	std::shared_ptr<Mesh> sphere2 = std::make_shared<Mesh>(GetFullPathTo("../../Assets/Models/sphere.obj").c_str(), device);
-	meshes.push_back(sphere2);
-	std::shared_ptr<Mesh> sphere3 = std::make_shared<Mesh>(GetFullPathTo("../../Assets/Models/sphere.obj").c_str(), device);
-	meshes.push_back(sphere3);
-	std::shared_ptr<Mesh> sphere4 = std::make_shared<Mesh>(GetFullPathTo("../../Assets/Models/sphere.obj").c_str(), device);
-	meshes.push_back(sphere4);
-	std::shared_ptr<Mesh> sphere5 = std::make_shared<Mesh>(GetFullPathTo("../../Assets/Models/sphere.obj").c_str(), device);
-	meshes.push_back(sphere5);
-	
+	for (auto& material : materials)
+		material->AddSampler("BasicSampler", samplerState);
 
 
 #pragma region Create old game entities
@@ -374,12 +362,129 @@ void Game::CreateBasicGeometry()
 	// gameEntities.push_back(std::make_shared<GameEntity>(meshes[2], materials[2]));
 #pragma endregion
 
-	gameEntities.push_back(std::make_shared<GameEntity>(meshes[0], materials[0]));
-	gameEntities.push_back(std::make_shared<GameEntity>(meshes[1], materials[1]));
-	gameEntities.push_back(std::make_shared<GameEntity>(meshes[2], materials[3]));
-	gameEntities.push_back(std::make_shared<GameEntity>(meshes[3], materials[5]));
-	gameEntities.push_back(std::make_shared<GameEntity>(meshes[4], materials[3]));
-	gameEntities.push_back(std::make_shared<GameEntity>(meshes[5], materials[5]));
+	transformSystem = std::make_shared<TransformSystem>();
+	gameEntities.push_back(std::make_shared<GameEntity>(meshes[0], materials[0], transformSystem));
+	gameEntities.push_back(std::make_shared<GameEntity>(meshes[1], materials[1], transformSystem));
+	gameEntities.push_back(std::make_shared<GameEntity>(meshes[2], materials[3], transformSystem));
+	gameEntities.push_back(std::make_shared<GameEntity>(meshes[3], materials[5], transformSystem));
+	gameEntities.push_back(std::make_shared<GameEntity>(meshes[4], materials[3], transformSystem));
+	gameEntities.push_back(std::make_shared<GameEntity>(meshes[5], materials[5], transformSystem));
+
+	// Lay out the scenery, which never moves, and bake it
+	gameEntities[0]->GetTransform()->SetPosition(0.0f, -17.0f, 0.0f);
+	gameEntities[0]->GetTransform()->SetScale(15.0f, 15.0f, 15.0f);
+	gameEntities[1]->GetTransform()->SetPosition(0.0f, 0.0f, 0.0f);
+	gameEntities[2]->GetTransform()->SetPosition(2.0f, 0.0f, 5.0f);
+	gameEntities[3]->GetTransform()->SetPosition(4.0f, 0.0f, 0.0f);
+	gameEntities[4]->GetTransform()->SetPosition(6.0f, 0.0f, 5.0f);
+	gameEntities[5]->GetTransform()->SetPosition(8.0f, 0.0f, 0.0f);
+	for (auto& entity : gameEntities)
+		entity->MakeStatic(device);
+
+#if defined(SPHERE_FIELD)
+	// A field of small spheres above the floor, to stress the instanced
+	// path. They share one mesh and two materials, so each pass draws
+	// them with a couple of calls.
+	for (int z = 0; z < 50; z++)
+	{
+		for (int x = 0; x < 50; x++)
+		{
+			std::shared_ptr<GameEntity> entity = std::make_shared<GameEntity>(sphere, materials[(x + z) % 2 == 0 ? 2 : 4], transformSystem);
+			entity->GetTransform()->SetPosition(x * 0.5f - 12.25f, -1.5f, z * 0.5f - 12.25f);
+			entity->GetTransform()->SetScale(0.2f, 0.2f, 0.2f);
+			gameEntities.push_back(entity);
+		}
+	}
+#endif
+
+	// Load the PBR textures of every material something is drawn with, in parallel
+	// - Each material's roughness and metalness maps (and AO, if there is
+	//   one) are packed into a single ORM texture
+	// - The cache hands out one copy of each texture however many materials use it
+	// - Only the small levels load now; the streamer brings in the rest
+	//   as they're needed, within the budget
+	const std::string materialNames[] = { "ground", "bronze", "floor", "paint", "rough", "scratched" };
+	const size_t textureBudget = 64 * 1024 * 1024;
+	textureCache = std::make_shared<TextureCache>(device, context);
+	textureCache->SetBudget(textureBudget);
+	textureStreamer = std::make_shared<TextureStreamer>(device, textureBudget);
+	{
+		AssetLoader textureLoader(device, context, meshRegistry);
+		TextureParams streamed;
+#if !defined(MATERIAL_ARRAYS)
+		streamed.Streamed = true;		// Arrays are copied from every level, so need them all
+#endif
+		TextureParams packedORM = streamed;
+		packedORM.PackedORM = true;
+
+		for (size_t i = 0; i < materials.size(); i++)
+		{
+			bool used = false;
+			for (auto& entity : gameEntities)
+				used = used || entity->GetMaterial() == materials[i];
+			if (!used)
+				continue;
+
+			std::wstring prefix = GetFullPathTo_Wide(L"../../Assets/Textures/PBR/") + std::wstring(materialNames[i].begin(), materialNames[i].end());
+			std::string consumer = materialNames[i] + " material";
+			materials[i]->AddTexture("AlbedoTexture", textureCache->Queue(textureLoader, prefix + L"_albedo.png", streamed, consumer));
+			materials[i]->AddTexture("NormalMap", textureCache->Queue(textureLoader, prefix + L"_normals.png", streamed, consumer));
+			materials[i]->AddTexture("ORMMap", textureCache->Queue(textureLoader, prefix + L"_roughness.png", packedORM, consumer));
+		}
+		textureLoader.Finish();
+
+#if defined(MATERIAL_ARRAYS)
+		// Every material whose maps match shares one set of texture arrays,
+		// so entities using any of them can be drawn with one instanced draw.
+		// The rest (like ground, whose maps are a different size) keep their own.
+		materialArray = std::make_shared<MaterialArray>(device, context);
+		std::vector<std::pair<std::shared_ptr<Material>, int>> arrayMaterials;
+		for (auto& material : materials)
+		{
+			const auto& maps = material->GetTextures();
+			if (maps.size() != MaterialArray::MapCount)
+				continue;
+
+			int index = materialArray->Add(material, maps.at("AlbedoTexture"), maps.at("NormalMap"), maps.at("ORMMap"));
+			if (index >= 0)
+				arrayMaterials.push_back({ material, index });
+		}
+
+		if (materialArray->Build())
+		{
+			for (auto& entry : arrayMaterials)
+			{
+				entry.first->SetMaterialArray(materialArray, entry.second);
+				entry.first->SetPixelShader(pixelShaderArray);
+			}
+
+			// The arrays have their own copies of the maps
+			textureCache->UnloadUnused();
+#if defined(DEBUG) || defined(_DEBUG)
+			printf("Material array: %zu materials, %u/%u/%u albedo/normal/ORM slices, %.2f MB\n",
+				materialArray->GetMaterialCount(), materialArray->GetSliceCount(0), materialArray->GetSliceCount(1),
+				materialArray->GetSliceCount(2), materialArray->GetBytes() / (1024.0 * 1024.0));
+#endif
+		}
+#endif
+
+		// Shared textures are only added once
+		std::vector<CachedTexture*> added;
+		for (auto& material : materials)
+		{
+			for (auto& texture : material->GetTextures())
+			{
+				if (std::find(added.begin(), added.end(), texture.second.get()) != added.end())
+					continue;
+				added.push_back(texture.second.get());
+				textureStreamer->Add(texture.second);
+			}
+		}
+	}
+
+#if defined(DEBUG) || defined(_DEBUG)
+	textureCache->ReportResidency();
+#endif
 
 	// Creates the skybox texture
 	CreateDDSTextureFromFile(device.Get(), context.Get(), GetFullPathTo_Wide(L"../../Assets/Textures/SunnyCubeMap.dds").c_str(), nullptr, skyboxTexture.GetAddressOf());
@@ -457,6 +562,91 @@ void Game::MakeShadowMapResources()
 
 }
 
+// --------------------------------------------------------
+// Finds the entities the camera and the shadow map's light
+// can see, by walking the scene's BVH with each frustum
+// --------------------------------------------------------
+void Game::CullScene()
+{
+	ProfileScope profile("Cull");
+	auto start = std::chrono::high_resolution_clock::now();
+	unsigned int nodesBefore = sceneBVH->GetStats().NodesVisited;
+
+	// New entities mean a new tree. Otherwise only dynamic entities
+	// can have moved, and the tree only refits the ones that did.
+	bool rebuild = sceneBVH->GetObjectCount() != gameEntities.size();
+	if (rebuild)
+		sceneBVH->Clear();
+	for (size_t i = 0; i < gameEntities.size(); i++)
+	{
+		if (!rebuild && gameEntities[i]->IsStatic())
+			continue;
+
+		std::shared_ptr<Mesh> mesh = gameEntities[i]->GetMesh();
+		XMFLOAT3 boundsMin;
+		XMFLOAT3 boundsMax;
+		BVH::TransformBounds(mesh->GetBoundsMin(), mesh->GetBoundsMax(), gameEntities[i]->GetTransform()->GetWorldMatrix(), boundsMin, boundsMax);
+		if (rebuild)
+			sceneBVH->Add(boundsMin, boundsMax);
+		else
+			sceneBVH->SetBounds((unsigned int)i, boundsMin, boundsMax);
+	}
+	sceneBVH->Update();
+
+	XMFLOAT4X4 view = camera->GetViewMatrix();
+	XMFLOAT4X4 projection = camera->GetProjectionMatrix();
+	XMFLOAT4 planes[6];
+	FrustumCuller::ExtractPlanes(XMMatrixMultiply(XMLoadFloat4x4(&view), XMLoadFloat4x4(&projection)), planes);
+	sceneBVH->QueryFrustum(planes, mainVisible);
+	FrustumCuller::ExtractPlanes(XMMatrixMultiply(XMLoadFloat4x4(&shadowViewMatrix), XMLoadFloat4x4(&shadowProjMatrix)), planes);
+	sceneBVH->QueryFrustum(planes, shadowVisible);
+
+	auto end = std::chrono::high_resolution_clock::now();
+	cullStats.Objects = (unsigned int)gameEntities.size();
+	cullStats.MainVisible = (unsigned int)mainVisible.size();
+	cullStats.ShadowVisible = (unsigned int)shadowVisible.size();
+	cullStats.NodesVisited = sceneBVH->GetStats().NodesVisited - nodesBefore;
+	cullStats.CpuMs = std::chrono::duration<float, std::milli>(end - start).count();
+
+	cullTotals.Objects += cullStats.Objects;
+	cullTotals.MainVisible += cullStats.MainVisible;
+	cullTotals.ShadowVisible += cullStats.ShadowVisible;
+	cullTotals.NodesVisited += cullStats.NodesVisited;
+	cullTotals.CpuMs += cullStats.CpuMs;
+}
+
+const Game::CullStats& Game::GetCullStats() { return cullStats; }
+
+unsigned int Game::CookTextures(MipFilter filter)
+{
+	return TextureCooker::CookFolder(GetFullPathTo_Wide(L"../../Assets/Textures/PBR/"), filter, true);
+}
+
+// --------------------------------------------------------
+// Gets an entity's matrices to the PerObject slot. Static
+// entities bind their baked buffer and upload nothing;
+// dynamic ones upload into the shared per-object buffer.
+// --------------------------------------------------------
+void Game::BindPerObjectData(GameEntity* entity)
+{
+	if (entity->IsStatic())
+	{
+		context->VSSetConstantBuffers(PerObjectSlot, 1, entity->GetBakedTransformBuffer().GetAddressOf());
+		renderQueue->GetStats().BufferBinds++;
+		return;
+	}
+
+	PerObjectData data;
+	data.world = entity->GetTransform()->GetWorldMatrix();
+	data.worldInvTranspose = entity->GetTransform()->GetWorldInverseTransposeMatrix();
+	perObjectBuffer->Update(data);
+	context->VSSetConstantBuffers(PerObjectSlot, 1, perObjectBuffer->GetBuffer().GetAddressOf());
+	renderQueue->GetStats().BufferBinds++;
+}
+
+// --------------------------------------------------------
+// Renders every entity's depth from the light's point of view
+// --------------------------------------------------------
 void Game::RenderShadowMap()
 {
 	// Set pipeline up for shadow map
@@ -474,24 +664,21 @@ void Game::RenderShadowMap()
 	viewport.MaxDepth = 1.0f;
 	context->RSSetViewports(1, &viewport);
 
-	// Turn on shadow vertex shader
-	std::shared_ptr<SimpleVertexShader> shadowVS = shadowVertexShader;
-	shadowVS->SetShader();
-	shadowVS->SetMatrix4x4("view", shadowViewMatrix);
-	shadowVS->SetMatrix4x4("projection", shadowProjMatrix);
-	context->PSSetShader(0, 0, 0); 
-
-	// draw
-	for (int i = 0; i < gameEntities.size(); i++)
+	// This pass sees the scene from the light
+	PerPassData pass;
+	pass.view = shadowViewMatrix;
+	pass.projection = shadowProjMatrix;
+	pass.lightView = shadowViewMatrix;
+	pass.lightProj = shadowProjMatrix;
+	perPassBuffer->Update(pass);
+
+	// Draw with just the shadow vertex shader (or its instanced
+	// variant), which the queue binds
+	renderQueue->Execute(context, RenderPass::Shadow, [&](GameEntity* entity, unsigned int changes)
 	{
-		shadowVS->SetMatrix4x4("world", gameEntities[i]->GetTransform()->GetWorldMatrix());
-		shadowVS->CopyAllBufferData();
-
-		context->DrawIndexed(
-			gameEntities[i]->GetMesh()->GetIndexCount(),
-			0,
-			0);
-	}
+		if (!(changes & RenderQueue::Instanced))
+			BindPerObjectData(entity);
+	}, shadowVertexShader, shadowVertexShaderInstanced);
 
 	// Return to the screen after rendering shadow map
 	context->OMSetRenderTargets(1, backBufferRTV.GetAddressOf(), depthStencilView.Get());
@@ -520,10 +707,23 @@ void Game::OnResize()
 // --------------------------------------------------------
 void Game::Update(float deltaTime, float totalTime)
 {
+	ProfileScope profile("Update");
+
 	// Example input checking: Quit if the escape key is pressed
 	if (Input::GetInstance().KeyDown(VK_ESCAPE))
 		Quit();
 
+	// F9 writes the next 120 frames out as a trace
+	if (Input::GetInstance().KeyPress(VK_F9))
+		Profiler::GetInstance().BeginCapture(120, GetFullPathTo("Trace.json"));
+
+	// F10 prints which levels of each texture are in memory
+	if (Input::GetInstance().KeyPress(VK_F10))
+	{
+		textureStreamer->Report();
+		textureCache->ReportResidency();
+	}
+
 #pragma region Transform old meshes
 	/*
 	float scale = cos(totalTime) * 0.5f + 0.5f;
@@ -543,15 +743,152 @@ void Game::Update(float deltaTime, float totalTime)
 	*/
 #pragma endregion
 
-	gameEntities[0]->GetTransform()->SetPosition(0.0f, -17.0f, 0.0f);
-	gameEntities[0]->GetTransform()->SetScale(15.0f, 15.0f, 15.0f);
-	gameEntities[1]->GetTransform()->SetPosition(0.0f, 0.0f, 0.0f);
-	gameEntities[2]->GetTransform()->SetPosition(2.0f, 0.0f, 5.0f);
-	gameEntities[3]->GetTransform()->SetPosition(4.0f, 0.0f, 0.0f);
-	gameEntities[4]->GetTransform()->SetPosition(6.0f, 0.0f, 5.0f);
-	gameEntities[5]->GetTransform()->SetPosition(8.0f, 0.0f, 0.0f);
+	// Rebuild the matrices of everything that moved this frame in one pass
+	transformSystem->UpdateMatrices();
 
 	camera->Update(deltaTime);
+
+	// Stream texture levels in or out for where the camera is now
+	textureStreamer->Update(camera.get(), gameEntities, (float)height);
+
+	ReportFrameStats(totalTime);
+}
+
+// --------------------------------------------------------
+// Prints how much per-object work the last second's frames
+// did on average (debug builds only)
+// --------------------------------------------------------
+void Game::ReportFrameStats(float totalTime)
+{
+#if defined(DEBUG) || defined(_DEBUG)
+	statsFrameCount++;
+	if (totalTime - statsStartTime < 1.0f)
+		return;
+
+	RenderStats& binds = renderQueue->GetStats();
+	printf("Per frame: %.1f matrices rebuilt, %.1f KB of constant data uploaded (%.1f KB changed, %.1f unchanged buffers skipped)\n",
+		(double)transformSystem->GetRebuiltMatrixCount() / statsFrameCount,
+		(double)ISimpleShader::UploadedBytes / statsFrameCount / 1024.0,
+		(double)ISimpleShader::ChangedBytes / statsFrameCount / 1024.0,
+		(double)ISimpleShader::SkippedUploads / statsFrameCount);
+	printf("           %.1f draws (%.1f instances), binds: %.1f shader, %.1f SRV, %.1f sampler, %.1f buffer (%.1f skipped)\n",
+		(double)binds.DrawCalls / statsFrameCount,
+		(double)binds.Instances / statsFrameCount,
+		(double)binds.ShaderBinds / statsFrameCount,
+		(double)binds.SRVBinds / statsFrameCount,
+		(double)binds.SamplerBinds / statsFrameCount,
+		(double)binds.BufferBinds / statsFrameCount,
+		(double)binds.SkippedBinds / statsFrameCount);
+	printf("           culling %6.3f ms, %.1f BVH nodes visited, %.1f objects: %.1f visible (%.1f culled), %.1f casting shadows (%.1f culled)\n",
+		(double)cullTotals.CpuMs / statsFrameCount,
+		(double)cullTotals.NodesVisited / statsFrameCount,
+		(double)cullTotals.Objects / statsFrameCount,
+		(double)cullTotals.MainVisible / statsFrameCount,
+		(double)(cullTotals.Objects - cullTotals.MainVisible) / statsFrameCount,
+		(double)cullTotals.ShadowVisible / statsFrameCount,
+		(double)(cullTotals.Objects - cullTotals.ShadowVisible) / statsFrameCount);
+	cullTotals = CullStats();
+	printf("           textures %.2f MB streamed in, %u loads, %u evictions\n",
+		textureStreamer->GetResidentBytes() / (1024.0 * 1024.0),
+		textureStreamer->GetLoadCount(),
+		textureStreamer->GetEvictionCount());
+	textureStreamer->ResetStats();
+	for (FramePass& pass : framePasses)
+	{
+		printf("           %-7s pass %6.3f ms, %.1f draws\n",
+			pass.Name, pass.TotalMs / statsFrameCount, (double)pass.TotalDraws / statsFrameCount);
+		pass.TotalMs = 0.0;
+		pass.TotalDraws = 0;
+	}
+
+	// Every profiled scope, nested under the one it ran in
+	std::vector<ProfileScopeStats> scopes;
+	Profiler::GetInstance().GetStats(scopes);
+	printf("           %-24s %6s %8s %8s %8s %8s\n", "scope (ms)", "calls", "min", "avg", "p99", "max");
+	for (ProfileScopeStats& scope : scopes)
+	{
+		printf("           %*s%-*s %6u %8.3f %8.3f %8.3f %8.3f\n",
+			scope.Depth * 2, "", 24 - scope.Depth * 2, scope.Name,
+			scope.Calls, scope.MinMs, scope.AvgMs, scope.P99Ms, scope.MaxMs);
+	}
+	Profiler::GetInstance().ResetStats();
+
+	transformSystem->ResetStats();
+	renderQueue->ResetStats();
+	ISimpleShader::UploadedBytes = 0;
+	ISimpleShader::ChangedBytes = 0;
+	ISimpleShader::SkippedUploads = 0;
+	statsFrameCount = 0;
+	statsStartTime = totalTime;
+#endif
+}
+
+// --------------------------------------------------------
+// Draws every entity with its own material, only uploading
+// material data when the material changes
+// --------------------------------------------------------
+void Game::RenderOpaque()
+{
+	// This pass sees the scene from the camera, sampling the shadow map
+	PerPassData pass;
+	pass.view = camera->GetViewMatrix();
+	pass.projection = camera->GetProjectionMatrix();
+	pass.lightView = shadowViewMatrix;
+	pass.lightProj = shadowProjMatrix;
+	perPassBuffer->Update(pass);
+
+	renderQueue->Execute(context, RenderPass::Opaque, [&](GameEntity* entity, unsigned int changes)
+	{
+		std::shared_ptr<Material> material = entity->GetMaterial();
+
+		// The shadow map, which each pixel shader needs bound once
+		if (changes & RenderQueue::ShaderChanged)
+		{
+			std::shared_ptr<SimplePixelShader> ps = material->GetPixelShader();
+			ps->SetShaderResourceView("ShadowMap", shadowSRV);
+			ps->SetSamplerState("ShadowSampler", shadowSampler);
+			renderQueue->GetStats().SRVBinds++;
+			renderQueue->GetStats().SamplerBinds++;
+		}
+
+		if (changes & RenderQueue::MaterialChanged)
+		{
+			PerMaterialData data = {};
+			data.colorTint = material->GetColorTint();
+			data.roughness = material->GetRoughness();
+			data.uvScale = material->GetUvScale();
+			data.uvOffset = material->GetUvOffset();
+			data.materialIndex = material->GetArrayIndex();
+			perMaterialBuffer->Update(data);
+		}
+
+		// Instanced draws already have their matrices in the instance buffer
+		if (!(changes & RenderQueue::Instanced))
+			BindPerObjectData(entity);
+	});
+}
+
+// --------------------------------------------------------
+// Draws the sky, once, after everything that can cover it.
+// It sits at the far plane with depth writes off, so the
+// hardware rejects every covered pixel before shading it.
+// --------------------------------------------------------
+void Game::RenderSky()
+{
+	skybox->Draw(context);
+	renderQueue->GetStats().ShaderBinds += 2;
+	renderQueue->GetStats().DrawCalls++;
+}
+
+// --------------------------------------------------------
+// Where post processing goes. For now it just unbinds the
+// pixel shader's textures, so the shadow map isn't still
+// bound as one when the next frame renders into it.
+// --------------------------------------------------------
+void Game::RenderPost()
+{
+	ID3D11ShaderResourceView* noSRVs[16] = {};
+	context->PSSetShaderResources(0, 16, noSRVs);
 }
 
 // --------------------------------------------------------
@@ -588,64 +925,65 @@ void Game::Draw(float deltaTime, float totalTime)
 	// - However, this isn't always the case (but might be for this course)
 	// context->IASetInputLayout(inputLayout.Get());
 
-	// Render shadow map first
-	RenderShadowMap();
-
-	// draw all meshes in gameEntities
-	for (int i = 0; i < gameEntities.size(); i++)
+	// Queue up what the light and the camera can each see for the
+	// shadow and opaque passes, sorted so draws that share shaders,
+	// materials and meshes are back to back
+	CullScene();
+	XMFLOAT3 cameraPos = camera->GetTransform()->GetPosition();
+	renderQueue->Clear();
+	for (unsigned int i : shadowVisible)
+		renderQueue->Submit(RenderPass::Shadow, gameEntities[i].get(), 0.0f);
+	for (unsigned int i : mainVisible)
 	{
-		// Set the current shaders
-		gameEntities[i]->GetMaterial()->GetVertexShader()->SetShader();
-		gameEntities[i]->GetMaterial()->GetPixelShader()->SetShader();
-
-		// Define Vertex data
-		std::shared_ptr<SimpleVertexShader> vs = gameEntities[i]->GetMaterial()->GetVertexShader();
-		vs->SetMatrix4x4("world", gameEntities[i]->GetTransform()->GetWorldMatrix());
-		vs->SetMatrix4x4("worldInvTranspose", gameEntities[i]->GetTransform()->GetWorldInverseTransposeMatrix());
-		vs->SetMatrix4x4("view", camera->GetViewMatrix());
-		vs->SetMatrix4x4("projection", camera->GetProjectionMatrix());
-		vs->SetMatrix4x4("lightView", shadowViewMatrix);
-		vs->SetMatrix4x4("lightProj", shadowProjMatrix);
-		vs->CopyAllBufferData();
-
-		// Define Pixel Shader data
-		std::shared_ptr<SimplePixelShader> ps = gameEntities[i]->GetMaterial()->GetPixelShader();
-		ps->SetFloat4("colorTint", gameEntities[i]->GetMaterial()->GetColorTint());
-		ps->SetFloat3("cameraPosition", camera->GetTransform()->GetPosition());
-		ps->SetFloat("roughness", gameEntities[i]->GetMaterial()->GetRoughness());
-		ps->SetFloat3("cameraPos", camera->GetTransform()->GetPosition());
-		ps->SetFloat3("ambientLight", ambientLight);
-		ps->SetFloat("uvScale", gameEntities[i]->GetMaterial()->GetUvScale());
-		ps->SetFloat2("uvOffset", gameEntities[i]->GetMaterial()->GetUvOffset());
-		ps->SetData("dirLight1", &dirLight1, sizeof(Light));
-		//ps->SetData("dirLight2", &dirLight2, sizeof(Light));
-		//ps->SetData("dirLight3", &dirLight3, sizeof(Light));
-		//ps->SetData("pointLight1", &pointLight1, sizeof(Light));
-		//ps->SetData("pointLight2", &pointLight2, sizeof(Light));
-		ps->SetShaderResourceView("ShadowMap", shadowSRV);
-		ps->SetSamplerState("ShadowSampler", shadowSampler);
-		gameEntities[i]->GetMaterial()->SetMaps();
-		ps->CopyAllBufferData();
-
-		UINT stride = sizeof(Vertex);
-		UINT offset = 0;
-
-		context->IASetVertexBuffers(0, 1, gameEntities[i]->GetMesh()->GetVertexBuffer().GetAddressOf(), &stride, &offset);
-		context->IASetIndexBuffer(gameEntities[i]->GetMesh()->GetIndexBuffer().Get(), DXGI_FORMAT_R32_UINT, 0);
-
-		// Draws meshes
-		context->DrawIndexed(
-			gameEntities[i]->GetMesh()->GetIndexCount(),
-			0,
-			0);
-
-		// Draw skybox
-		skybox->Draw(context, camera);
+		XMFLOAT4X4 world = gameEntities[i]->GetTransform()->GetWorldMatrix();
+		float x = world._41 - cameraPos.x;
+		float y = world._42 - cameraPos.y;
+		float z = world._43 - cameraPos.z;
+		renderQueue->Submit(RenderPass::Opaque, gameEntities[i].get(), sqrtf(x * x + y * y + z * z) / camera->GetFarPlane());
 	}
+	renderQueue->Sort();
+
+	// Data that stays the same for the whole frame. The shared
+	// buffers are bound once; shaders leave their slots alone.
+	PerFrameData frame = {};
+	frame.cameraPosition = cameraPos;
+	frame.ambientLight = ambientLight;
+	frame.dirLight1 = dirLight1;
+	//frame.dirLight2 = dirLight2;
+	//frame.dirLight3 = dirLight3;
+	//frame.pointLight1 = pointLight1;
+	//frame.pointLight2 = pointLight2;
+	perFrameBuffer->Update(frame);
+	perFrameBuffer->Bind();
+	perPassBuffer->Bind();
+	perMaterialBuffer->Bind();
+	perObjectBuffer->Bind();
+
+	// Run each pass in order, noting what it cost
+	for (FramePass& pass : framePasses)
+	{
+		ProfileScope profile(pass.Name);
+		unsigned int drawsBefore = renderQueue->GetStats().DrawCalls;
+		auto start = std::chrono::high_resolution_clock::now();
+
+		(this->*pass.Render)();
+
+		auto end = std::chrono::high_resolution_clock::now();
+		pass.CpuMs = std::chrono::duration<float, std::milli>(end - start).count();
+		pass.Draws = renderQueue->GetStats().DrawCalls - drawsBefore;
+		pass.TotalMs += pass.CpuMs;
+		pass.TotalDraws += pass.Draws;
+	}
+
 	// Present the back buffer to the user
 	//  - Puts the final frame we're drawing into the window so the user can see it
 	//  - Do this exactly ONCE PER FRAME (always at the very end of the frame)
-	swapChain->Present(vsync ? 1 : 0, 0);
+	//  - Headless runs have nothing to present to
+	if (swapChain)
+	{
+		ProfileScope profile("Present");
+		swapChain->Present(vsync ? 1 : 0, 0);
+	}
 
 	// Due to the usage of a more sophisticated swap chain,
 	// the render target must be re-bound after every call to Present()
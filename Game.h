@@ -2,13 +2,24 @@
 
 #include "DXCore.h"
 #include "Mesh.h"
+#include "MeshRegistry.h"
 #include "Transform.h"
+#include "TransformSystem.h"
 #include "GameEntity.h"
 #include "Camera.h"
 #include "SimpleShader.h"
 #include "Material.h"
 #include "Light.h"
 #include "Sky.h"
+#include "RenderQueue.h"
+#include "FrustumCuller.h"
+#include "BVH.h"
+#include "ConstantBuffer.h"
+#include "BufferStructs.h"
+#include "TextureCooker.h"
+#include "TextureCache.h"
+#include "TextureStreamer.h"
+#include "MaterialArray.h"
 #include <DirectXMath.h>
 #include <wrl/client.h> // Used for ComPtr - a smart pointer for COM objects
 #include <memory>
@@ -29,6 +40,20 @@ public:
 	void Update(float deltaTime, float totalTime);
 	void Draw(float deltaTime, float totalTime);
 
+	// What frustum culling kept, for the camera and the shadow map
+	struct CullStats
+	{
+		unsigned int Objects = 0;
+		unsigned int MainVisible = 0;
+		unsigned int ShadowVisible = 0;
+		unsigned int NodesVisited = 0;
+		float CpuMs = 0.0f;				// Bounds updates and both culls
+	};
+	const CullStats& GetCullStats();
+
+	// Recooks every PBR texture, without needing a device. Returns the number cooked.
+	unsigned int CookTextures(MipFilter filter);
+
 private:
 
 	// Should we use vsync to limit the frame rate?
@@ -38,7 +63,17 @@ private:
 	void LoadShaders(); 
 	void CreateBasicGeometry();
 	void MakeShadowMapResources();
+
+	// Frame passes, run in order by Draw()
 	void RenderShadowMap();
+	void RenderOpaque();
+	void RenderSky();
+	void RenderPost();
+
+
+	void CullScene();
+	void BindPerObjectData(GameEntity* entity);
+	void ReportFrameStats(float totalTime);
 
 	// Note the usage of ComPtr below
 	//  - This is a smart pointer for objects that abide by the
@@ -47,18 +82,55 @@ private:
 
 	// Simple Shaders
 	std::shared_ptr<SimpleVertexShader> vertexShader;
+	std::shared_ptr<SimpleVertexShader> vertexShaderInstanced;
 	std::shared_ptr<SimplePixelShader> pixelShader;
+	std::shared_ptr<SimplePixelShader> pixelShaderORM;
+	std::shared_ptr<SimplePixelShader> pixelShaderArray;
 	std::shared_ptr<SimplePixelShader> myShader;
 	std::shared_ptr<SimpleVertexShader> shadowVertexShader;
+	std::shared_ptr<SimpleVertexShader> shadowVertexShaderInstanced;
 	std::shared_ptr<SimpleVertexShader> skyVertexShader;
 	std::shared_ptr<SimplePixelShader> skyPixelShader;
 
 
 	// Shared ptr
+	std::shared_ptr<MeshRegistry> meshRegistry;
 	std::vector <std::shared_ptr<Mesh>> meshes;
+	std::shared_ptr<TransformSystem> transformSystem;
 	std::vector<std::shared_ptr<GameEntity>> gameEntities;
 	std::vector < std::shared_ptr<Material> > materials;
 	std::shared_ptr<Camera> camera;
+	std::shared_ptr<RenderQueue> renderQueue;
+
+	// Constant buffers shared by every shader, by how often they change
+	std::shared_ptr<ConstantBuffer<PerFrameData>> perFrameBuffer;
+	std::shared_ptr<ConstantBuffer<PerPassData>> perPassBuffer;
+	std::shared_ptr<ConstantBuffer<PerMaterialData>> perMaterialBuffer;
+	std::shared_ptr<ConstantBuffer<PerObjectData>> perObjectBuffer;
+
+	// One step of the frame, with what it cost
+	struct FramePass
+	{
+		const char* Name;
+		void (Game::*Render)();
+		float CpuMs = 0.0f;				// Time spent submitting it last frame
+		unsigned int Draws = 0;			// Draw calls it issued last frame
+		double TotalMs = 0.0;			// Totals since the last stats report
+		unsigned int TotalDraws = 0;
+	};
+	std::vector<FramePass> framePasses;
+
+	// Every entity's world space box, by index into gameEntities,
+	// and the indices of the entities each pass can see this frame
+	std::shared_ptr<BVH> sceneBVH;
+	std::vector<unsigned int> mainVisible;
+	std::vector<unsigned int> shadowVisible;
+	CullStats cullStats;				// Last frame
+	CullStats cullTotals;				// Since the last stats report
+
+	// Per-frame stats, averaged and printed once a second
+	unsigned int statsFrameCount;
+	float statsStartTime;
 
 	// Lights
 	DirectX::XMFLOAT3 ambientLight;
@@ -68,44 +140,11 @@ private:
 	Light pointLight1;
 	Light pointLight2;
 
-	// Textures
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> texture1;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> texture2;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> texture3;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> normal1;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> normal2;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> normal3;
-
-	// PBR Textures
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> albedo1;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> normals1;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> roughness1;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> metalness1;
-
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> albedo2;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> normals2;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> roughness2;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> metalness2;
-
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> albedo3;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> normals3;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> roughness3;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> metalness3;
-
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> albedo4;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> normals4;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> roughness4;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> metalness4;
-
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> albedo5;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> normals5;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> roughness5;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> metalness5;
-
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> albedo6;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> normals6;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> roughness6;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> metalness6;
+	// Textures, loaded for the materials that are drawn with, and
+	// their finer levels streamed in as the camera gets close
+	std::shared_ptr<TextureCache> textureCache;
+	std::shared_ptr<TextureStreamer> textureStreamer;
+	std::shared_ptr<MaterialArray> materialArray;		// Only with MATERIAL_ARRAYS defined
 
 	// Shadows
 	int shadowMapRes;
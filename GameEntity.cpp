@@ -1,20 +1,18 @@
 #include "GameEntity.h"
+#include "BufferStructs.h"
 
-GameEntity::GameEntity(std::shared_ptr<Mesh> mesh, std::shared_ptr<Material> material) : transform()
+GameEntity::GameEntity(std::shared_ptr<Mesh> mesh, std::shared_ptr<Material> material, std::shared_ptr<TransformSystem> transformSystem)
+	: transform(transformSystem.get(), transformSystem->Create())
 {
+	this->transformSystem = transformSystem;
 	this->mesh = mesh;
 	this->material = material;
 }
 
-Transform* GameEntity::GetTransform() { return &transform; }
+TransformHandle* GameEntity::GetTransform() { return &transform; }
 std::shared_ptr<Mesh> GameEntity::GetMesh() { return mesh; }
 std::shared_ptr<Material> GameEntity::GetMaterial() { return material; }
 
-void GameEntity::SetTransform(Transform transform)
-{
-	this->transform = transform;
-}
-
 void GameEntity::SetMesh(std::shared_ptr<Mesh> mesh)
 {
 	this->mesh = mesh;
@@ -24,3 +22,32 @@ void GameEntity::SetMaterial(std::shared_ptr<Material> material)
 {
 	this->material = material;
 }
+
+// --------------------------------------------------------
+// Bakes the current world matrices into an immutable
+// constant buffer, matching the shaders' PerObject cbuffer
+//
+// The entity shouldn't move afterwards; to move it again,
+// call MakeDynamic() first
+// --------------------------------------------------------
+void GameEntity::MakeStatic(Microsoft::WRL::ComPtr<ID3D11Device> device)
+{
+	PerObjectData data = {};
+	data.world = transform.GetWorldMatrix();
+	data.worldInvTranspose = transform.GetWorldInverseTransposeMatrix();
+
+	D3D11_BUFFER_DESC desc = {};
+	desc.ByteWidth = sizeof(PerObjectData);
+	desc.Usage = D3D11_USAGE_IMMUTABLE;
+	desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+
+	D3D11_SUBRESOURCE_DATA initialData = {};
+	initialData.pSysMem = &data;
+
+	bakedTransformBuffer.Reset();
+	device->CreateBuffer(&desc, &initialData, bakedTransformBuffer.GetAddressOf());
+}
+
+void GameEntity::MakeDynamic() { bakedTransformBuffer.Reset(); }
+bool GameEntity::IsStatic() { return bakedTransformBuffer != nullptr; }
+Microsoft::WRL::ComPtr<ID3D11Buffer> GameEntity::GetBakedTransformBuffer() { return bakedTransformBuffer; }
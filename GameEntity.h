@@ -1,28 +1,37 @@
 #pragma once
 
 #include "Mesh.h"
-#include "Transform.h"
+#include "TransformSystem.h"
 #include "Material.h"
 #include <memory>
 
 class GameEntity
 {
 public:
-	GameEntity(std::shared_ptr<Mesh> mesh, std::shared_ptr<Material> material);
+	GameEntity(std::shared_ptr<Mesh> mesh, std::shared_ptr<Material> material, std::shared_ptr<TransformSystem> transformSystem);
 
-	Transform* GetTransform();
+	TransformHandle* GetTransform();
 	std::shared_ptr<Mesh> GetMesh();
 	std::shared_ptr<Material> GetMaterial();
 
 	// Setters
-	void SetTransform(Transform transform);
 	void SetMesh(std::shared_ptr<Mesh> mesh);
 	void SetMaterial(std::shared_ptr<Material> material);
 
+	// Static entities have their matrices baked into a buffer once,
+	// which is bound in place of the per-object constant buffer
+	void MakeStatic(Microsoft::WRL::ComPtr<ID3D11Device> device);
+	void MakeDynamic();
+	bool IsStatic();
+	Microsoft::WRL::ComPtr<ID3D11Buffer> GetBakedTransformBuffer();
+
 private:
-	Transform transform;
+	std::shared_ptr<TransformSystem> transformSystem;
+	TransformHandle transform;
 	std::shared_ptr<Mesh> mesh;
 	std::shared_ptr<Material> material;
 
+	// Per-object data for static entities, or null for dynamic ones
+	Microsoft::WRL::ComPtr<ID3D11Buffer> bakedTransformBuffer;
 };
 
@@ -1,5 +1,7 @@
 
 #include <Windows.h>
+#include <cstdio>
+#include <cstring>
 #include "Game.h"
 
 // --------------------------------------------------------
@@ -22,6 +24,39 @@ int WINAPI WinMain(
 	// the app handle we got from WinMain
 	Game dxGame(hInstance);
 
+	// "-cook" recooks every PBR texture into a block compressed DDS,
+	// then exits ("-cook box" for box filtered mips). Textures are
+	// otherwise cooked the first time they load, and when they change.
+	const char* cook = strstr(lpCmdLine, "-cook");
+	if (cook)
+	{
+		if (GetStdHandle(STD_OUTPUT_HANDLE) == 0 && AttachConsole(ATTACH_PARENT_PROCESS))
+		{
+			FILE* stream;
+			freopen_s(&stream, "CONOUT$", "w", stdout);
+		}
+
+		MipFilter filter = strstr(cook, "box") ? MipFilter::Box : MipFilter::Kaiser;
+		dxGame.CookTextures(filter);
+		fflush(stdout);
+		return 0;
+	}
+
+	// "-record" records every D3D call while running normally, and
+	// "-headless [frames]" runs that many frames (300 by default) on
+	// a null device, without a visible window, then reports and exits
+	const char* headless = strstr(lpCmdLine, "-headless");
+	if (headless)
+	{
+		unsigned int frames = 300;
+		sscanf_s(headless + strlen("-headless"), "%u", &frames);
+		dxGame.SetDeviceMode(DeviceMode::Headless, frames);
+	}
+	else if (strstr(lpCmdLine, "-record"))
+	{
+		dxGame.SetDeviceMode(DeviceMode::Recording);
+	}
+
 	// Result variable for function calls below
 	HRESULT hr = S_OK;
 
@@ -0,0 +1,61 @@
+#include "MappedFile.h"
+
+MappedFile::MappedFile(const char* path)
+{
+	file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	Map();
+}
+
+MappedFile::MappedFile(const wchar_t* path)
+{
+	file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	Map();
+}
+
+MappedFile::~MappedFile()
+{
+	if (data) UnmapViewOfFile(data);
+	if (mapping) CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+}
+
+// --------------------------------------------------------
+// Maps the whole of the opened file, if it opened
+// --------------------------------------------------------
+void MappedFile::Map()
+{
+	mapping = 0;
+	data = 0;
+	size = 0;
+
+	if (file == INVALID_HANDLE_VALUE)
+		return;
+
+	// Empty files can't be mapped, so treat them as missing
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+		return;
+
+	mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+	if (!mapping)
+		return;
+
+	data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (data)
+		size = (size_t)fileSize.QuadPart;
+}
+
+bool MappedFile::IsValid()
+{
+	return data != 0;
+}
+
+const unsigned char* MappedFile::GetData()
+{
+	return data;
+}
+
+size_t MappedFile::GetSize()
+{
+	return size;
+}
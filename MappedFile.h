@@ -0,0 +1,35 @@
+#pragma once
+
+#include <Windows.h>
+#include <cstddef>
+
+// --------------------------------------------------------
+// A read-only view of an entire file, mapped into memory
+//
+// - The contents are paged in by the OS on first access,
+//   so nothing is copied until it is actually read
+// - The view is released when this object is destroyed
+// --------------------------------------------------------
+class MappedFile
+{
+public:
+	MappedFile(const char* path);
+	MappedFile(const wchar_t* path);
+	~MappedFile();
+
+	// Mapped views can't be shared between owners
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool IsValid();
+	const unsigned char* GetData();
+	size_t GetSize();
+
+private:
+	HANDLE file;
+	HANDLE mapping;
+	const unsigned char* data;
+	size_t size;
+
+	void Map();
+};
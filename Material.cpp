@@ -1,4 +1,5 @@
 #include "Material.h"
+#include "MaterialArray.h"
 
 Material::Material(DirectX::XMFLOAT4 colorTint, std::shared_ptr<SimpleVertexShader> vertexShader, std::shared_ptr<SimplePixelShader> pixelShader, float roughness, float uvScale, DirectX::XMFLOAT2 uvOffset)
 {
@@ -8,6 +9,9 @@ Material::Material(DirectX::XMFLOAT4 colorTint, std::shared_ptr<SimpleVertexShad
     this->roughness = roughness;
     this->uvScale = uvScale;
     this->uvOffset = uvOffset;
+    this->instancedVertexShader = 0;
+    this->materialArray = 0;
+    this->arrayIndex = 0;
 }
 
 Material::~Material()
@@ -17,6 +21,7 @@ Material::~Material()
 DirectX::XMFLOAT4 Material::GetColorTint() { return colorTint; }
 std::shared_ptr<SimpleVertexShader> Material::GetVertexShader() { return vertexShader; }
 std::shared_ptr<SimplePixelShader> Material::GetPixelShader() { return pixelShader; }
+std::shared_ptr<SimpleVertexShader> Material::GetInstancedVertexShader() { return instancedVertexShader; }
 float Material::GetRoughness() { return roughness; }
 float Material::GetUvScale() { return uvScale; }
 DirectX::XMFLOAT2 Material::GetUvOffset() { return uvOffset; }
@@ -31,6 +36,13 @@ void Material::SetVertexShader(std::shared_ptr<SimpleVertexShader> vertexShader)
     this->vertexShader = vertexShader;
 }
 
+// The vertex shader to use when this material's draws are instanced,
+// which must match the regular one apart from its per-instance inputs
+void Material::SetInstancedVertexShader(std::shared_ptr<SimpleVertexShader> instancedVertexShader)
+{
+    this->instancedVertexShader = instancedVertexShader;
+}
+
 void Material::SetPixelShader(std::shared_ptr<SimplePixelShader> pixelShader)
 {
     this->pixelShader = pixelShader;
@@ -56,14 +68,37 @@ void Material::AddTextureSRV(std::string name, Microsoft::WRL::ComPtr<ID3D11Shad
     textureSRVs.insert({ name, texture });
 }
 
+// Cached textures are bound by handle, so whatever the cache
+// holds when the material is drawn is what gets bound
+void Material::AddTexture(std::string name, std::shared_ptr<CachedTexture> texture)
+{
+    textures.insert({ name, texture });
+}
+
 void Material::AddSampler(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> state)
 {
     samplers.insert({ name, state });
 }
 
+// Its own maps are released, as the array has its copies
+void Material::SetMaterialArray(std::shared_ptr<MaterialArray> materialArray, unsigned int index)
+{
+    this->materialArray = materialArray;
+    this->arrayIndex = index;
+    textures.clear();
+}
+
+std::shared_ptr<MaterialArray> Material::GetMaterialArray() { return materialArray; }
+unsigned int Material::GetArrayIndex() { return arrayIndex; }
+
 void Material::SetMaps()
 {
+    if (materialArray) { materialArray->SetMaps(pixelShader); }
     for (auto& t : textureSRVs) { pixelShader->SetShaderResourceView(t.first.c_str(), t.second); }
+    for (auto& t : textures) { pixelShader->SetShaderResourceView(t.first.c_str(), t.second->SRV); }
     for (auto& s : samplers) { pixelShader->SetSamplerState(s.first.c_str(), s.second); }
-    pixelShader->CopyAllBufferData();
 }
+
+size_t Material::GetTextureSRVCount() { return textureSRVs.size() + textures.size() + (materialArray ? MaterialArray::GetSRVCount() : 0); }
+size_t Material::GetSamplerCount() { return samplers.size(); }
+const std::unordered_map<std::string, std::shared_ptr<CachedTexture>>& Material::GetTextures() { return textures; }
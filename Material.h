@@ -4,6 +4,9 @@
 #include <memory>
 #include <unordered_map>
 #include "SimpleShader.h"
+#include "TextureCache.h"
+
+class MaterialArray;
 
 class Material
 {
@@ -15,6 +18,7 @@ public:
 	DirectX::XMFLOAT4 GetColorTint();
 	std::shared_ptr<SimpleVertexShader> GetVertexShader();
 	std::shared_ptr<SimplePixelShader> GetPixelShader();
+	std::shared_ptr<SimpleVertexShader> GetInstancedVertexShader();
 	float GetRoughness();
 	float GetUvScale();
 	DirectX::XMFLOAT2 GetUvOffset();
@@ -23,25 +27,40 @@ public:
 	void SetColorTint(DirectX::XMFLOAT4 colorTint);
 	void SetVertexShader(std::shared_ptr<SimpleVertexShader> vertexShader);
 	void SetPixelShader(std::shared_ptr<SimplePixelShader> pixelShader);
+	void SetInstancedVertexShader(std::shared_ptr<SimpleVertexShader> instancedVertexShader);
 	void SetRoughness(float roughness);
 	void SetUvScale(float uvScale);
 	void SetUvOffset(DirectX::XMFLOAT2 uvOffset);
 
 	// Textures
 	void AddTextureSRV(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> texture);
+	void AddTexture(std::string name, std::shared_ptr<CachedTexture> texture);
 	void AddSampler(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> state);
 	void SetMaps();
+	size_t GetTextureSRVCount();
+	size_t GetSamplerCount();
+	const std::unordered_map<std::string, std::shared_ptr<CachedTexture>>& GetTextures();
+
+	// Material array mode: maps are bound from the array's slices and parameters
+	// read from its buffer at this index (see MaterialArray), in place of its own
+	void SetMaterialArray(std::shared_ptr<MaterialArray> materialArray, unsigned int index);
+	std::shared_ptr<MaterialArray> GetMaterialArray();
+	unsigned int GetArrayIndex();
 
 private:
 	DirectX::XMFLOAT4 colorTint;
 	std::shared_ptr<SimpleVertexShader> vertexShader;
 	std::shared_ptr<SimplePixelShader> pixelShader;
+	std::shared_ptr<SimpleVertexShader> instancedVertexShader;
 	float roughness;
 	float uvScale;
 	DirectX::XMFLOAT2 uvOffset;
+	std::shared_ptr<MaterialArray> materialArray;
+	unsigned int arrayIndex;
 
 	// Unordered maps - C# Dictionaries
 	std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> textureSRVs;
+	std::unordered_map<std::string, std::shared_ptr<CachedTexture>> textures;	// Kept resident by holding them
 	std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3D11SamplerState>> samplers;
 
 };
@@ -0,0 +1,178 @@
+#include "MaterialArray.h"
+#include "Material.h"
+#include "BufferStructs.h"
+#include <cstring>
+
+// Shader names of each map's array, in map order
+static const char* ArrayNames[MaterialArray::MapCount] = { "AlbedoArray", "NormalArray", "ORMArray" };
+
+MaterialArray::MaterialArray(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+{
+	this->device = device;
+	this->context = context;
+	memset(sliceDescs, 0, sizeof(sliceDescs));
+	memset(sliceCounts, 0, sizeof(sliceCounts));
+}
+
+MaterialArray::~MaterialArray()
+{
+}
+
+int MaterialArray::Add(std::shared_ptr<Material> material, std::shared_ptr<CachedTexture> albedo,
+	std::shared_ptr<CachedTexture> normals, std::shared_ptr<CachedTexture> orm)
+{
+	std::shared_ptr<CachedTexture> maps[MapCount] = { albedo, normals, orm };
+	D3D11_TEXTURE2D_DESC descs[MapCount];
+	for (unsigned int map = 0; map < MapCount; map++)
+	{
+		Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+		if (!maps[map] || !GetTexture(maps[map]->SRV.Get(), texture))
+			return -1;
+		texture->GetDesc(&descs[map]);
+
+		// Every slice of an array has the same size, format and mips
+		const D3D11_TEXTURE2D_DESC& first = sliceDescs[map];
+		if (!slices[map].empty() &&
+			(descs[map].Width != first.Width || descs[map].Height != first.Height ||
+			descs[map].MipLevels != first.MipLevels || descs[map].Format != first.Format))
+			return -1;
+	}
+
+	Entry entry;
+	entry.Owner = material;
+	for (unsigned int map = 0; map < MapCount; map++)
+	{
+		unsigned int slice = 0;
+		while (slice < slices[map].size() && slices[map][slice] != maps[map])
+			slice++;
+		if (slice == slices[map].size())
+			slices[map].push_back(maps[map]);
+
+		entry.Slices[map] = slice;
+		sliceDescs[map] = descs[map];
+	}
+
+	entries.push_back(entry);
+	return (int)entries.size() - 1;
+}
+
+bool MaterialArray::Build()
+{
+	if (entries.empty())
+		return false;
+
+	for (unsigned int map = 0; map < MapCount; map++)
+	{
+		D3D11_TEXTURE2D_DESC desc = sliceDescs[map];
+		desc.ArraySize = (UINT)slices[map].size();
+		desc.Usage = D3D11_USAGE_DEFAULT;
+		desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		desc.CPUAccessFlags = 0;
+		desc.MiscFlags = 0;
+
+		Microsoft::WRL::ComPtr<ID3D11Texture2D> array;
+		if (FAILED(device->CreateTexture2D(&desc, 0, array.GetAddressOf())))
+			return false;
+
+		// Straight copies on the GPU, block compressed or not
+		for (UINT slice = 0; slice < desc.ArraySize; slice++)
+		{
+			Microsoft::WRL::ComPtr<ID3D11Texture2D> source;
+			GetTexture(slices[map][slice]->SRV.Get(), source);
+			for (UINT mip = 0; mip < desc.MipLevels; mip++)
+				context->CopySubresourceRegion(array.Get(), D3D11CalcSubresource(mip, slice, desc.MipLevels), 0, 0, 0, source.Get(), mip, 0);
+		}
+
+		// An array of one slice still needs to be viewed as an array
+		D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc = {};
+		viewDesc.Format = desc.Format;
+		viewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+		viewDesc.Texture2DArray.MipLevels = desc.MipLevels;
+		viewDesc.Texture2DArray.ArraySize = desc.ArraySize;
+		if (FAILED(device->CreateShaderResourceView(array.Get(), &viewDesc, arrays[map].GetAddressOf())))
+			return false;
+
+		sliceCounts[map] = desc.ArraySize;
+	}
+
+	D3D11_BUFFER_DESC bufferDesc = {};
+	bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	bufferDesc.ByteWidth = (UINT)(entries.size() * sizeof(MaterialArrayData));
+	bufferDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	bufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	bufferDesc.StructureByteStride = sizeof(MaterialArrayData);
+	if (FAILED(device->CreateBuffer(&bufferDesc, 0, materialBuffer.GetAddressOf())))
+		return false;
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC bufferViewDesc = {};
+	bufferViewDesc.Format = DXGI_FORMAT_UNKNOWN;
+	bufferViewDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	bufferViewDesc.Buffer.FirstElement = 0;
+	bufferViewDesc.Buffer.NumElements = (UINT)entries.size();
+	if (FAILED(device->CreateShaderResourceView(materialBuffer.Get(), &bufferViewDesc, materialSRV.GetAddressOf())))
+		return false;
+
+	for (unsigned int map = 0; map < MapCount; map++)
+		slices[map].clear();
+
+	UpdateMaterials();
+	return true;
+}
+
+void MaterialArray::UpdateMaterials()
+{
+	if (!materialBuffer)
+		return;
+
+	std::vector<MaterialArrayData> data(entries.size());
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		std::shared_ptr<Material> material = entries[i].Owner.lock();
+		if (!material)
+			continue;
+
+		data[i].colorTint = material->GetColorTint();
+		data[i].roughness = material->GetRoughness();
+		data[i].uvScale = material->GetUvScale();
+		data[i].uvOffset = material->GetUvOffset();
+		data[i].albedoSlice = entries[i].Slices[0];
+		data[i].normalSlice = entries[i].Slices[1];
+		data[i].ormSlice = entries[i].Slices[2];
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	if (FAILED(context->Map(materialBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+		return;
+	memcpy(mapped.pData, data.data(), data.size() * sizeof(MaterialArrayData));
+	context->Unmap(materialBuffer.Get(), 0);
+}
+
+void MaterialArray::SetMaps(std::shared_ptr<SimplePixelShader> pixelShader)
+{
+	for (unsigned int map = 0; map < MapCount; map++)
+		pixelShader->SetShaderResourceView(ArrayNames[map], arrays[map]);
+	pixelShader->SetShaderResourceView("Materials", materialSRV);
+}
+
+size_t MaterialArray::GetSRVCount() { return MapCount + 1; }
+size_t MaterialArray::GetMaterialCount() { return entries.size(); }
+unsigned int MaterialArray::GetSliceCount(unsigned int map) { return map < MapCount ? sliceCounts[map] : 0; }
+
+size_t MaterialArray::GetBytes()
+{
+	size_t bytes = 0;
+	for (unsigned int map = 0; map < MapCount; map++)
+		bytes += TextureCache::GetTextureBytes(arrays[map].Get());
+	return bytes;
+}
+
+bool MaterialArray::GetTexture(ID3D11ShaderResourceView* view, Microsoft::WRL::ComPtr<ID3D11Texture2D>& texture)
+{
+	if (!view)
+		return false;
+
+	Microsoft::WRL::ComPtr<ID3D11Resource> resource;
+	view->GetResource(resource.GetAddressOf());
+	return SUCCEEDED(resource->QueryInterface(__uuidof(ID3D11Texture2D), reinterpret_cast<void**>(texture.GetAddressOf())));
+}
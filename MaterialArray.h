@@ -0,0 +1,84 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <memory>
+#include <vector>
+#include "SimpleShader.h"
+#include "TextureCache.h"
+
+class Material;
+
+// --------------------------------------------------------
+// Materials whose PBR maps are all the same size, format
+// and mip count, sharing one Texture2DArray per map
+//
+// - Each material's albedo, normal and ORM maps become a
+//   slice of their array. Maps shared between materials
+//   are only stored once
+// - Each material's parameters and slice indices live in
+//   a structured buffer, read by PixelShaderArray.hlsl at
+//   the index passed with each instance (or the PerMaterial
+//   cbuffer, for draws that aren't instanced)
+// - Every material in the array binds the same resources,
+//   so the render queue batches entities using any of them
+//   into one instanced draw
+// - Add every material, then Build() once. The arrays are
+//   copied from the maps on the GPU, so the maps have to
+//   be loaded with every level (not streamed)
+// --------------------------------------------------------
+class MaterialArray
+{
+public:
+	// Albedo, normals and ORM
+	static const unsigned int MapCount = 3;
+
+	MaterialArray(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+	~MaterialArray();
+
+	// Adds a material and its loaded maps, returning its index in the array, or -1
+	// if a map is missing or doesn't match the size, format and mips of the others
+	int Add(std::shared_ptr<Material> material, std::shared_ptr<CachedTexture> albedo,
+		std::shared_ptr<CachedTexture> normals, std::shared_ptr<CachedTexture> orm);
+
+	// Creates the arrays, copies every map into its slice and uploads the
+	// materials. The array's references to the maps are released after.
+	bool Build();
+
+	// Uploads every material's parameters again, after any of them change
+	void UpdateMaterials();
+
+	// Binds the arrays and the material buffer to a PixelShaderArray.hlsl shader
+	void SetMaps(std::shared_ptr<SimplePixelShader> pixelShader);
+
+	// Shader resources SetMaps() binds: the arrays and the buffer
+	static size_t GetSRVCount();
+
+	size_t GetMaterialCount();
+	unsigned int GetSliceCount(unsigned int map);
+
+	// Video memory used by the arrays
+	size_t GetBytes();
+
+private:
+	// One material, and the slice each of its maps is in
+	struct Entry
+	{
+		std::weak_ptr<Material> Owner;			// Weak, as materials hold the array
+		unsigned int Slices[MapCount];
+	};
+
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+
+	std::vector<Entry> entries;
+	std::vector<std::shared_ptr<CachedTexture>> slices[MapCount];	// Until Build()
+	D3D11_TEXTURE2D_DESC sliceDescs[MapCount];
+	unsigned int sliceCounts[MapCount];
+
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> arrays[MapCount];
+	Microsoft::WRL::ComPtr<ID3D11Buffer> materialBuffer;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> materialSRV;
+
+	static bool GetTexture(ID3D11ShaderResourceView* view, Microsoft::WRL::ComPtr<ID3D11Texture2D>& texture);
+};
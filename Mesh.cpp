@@ -1,11 +1,25 @@
 #include "Mesh.h"
-#include <fstream>
+#include "ObjLoader.h"
+#include "MeshCache.h"
 #include <DirectXMath.h>
 #include <vector>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+
+using namespace DirectX;
+
+bool Mesh::UseBinaryCache = true;
+
+// Tangent generation for meshes with at least this many
+// triangles is split across threads
+static const int TangentThreadThreshold = 65536;
+static const unsigned int MaxTangentThreads = 8;
 
 Mesh::Mesh(Vertex* _vertices, int _nVertices, unsigned int* _indices, int _nIndicies, Microsoft::WRL::ComPtr<ID3D11Device> _device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> _context)
 {
-	// save indicies
+	// save counts
+	nVertices = _nVertices;
 	nIndicies = _nIndicies;
 
 	context = _context;
@@ -13,13 +27,186 @@ Mesh::Mesh(Vertex* _vertices, int _nVertices, unsigned int* _indices, int _nIndi
 	// Calculates Tangents
 	CalculateTangents(_vertices, _nVertices, _indices, nIndicies);
 
+	// Calculate the bounding box
+	MeshCache::CalculateBounds(_vertices, _nVertices, boundsMin, boundsMax);
+	boundingRadius = CalculateBoundingRadius(_vertices, _nVertices, boundsMin, boundsMax);
+
+	// Create the GPU buffers
+	CreateBuffers(_vertices, _nVertices, _indices, _nIndicies, _device.Get());
+}
+
+Mesh::Mesh(const char* objFile, Microsoft::WRL::ComPtr<ID3D11Device> _device)
+{
+	nVertices = 0;
+	nIndicies = 0;
+	boundsMin = DirectX::XMFLOAT3(0, 0, 0);
+	boundsMax = DirectX::XMFLOAT3(0, 0, 0);
+	boundingRadius = 0.0f;
+
+	MeshSource source;
+	if (!LoadSource(objFile, source))
+		return;
+
+	nVertices = source.VertexCount;
+	nIndicies = source.IndexCount;
+	boundsMin = source.BoundsMin;
+	boundsMax = source.BoundsMax;
+	boundingRadius = CalculateBoundingRadius(source.Vertices, nVertices, boundsMin, boundsMax);
+	CreateBuffers(source.Vertices, nVertices, source.Indices, nIndicies, _device.Get());
+}
+
+Mesh::Mesh(const MeshSource& source, Microsoft::WRL::ComPtr<ID3D11Device> _device)
+{
+	nVertices = source.VertexCount;
+	nIndicies = source.IndexCount;
+	boundsMin = source.BoundsMin;
+	boundsMax = source.BoundsMax;
+	boundingRadius = CalculateBoundingRadius(source.Vertices, nVertices, boundsMin, boundsMax);
+
+	if (nVertices > 0 && nIndicies > 0)
+		CreateBuffers(source.Vertices, nVertices, source.Indices, nIndicies, _device.Get());
+}
+
+// --------------------------------------------------------
+// Reads an .obj file into memory, either straight out of
+// an up to date cache file or by parsing it (and then
+// writing a new cache for next time)
+//
+// - Doesn't touch the device, so it can run on any thread
+// --------------------------------------------------------
+bool Mesh::LoadSource(const char* objFile, MeshSource& source)
+{
+	// Map the source file - its hash tells us if the cache is stale
+	MappedFile sourceFile(objFile);
+	if (!sourceFile.IsValid())
+		return false;
+
+	unsigned long long sourceHash = MeshCache::Hash(sourceFile.GetData(), sourceFile.GetSize());
+	std::string cachePath = MeshCache::GetCachePath(objFile);
+
+	// Use an up to date cache file if we have one, leaving it mapped for the upload
+	if (UseBinaryCache)
+	{
+		std::unique_ptr<MappedFile> cacheFile = std::make_unique<MappedFile>(cachePath.c_str());
+		MeshCacheView cache;
+		if (MeshCache::Open(*cacheFile, sourceHash, cache))
+		{
+			source.CacheFile = std::move(cacheFile);
+			source.Vertices = cache.Vertices;
+			source.Indices = cache.Indices;
+			source.VertexCount = (int)cache.Header->VertexCount;
+			source.IndexCount = (int)cache.Header->IndexCount;
+			source.BoundsMin = cache.Header->BoundsMin;
+			source.BoundsMax = cache.Header->BoundsMax;
+			return true;
+		}
+	}
+
+	// Otherwise parse the already mapped text into welded, indexed geometry
+	MeshData& meshData = source.Parsed;
+	if (!ObjLoader::Parse((const char*)sourceFile.GetData(), sourceFile.GetSize(), meshData))
+		return false;
+
+	int numVerts = (int)meshData.Vertices.size();
+	int numIndices = (int)meshData.Indices.size();
+
+#if defined(DEBUG) || defined(_DEBUG)
+	// Without welding, every face corner would have been its own vertex
+	printf("Mesh '%s': %d face vertices welded into %d unique vertices (%.1f%% of the unwelded size)\n",
+		objFile, numIndices, numVerts, 100.0f * numVerts / numIndices);
+#endif
+
+	// Calculate Tangents
+	CalculateTangents(meshData.Vertices.data(), numVerts, meshData.Indices.data(), numIndices);
+	MeshCache::CalculateBounds(meshData.Vertices.data(), numVerts, source.BoundsMin, source.BoundsMax);
+
+	// Save the fully processed data so the next launch can skip all of the above
+	if (UseBinaryCache)
+		MeshCache::Write(cachePath.c_str(), sourceHash, meshData, source.BoundsMin, source.BoundsMax);
+
+	source.Vertices = meshData.Vertices.data();
+	source.Indices = meshData.Indices.data();
+	source.VertexCount = numVerts;
+	source.IndexCount = numIndices;
+	return true;
+}
+
+Mesh::~Mesh()
+{
+
+}
+
+Microsoft::WRL::ComPtr<ID3D11Buffer> Mesh::GetVertexBuffer()
+{
+	return vb;
+}
+
+Microsoft::WRL::ComPtr<ID3D11Buffer> Mesh::GetIndexBuffer()
+{
+	return ib;
+}
+
+int Mesh::GetIndexCount()
+{
+	return nIndicies;
+}
+
+int Mesh::GetVertexCount()
+{
+	return nVertices;
+}
+
+// --------------------------------------------------------
+// Size of this mesh's vertex and index buffers, in bytes
+// --------------------------------------------------------
+size_t Mesh::GetBufferSize()
+{
+	return sizeof(Vertex) * nVertices + sizeof(unsigned int) * nIndicies;
+}
+
+DirectX::XMFLOAT3 Mesh::GetBoundsMin()
+{
+	return boundsMin;
+}
+
+DirectX::XMFLOAT3 Mesh::GetBoundsMax()
+{
+	return boundsMax;
+}
+
+float Mesh::GetBoundingRadius()
+{
+	return boundingRadius;
+}
+
+// --------------------------------------------------------
+// Finds the furthest vertex from the bounding box's center,
+// so the sphere and box can share a center when culling
+// --------------------------------------------------------
+float Mesh::CalculateBoundingRadius(const Vertex* verts, int numVerts, XMFLOAT3 boundsMin, XMFLOAT3 boundsMax)
+{
+	XMVECTOR center = XMVectorScale(XMVectorAdd(XMLoadFloat3(&boundsMin), XMLoadFloat3(&boundsMax)), 0.5f);
+	XMVECTOR maxDistanceSq = XMVectorZero();
+	for (int i = 0; i < numVerts; i++)
+	{
+		XMVECTOR offset = XMVectorSubtract(XMLoadFloat3(&verts[i].Position), center);
+		maxDistanceSq = XMVectorMax(maxDistanceSq, XMVector3LengthSq(offset));
+	}
+	return sqrtf(XMVectorGetX(maxDistanceSq));
+}
+
+// --------------------------------------------------------
+// Creates the immutable vertex and index buffers for this mesh
+// --------------------------------------------------------
+void Mesh::CreateBuffers(const Vertex* verts, int numVerts, const unsigned int* indices, int numIndices, ID3D11Device* device)
+{
 	// Create the VERTEX BUFFER description -----------------------------------
 	// - The description is created on the stack because we only need
 	//    it to create the buffer.  The description is then useless.
 	D3D11_BUFFER_DESC vbd = {};
 	vbd.Usage = D3D11_USAGE_IMMUTABLE;
-	vbd.ByteWidth = sizeof(Vertex) * _nVertices;       // _nVertices = number of vertices in the buffer
-	vbd.BindFlags = D3D11_BIND_VERTEX_BUFFER; // Tells DirectX this is a vertex buffer
+	vbd.ByteWidth = sizeof(Vertex) * numVerts;	// numVerts = number of vertices in the buffer
+	vbd.BindFlags = D3D11_BIND_VERTEX_BUFFER;	// Tells DirectX this is a vertex buffer
 	vbd.CPUAccessFlags = 0;
 	vbd.MiscFlags = 0;
 	vbd.StructureByteStride = 0;
@@ -27,369 +214,296 @@ Mesh::Mesh(Vertex* _vertices, int _nVertices, unsigned int* _indices, int _nIndi
 	// Create the proper struct to hold the initial vertex data
 	// - This is how we put the initial data into the buffer
 	D3D11_SUBRESOURCE_DATA initialVertexData = {};
-	initialVertexData.pSysMem = _vertices;
+	initialVertexData.pSysMem = verts;
 
 	// Actually create the buffer with the initial data
 	// - Once we do this, we'll NEVER CHANGE THE BUFFER AGAIN
-	_device->CreateBuffer(&vbd, &initialVertexData, vb.GetAddressOf());
-
-
+	device->CreateBuffer(&vbd, &initialVertexData, vb.ReleaseAndGetAddressOf());
 
 	// Create the INDEX BUFFER description ------------------------------------
-	// - The description is created on the stack because we only need
-	//    it to create the buffer.  The description is then useless.
 	D3D11_BUFFER_DESC ibd = {};
 	ibd.Usage = D3D11_USAGE_IMMUTABLE;
-	ibd.ByteWidth = sizeof(unsigned int) * _nIndicies;	// _nIndicies = number of indices in the buffer
+	ibd.ByteWidth = sizeof(unsigned int) * numIndices;	// numIndices = number of indices in the buffer
 	ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;	// Tells DirectX this is an index buffer
 	ibd.CPUAccessFlags = 0;
 	ibd.MiscFlags = 0;
 	ibd.StructureByteStride = 0;
 
 	// Create the proper struct to hold the initial index data
-	// - This is how we put the initial data into the buffer
 	D3D11_SUBRESOURCE_DATA initialIndexData = {};
-	initialIndexData.pSysMem = _indices;
+	initialIndexData.pSysMem = indices;
 
 	// Actually create the buffer with the initial data
-	// - Once we do this, we'll NEVER CHANGE THE BUFFER AGAIN
-	_device->CreateBuffer(&ibd, &initialIndexData, ib.GetAddressOf());
+	device->CreateBuffer(&ibd, &initialIndexData, ib.ReleaseAndGetAddressOf());
 }
 
-Mesh::Mesh(const char* objFile, Microsoft::WRL::ComPtr<ID3D11Device> _device)
+// --------------------------------------------------------
+// Adds the tangent and bitangent of each triangle in
+// [firstTriangle, lastTriangle) to its three vertices
+//
+// - Four triangles are processed per iteration, one per
+//   SIMD lane, with leftovers handled one at a time
+// - Triangles with degenerate uvs add nothing (rather than
+//   spreading NaNs to their vertices)
+// --------------------------------------------------------
+static void AccumulateTangents(const Vertex* verts, const unsigned int* indices, int firstTriangle, int lastTriangle,
+	XMFLOAT4A* accumulators)
 {
-	// Author: Chris Cascioli
-	// Purpose: Basic .OBJ 3D model loading, supporting positions, uvs and normals
-	// File input object
-	std::ifstream obj(objFile);
-
-	// Check for successful open
-	if (!obj.is_open())
-		return;
+	XMVECTOR zero = XMVectorZero();
 
-	// Variables used while reading the file
-	std::vector<DirectX::XMFLOAT3> positions;	// Positions from the file
-	std::vector<DirectX::XMFLOAT3> normals;		// Normals from the file
-	std::vector<DirectX::XMFLOAT2> uvs;		// UVs from the file
-	std::vector<Vertex> verts;		// Verts we're assembling
-	std::vector<UINT> indices;		// Indices of these verts
-	int vertCounter = 0;			// Count of vertices
-	int indexCounter = 0;			// Count of indices
-	char chars[100];			// String for line reading
-
-	// Still have data left?
-	while (obj.good())
+	int t = firstTriangle;
+	for (; t + 4 <= lastTriangle; t += 4)
 	{
-		// Get the line (100 characters should be more than enough)
-		obj.getline(chars, 100);
+		const unsigned int* tri = indices + t * 3;
+
+		// Gather each corner of the four triangles, then transpose
+		// so each row holds one component (x, y or z) of all four
+		XMMATRIX p0 = XMMatrixTranspose(XMMATRIX(
+			XMLoadFloat3(&verts[tri[0]].Position), XMLoadFloat3(&verts[tri[3]].Position),
+			XMLoadFloat3(&verts[tri[6]].Position), XMLoadFloat3(&verts[tri[9]].Position)));
+		XMMATRIX p1 = XMMatrixTranspose(XMMATRIX(
+			XMLoadFloat3(&verts[tri[1]].Position), XMLoadFloat3(&verts[tri[4]].Position),
+			XMLoadFloat3(&verts[tri[7]].Position), XMLoadFloat3(&verts[tri[10]].Position)));
+		XMMATRIX p2 = XMMatrixTranspose(XMMATRIX(
+			XMLoadFloat3(&verts[tri[2]].Position), XMLoadFloat3(&verts[tri[5]].Position),
+			XMLoadFloat3(&verts[tri[8]].Position), XMLoadFloat3(&verts[tri[11]].Position)));
+		XMMATRIX uv0 = XMMatrixTranspose(XMMATRIX(
+			XMLoadFloat2(&verts[tri[0]].UV), XMLoadFloat2(&verts[tri[3]].UV),
+			XMLoadFloat2(&verts[tri[6]].UV), XMLoadFloat2(&verts[tri[9]].UV)));
+		XMMATRIX uv1 = XMMatrixTranspose(XMMATRIX(
+			XMLoadFloat2(&verts[tri[1]].UV), XMLoadFloat2(&verts[tri[4]].UV),
+			XMLoadFloat2(&verts[tri[7]].UV), XMLoadFloat2(&verts[tri[10]].UV)));
+		XMMATRIX uv2 = XMMatrixTranspose(XMMATRIX(
+			XMLoadFloat2(&verts[tri[2]].UV), XMLoadFloat2(&verts[tri[5]].UV),
+			XMLoadFloat2(&verts[tri[8]].UV), XMLoadFloat2(&verts[tri[11]].UV)));
 
-		// Check the type of line
-		if (chars[0] == 'v' && chars[1] == 'n')
-		{
-			// Read the 3 numbers directly into an XMFLOAT3
-			DirectX::XMFLOAT3 norm;
-			sscanf_s(
-				chars,
-				"vn %f %f %f",
-				&norm.x, &norm.y, &norm.z);
-
-			// Add to the list of normals
-			normals.push_back(norm);
-		}
-		else if (chars[0] == 'v' && chars[1] == 't')
-		{
-			// Read the 2 numbers directly into an XMFLOAT2
-			DirectX::XMFLOAT2 uv;
-			sscanf_s(
-				chars,
-				"vt %f %f",
-				&uv.x, &uv.y);
-
-			// Add to the list of uv's
-			uvs.push_back(uv);
-		}
-		else if (chars[0] == 'v')
-		{
-			// Read the 3 numbers directly into an XMFLOAT3
-			DirectX::XMFLOAT3 pos;
-			sscanf_s(
-				chars,
-				"v %f %f %f",
-				&pos.x, &pos.y, &pos.z);
-
-			// Add to the positions
-			positions.push_back(pos);
-		}
-		else if (chars[0] == 'f')
-		{
-			// Read the face indices into an array
-			// NOTE: This assumes the given obj file contains
-			//  vertex positions, uv coordinates AND normals.
-			unsigned int i[12];
-			int numbersRead = sscanf_s(
-				chars,
-				"f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d",
-				&i[0], &i[1], &i[2],
-				&i[3], &i[4], &i[5],
-				&i[6], &i[7], &i[8],
-				&i[9], &i[10], &i[11]);
-
-			// If we only got the first number, chances are the OBJ
-			// file has no UV coordinates.  This isn't great, but we
-			// still want to load the model without crashing, so we
-			// need to re-read a different pattern (in which we assume
-			// there are no UVs denoted for any of the vertices)
-			if (numbersRead == 1)
-			{
-				// Re-read with a different pattern
-				numbersRead = sscanf_s(
-					chars,
-					"f %d//%d %d//%d %d//%d %d//%d",
-					&i[0], &i[2],
-					&i[3], &i[5],
-					&i[6], &i[8],
-					&i[9], &i[11]);
-
-				// The following indices are where the UVs should 
-				// have been, so give them a valid value
-				i[1] = 1;
-				i[4] = 1;
-				i[7] = 1;
-				i[10] = 1;
-
-				// If we have no UVs, create a single UV coordinate
-				// that will be used for all vertices
-				if (uvs.size() == 0)
-					uvs.push_back(DirectX::XMFLOAT2(0, 0));
-			}
+		// Calculate vectors relative to triangle positions
+		XMVECTOR x1 = XMVectorSubtract(p1.r[0], p0.r[0]);
+		XMVECTOR y1 = XMVectorSubtract(p1.r[1], p0.r[1]);
+		XMVECTOR z1 = XMVectorSubtract(p1.r[2], p0.r[2]);
+		XMVECTOR x2 = XMVectorSubtract(p2.r[0], p0.r[0]);
+		XMVECTOR y2 = XMVectorSubtract(p2.r[1], p0.r[1]);
+		XMVECTOR z2 = XMVectorSubtract(p2.r[2], p0.r[2]);
 
-			// - Create the verts by looking up
-			//    corresponding data from vectors
-			// - OBJ File indices are 1-based, so
-			//    they need to be adusted
-			Vertex v1;
-			v1.Position = positions[i[0] - 1];
-			v1.UV = uvs[i[1] - 1];
-			v1.Normal = normals[i[2] - 1];
-
-			Vertex v2;
-			v2.Position = positions[i[3] - 1];
-			v2.UV = uvs[i[4] - 1];
-			v2.Normal = normals[i[5] - 1];
-
-			Vertex v3;
-			v3.Position = positions[i[6] - 1];
-			v3.UV = uvs[i[7] - 1];
-			v3.Normal = normals[i[8] - 1];
-
-			// Flip the UV's since they're probably "upside down"
-			v1.UV.y = 1.0f - v1.UV.y;
-			v2.UV.y = 1.0f - v2.UV.y;
-			v3.UV.y = 1.0f - v3.UV.y;
-
-			// Flip Z (LH vs. RH)
-			v1.Position.z *= -1.0f;
-			v2.Position.z *= -1.0f;
-			v3.Position.z *= -1.0f;
-
-			// Flip normal's Z
-			v1.Normal.z *= -1.0f;
-			v2.Normal.z *= -1.0f;
-			v3.Normal.z *= -1.0f;
-
-			// Add the verts to the vector (flipping the winding order)
-			verts.push_back(v1);
-			verts.push_back(v3);
-			verts.push_back(v2);
-			vertCounter += 3;
-
-			// Add three more indices
-			indices.push_back(indexCounter); indexCounter += 1;
-			indices.push_back(indexCounter); indexCounter += 1;
-			indices.push_back(indexCounter); indexCounter += 1;
-
-			// Was there a 4th face?
-			// - 12 numbers read means 4 faces WITH uv's
-			// - 8 numbers read means 4 faces WITHOUT uv's
-			if (numbersRead == 12 || numbersRead == 8)
+		// Do the same for vectors relative to triangle uv's
+		XMVECTOR s1 = XMVectorSubtract(uv1.r[0], uv0.r[0]);
+		XMVECTOR t1 = XMVectorSubtract(uv1.r[1], uv0.r[1]);
+		XMVECTOR s2 = XMVectorSubtract(uv2.r[0], uv0.r[0]);
+		XMVECTOR t2 = XMVectorSubtract(uv2.r[1], uv0.r[1]);
+
+		XMVECTOR denominator = XMVectorSubtract(XMVectorMultiply(s1, t2), XMVectorMultiply(s2, t1));
+		XMVECTOR r = XMVectorSelect(XMVectorReciprocal(denominator), zero, XMVectorEqual(denominator, zero));
+
+		// Tangents (along u) and bitangents (along v) of all four triangles
+		XMMATRIX triTangents = XMMatrixTranspose(XMMATRIX(
+			XMVectorMultiply(XMVectorSubtract(XMVectorMultiply(t2, x1), XMVectorMultiply(t1, x2)), r),
+			XMVectorMultiply(XMVectorSubtract(XMVectorMultiply(t2, y1), XMVectorMultiply(t1, y2)), r),
+			XMVectorMultiply(XMVectorSubtract(XMVectorMultiply(t2, z1), XMVectorMultiply(t1, z2)), r),
+			zero));
+		XMMATRIX triBitangents = XMMatrixTranspose(XMMATRIX(
+			XMVectorMultiply(XMVectorSubtract(XMVectorMultiply(s1, x2), XMVectorMultiply(s2, x1)), r),
+			XMVectorMultiply(XMVectorSubtract(XMVectorMultiply(s1, y2), XMVectorMultiply(s2, y1)), r),
+			XMVectorMultiply(XMVectorSubtract(XMVectorMultiply(s1, z2), XMVectorMultiply(s2, z1)), r),
+			zero));
+
+		// Scatter them back out - row k is now triangle k's vector
+		for (int k = 0; k < 4; k++)
+		{
+			for (int c = 0; c < 3; c++)
 			{
-				// Make the last vertex
-				Vertex v4;
-				v4.Position = positions[i[9] - 1];
-				v4.UV = uvs[i[10] - 1];
-				v4.Normal = normals[i[11] - 1];
-
-				// Flip the UV, Z pos and normal's Z
-				v4.UV.y = 1.0f - v4.UV.y;
-				v4.Position.z *= -1.0f;
-				v4.Normal.z *= -1.0f;
-
-				// Add a whole triangle (flipping the winding order)
-				verts.push_back(v1);
-				verts.push_back(v4);
-				verts.push_back(v3);
-				vertCounter += 3;
-
-				// Add three more indices
-				indices.push_back(indexCounter); indexCounter += 1;
-				indices.push_back(indexCounter); indexCounter += 1;
-				indices.push_back(indexCounter); indexCounter += 1;
+				XMFLOAT4A* accumulator = &accumulators[tri[k * 3 + c] * 2];
+				XMStoreFloat4A(&accumulator[0], XMVectorAdd(XMLoadFloat4A(&accumulator[0]), triTangents.r[k]));
+				XMStoreFloat4A(&accumulator[1], XMVectorAdd(XMLoadFloat4A(&accumulator[1]), triBitangents.r[k]));
 			}
 		}
 	}
 
-	// Close the file and create the actual buffers
-	obj.close();
-
-	// Calculate Tangents
-	CalculateTangents(verts.data(), vertCounter, indices.data(), indexCounter);
-
-	// Sets Up The Vertex Buffer
-	// Creates the Vertex Buffer Description
-	D3D11_BUFFER_DESC vbd = {};
-	vbd.Usage = D3D11_USAGE_IMMUTABLE;
-	vbd.ByteWidth = sizeof(Vertex) * vertCounter;
-	vbd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-	vbd.CPUAccessFlags = 0;
-	vbd.MiscFlags = 0;
-	vbd.StructureByteStride = 0;
-
-	// Create struct to hold vertex data
-	D3D11_SUBRESOURCE_DATA initialVertexData = {};
-	initialVertexData.pSysMem = &verts[0];
-
-	// Create the Vertex Buffer with the appropriate data
-	_device->CreateBuffer(&vbd, &initialVertexData, vb.GetAddressOf());
+	// Leftover triangles
+	for (; t < lastTriangle; t++)
+	{
+		const unsigned int* tri = indices + t * 3;
 
+		XMVECTOR p0 = XMLoadFloat3(&verts[tri[0]].Position);
+		XMVECTOR e1 = XMVectorSubtract(XMLoadFloat3(&verts[tri[1]].Position), p0);
+		XMVECTOR e2 = XMVectorSubtract(XMLoadFloat3(&verts[tri[2]].Position), p0);
 
-	// Sets up the Index Buffer
-	// Creates the Index Buffer Description
-	D3D11_BUFFER_DESC ibd = {};
-	ibd.Usage = D3D11_USAGE_IMMUTABLE;
-	ibd.ByteWidth = sizeof(unsigned int) * indexCounter;
-	ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
-	ibd.CPUAccessFlags = 0;
-	ibd.MiscFlags = 0;
-	ibd.StructureByteStride = 0;
+		float s1 = verts[tri[1]].UV.x - verts[tri[0]].UV.x;
+		float t1 = verts[tri[1]].UV.y - verts[tri[0]].UV.y;
+		float s2 = verts[tri[2]].UV.x - verts[tri[0]].UV.x;
+		float t2 = verts[tri[2]].UV.y - verts[tri[0]].UV.y;
 
-	// Create struct to hold index data
-	D3D11_SUBRESOURCE_DATA initialIndexData = {};
-	initialIndexData.pSysMem = &indices[0];
+		float denominator = s1 * t2 - s2 * t1;
+		float r = denominator == 0.0f ? 0.0f : 1.0f / denominator;
 
-	// Create the Index Buffer with the appropriate data
-	_device->CreateBuffer(&ibd, &initialIndexData, ib.GetAddressOf());
+		XMVECTOR triTangent = XMVectorScale(XMVectorSubtract(XMVectorScale(e1, t2), XMVectorScale(e2, t1)), r);
+		XMVECTOR triBitangent = XMVectorScale(XMVectorSubtract(XMVectorScale(e2, s1), XMVectorScale(e1, s2)), r);
 
-	nIndicies = indexCounter;
+		for (int c = 0; c < 3; c++)
+		{
+			XMFLOAT4A* accumulator = &accumulators[tri[c] * 2];
+			XMStoreFloat4A(&accumulator[0], XMVectorAdd(XMLoadFloat4A(&accumulator[0]), triTangent));
+			XMStoreFloat4A(&accumulator[1], XMVectorAdd(XMLoadFloat4A(&accumulator[1]), triBitangent));
+		}
+	}
 }
 
-Mesh::~Mesh()
+// --------------------------------------------------------
+// Sums the accumulated vectors for vertices [firstVert,
+// lastVert), makes each tangent orthogonal to its normal
+// and stores the bitangent sign in the tangent's w
+//
+// - Four vertices are processed per iteration, one per
+//   SIMD lane, with leftovers handled one at a time
+// --------------------------------------------------------
+static void FinishTangents(Vertex* verts, int firstVert, int lastVert,
+	const std::vector<XMFLOAT4A*>& accumulators)
 {
+	XMVECTOR zero = XMVectorZero();
+	XMVECTOR one = XMVectorSplatOne();
+	XMVECTOR negativeOne = XMVectorNegate(one);
 
-}
+	int i = firstVert;
+	for (; i + 4 <= lastVert; i += 4)
+	{
+		// Sum each vertex's accumulators, then transpose so
+		// each row holds one component of all four vertices
+		XMMATRIX t, b;
+		for (int k = 0; k < 4; k++)
+		{
+			t.r[k] = XMLoadFloat4A(&accumulators[0][(i + k) * 2]);
+			b.r[k] = XMLoadFloat4A(&accumulators[0][(i + k) * 2 + 1]);
+			for (size_t a = 1; a < accumulators.size(); a++)
+			{
+				t.r[k] = XMVectorAdd(t.r[k], XMLoadFloat4A(&accumulators[a][(i + k) * 2]));
+				b.r[k] = XMVectorAdd(b.r[k], XMLoadFloat4A(&accumulators[a][(i + k) * 2 + 1]));
+			}
+		}
+		t = XMMatrixTranspose(t);
+		b = XMMatrixTranspose(b);
+		XMMATRIX n = XMMatrixTranspose(XMMATRIX(
+			XMLoadFloat3(&verts[i].Normal), XMLoadFloat3(&verts[i + 1].Normal),
+			XMLoadFloat3(&verts[i + 2].Normal), XMLoadFloat3(&verts[i + 3].Normal)));
 
-Microsoft::WRL::ComPtr<ID3D11Buffer> Mesh::GetVertexBuffer()
-{
-	return vb;
-}
+		// Use Gram-Schmidt orthonormalize to ensure
+		// the normal and tangent are exactly 90 degrees apart
+		XMVECTOR nDotT = XMVectorAdd(XMVectorAdd(
+			XMVectorMultiply(n.r[0], t.r[0]), XMVectorMultiply(n.r[1], t.r[1])), XMVectorMultiply(n.r[2], t.r[2]));
+		XMVECTOR tx = XMVectorSubtract(t.r[0], XMVectorMultiply(n.r[0], nDotT));
+		XMVECTOR ty = XMVectorSubtract(t.r[1], XMVectorMultiply(n.r[1], nDotT));
+		XMVECTOR tz = XMVectorSubtract(t.r[2], XMVectorMultiply(n.r[2], nDotT));
+
+		XMVECTOR length = XMVectorSqrt(XMVectorAdd(XMVectorAdd(
+			XMVectorMultiply(tx, tx), XMVectorMultiply(ty, ty)), XMVectorMultiply(tz, tz)));
+		XMVECTOR invLength = XMVectorSelect(XMVectorReciprocal(length), zero, XMVectorEqual(length, zero));
+		tx = XMVectorMultiply(tx, invLength);
+		ty = XMVectorMultiply(ty, invLength);
+		tz = XMVectorMultiply(tz, invLength);
+
+		// Mirrored uvs flip the bitangent relative to cross(N, T)
+		XMVECTOR cx = XMVectorSubtract(XMVectorMultiply(n.r[1], tz), XMVectorMultiply(n.r[2], ty));
+		XMVECTOR cy = XMVectorSubtract(XMVectorMultiply(n.r[2], tx), XMVectorMultiply(n.r[0], tz));
+		XMVECTOR cz = XMVectorSubtract(XMVectorMultiply(n.r[0], ty), XMVectorMultiply(n.r[1], tx));
+		XMVECTOR crossDotB = XMVectorAdd(XMVectorAdd(
+			XMVectorMultiply(cx, b.r[0]), XMVectorMultiply(cy, b.r[1])), XMVectorMultiply(cz, b.r[2]));
+		XMVECTOR handedness = XMVectorSelect(one, negativeOne, XMVectorLess(crossDotB, zero));
+
+		// Back to one tangent per row and store
+		XMMATRIX result = XMMatrixTranspose(XMMATRIX(tx, ty, tz, handedness));
+		for (int k = 0; k < 4; k++)
+		{
+			XMStoreFloat4(&verts[i + k].Tangent, result.r[k]);
+		}
+	}
 
-Microsoft::WRL::ComPtr<ID3D11Buffer> Mesh::GetIndexBuffer()
-{
-	return ib;
-}
+	// Leftover vertices
+	for (; i < lastVert; i++)
+	{
+		XMVECTOR tangent = XMVectorZero();
+		XMVECTOR bitangent = XMVectorZero();
+		for (size_t a = 0; a < accumulators.size(); a++)
+		{
+			tangent = XMVectorAdd(tangent, XMLoadFloat4A(&accumulators[a][i * 2]));
+			bitangent = XMVectorAdd(bitangent, XMLoadFloat4A(&accumulators[a][i * 2 + 1]));
+		}
 
-int Mesh::GetIndexCount()
-{
-	return nIndicies;
+		XMVECTOR normal = XMLoadFloat3(&verts[i].Normal);
+		tangent = XMVector3Normalize(
+			XMVectorSubtract(tangent, XMVectorMultiply(normal, XMVector3Dot(normal, tangent))));
+
+		float handedness = XMVectorGetX(XMVector3Dot(XMVector3Cross(normal, tangent), bitangent)) < 0.0f ? -1.0f : 1.0f;
+		XMStoreFloat4(&verts[i].Tangent, XMVectorSetW(tangent, handedness));
+	}
 }
 
 // --------------------------------------------------------
-// Author: Chris Cascioli
-// Purpose: Calculates the tangents of the vertices in a mesh
-// 
-// - You are allowed to directly copy/paste this into your code base
-//   for assignments, given that you clearly cite that this is not
-//   code of your own design.
-//
-// - Code originally adapted from: http://www.terathon.com/code/tangent.html
-//   - Updated version now found here: http://foundationsofgameenginedev.com/FGED2-sample.pdf
-//   - See listing 7.4 in section 7.5 (page 9 of the PDF)
+// Calculates the tangents of the vertices in a mesh
 //
-// - Note: For this code to work, your Vertex format must
-//         contain an XMFLOAT3 called Tangent
+// - Based on Chris Cascioli's version of Eric Lengyel's method:
+//   http://foundationsofgameenginedev.com/FGED2-sample.pdf
+//   (see listing 7.4 in section 7.5, page 9 of the PDF)
+// - Triangles are processed four at a time with SIMD
+// - Meshes with at least TangentThreadThreshold triangles
+//   are split across threads (unless threadCount says
+//   otherwise), each accumulating into its own arrays
+// - w holds the bitangent sign, so the shader can rebuild
+//   the bitangent as cross(T, N) * w even on mirrored uvs
 //
 // - Be sure to call this BEFORE creating your D3D vertex/index buffers
 // --------------------------------------------------------
-void Mesh::CalculateTangents(Vertex* verts, int numVerts, unsigned int* indices, int numIndices)
+void Mesh::CalculateTangents(Vertex* verts, int numVerts, const unsigned int* indices, int numIndices, unsigned int threadCount)
 {
-	// Reset tangents
-	for (int i = 0; i < numVerts; i++)
-	{
-		verts[i].Tangent = DirectX::XMFLOAT3(0, 0, 0);
-	}
+	int numTriangles = numIndices / 3;
 
-	// Calculate tangents one whole triangle at a time
-	for (int i = 0; i < numIndices;)
+	if (threadCount == 0)
 	{
-		// Grab indices and vertices of first triangle
-		unsigned int i1 = indices[i++];
-		unsigned int i2 = indices[i++];
-		unsigned int i3 = indices[i++];
-		Vertex* v1 = &verts[i1];
-		Vertex* v2 = &verts[i2];
-		Vertex* v3 = &verts[i3];
-
-		// Calculate vectors relative to triangle positions
-		float x1 = v2->Position.x - v1->Position.x;
-		float y1 = v2->Position.y - v1->Position.y;
-		float z1 = v2->Position.z - v1->Position.z;
-
-		float x2 = v3->Position.x - v1->Position.x;
-		float y2 = v3->Position.y - v1->Position.y;
-		float z2 = v3->Position.z - v1->Position.z;
-
-		// Do the same for vectors relative to triangle uv's
-		float s1 = v2->UV.x - v1->UV.x;
-		float t1 = v2->UV.y - v1->UV.y;
-
-		float s2 = v3->UV.x - v1->UV.x;
-		float t2 = v3->UV.y - v1->UV.y;
-
-		// Create vectors for tangent calculation
-		float r = 1.0f / (s1 * t2 - s2 * t1);
-
-		float tx = (t2 * x1 - t1 * x2) * r;
-		float ty = (t2 * y1 - t1 * y2) * r;
-		float tz = (t2 * z1 - t1 * z2) * r;
-
-		// Adjust tangents of each vert of the triangle
-		v1->Tangent.x += tx;
-		v1->Tangent.y += ty;
-		v1->Tangent.z += tz;
+		threadCount = numTriangles >= TangentThreadThreshold ? std::thread::hardware_concurrency() : 1;
+	}
 
-		v2->Tangent.x += tx;
-		v2->Tangent.y += ty;
-		v2->Tangent.z += tz;
+	// Each thread needs its own accumulators, so cap the extra memory
+	if (threadCount > MaxTangentThreads) threadCount = MaxTangentThreads;
+	if (threadCount < 1) threadCount = 1;
 
-		v3->Tangent.x += tx;
-		v3->Tangent.y += ty;
-		v3->Tangent.z += tz;
+	// One set of zeroed accumulators per thread, holding
+	// each vertex's tangent and bitangent side by side
+	std::vector<XMFLOAT4A> storage((size_t)numVerts * threadCount * 2, XMFLOAT4A(0, 0, 0, 0));
+	std::vector<XMFLOAT4A*> accumulators(threadCount);
+	for (unsigned int i = 0; i < threadCount; i++)
+	{
+		accumulators[i] = storage.data() + (size_t)numVerts * i * 2;
 	}
 
-	// Ensure all of the tangents are orthogonal to the normals
-	for (int i = 0; i < numVerts; i++)
+	if (threadCount == 1)
 	{
-		// Grab the two vectors
-		DirectX::XMVECTOR normal = XMLoadFloat3(&verts[i].Normal);
-		DirectX::XMVECTOR tangent = XMLoadFloat3(&verts[i].Tangent);
-
-		// Use Gram-Schmidt orthonormalize to ensure
-		// the normal and tangent are exactly 90 degrees apart
-		tangent = DirectX::XMVector3Normalize(
-			DirectX::XMVectorSubtract(tangent, DirectX::XMVectorMultiply(normal, DirectX::XMVector3Dot(normal, tangent))));
+		AccumulateTangents(verts, indices, 0, numTriangles, accumulators[0]);
+		FinishTangents(verts, 0, numVerts, accumulators);
+		return;
+	}
 
-		DirectX::XMVectorSubtract(tangent, DirectX::XMVectorMultiply(normal, DirectX::XMVector3Dot(normal, tangent)));
+	// Each thread takes a slice of the triangles...
+	std::vector<std::thread> threads;
+	for (unsigned int i = 0; i < threadCount; i++)
+	{
+		threads.push_back(std::thread([&, i]()
+		{
+			AccumulateTangents(verts, indices,
+				(int)((long long)numTriangles * i / threadCount),
+				(int)((long long)numTriangles * (i + 1) / threadCount),
+				accumulators[i]);
+		}));
+	}
+	for (std::thread& thread : threads) thread.join();
+	threads.clear();
 
-		// Store the tangent
-		DirectX::XMStoreFloat3(&verts[i].Tangent, tangent);
+	// ...and then a slice of the vertices to finish
+	for (unsigned int i = 0; i < threadCount; i++)
+	{
+		threads.push_back(std::thread([&, i]()
+		{
+			FinishTangents(verts,
+				(int)((long long)numVerts * i / threadCount),
+				(int)((long long)numVerts * (i + 1) / threadCount),
+				accumulators);
+		}));
 	}
+	for (std::thread& thread : threads) thread.join();
 }
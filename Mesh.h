@@ -2,7 +2,32 @@
 
 #include <d3d11.h>
 #include <wrl/client.h>
+#include <memory>
 #include "Vertex.h"
+#include "MeshData.h"
+#include "MappedFile.h"
+
+// --------------------------------------------------------
+// Everything needed to create a mesh's GPU buffers, read
+// from disk without touching the device (so it can be
+// produced on any thread)
+//
+// - Vertices/Indices point either into a mapped cache
+//   file or into Parsed, so keep this alive (and don't
+//   copy it) until the buffers have been created
+// --------------------------------------------------------
+struct MeshSource
+{
+	std::unique_ptr<MappedFile> CacheFile;
+	MeshData Parsed;
+
+	const Vertex* Vertices = 0;
+	const unsigned int* Indices = 0;
+	int VertexCount = 0;
+	int IndexCount = 0;
+	DirectX::XMFLOAT3 BoundsMin = DirectX::XMFLOAT3(0, 0, 0);
+	DirectX::XMFLOAT3 BoundsMax = DirectX::XMFLOAT3(0, 0, 0);
+};
 
 class Mesh
 {
@@ -11,20 +36,48 @@ public:
 		Microsoft::WRL::ComPtr<ID3D11Device> _device,
 		Microsoft::WRL::ComPtr<ID3D11DeviceContext> _context);
 	Mesh(const char* objFile, Microsoft::WRL::ComPtr<ID3D11Device> _device);
+	Mesh(const MeshSource& source, Microsoft::WRL::ComPtr<ID3D11Device> _device);
 	~Mesh();
 
 	Microsoft::WRL::ComPtr<ID3D11Buffer> GetVertexBuffer();
 	Microsoft::WRL::ComPtr<ID3D11Buffer> GetIndexBuffer();
 	int GetIndexCount();
+	int GetVertexCount();
+	size_t GetBufferSize();
+	DirectX::XMFLOAT3 GetBoundsMin();
+	DirectX::XMFLOAT3 GetBoundsMax();
+	float GetBoundingRadius();
+
+	// When false, .obj files are always parsed and no
+	// .meshcache files are read or written
+	static bool UseBinaryCache;
+
+	// Reads an .obj (or its cache) into memory, ready for the
+	// constructor above - safe to call from any thread
+	static bool LoadSource(const char* objFile, MeshSource& source);
+
+	// Fills in each vertex's tangent (xyz) and bitangent sign (w)
+	// - threadCount of 0 only uses extra threads for very large meshes
+	static void CalculateTangents(Vertex* verts, int numVerts, const unsigned int* indices, int numIndices, unsigned int threadCount = 0);
+
+	// Radius of the sphere around the bounding box's center that holds
+	// every vertex, which is often much tighter than the box's corners
+	static float CalculateBoundingRadius(const Vertex* verts, int numVerts, DirectX::XMFLOAT3 boundsMin, DirectX::XMFLOAT3 boundsMax);
 
 private:
 	Microsoft::WRL::ComPtr<ID3D11Buffer> vb;
 	Microsoft::WRL::ComPtr<ID3D11Buffer> ib;
 	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
 
-	// number of indicies
+	// number of vertices and indicies
+	int nVertices;
 	int nIndicies;
 
-	void CalculateTangents(Vertex* verts, int numVerts, unsigned int* indices, int numIndices);
+	// Object space bounding box
+	DirectX::XMFLOAT3 boundsMin;
+	DirectX::XMFLOAT3 boundsMax;
+	float boundingRadius;
+
+	void CreateBuffers(const Vertex* verts, int numVerts, const unsigned int* indices, int numIndices, ID3D11Device* device);
 
 };
@@ -0,0 +1,118 @@
+#include "MeshCache.h"
+#include <fstream>
+#include <cstdio>
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// The cache lives right next to the source file
+// --------------------------------------------------------
+std::string MeshCache::GetCachePath(const char* sourceFile)
+{
+	return std::string(sourceFile) + ".meshcache";
+}
+
+// --------------------------------------------------------
+// 64-bit FNV-1a hash of a block of memory
+// --------------------------------------------------------
+unsigned long long MeshCache::Hash(const unsigned char* data, size_t size)
+{
+	unsigned long long hash = 14695981039346656037ull;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= data[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+// --------------------------------------------------------
+// Finds the object space bounding box of the given vertices
+// --------------------------------------------------------
+void MeshCache::CalculateBounds(const Vertex* verts, int numVerts, XMFLOAT3& boundsMin, XMFLOAT3& boundsMax)
+{
+	if (numVerts <= 0)
+	{
+		boundsMin = XMFLOAT3(0, 0, 0);
+		boundsMax = XMFLOAT3(0, 0, 0);
+		return;
+	}
+
+	XMVECTOR minV = XMLoadFloat3(&verts[0].Position);
+	XMVECTOR maxV = minV;
+	for (int i = 1; i < numVerts; i++)
+	{
+		XMVECTOR pos = XMLoadFloat3(&verts[i].Position);
+		minV = XMVectorMin(minV, pos);
+		maxV = XMVectorMax(maxV, pos);
+	}
+
+	XMStoreFloat3(&boundsMin, minV);
+	XMStoreFloat3(&boundsMax, maxV);
+}
+
+// --------------------------------------------------------
+// Validates a mapped cache file and points the view at
+// its vertex and index blocks
+//
+// Returns false if the file is missing, truncated, from an
+// older version or built from a different source file
+// --------------------------------------------------------
+bool MeshCache::Open(MappedFile& cacheFile, unsigned long long sourceHash, MeshCacheView& view)
+{
+	if (!cacheFile.IsValid() || cacheFile.GetSize() < sizeof(MeshCacheHeader))
+		return false;
+
+	const MeshCacheHeader* header = (const MeshCacheHeader*)cacheFile.GetData();
+	if (header->Magic != Magic ||
+		header->Version != Version ||
+		header->SourceHash != sourceHash ||
+		header->VertexStride != sizeof(Vertex) ||
+		!(header->Flags & MESH_CACHE_HAS_TANGENTS))
+		return false;
+
+	// The blocks must exactly fill the rest of the file
+	size_t expectedSize = sizeof(MeshCacheHeader) +
+		(size_t)header->VertexCount * sizeof(Vertex) +
+		(size_t)header->IndexCount * sizeof(unsigned int);
+	if (cacheFile.GetSize() != expectedSize || header->VertexCount == 0 || header->IndexCount == 0)
+		return false;
+
+	view.Header = header;
+	view.Vertices = (const Vertex*)(cacheFile.GetData() + sizeof(MeshCacheHeader));
+	view.Indices = (const unsigned int*)(view.Vertices + header->VertexCount);
+	return true;
+}
+
+// --------------------------------------------------------
+// Writes a cache file for fully processed mesh data
+// (welded, with tangents already calculated)
+// --------------------------------------------------------
+bool MeshCache::Write(const char* cachePath, unsigned long long sourceHash, const MeshData& meshData,
+	XMFLOAT3 boundsMin, XMFLOAT3 boundsMax)
+{
+	MeshCacheHeader header = {};
+	header.Magic = Magic;
+	header.Version = Version;
+	header.SourceHash = sourceHash;
+	header.VertexStride = sizeof(Vertex);
+	header.VertexCount = (unsigned int)meshData.Vertices.size();
+	header.IndexCount = (unsigned int)meshData.Indices.size();
+	header.Flags = MESH_CACHE_HAS_TANGENTS;
+	header.BoundsMin = boundsMin;
+	header.BoundsMax = boundsMax;
+
+	std::ofstream out(cachePath, std::ios::binary | std::ios::trunc);
+	if (!out.is_open())
+	{
+#if defined(DEBUG) || defined(_DEBUG)
+		printf("Unable to write mesh cache '%s'\n", cachePath);
+#endif
+		return false;
+	}
+
+	out.write((const char*)&header, sizeof(header));
+	out.write((const char*)meshData.Vertices.data(), sizeof(Vertex) * meshData.Vertices.size());
+	out.write((const char*)meshData.Indices.data(), sizeof(unsigned int) * meshData.Indices.size());
+	return out.good();
+}
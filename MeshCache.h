@@ -0,0 +1,67 @@
+#pragma once
+
+#include <string>
+#include <DirectXMath.h>
+#include "MappedFile.h"
+#include "MeshData.h"
+
+// Flags stored in MeshCacheHeader::Flags
+#define MESH_CACHE_HAS_TANGENTS 0x1
+
+// --------------------------------------------------------
+// On-disk header of a cached mesh
+//
+// The file is laid out as:
+//   [MeshCacheHeader][Vertex * VertexCount][unsigned int * IndexCount]
+// --------------------------------------------------------
+struct MeshCacheHeader
+{
+	unsigned int Magic;				// Always MeshCache::Magic
+	unsigned int Version;			// Bumped whenever this layout or Vertex changes
+	unsigned long long SourceHash;	// Hash of the source .obj this was built from
+	unsigned int VertexStride;		// sizeof(Vertex) when the file was written
+	unsigned int VertexCount;
+	unsigned int IndexCount;
+	unsigned int Flags;
+	DirectX::XMFLOAT3 BoundsMin;	// Object space bounding box
+	DirectX::XMFLOAT3 BoundsMax;
+	unsigned int Reserved[2];		// Keeps the vertex block 16 byte aligned
+};
+
+static_assert(sizeof(MeshCacheHeader) == 64, "MeshCacheHeader must stay 64 bytes");
+
+// --------------------------------------------------------
+// Pointers into a mapped cache file, ready to be handed
+// straight to D3D11_SUBRESOURCE_DATA
+// --------------------------------------------------------
+struct MeshCacheView
+{
+	const MeshCacheHeader* Header;
+	const Vertex* Vertices;
+	const unsigned int* Indices;
+};
+
+// --------------------------------------------------------
+// Binary mesh cache
+//
+// - The first load of a .obj writes a ".meshcache" file
+//   next to it, with welded vertices, tangents and bounds
+// - Later loads memory map that file and upload from it
+//   directly, skipping parsing and tangent generation
+// - Caches are keyed on a hash of the source file, so
+//   editing the .obj rebuilds its cache automatically
+// --------------------------------------------------------
+class MeshCache
+{
+public:
+	static const unsigned int Magic = 0x4853454D; // "MESH"
+	static const unsigned int Version = 2;
+
+	static std::string GetCachePath(const char* sourceFile);
+	static unsigned long long Hash(const unsigned char* data, size_t size);
+	static void CalculateBounds(const Vertex* verts, int numVerts, DirectX::XMFLOAT3& boundsMin, DirectX::XMFLOAT3& boundsMax);
+
+	static bool Open(MappedFile& cacheFile, unsigned long long sourceHash, MeshCacheView& view);
+	static bool Write(const char* cachePath, unsigned long long sourceHash, const MeshData& meshData,
+		DirectX::XMFLOAT3 boundsMin, DirectX::XMFLOAT3 boundsMax);
+};
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <vector>
+#include "Vertex.h"
+
+// --------------------------------------------------------
+// CPU-side copy of a mesh's geometry, ready to be
+// uploaded into vertex and index buffers
+// --------------------------------------------------------
+struct MeshData
+{
+	std::vector<Vertex> Vertices;
+	std::vector<unsigned int> Indices;
+};
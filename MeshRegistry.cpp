@@ -0,0 +1,134 @@
+#include "MeshRegistry.h"
+#include <chrono>
+#include <cstdio>
+
+MeshRegistry::MeshRegistry(Microsoft::WRL::ComPtr<ID3D11Device> device)
+{
+	this->device = device;
+}
+
+MeshRegistry::~MeshRegistry()
+{
+}
+
+// --------------------------------------------------------
+// Returns the mesh for the given file, loading it only if
+// it isn't already loaded (or being loaded)
+// --------------------------------------------------------
+std::shared_ptr<Mesh> MeshRegistry::Load(const std::string& path)
+{
+	std::promise<std::shared_ptr<Mesh>> promise;
+	std::shared_future<std::shared_ptr<Mesh>> mesh;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		// Already loaded, or in flight on another thread?
+		auto existing = meshes.find(path);
+		if (existing != meshes.end())
+			mesh = existing->second;
+		else
+			meshes[path] = promise.get_future().share();
+	}
+
+	// Wait for whoever is loading it
+	if (mesh.valid())
+		return mesh.get();
+
+	// We're first, so do the load outside of the lock
+	std::shared_ptr<Mesh> loaded = std::make_shared<Mesh>(path.c_str(), device);
+	promise.set_value(loaded);
+	return loaded;
+}
+
+std::shared_ptr<Mesh> MeshRegistry::Add(const std::string& path, std::shared_ptr<Mesh> mesh)
+{
+	std::shared_future<std::shared_ptr<Mesh>> existing;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		auto entry = meshes.find(path);
+		if (entry == meshes.end())
+		{
+			std::promise<std::shared_ptr<Mesh>> promise;
+			promise.set_value(mesh);
+			meshes[path] = promise.get_future().share();
+			return mesh;
+		}
+
+		existing = entry->second;
+	}
+
+	// Someone else got there first
+	return existing.get();
+}
+
+// --------------------------------------------------------
+// Drops the registry's reference to any mesh that has no
+// other owners, which releases its GPU buffers
+// --------------------------------------------------------
+int MeshRegistry::EvictUnused()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	int evicted = 0;
+	for (auto it = meshes.begin(); it != meshes.end();)
+	{
+		// The future holds the registry's one reference
+		if (IsLoaded(it->second) && it->second.get().use_count() == 1)
+		{
+			it = meshes.erase(it);
+			evicted++;
+		}
+		else
+		{
+			it++;
+		}
+	}
+
+	return evicted;
+}
+
+size_t MeshRegistry::GetResidentBytes()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	size_t bytes = 0;
+	for (auto& entry : meshes)
+	{
+		if (IsLoaded(entry.second))
+			bytes += entry.second.get()->GetBufferSize();
+	}
+
+	return bytes;
+}
+
+void MeshRegistry::ReportMemory()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	printf("\n--- Resident meshes ---\n");
+	size_t total = 0;
+	for (auto& entry : meshes)
+	{
+		if (!IsLoaded(entry.second))
+		{
+			printf("%10s        (loading)  %s\n", "", entry.first.c_str());
+			continue;
+		}
+
+		std::shared_ptr<Mesh> mesh = entry.second.get();
+		// Don't count the registry's reference or our local copy
+		printf("%10zu bytes  %3ld users  %s\n", mesh->GetBufferSize(), mesh.use_count() - 2, entry.first.c_str());
+		total += mesh->GetBufferSize();
+	}
+	printf("%10zu bytes in %zu meshes\n", total, meshes.size());
+}
+
+// --------------------------------------------------------
+// Has the load for this entry finished?
+// --------------------------------------------------------
+bool MeshRegistry::IsLoaded(const std::shared_future<std::shared_ptr<Mesh>>& mesh)
+{
+	return mesh.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
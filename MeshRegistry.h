@@ -0,0 +1,55 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "Mesh.h"
+
+// --------------------------------------------------------
+// Hands out shared handles to meshes, keyed by file path
+//
+// - Each file is loaded (and uploaded to the GPU) once, no
+//   matter how many entities use it
+// - Load() is thread safe; if a file is already being
+//   loaded on another thread, callers wait for that load
+//   instead of starting their own
+// - The registry keeps one reference to every mesh, so a
+//   mesh whose only remaining reference is the registry's
+//   is unused and can be evicted with EvictUnused()
+// --------------------------------------------------------
+class MeshRegistry
+{
+public:
+	MeshRegistry(Microsoft::WRL::ComPtr<ID3D11Device> device);
+	~MeshRegistry();
+
+	std::shared_ptr<Mesh> Load(const std::string& path);
+
+	// Registers a mesh that was loaded elsewhere (see AssetLoader)
+	// - Returns the already registered mesh instead if there is one
+	std::shared_ptr<Mesh> Add(const std::string& path, std::shared_ptr<Mesh> mesh);
+
+	// Releases every mesh that nothing outside the registry is using
+	// - Returns the number of meshes that were evicted
+	int EvictUnused();
+
+	// GPU buffer memory used by all loaded meshes, in bytes
+	size_t GetResidentBytes();
+
+	// Prints each mesh's buffer size and reference count to the console
+	void ReportMemory();
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+
+	// Entries are added before their load finishes, so
+	// concurrent requests for the same path share one load
+	std::mutex mutex;
+	std::unordered_map<std::string, std::shared_future<std::shared_ptr<Mesh>>> meshes;
+
+	static bool IsLoaded(const std::shared_future<std::shared_ptr<Mesh>>& mesh);
+};
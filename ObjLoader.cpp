@@ -0,0 +1,353 @@
+#include "ObjLoader.h"
+#include <fstream>
+#include <cmath>
+#include <unordered_map>
+#include <DirectXMath.h>
+
+using namespace DirectX;
+
+// Exactly representable powers of ten for fast float parsing
+static const double PowersOf10[] =
+{
+	1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+	1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+	1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Helpers for walking the text buffer
+static inline bool IsSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+static inline bool IsDigit(char c) { return c >= '0' && c <= '9'; }
+
+static const char* SkipSpaces(const char* p, const char* end)
+{
+	while (p < end && IsSpace(*p)) p++;
+	return p;
+}
+
+static const char* SkipLine(const char* p, const char* end)
+{
+	while (p < end && *p != '\n') p++;
+	return p < end ? p + 1 : end;
+}
+
+// --------------------------------------------------------
+// Parses a (possibly signed) integer
+//
+// Returns the position after the number, or null if
+// there were no digits to read
+// --------------------------------------------------------
+static const char* ParseInt(const char* p, const char* end, int& out)
+{
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+	{
+		negative = *p == '-';
+		p++;
+	}
+
+	if (p >= end || !IsDigit(*p))
+		return 0;
+
+	int value = 0;
+	while (p < end && IsDigit(*p))
+	{
+		value = value * 10 + (*p - '0');
+		p++;
+	}
+
+	out = negative ? -value : value;
+	return p;
+}
+
+// --------------------------------------------------------
+// Locale-free float parser
+//
+// - Up to 19 significant digits are gathered into an integer
+//   mantissa, which is then scaled by a power of ten
+// - Missing numbers are read as zero so short lines still load
+// --------------------------------------------------------
+static const char* ParseFloat(const char* p, const char* end, float& out)
+{
+	p = SkipSpaces(p, end);
+
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+	{
+		negative = *p == '-';
+		p++;
+	}
+
+	unsigned long long mantissa = 0;
+	int digits = 0;
+	int exponent = 0;
+
+	// Whole part
+	while (p < end && IsDigit(*p))
+	{
+		if (digits < 19)
+		{
+			mantissa = mantissa * 10 + (*p - '0');
+			if (mantissa) digits++;
+		}
+		else
+		{
+			exponent++;
+		}
+		p++;
+	}
+
+	// Fractional part
+	if (p < end && *p == '.')
+	{
+		p++;
+		while (p < end && IsDigit(*p))
+		{
+			if (digits < 19)
+			{
+				mantissa = mantissa * 10 + (*p - '0');
+				if (mantissa) digits++;
+				exponent--;
+			}
+			p++;
+		}
+	}
+
+	// Exponent
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		int e = 0;
+		const char* afterExponent = ParseInt(p + 1, end, e);
+		if (afterExponent)
+		{
+			exponent += e;
+			p = afterExponent;
+		}
+	}
+
+	// Scale the mantissa
+	double value = (double)mantissa;
+	int absExponent = exponent < 0 ? -exponent : exponent;
+	double scale = absExponent <= 22 ? PowersOf10[absExponent] : pow(10.0, absExponent);
+	value = exponent < 0 ? value / scale : value * scale;
+
+	out = (float)(negative ? -value : value);
+	return p;
+}
+
+// --------------------------------------------------------
+// Parses one face corner: "v", "v/vt", "v//vn" or "v/vt/vn"
+//
+// Indices are left as written in the file (1-based, or
+// negative for relative indices); missing ones are zero
+// --------------------------------------------------------
+static const char* ParseCorner(const char* p, const char* end, int& v, int& t, int& n)
+{
+	t = 0;
+	n = 0;
+
+	p = ParseInt(p, end, v);
+	if (!p) return 0;
+
+	if (p < end && *p == '/')
+	{
+		p++;
+		if (p < end && *p != '/')
+		{
+			p = ParseInt(p, end, t);
+			if (!p) return 0;
+		}
+
+		if (p < end && *p == '/')
+		{
+			p = ParseInt(p + 1, end, n);
+			if (!p) return 0;
+		}
+	}
+
+	return p;
+}
+
+// --------------------------------------------------------
+// Converts an OBJ index into a 1-based index, resolving
+// negative (relative) indices against the current count
+//
+// Returns 0 if the index is missing or out of range
+// --------------------------------------------------------
+static unsigned int ResolveIndex(int index, size_t count)
+{
+	if (index < 0)
+		index = (int)count + index + 1;
+
+	if (index <= 0 || (size_t)index > count)
+		return 0;
+
+	return (unsigned int)index;
+}
+
+// --------------------------------------------------------
+// Reads the whole file in one block and parses it
+// --------------------------------------------------------
+bool ObjLoader::Load(const char* objFile, MeshData& meshData)
+{
+	std::ifstream obj(objFile, std::ios::binary | std::ios::ate);
+	if (!obj.is_open())
+		return false;
+
+	// Grab the entire file at once
+	std::streamsize size = obj.tellg();
+	if (size <= 0)
+		return false;
+
+	std::vector<char> text((size_t)size);
+	obj.seekg(0, std::ios::beg);
+	if (!obj.read(text.data(), size))
+		return false;
+
+	return Parse(text.data(), text.size(), meshData);
+}
+
+// --------------------------------------------------------
+// Parses .OBJ text that is already in memory
+// --------------------------------------------------------
+bool ObjLoader::Parse(const char* text, size_t length, MeshData& meshData)
+{
+	std::vector<XMFLOAT3> positions;	// Positions from the file
+	std::vector<XMFLOAT3> normals;		// Normals from the file
+	std::vector<XMFLOAT2> uvs;			// UVs from the file
+	std::vector<unsigned int> corners;	// Welded verts of the current face
+	std::vector<bool> needsNormal;		// Verts whose face didn't specify a normal
+
+	std::vector<Vertex>& verts = meshData.Vertices;
+	std::vector<unsigned int>& indices = meshData.Indices;
+	verts.clear();
+	indices.clear();
+
+	// Maps each unique position/uv/normal triple to the index of its welded vertex
+	std::unordered_map<ObjVertexKey, unsigned int, ObjVertexKeyHash> vertexLookup;
+
+	const char* p = text;
+	const char* end = text + length;
+	while (p < end)
+	{
+		p = SkipSpaces(p, end);
+		if (p + 1 >= end)
+			break;
+
+		if (p[0] == 'v' && IsSpace(p[1]))
+		{
+			XMFLOAT3 pos;
+			p = ParseFloat(p + 2, end, pos.x);
+			p = ParseFloat(p, end, pos.y);
+			p = ParseFloat(p, end, pos.z);
+			positions.push_back(pos);
+		}
+		else if (p[0] == 'v' && p[1] == 't')
+		{
+			XMFLOAT2 uv;
+			p = ParseFloat(p + 2, end, uv.x);
+			p = ParseFloat(p, end, uv.y);
+			uvs.push_back(uv);
+		}
+		else if (p[0] == 'v' && p[1] == 'n')
+		{
+			XMFLOAT3 norm;
+			p = ParseFloat(p + 2, end, norm.x);
+			p = ParseFloat(p, end, norm.y);
+			p = ParseFloat(p, end, norm.z);
+			normals.push_back(norm);
+		}
+		else if (p[0] == 'f' && IsSpace(p[1]))
+		{
+			// Gather every corner of this face, however many there are
+			corners.clear();
+			p++;
+			while (true)
+			{
+				p = SkipSpaces(p, end);
+				if (p >= end || *p == '\n' || *p == '#')
+					break;
+
+				int v, t, n;
+				p = ParseCorner(p, end, v, t, n);
+				if (!p)
+					return false;
+
+				// A missing uv or normal resolves to index 0
+				ObjVertexKey key;
+				key.Position = ResolveIndex(v, positions.size());
+				key.UV = ResolveIndex(t, uvs.size());
+				key.Normal = ResolveIndex(n, normals.size());
+				if (key.Position == 0 || (t != 0 && key.UV == 0) || (n != 0 && key.Normal == 0))
+					return false;
+
+				// Find (or create) the welded vertex for this corner
+				auto existing = vertexLookup.find(key);
+				if (existing != vertexLookup.end())
+				{
+					corners.push_back(existing->second);
+					continue;
+				}
+
+				Vertex vert;
+				vert.Position = positions[key.Position - 1];
+				vert.UV = key.UV ? uvs[key.UV - 1] : XMFLOAT2(0, 0);
+				vert.Normal = key.Normal ? normals[key.Normal - 1] : XMFLOAT3(0, 0, 0);
+				vert.Tangent = XMFLOAT4(0, 0, 0, 1);
+
+				// Flip the UV's since they're probably "upside down"
+				vert.UV.y = 1.0f - vert.UV.y;
+
+				// Flip Z (LH vs. RH)
+				vert.Position.z *= -1.0f;
+				vert.Normal.z *= -1.0f;
+
+				unsigned int index = (unsigned int)verts.size();
+				verts.push_back(vert);
+				needsNormal.push_back(key.Normal == 0);
+				vertexLookup.insert({ key, index });
+				corners.push_back(index);
+			}
+
+			// Fan triangulate the face (flipping the winding order)
+			for (size_t c = 1; c + 1 < corners.size(); c++)
+			{
+				indices.push_back(corners[0]);
+				indices.push_back(corners[c + 1]);
+				indices.push_back(corners[c]);
+			}
+
+			// Don't skip the line we just finished
+			continue;
+		}
+
+		// Anything else (comments, groups, materials) is skipped
+		p = SkipLine(p, end);
+	}
+
+	// Generate smooth normals for any corners the file didn't provide them for
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		unsigned int tri[3] = { indices[i], indices[i + 1], indices[i + 2] };
+		if (!needsNormal[tri[0]] && !needsNormal[tri[1]] && !needsNormal[tri[2]])
+			continue;
+
+		XMVECTOR p0 = XMLoadFloat3(&verts[tri[0]].Position);
+		XMVECTOR faceNormal = XMVector3Cross(
+			XMVectorSubtract(XMLoadFloat3(&verts[tri[1]].Position), p0),
+			XMVectorSubtract(XMLoadFloat3(&verts[tri[2]].Position), p0));
+
+		for (unsigned int v : tri)
+		{
+			if (needsNormal[v])
+				XMStoreFloat3(&verts[v].Normal, XMVectorAdd(XMLoadFloat3(&verts[v].Normal), faceNormal));
+		}
+	}
+
+	for (size_t v = 0; v < verts.size(); v++)
+	{
+		if (needsNormal[v])
+			XMStoreFloat3(&verts[v].Normal, XMVector3Normalize(XMLoadFloat3(&verts[v].Normal)));
+	}
+
+	return !verts.empty() && !indices.empty();
+}
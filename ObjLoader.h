@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include "MeshData.h"
+
+// --------------------------------------------------------
+// Identifies one unique corner of an OBJ face by the
+// (1-based) position, uv and normal indices it references
+// --------------------------------------------------------
+struct ObjVertexKey
+{
+	unsigned int Position;
+	unsigned int UV;
+	unsigned int Normal;
+
+	bool operator==(const ObjVertexKey& other) const
+	{
+		return Position == other.Position && UV == other.UV && Normal == other.Normal;
+	}
+};
+
+// Hash for ObjVertexKey so it can be used in an unordered_map
+struct ObjVertexKeyHash
+{
+	size_t operator()(const ObjVertexKey& key) const
+	{
+		size_t hash = key.Position;
+		hash = hash * 73856093u ^ key.UV;
+		hash = hash * 19349663u ^ key.Normal;
+		return hash;
+	}
+};
+
+// --------------------------------------------------------
+// Fast .OBJ parser
+//
+// - Reads the whole file in one block and tokenizes it in
+//   place, so lines may be any length
+// - Numbers are parsed by hand (no locale, no sscanf)
+// - Supports n-gon faces (fan triangulated), negative
+//   (relative) indices and faces without uvs or normals
+// - Identical position/uv/normal corners are welded into
+//   a single vertex
+// - Output is converted to a left-handed coordinate system
+//   with flipped V, matching the rest of the engine
+// --------------------------------------------------------
+class ObjLoader
+{
+public:
+	static bool Load(const char* objFile, MeshData& meshData);
+	static bool Parse(const char* text, size_t length, MeshData& meshData);
+};
@@ -1,26 +1,35 @@
 #include "ShaderIncludes.hlsli"
 
-cbuffer ExternalData : register(b0)
+// Texture2D SurfaceTexture	: register(t0); Non-PBR lighting
+#if defined(MATERIAL_ARRAY)
+// One entry per material in the array (MaterialArrayData on the C++ side),
+// with the slice each of its maps is in
+struct ArrayMaterial
 {
 	float4 colorTint;
-	float3 cameraPosition;
 	float roughness;
-	float3 cameraPos;
-	float3 ambientLight;
 	float uvScale;
 	float2 uvOffset;
-	Light dirLight1;
-	Light dirLight2;
-	Light dirLight3;
-	Light pointLight1;
-	Light pointLight2;
-}
-
-// Texture2D SurfaceTexture	: register(t0); Non-PBR lighting
+	uint albedoSlice;
+	uint normalSlice;
+	uint ormSlice;
+	uint padding;
+};
+
+Texture2DArray AlbedoArray	: register(t0);
+Texture2DArray NormalArray	: register(t1);
+Texture2DArray ORMArray		: register(t2); // Packed, as with PACKED_ORM
+StructuredBuffer<ArrayMaterial> Materials : register(t3);
+#else
 Texture2D AlbedoTexture		: register(t0);
 Texture2D NormalMap			: register(t1);
+#if defined(PACKED_ORM)
+Texture2D ORMMap			: register(t2); // R = occlusion, G = roughness, B = metalness
+#else
 Texture2D RoughnessMap		: register(t2);
 Texture2D MetalnessMap		: register(t3);
+#endif
+#endif
 Texture2D ShadowMap			: register(t4);
 
 SamplerState BasicSampler				: register(s0);
@@ -233,6 +242,19 @@ float4 main(VertexToPixel input) : SV_TARGET
 {
 	input.normal = normalize(input.normal);
 
+#if defined(MATERIAL_ARRAY)
+	// This pixel's material, which may differ from the rest of the draw's
+	ArrayMaterial material = Materials[input.materialIndex];
+
+	// Scale/Offseet the uvs of the texture
+	input.uv = (input.uv + material.uvOffset) * material.uvScale;
+
+	// Sets texture colors, tinted with material surface
+	float3 surfaceColor = pow(AlbedoArray.Sample(BasicSampler, float3(input.uv, material.albedoSlice)).rgb, 2.2f);
+	surfaceColor = surfaceColor * material.colorTint.rgb;
+
+	float2 normalXY = NormalArray.Sample(BasicSampler, float3(input.uv, material.normalSlice)).rg * 2 - 1;
+#else
 	// Scale/Offseet the uvs of the texture
 	input.uv = (input.uv + uvOffset) * uvScale;
 
@@ -242,24 +264,39 @@ float4 main(VertexToPixel input) : SV_TARGET
 	// Tint with material surface
 	surfaceColor = surfaceColor * colorTint;
 
-	// Unpack normals
-	float3 unpackedNormal = NormalMap.Sample(BasicSampler, input.uv).rgb * 2 - 1;
+	// Unpack normals. Only X and Y are read, as cooked (BC5)
+	// normal maps don't store Z; it's rebuilt from their length.
+	float2 normalXY = NormalMap.Sample(BasicSampler, input.uv).rg * 2 - 1;
+#endif
+	float3 unpackedNormal = float3(normalXY, sqrt(saturate(1 - dot(normalXY, normalXY))));
 
 	// Create TangentBi-tangentNormal matrix
 	float3 N = input.normal;
-	float3 T = normalize(input.tangent);
+	float3 T = normalize(input.tangent.xyz);
 	T = normalize(T - N * dot(T, N));
-	float3 B = cross(T, N);
+	float3 B = cross(T, N) * input.tangent.w; // Flipped for mirrored uvs
 	float3x3 TBN = float3x3(T, B, N);
 
 	// Transform the unpacked normal
 	input.normal = mul(unpackedNormal, TBN);
 
+#if defined(MATERIAL_ARRAY)
+	float3 orm = ORMArray.Sample(BasicSampler, float3(input.uv, material.ormSlice)).rgb;
+	float roughness = orm.g;
+	float metalness = orm.b;
+#elif defined(PACKED_ORM)
+	// Roughness and metalness from one fetch. Occlusion (R) is
+	// unused until there's ambient light for it to darken.
+	float3 orm = ORMMap.Sample(BasicSampler, input.uv).rgb;
+	float roughness = orm.g;
+	float metalness = orm.b;
+#else
 	// Sample roughness map
 	float roughness = RoughnessMap.Sample(BasicSampler, input.uv).r;
 
 	// Sample metalness map
 	float metalness = MetalnessMap.Sample(BasicSampler, input.uv).r;
+#endif
 
 	// Shadow Mapping
 	// convert from [-1 to 1] to [0 to 1]
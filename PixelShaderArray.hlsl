@@ -0,0 +1,6 @@
+// The packed ORM pixel shader, for materials in a MaterialArray:
+// maps are array slices and parameters come from a structured
+// buffer, so a draw can mix materials
+#define PACKED_ORM
+#define MATERIAL_ARRAY
+#include "PixelShader.hlsl"
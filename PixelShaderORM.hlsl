@@ -0,0 +1,4 @@
+// The PBR pixel shader, reading roughness and metalness from
+// one channel packed ORM texture instead of two separate maps
+#define PACKED_ORM
+#include "PixelShader.hlsl"
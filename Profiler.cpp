@@ -0,0 +1,279 @@
+#include "Profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+// Singleton requirement
+Profiler* Profiler::instance;
+
+thread_local Profiler::ThreadBuffer* Profiler::threadBuffer = 0;
+
+// Scopes currently open on this thread
+static thread_local unsigned int openScopes = 0;
+
+ProfileScope::ProfileScope(const char* name)
+{
+	this->name = name;
+	this->depth = openScopes++;
+	this->start = Profiler::Now();
+}
+
+ProfileScope::~ProfileScope()
+{
+	long long end = Profiler::Now();
+	openScopes--;
+	Profiler::GetInstance().Record(name, start, end, depth);
+}
+
+Profiler::Profiler()
+{
+	origin = Now();
+	captureFramesLeft = 0;
+}
+
+long long Profiler::Now()
+{
+	return std::chrono::steady_clock::now().time_since_epoch().count();
+}
+
+double Profiler::TicksToMs(long long ticks)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::duration(ticks)).count();
+}
+
+// --------------------------------------------------------
+// Appends an event to the calling thread's buffer. Only
+// this thread moves Head, and only EndFrame() moves Tail,
+// so the release store of Head is all it takes to hand
+// the event over.
+// --------------------------------------------------------
+void Profiler::Record(const char* name, long long start, long long end, unsigned int depth)
+{
+	ThreadBuffer* buffer = threadBuffer ? threadBuffer : GetThreadBuffer();
+
+	unsigned int head = buffer->Head.load(std::memory_order_relaxed);
+	if (head - buffer->Tail.load(std::memory_order_acquire) >= BufferSize)
+	{
+		buffer->Dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	ProfileEvent& event = buffer->Events[head & (BufferSize - 1)];
+	event.Name = name;
+	event.Start = start;
+	event.End = end;
+	event.Depth = depth;
+	buffer->Head.store(head + 1, std::memory_order_release);
+}
+
+// --------------------------------------------------------
+// Creates the calling thread's buffer the first time it
+// records anything
+// --------------------------------------------------------
+Profiler::ThreadBuffer* Profiler::GetThreadBuffer()
+{
+	if (threadBuffer)
+		return threadBuffer;
+
+	std::lock_guard<std::mutex> lock(buffersMutex);
+	buffers.push_back(std::make_unique<ThreadBuffer>());
+	threadBuffer = buffers.back().get();
+	threadBuffer->Head = 0;
+	threadBuffer->Tail = 0;
+	threadBuffer->Dropped = 0;
+	threadBuffer->ThreadId = (unsigned int)buffers.size();
+	threadBuffer->Name = "Thread " + std::to_string(buffers.size());
+	return threadBuffer;
+}
+
+void Profiler::SetThreadName(const char* name)
+{
+	ThreadBuffer* buffer = GetThreadBuffer();
+	std::lock_guard<std::mutex> lock(buffersMutex);
+	buffer->Name = name;
+}
+
+// --------------------------------------------------------
+// Moves every event recorded since the last frame into the
+// stats, and into the capture if one is running
+// --------------------------------------------------------
+void Profiler::EndFrame()
+{
+	{
+		std::lock_guard<std::mutex> lock(buffersMutex);
+		for (auto& buffer : buffers)
+		{
+			unsigned int tail = buffer->Tail.load(std::memory_order_relaxed);
+			unsigned int head = buffer->Head.load(std::memory_order_acquire);
+			for (; tail != head; tail++)
+			{
+				const ProfileEvent& event = buffer->Events[tail & (BufferSize - 1)];
+				AddSample(event);
+				if (captureFramesLeft > 0)
+					capture.push_back({ event, buffer->ThreadId });
+			}
+			buffer->Tail.store(tail, std::memory_order_release);
+		}
+	}
+
+	if (captureFramesLeft > 0 && --captureFramesLeft == 0)
+		WriteTrace();
+}
+
+void Profiler::BeginCapture(unsigned int frames, const std::string& path)
+{
+	if (captureFramesLeft > 0 || frames == 0)
+		return;
+
+	capture.clear();
+	capturePath = path;
+	captureFramesLeft = frames;
+}
+
+bool Profiler::IsCapturing()
+{
+	return captureFramesLeft > 0;
+}
+
+// --------------------------------------------------------
+// Adds one event's duration to the totals for its scope
+// --------------------------------------------------------
+void Profiler::AddSample(const ProfileEvent& event)
+{
+	// Few enough scopes that a search beats hashing. Names
+	// are compared by pointer first, as they're literals.
+	ScopeRecord* record = 0;
+	for (ScopeRecord& scope : scopes)
+	{
+		if (scope.Depth == event.Depth && (scope.Name == event.Name || strcmp(scope.Name, event.Name) == 0))
+		{
+			record = &scope;
+			break;
+		}
+	}
+
+	if (!record)
+	{
+		scopes.push_back(ScopeRecord());
+		record = &scopes.back();
+		record->Name = event.Name;
+		record->Depth = event.Depth;
+		record->FirstStart = event.Start;
+		record->Calls = 0;
+		record->TotalMs = 0.0;
+	}
+
+	double ms = TicksToMs(event.End - event.Start);
+	record->MinMs = record->Calls == 0 || ms < record->MinMs ? ms : record->MinMs;
+	record->MaxMs = record->Calls == 0 || ms > record->MaxMs ? ms : record->MaxMs;
+	record->TotalMs += ms;
+
+	if (record->Samples.size() < SampleLimit)
+		record->Samples.push_back((float)ms);
+	else
+		record->Samples[record->Calls % SampleLimit] = (float)ms;
+	record->Calls++;
+}
+
+void Profiler::GetStats(std::vector<ProfileScopeStats>& stats)
+{
+	// Children finish, and so are first seen, before their
+	// parents, so order by when each scope first started
+	std::vector<ScopeRecord*> ordered;
+	for (ScopeRecord& scope : scopes)
+	{
+		if (scope.Calls > 0)
+			ordered.push_back(&scope);
+	}
+	std::stable_sort(ordered.begin(), ordered.end(), [](ScopeRecord* a, ScopeRecord* b) { return a->FirstStart < b->FirstStart; });
+
+	stats.clear();
+	std::vector<float> sorted;
+	for (ScopeRecord* scope : ordered)
+	{
+		// The 99th percentile of the durations still kept
+		sorted = scope->Samples;
+		size_t rank = (sorted.size() * 99 + 99) / 100 - 1;
+		std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+
+		ProfileScopeStats entry;
+		entry.Name = scope->Name;
+		entry.Depth = scope->Depth;
+		entry.Calls = scope->Calls;
+		entry.MinMs = scope->MinMs;
+		entry.AvgMs = scope->TotalMs / scope->Calls;
+		entry.P99Ms = sorted[rank];
+		entry.MaxMs = scope->MaxMs;
+		stats.push_back(entry);
+	}
+}
+
+// --------------------------------------------------------
+// Starts the stats over, keeping the order scopes were
+// first seen in
+// --------------------------------------------------------
+void Profiler::ResetStats()
+{
+	for (ScopeRecord& scope : scopes)
+	{
+		scope.Calls = 0;
+		scope.TotalMs = 0.0;
+		scope.Samples.clear();
+	}
+}
+
+unsigned int Profiler::GetDroppedEvents()
+{
+	std::lock_guard<std::mutex> lock(buffersMutex);
+	unsigned int dropped = 0;
+	for (auto& buffer : buffers)
+		dropped += buffer->Dropped.load(std::memory_order_relaxed);
+	return dropped;
+}
+
+// --------------------------------------------------------
+// Writes the capture as complete ("X") trace events, with
+// times in microseconds since the profiler started, and
+// names each thread with a metadata ("M") event
+// --------------------------------------------------------
+void Profiler::WriteTrace()
+{
+	std::ofstream out(capturePath, std::ios::trunc);
+	if (!out)
+	{
+		capture.clear();
+		return;
+	}
+
+	out << "{\"traceEvents\":[\n";
+	{
+		std::lock_guard<std::mutex> lock(buffersMutex);
+		for (auto& buffer : buffers)
+		{
+			out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->ThreadId
+				<< ",\"args\":{\"name\":\"" << buffer->Name << "\"}},\n";
+		}
+	}
+
+	char line[256];
+	for (CapturedEvent& captured : capture)
+	{
+		snprintf(line, sizeof(line), "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f},\n",
+			captured.Event.Name,
+			captured.ThreadId,
+			TicksToMs(captured.Event.Start - origin) * 1000.0,
+			TicksToMs(captured.Event.End - captured.Event.Start) * 1000.0);
+		out << line;
+	}
+
+	// Every entry above ends with a comma, so finish on one more that doesn't
+	out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"DX11Starter\"}}\n";
+	out << "],\"displayTimeUnit\":\"ms\"}\n";
+
+#if defined(DEBUG) || defined(_DEBUG)
+	printf("Profiler: wrote %zu events to %s\n", capture.size(), capturePath.c_str());
+#endif
+	capture.clear();
+}
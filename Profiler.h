@@ -0,0 +1,171 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// One finished scope, as recorded by the thread that ran it
+struct ProfileEvent
+{
+	const char* Name;
+	long long Start;			// Profiler::Now() ticks
+	long long End;
+	unsigned int Depth;			// Scopes open on the thread when it started
+};
+
+// How long a scope took, over every time it ran since the last reset
+struct ProfileScopeStats
+{
+	const char* Name;
+	unsigned int Depth;
+	unsigned int Calls;
+	double MinMs;
+	double AvgMs;
+	double P99Ms;
+	double MaxMs;
+};
+
+// --------------------------------------------------------
+// Times a block of code, from construction to the end of
+// its scope:
+//
+//   {
+//       ProfileScope profile("Shadow");
+//       ...
+//   }
+//
+// The name must outlive the profiler (a string literal)
+// --------------------------------------------------------
+class ProfileScope
+{
+public:
+	ProfileScope(const char* name);
+	~ProfileScope();
+
+	ProfileScope(ProfileScope const&) = delete;
+	void operator=(ProfileScope const&) = delete;
+
+private:
+	const char* name;
+	long long start;
+	unsigned int depth;
+};
+
+// --------------------------------------------------------
+// Collects timed scopes from every thread into per-scope
+// stats and, on request, a Chrome trace of a few frames
+//
+// - Each thread records into its own ring buffer, which
+//   only that thread writes and only EndFrame() reads, so
+//   recording a scope never takes a lock. A full buffer
+//   drops new events rather than waiting
+// - EndFrame() runs once a frame on the main thread. It
+//   drains every buffer into the stats and any capture
+// - Captures are written as Chrome trace event JSON, for
+//   chrome://tracing or ui.perfetto.dev
+// --------------------------------------------------------
+class Profiler
+{
+#pragma region Singleton
+public:
+	// Gets the one and only instance of this class
+	static Profiler& GetInstance()
+	{
+		if (!instance)
+		{
+			instance = new Profiler();
+		}
+
+		return *instance;
+	}
+
+	// Remove these functions (C++ 11 version)
+	Profiler(Profiler const&) = delete;
+	void operator=(Profiler const&) = delete;
+
+private:
+	static Profiler* instance;
+	Profiler();
+#pragma endregion
+
+public:
+	// Called by ProfileScope
+	void Record(const char* name, long long start, long long end, unsigned int depth);
+
+	// Names the calling thread in traces
+	void SetThreadName(const char* name);
+
+	// Gathers everything recorded since the last call
+	void EndFrame();
+
+	// Records the next frames and writes them to the given
+	// file as a trace once they're done. Ignored while a
+	// capture is already running.
+	void BeginCapture(unsigned int frames, const std::string& path);
+	bool IsCapturing();
+
+	// Scopes in the order they first started, so nested
+	// scopes follow their parents
+	void GetStats(std::vector<ProfileScopeStats>& stats);
+	void ResetStats();
+
+	// Events dropped because a thread's buffer was full
+	unsigned int GetDroppedEvents();
+
+	static long long Now();
+	static double TicksToMs(long long ticks);
+
+private:
+	static const unsigned int BufferSize = 8192;	// Events per thread, a power of two
+	static const unsigned int SampleLimit = 4096;	// Durations kept per scope for percentiles
+
+	// One thread's events, written at Head by that thread and read from
+	// Tail by EndFrame(). Each end gets its own cache line.
+	struct ThreadBuffer
+	{
+		alignas(64) std::atomic<unsigned int> Head;
+		std::atomic<unsigned int> Dropped;
+		alignas(64) std::atomic<unsigned int> Tail;
+		ProfileEvent Events[BufferSize];
+		unsigned int ThreadId;
+		std::string Name;
+	};
+
+	// Running totals for one scope name at one depth
+	struct ScopeRecord
+	{
+		const char* Name;
+		unsigned int Depth;
+		long long FirstStart;			// For ordering the stats
+		unsigned int Calls;
+		double TotalMs;
+		double MinMs;
+		double MaxMs;
+		std::vector<float> Samples;		// The most recent durations, wrapping at SampleLimit
+	};
+
+	// A drained event and the thread it ran on, kept for a capture
+	struct CapturedEvent
+	{
+		ProfileEvent Event;
+		unsigned int ThreadId;
+	};
+
+	// Only taken when a thread first records or is named, and by EndFrame()
+	std::mutex buffersMutex;
+	std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+	static thread_local ThreadBuffer* threadBuffer;
+
+	std::vector<ScopeRecord> scopes;
+	long long origin;
+
+	std::vector<CapturedEvent> capture;
+	std::string capturePath;
+	unsigned int captureFramesLeft;
+
+	ThreadBuffer* GetThreadBuffer();
+	void AddSample(const ProfileEvent& event);
+	void WriteTrace();
+};
@@ -0,0 +1,1059 @@
+#include "RecordingContext.h"
+#include <cstring>
+
+using namespace Microsoft::WRL;
+
+// Empties an output array, for getters with nothing to forward to
+template <typename T>
+static void ClearOutput(T** items, UINT count)
+{
+	if (items)
+		memset(items, 0, sizeof(T*) * count);
+}
+
+RecordingContext::RecordingContext(ComPtr<ID3D11Device> device, ComPtr<ID3D11DeviceContext> inner)
+{
+	this->references = 1;
+	this->device = device;
+	this->inner = inner;
+	ResetState();
+}
+
+// --------------------------------------------------------
+// Starts a new log and frame totals. The shadow state
+// carries over, since the pipeline does too.
+// --------------------------------------------------------
+void RecordingContext::BeginFrame()
+{
+	log.clear();
+	frameStats = RecordingStats();
+}
+
+const std::vector<RecordedCommand>& RecordingContext::GetLog() { return log; }
+const RecordingStats& RecordingContext::GetFrameStats() { return frameStats; }
+const RecordingStats& RecordingContext::GetTotalStats() { return totalStats; }
+void RecordingContext::ResetTotalStats() { totalStats = RecordingStats(); }
+bool RecordingContext::IsForwarding() { return inner.Get() != 0; }
+
+void RecordingContext::WriteLog(FILE* file)
+{
+	static const char* typeNames[] = { "bind", "upload", "draw", "dispatch", "clear", "copy", "other" };
+	for (size_t i = 0; i < log.size(); i++)
+	{
+		const RecordedCommand& command = log[i];
+		fprintf(file, "%6zu %-8s %-40s slot %2u count %6u",
+			i, typeNames[(int)command.Type], command.Name, command.Slot, command.Count);
+		if (command.Type == RecordedCommandType::Draw)
+			fprintf(file, " instances %u", command.Instances);
+		if (command.Type == RecordedCommandType::Upload)
+			fprintf(file, " bytes %u", command.Bytes);
+		if (command.Redundant)
+			fprintf(file, " (redundant)");
+		fprintf(file, "\n");
+	}
+}
+
+void RecordingContext::Record(const char* name, RecordedCommandType type, unsigned int slot, unsigned int count, unsigned int instances, unsigned int bytes, bool redundant)
+{
+	RecordedCommand command = { name, type, redundant, slot, count, instances, bytes };
+	log.push_back(command);
+
+	for (RecordingStats* stats : { &frameStats, &totalStats })
+	{
+		stats->Commands++;
+		switch (type)
+		{
+		case RecordedCommandType::Bind:
+			stats->Binds++;
+			if (redundant)
+				stats->RedundantBinds++;
+			break;
+		case RecordedCommandType::Upload:
+			stats->Uploads++;
+			stats->UploadBytes += bytes;
+			break;
+		case RecordedCommandType::Draw:
+			stats->Draws++;
+			stats->Instances += instances;
+			stats->Elements += (uint64_t)count * instances;
+			break;
+		case RecordedCommandType::Dispatch: stats->Dispatches++; break;
+		case RecordedCommandType::Clear: stats->Clears++; break;
+		case RecordedCommandType::Copy: stats->Copies++; break;
+		default: break;
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Matches a freshly created context: nothing bound, and
+// the default sample mask and blend factor
+// --------------------------------------------------------
+void RecordingContext::ResetState()
+{
+	memset(&state, 0, sizeof(PipelineState));
+	state.SampleMask = 0xFFFFFFFF;
+	for (int i = 0; i < 4; i++)
+		state.BlendFactor[i] = 1.0f;
+}
+
+// --------------------------------------------------------
+// Copies a range of bindings into the shadow state. Slots
+// past what's tracked are ignored, and a null array means
+// the slots are being cleared.
+// --------------------------------------------------------
+bool RecordingContext::BindSlots(void** slots, UINT slotCount, UINT startSlot, UINT count, void* const* items)
+{
+	bool redundant = true;
+	for (UINT i = 0; i < count && startSlot + i < slotCount; i++)
+	{
+		void* item = items ? items[i] : 0;
+		redundant = redundant && slots[startSlot + i] == item;
+		slots[startSlot + i] = item;
+	}
+	return redundant;
+}
+
+bool RecordingContext::BindOne(void*& slot, void* item)
+{
+	bool redundant = slot == item;
+	slot = item;
+	return redundant;
+}
+
+void RecordingContext::SetShader(const char* name, Stage stage, void* shader)
+{
+	bool redundant = BindOne(state.Stages[stage].Shader, shader);
+	Record(name, RecordedCommandType::Bind, 0, 1, 0, 0, redundant);
+}
+
+void RecordingContext::SetConstantBuffers(const char* name, Stage stage, UINT startSlot, UINT count, ID3D11Buffer* const* buffers)
+{
+	StageState& stageState = state.Stages[stage];
+	bool redundant = BindSlots(stageState.ConstantBuffers, D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT, startSlot, count, (void* const*)buffers);
+	Record(name, RecordedCommandType::Bind, startSlot, count, 0, 0, redundant);
+}
+
+void RecordingContext::SetShaderResources(const char* name, Stage stage, UINT startSlot, UINT count, ID3D11ShaderResourceView* const* views)
+{
+	StageState& stageState = state.Stages[stage];
+	bool redundant = BindSlots(stageState.ShaderResources, D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT, startSlot, count, (void* const*)views);
+	Record(name, RecordedCommandType::Bind, startSlot, count, 0, 0, redundant);
+}
+
+void RecordingContext::SetSamplers(const char* name, Stage stage, UINT startSlot, UINT count, ID3D11SamplerState* const* samplers)
+{
+	StageState& stageState = state.Stages[stage];
+	bool redundant = BindSlots(stageState.Samplers, D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT, startSlot, count, (void* const*)samplers);
+	Record(name, RecordedCommandType::Bind, startSlot, count, 0, 0, redundant);
+}
+
+// --------------------------------------------------------
+// How many bytes an UpdateSubresource call sends: the box's
+// width for buffers, and for textures the rows of source
+// data (block rows, for compressed formats) in the box or
+// in the whole subresource
+// --------------------------------------------------------
+unsigned int RecordingContext::UploadSize(ID3D11Resource* resource, UINT subresource, const D3D11_BOX* box, UINT rowPitch, UINT depthPitch)
+{
+	D3D11_RESOURCE_DIMENSION dimension = D3D11_RESOURCE_DIMENSION_UNKNOWN;
+	resource->GetType(&dimension);
+
+	if (dimension == D3D11_RESOURCE_DIMENSION_BUFFER)
+	{
+		if (box)
+			return box->right - box->left;
+		D3D11_BUFFER_DESC desc = {};
+		((ID3D11Buffer*)resource)->GetDesc(&desc);
+		return desc.ByteWidth;
+	}
+
+	UINT rows = 1;
+	UINT depth = 1;
+	DXGI_FORMAT format = DXGI_FORMAT_UNKNOWN;
+	if (dimension == D3D11_RESOURCE_DIMENSION_TEXTURE2D)
+	{
+		D3D11_TEXTURE2D_DESC desc = {};
+		((ID3D11Texture2D*)resource)->GetDesc(&desc);
+		UINT mip = subresource % desc.MipLevels;
+		rows = box ? box->bottom - box->top : desc.Height >> mip;
+		format = desc.Format;
+	}
+	else if (dimension == D3D11_RESOURCE_DIMENSION_TEXTURE3D)
+	{
+		D3D11_TEXTURE3D_DESC desc = {};
+		((ID3D11Texture3D*)resource)->GetDesc(&desc);
+		UINT mip = subresource % desc.MipLevels;
+		rows = box ? box->bottom - box->top : desc.Height >> mip;
+		depth = box ? box->back - box->front : desc.Depth >> mip;
+		format = desc.Format;
+	}
+	if (rows == 0) rows = 1;
+	if (depth == 0) depth = 1;
+
+	bool blockCompressed =
+		(format >= DXGI_FORMAT_BC1_TYPELESS && format <= DXGI_FORMAT_BC5_SNORM) ||
+		(format >= DXGI_FORMAT_BC6H_TYPELESS && format <= DXGI_FORMAT_BC7_UNORM_SRGB);
+	if (blockCompressed)
+		rows = (rows + 3) / 4;
+
+	if (depth > 1)
+		return depthPitch * (depth - 1) + rowPitch * rows;
+	return rowPitch * rows;
+}
+
+// --------------------------------------------------------
+// IUnknown and ID3D11DeviceChild. The context only answers
+// for the interfaces it records, so newer context versions
+// can't be used to go around it.
+// --------------------------------------------------------
+HRESULT RecordingContext::QueryInterface(REFIID riid, void** ppvObject)
+{
+	if (!ppvObject)
+		return E_POINTER;
+
+	if (riid == __uuidof(IUnknown) || riid == __uuidof(ID3D11DeviceChild) || riid == __uuidof(ID3D11DeviceContext))
+	{
+		*ppvObject = static_cast<ID3D11DeviceContext*>(this);
+		AddRef();
+		return S_OK;
+	}
+
+	*ppvObject = 0;
+	return E_NOINTERFACE;
+}
+
+ULONG RecordingContext::AddRef()
+{
+	return ++references;
+}
+
+ULONG RecordingContext::Release()
+{
+	ULONG remaining = --references;
+	if (remaining == 0)
+		delete this;
+	return remaining;
+}
+
+void RecordingContext::GetDevice(ID3D11Device** ppDevice)
+{
+	*ppDevice = device.Get();
+	if (*ppDevice)
+		(*ppDevice)->AddRef();
+}
+
+HRESULT RecordingContext::GetPrivateData(REFGUID guid, UINT* pDataSize, void* pData)
+{
+	if (inner) return inner->GetPrivateData(guid, pDataSize, pData);
+	return DXGI_ERROR_NOT_FOUND;
+}
+
+HRESULT RecordingContext::SetPrivateData(REFGUID guid, UINT DataSize, const void* pData)
+{
+	if (inner) return inner->SetPrivateData(guid, DataSize, pData);
+	return S_OK;
+}
+
+HRESULT RecordingContext::SetPrivateDataInterface(REFGUID guid, const IUnknown* pData)
+{
+	if (inner) return inner->SetPrivateDataInterface(guid, pData);
+	return S_OK;
+}
+
+// --------------------------------------------------------
+// Shader stages
+// --------------------------------------------------------
+void RecordingContext::VSSetShader(ID3D11VertexShader* pVertexShader, ID3D11ClassInstance* const* ppClassInstances, UINT NumClassInstances)
+{
+	SetShader("VSSetShader", VS, pVertexShader);
+	if (inner) inner->VSSetShader(pVertexShader, ppClassInstances, NumClassInstances);
+}
+
+void RecordingContext::VSSetConstantBuffers(UINT StartSlot, UINT NumBuffers, ID3D11Buffer* const* ppConstantBuffers)
+{
+	SetConstantBuffers("VSSetConstantBuffers", VS, StartSlot, NumBuffers, ppConstantBuffers);
+	if (inner) inner->VSSetConstantBuffers(StartSlot, NumBuffers, ppConstantBuffers);
+}
+
+void RecordingContext::VSSetShaderResources(UINT StartSlot, UINT NumViews, ID3D11ShaderResourceView* const* ppShaderResourceViews)
+{
+	SetShaderResources("VSSetShaderResources", VS, StartSlot, NumViews, ppShaderResourceViews);
+	if (inner) inner->VSSetShaderResources(StartSlot, NumViews, ppShaderResourceViews);
+}
+
+void RecordingContext::VSSetSamplers(UINT StartSlot, UINT NumSamplers, ID3D11SamplerState* const* ppSamplers)
+{
+	SetSamplers("VSSetSamplers", VS, StartSlot, NumSamplers, ppSamplers);
+	if (inner) inner->VSSetSamplers(StartSlot, NumSamplers, ppSamplers);
+}
+
+void RecordingContext::HSSetShader(ID3D11HullShader* pHullShader, ID3D11ClassInstance* const* ppClassInstances, UINT NumClassInstances)
+{
+	SetShader("HSSetShader", HS, pHullShader);
+	if (inner) inner->HSSetShader(pHullShader, ppClassInstances, NumClassInstances);
+}
+
+void RecordingContext::HSSetConstantBuffers(UINT StartSlot, UINT NumBuffers, ID3D11Buffer* const* ppConstantBuffers)
+{
+	SetConstantBuffers("HSSetConstantBuffers", HS, StartSlot, NumBuffers, ppConstantBuffers);
+	if (inner) inner->HSSetConstantBuffers(StartSlot, NumBuffers, ppConstantBuffers);
+}
+
+void RecordingContext::HSSetShaderResources(UINT StartSlot, UINT NumViews, ID3D11ShaderResourceView* const* ppShaderResourceViews)
+{
+	SetShaderResources("HSSetShaderResources", HS, StartSlot, NumViews, ppShaderResourceViews);
+	if (inner) inner->HSSetShaderResources(StartSlot, NumViews, ppShaderResourceViews);
+}
+
+void RecordingContext::HSSetSamplers(UINT StartSlot, UINT NumSamplers, ID3D11SamplerState* const* ppSamplers)
+{
+	SetSamplers("HSSetSamplers", HS, StartSlot, NumSamplers, ppSamplers);
+	if (inner) inner->HSSetSamplers(StartSlot, NumSamplers, ppSamplers);
+}
+
+void RecordingContext::DSSetShader(ID3D11DomainShader* pDomainShader, ID3D11ClassInstance* const* ppClassInstances, UINT NumClassInstances)
+{
+	SetShader("DSSetShader", DS, pDomainShader);
+	if (inner) inner->DSSetShader(pDomainShader, ppClassInstances, NumClassInstances);
+}
+
+void RecordingContext::DSSetConstantBuffers(UINT StartSlot, UINT NumBuffers, ID3D11Buffer* const* ppConstantBuffers)
+{
+	SetConstantBuffers("DSSetConstantBuffers", DS, StartSlot, NumBuffers, ppConstantBuffers);
+	if (inner) inner->DSSetConstantBuffers(StartSlot, NumBuffers, ppConstantBuffers);
+}
+
+void RecordingContext::DSSetShaderResources(UINT StartSlot, UINT NumViews, ID3D11ShaderResourceView* const* ppShaderResourceViews)
+{
+	SetShaderResources("DSSetShaderResources", DS, StartSlot, NumViews, ppShaderResourceViews);
+	if (inner) inner->DSSetShaderResources(StartSlot, NumViews, ppShaderResourceViews);
+}
+
+void RecordingContext::DSSetSamplers(UINT StartSlot, UINT NumSamplers, ID3D11SamplerState* const* ppSamplers)
+{
+	SetSamplers("DSSetSamplers", DS, StartSlot, NumSamplers, ppSamplers);
+	if (inner) inner->DSSetSamplers(StartSlot, NumSamplers, ppSamplers);
+}
+
+void RecordingContext::GSSetShader(ID3D11GeometryShader* pShader, ID3D11ClassInstance* const* ppClassInstances, UINT NumClassInstances)
+{
+	SetShader("GSSetShader", GS, pShader);
+	if (inner) inner->GSSetShader(pShader, ppClassInstances, NumClassInstances);
+}
+
+void RecordingContext::GSSetConstantBuffers(UINT StartSlot, UINT NumBuffers, ID3D11Buffer* const* ppConstantBuffers)
+{
+	SetConstantBuffers("GSSetConstantBuffers", GS, StartSlot, NumBuffers, ppConstantBuffers);
+	if (inner) inner->GSSetConstantBuffers(StartSlot, NumBuffers, ppConstantBuffers);
+}
+
+void RecordingContext::GSSetShaderResources(UINT StartSlot, UINT NumViews, ID3D11ShaderResourceView* const* ppShaderResourceViews)
+{
+	SetShaderResources("GSSetShaderResources", GS, StartSlot, NumViews, ppShaderResourceViews);
+	if (inner) inner->GSSetShaderResources(StartSlot, NumViews, ppShaderResourceViews);
+}
+
+void RecordingContext::GSSetSamplers(UINT StartSlot, UINT NumSamplers, ID3D11SamplerState* const* ppSamplers)
+{
+	SetSamplers("GSSetSamplers", GS, StartSlot, NumSamplers, ppSamplers);
+	if (inner) inner->GSSetSamplers(StartSlot, NumSamplers, ppSamplers);
+}
+
+void RecordingContext::PSSetShader(ID3D11PixelShader* pPixelShader, ID3D11ClassInstance* const* ppClassInstances, UINT NumClassInstances)
+{
+	SetShader("PSSetShader", PS, pPixelShader);
+	if (inner) inner->PSSetShader(pPixelShader, ppClassInstances, NumClassInstances);
+}
+
+void RecordingContext::PSSetConstantBuffers(UINT StartSlot, UINT NumBuffers, ID3D11Buffer* const* ppConstantBuffers)
+{
+	SetConstantBuffers("PSSetConstantBuffers", PS, StartSlot, NumBuffers, ppConstantBuffers);
+	if (inner) inner->PSSetConstantBuffers(StartSlot, NumBuffers, ppConstantBuffers);
+}
+
+void RecordingContext::PSSetShaderResources(UINT StartSlot, UINT NumViews, ID3D11ShaderResourceView* const* ppShaderResourceViews)
+{
+	SetShaderResources("PSSetShaderResources", PS, StartSlot, NumViews, ppShaderResourceViews);
+	if (inner) inner->PSSetShaderResources(StartSlot, NumViews, ppShaderResourceViews);
+}
+
+void RecordingContext::PSSetSamplers(UINT StartSlot, UINT NumSamplers, ID3D11SamplerState* const* ppSamplers)
+{
+	SetSamplers("PSSetSamplers", PS, StartSlot, NumSamplers, ppSamplers);
+	if (inner) inner->PSSetSamplers(StartSlot, NumSamplers, ppSamplers);
+}
+
+void RecordingContext::CSSetShader(ID3D11ComputeShader* pComputeShader, ID3D11ClassInstance* const* ppClassInstances, UINT NumClassInstances)
+{
+	SetShader("CSSetShader", CS, pComputeShader);
+	if (inner) inner->CSSetShader(pComputeShader, ppClassInstances, NumClassInstances);
+}
+
+void RecordingContext::CSSetConstantBuffers(UINT StartSlot, UINT NumBuffers, ID3D11Buffer* const* ppConstantBuffers)
+{
+	SetConstantBuffers("CSSetConstantBuffers", CS, StartSlot, NumBuffers, ppConstantBuffers);
+	if (inner) inner->CSSetConstantBuffers(StartSlot, NumBuffers, ppConstantBuffers);
+}
+
+void RecordingContext::CSSetShaderResources(UINT StartSlot, UINT NumViews, ID3D11ShaderResourceView* const* ppShaderResourceViews)
+{
+	SetShaderResources("CSSetShaderResources", CS, StartSlot, NumViews, ppShaderResourceViews);
+	if (inner) inner->CSSetShaderResources(StartSlot, NumViews, ppShaderResourceViews);
+}
+
+void RecordingContext::CSSetSamplers(UINT StartSlot, UINT NumSamplers, ID3D11SamplerState* const* ppSamplers)
+{
+	SetSamplers("CSSetSamplers", CS, StartSlot, NumSamplers, ppSamplers);
+	if (inner) inner->CSSetSamplers(StartSlot, NumSamplers, ppSamplers);
+}
+
+void RecordingContext::CSSetUnorderedAccessViews(UINT StartSlot, UINT NumUAVs, ID3D11UnorderedAccessView* const* ppUnorderedAccessViews, const UINT* pUAVInitialCounts)
+{
+	// Initial counts reset append buffers, so those binds always do something
+	bool redundant = BindSlots(state.UnorderedAccessViews, D3D11_PS_CS_UAV_REGISTER_COUNT, StartSlot, NumUAVs, (void* const*)ppUnorderedAccessViews);
+	Record("CSSetUnorderedAccessViews", RecordedCommandType::Bind, StartSlot, NumUAVs, 0, 0, redundant && !pUAVInitialCounts);
+	if (inner) inner->CSSetUnorderedAccessViews(StartSlot, NumUAVs, ppUnorderedAccessViews, pUAVInitialCounts);
+}
+
+// --------------------------------------------------------
+// Input assembler
+// --------------------------------------------------------
+void RecordingContext::IASetInputLayout(ID3D11InputLayout* pInputLayout)
+{
+	bool redundant = BindOne(state.InputLayout, pInputLayout);
+	Record("IASetInputLayout", RecordedCommandType::Bind, 0, 1, 0, 0, redundant);
+	if (inner) inner->IASetInputLayout(pInputLayout);
+}
+
+void RecordingContext::IASetVertexBuffers(UINT StartSlot, UINT NumBuffers, ID3D11Buffer* const* ppVertexBuffers, const UINT* pStrides, const UINT* pOffsets)
+{
+	bool redundant = true;
+	for (UINT i = 0; i < NumBuffers && StartSlot + i < D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT; i++)
+	{
+		VertexBufferState binding = { ppVertexBuffers ? ppVertexBuffers[i] : 0, pStrides ? pStrides[i] : 0, pOffsets ? pOffsets[i] : 0 };
+		VertexBufferState& current = state.VertexBuffers[StartSlot + i];
+		redundant = redundant && current.Buffer == binding.Buffer && current.Stride == binding.Stride && current.Offset == binding.Offset;
+		current = binding;
+	}
+	Record("IASetVertexBuffers", RecordedCommandType::Bind, StartSlot, NumBuffers, 0, 0, redundant);
+	if (inner) inner->IASetVertexBuffers(StartSlot, NumBuffers, ppVertexBuffers, pStrides, pOffsets);
+}
+
+void RecordingContext::IASetIndexBuffer(ID3D11Buffer* pIndexBuffer, DXGI_FORMAT Format, UINT Offset)
+{
+	bool redundant = state.IndexBuffer == pIndexBuffer && state.IndexFormat == Format && state.IndexOffset == Offset;
+	state.IndexBuffer = pIndexBuffer;
+	state.IndexFormat = Format;
+	state.IndexOffset = Offset;
+	Record("IASetIndexBuffer", RecordedCommandType::Bind, 0, 1, 0, 0, redundant);
+	if (inner) inner->IASetIndexBuffer(pIndexBuffer, Format, Offset);
+}
+
+void RecordingContext::IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY Topology)
+{
+	bool redundant = state.Topology == Topology;
+	state.Topology = Topology;
+	Record("IASetPrimitiveTopology", RecordedCommandType::Bind, 0, 1, 0, 0, redundant);
+	if (inner) inner->IASetPrimitiveTopology(Topology);
+}
+
+// --------------------------------------------------------
+// Rasterizer and output merger
+// --------------------------------------------------------
+void RecordingContext::RSSetState(ID3D11RasterizerState* pRasterizerState)
+{
+	bool redundant = BindOne(state.RasterizerState, pRasterizerState);
+	Record("RSSetState", RecordedCommandType::Bind, 0, 1, 0, 0, redundant);
+	if (inner) inner->RSSetState(pRasterizerState);
+}
+
+void RecordingContext::RSSetViewports(UINT NumViewports, const D3D11_VIEWPORT* pViewports)
+{
+	UINT count = NumViewports < D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE ? NumViewports : D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE;
+	bool redundant = state.ViewportCount == count && memcmp(state.Viewports, pViewports, sizeof(D3D11_VIEWPORT) * count) == 0;
+	state.ViewportCount = count;
+	memcpy(state.Viewports, pViewports, sizeof(D3D11_VIEWPORT) * count);
+	Record("RSSetViewports", RecordedCommandType::Bind, 0, NumViewports, 0, 0, redundant);
+	if (inner) inner->RSSetViewports(NumViewports, pViewports);
+}
+
+void RecordingContext::RSSetScissorRects(UINT NumRects, const D3D11_RECT* pRects)
+{
+	Record("RSSetScissorRects", RecordedCommandType::Bind, 0, NumRects, 0, 0, false);
+	if (inner) inner->RSSetScissorRects(NumRects, pRects);
+}
+
+void RecordingContext::OMSetRenderTargets(UINT NumViews, ID3D11RenderTargetView* const* ppRenderTargetViews, ID3D11DepthStencilView* pDepthStencilView)
+{
+	// Any targets past the ones given are unbound
+	bool redundant = BindSlots(state.RenderTargets, D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT, 0, NumViews, (void* const*)ppRenderTargetViews);
+	redundant = BindSlots(state.RenderTargets, D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT, NumViews, D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT, 0) && redundant;
+	redundant = BindOne(state.DepthStencilView, pDepthStencilView) && redundant;
+	Record("OMSetRenderTargets", RecordedCommandType::Bind, 0, NumViews, 0, 0, redundant);
+	if (inner) inner->OMSetRenderTargets(NumViews, ppRenderTargetViews, pDepthStencilView);
+}
+
+void RecordingContext::OMSetRenderTargetsAndUnorderedAccessViews(UINT NumRTVs, ID3D11RenderTargetView* const* ppRenderTargetViews, ID3D11DepthStencilView* pDepthStencilView,
+	UINT UAVStartSlot, UINT NumUAVs, ID3D11UnorderedAccessView* const* ppUnorderedAccessViews, const UINT* pUAVInitialCounts)
+{
+	// Pixel shader UAVs share slots with render targets, so this is never treated as redundant
+	if (NumRTVs != D3D11_KEEP_RENDER_TARGETS_AND_DEPTH_STENCIL)
+	{
+		BindSlots(state.RenderTargets, D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT, 0, NumRTVs, (void* const*)ppRenderTargetViews);
+		BindSlots(state.RenderTargets, D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT, NumRTVs, D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT, 0);
+		state.DepthStencilView = pDepthStencilView;
+	}
+	Record("OMSetRenderTargetsAndUnorderedAccessViews", RecordedCommandType::Bind, 0, NumRTVs, 0, 0, false);
+	if (inner) inner->OMSetRenderTargetsAndUnorderedAccessViews(NumRTVs, ppRenderTargetViews, pDepthStencilView, UAVStartSlot, NumUAVs, ppUnorderedAccessViews, pUAVInitialCounts);
+}
+
+void RecordingContext::OMSetBlendState(ID3D11BlendState* pBlendState, const FLOAT BlendFactor[4], UINT SampleMask)
+{
+	FLOAT factor[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	if (BlendFactor)
+		memcpy(factor, BlendFactor, sizeof(factor));
+
+	bool redundant = state.BlendState == pBlendState && state.SampleMask == SampleMask && memcmp(state.BlendFactor, factor, sizeof(factor)) == 0;
+	state.BlendState = pBlendState;
+	state.SampleMask = SampleMask;
+	memcpy(state.BlendFactor, factor, sizeof(factor));
+	Record("OMSetBlendState", RecordedCommandType::Bind, 0, 1, 0, 0, redundant);
+	if (inner) inner->OMSetBlendState(pBlendState, BlendFactor, SampleMask);
+}
+
+void RecordingContext::OMSetDepthStencilState(ID3D11DepthStencilState* pDepthStencilState, UINT StencilRef)
+{
+	bool redundant = state.DepthStencilState == pDepthStencilState && state.StencilRef == StencilRef;
+	state.DepthStencilState = pDepthStencilState;
+	state.StencilRef = StencilRef;
+	Record("OMSetDepthStencilState", RecordedCommandType::Bind, 0, 1, 0, 0, redundant);
+	if (inner) inner->OMSetDepthStencilState(pDepthStencilState, StencilRef);
+}
+
+void RecordingContext::SOSetTargets(UINT NumBuffers, ID3D11Buffer* const* ppSOTargets, const UINT* pOffsets)
+{
+	Record("SOSetTargets", RecordedCommandType::Bind, 0, NumBuffers, 0, 0, false);
+	if (inner) inner->SOSetTargets(NumBuffers, ppSOTargets, pOffsets);
+}
+
+void RecordingContext::SetPredication(ID3D11Predicate* pPredicate, BOOL PredicateValue)
+{
+	Record("SetPredication", RecordedCommandType::Bind, 0, 1, 0, 0, false);
+	if (inner) inner->SetPredication(pPredicate, PredicateValue);
+}
+
+// --------------------------------------------------------
+// Draws and dispatches. Indirect ones can't know their
+// counts on the CPU, so they're recorded as zero.
+// --------------------------------------------------------
+void RecordingContext::Draw(UINT VertexCount, UINT StartVertexLocation)
+{
+	Record("Draw", RecordedCommandType::Draw, 0, VertexCount, 1, 0, false);
+	if (inner) inner->Draw(VertexCount, StartVertexLocation);
+}
+
+void RecordingContext::DrawIndexed(UINT IndexCount, UINT StartIndexLocation, INT BaseVertexLocation)
+{
+	Record("DrawIndexed", RecordedCommandType::Draw, 0, IndexCount, 1, 0, false);
+	if (inner) inner->DrawIndexed(IndexCount, StartIndexLocation, BaseVertexLocation);
+}
+
+void RecordingContext::DrawInstanced(UINT VertexCountPerInstance, UINT InstanceCount, UINT StartVertexLocation, UINT StartInstanceLocation)
+{
+	Record("DrawInstanced", RecordedCommandType::Draw, 0, VertexCountPerInstance, InstanceCount, 0, false);
+	if (inner) inner->DrawInstanced(VertexCountPerInstance, InstanceCount, StartVertexLocation, StartInstanceLocation);
+}
+
+void RecordingContext::DrawIndexedInstanced(UINT IndexCountPerInstance, UINT InstanceCount, UINT StartIndexLocation, INT BaseVertexLocation, UINT StartInstanceLocation)
+{
+	Record("DrawIndexedInstanced", RecordedCommandType::Draw, 0, IndexCountPerInstance, InstanceCount, 0, false);
+	if (inner) inner->DrawIndexedInstanced(IndexCountPerInstance, InstanceCount, StartIndexLocation, BaseVertexLocation, StartInstanceLocation);
+}
+
+void RecordingContext::DrawAuto()
+{
+	Record("DrawAuto", RecordedCommandType::Draw, 0, 0, 1, 0, false);
+	if (inner) inner->DrawAuto();
+}
+
+void RecordingContext::DrawIndexedInstancedIndirect(ID3D11Buffer* pBufferForArgs, UINT AlignedByteOffsetForArgs)
+{
+	Record("DrawIndexedInstancedIndirect", RecordedCommandType::Draw, 0, 0, 0, 0, false);
+	if (inner) inner->DrawIndexedInstancedIndirect(pBufferForArgs, AlignedByteOffsetForArgs);
+}
+
+void RecordingContext::DrawInstancedIndirect(ID3D11Buffer* pBufferForArgs, UINT AlignedByteOffsetForArgs)
+{
+	Record("DrawInstancedIndirect", RecordedCommandType::Draw, 0, 0, 0, 0, false);
+	if (inner) inner->DrawInstancedIndirect(pBufferForArgs, AlignedByteOffsetForArgs);
+}
+
+void RecordingContext::Dispatch(UINT ThreadGroupCountX, UINT ThreadGroupCountY, UINT ThreadGroupCountZ)
+{
+	Record("Dispatch", RecordedCommandType::Dispatch, 0, ThreadGroupCountX * ThreadGroupCountY * ThreadGroupCountZ, 0, 0, false);
+	if (inner) inner->Dispatch(ThreadGroupCountX, ThreadGroupCountY, ThreadGroupCountZ);
+}
+
+void RecordingContext::DispatchIndirect(ID3D11Buffer* pBufferForArgs, UINT AlignedByteOffsetForArgs)
+{
+	Record("DispatchIndirect", RecordedCommandType::Dispatch, 0, 0, 0, 0, false);
+	if (inner) inner->DispatchIndirect(pBufferForArgs, AlignedByteOffsetForArgs);
+}
+
+// --------------------------------------------------------
+// Uploads. Maps for writing count the whole buffer (or the
+// mapped texture subresource); reads are just recorded.
+// --------------------------------------------------------
+HRESULT RecordingContext::Map(ID3D11Resource* pResource, UINT Subresource, D3D11_MAP MapType, UINT MapFlags, D3D11_MAPPED_SUBRESOURCE* pMappedResource)
+{
+	HRESULT hr = S_OK;
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	D3D11_RESOURCE_DIMENSION dimension = D3D11_RESOURCE_DIMENSION_UNKNOWN;
+	pResource->GetType(&dimension);
+
+	unsigned int bytes = 0;
+	if (dimension == D3D11_RESOURCE_DIMENSION_BUFFER)
+	{
+		D3D11_BUFFER_DESC desc = {};
+		((ID3D11Buffer*)pResource)->GetDesc(&desc);
+		bytes = desc.ByteWidth;
+	}
+
+	if (inner)
+	{
+		hr = inner->Map(pResource, Subresource, MapType, MapFlags, &mapped);
+		if (SUCCEEDED(hr) && dimension != D3D11_RESOURCE_DIMENSION_BUFFER)
+			bytes = mapped.DepthPitch;
+	}
+	else if (dimension == D3D11_RESOURCE_DIMENSION_BUFFER)
+	{
+		std::vector<unsigned char>& memory = scratch[pResource];
+		memory.resize(bytes);
+		mapped.pData = memory.data();
+		mapped.RowPitch = bytes;
+		mapped.DepthPitch = bytes;
+	}
+	else
+	{
+		hr = E_NOTIMPL;
+	}
+
+	if (pMappedResource)
+		*pMappedResource = mapped;
+
+	bool writing = MapType != D3D11_MAP_READ;
+	Record("Map", writing ? RecordedCommandType::Upload : RecordedCommandType::Other, Subresource, 1, 0, writing && SUCCEEDED(hr) ? bytes : 0, false);
+	return hr;
+}
+
+void RecordingContext::Unmap(ID3D11Resource* pResource, UINT Subresource)
+{
+	Record("Unmap", RecordedCommandType::Other, Subresource, 1, 0, 0, false);
+	if (inner) inner->Unmap(pResource, Subresource);
+}
+
+void RecordingContext::UpdateSubresource(ID3D11Resource* pDstResource, UINT DstSubresource, const D3D11_BOX* pDstBox,
+	const void* pSrcData, UINT SrcRowPitch, UINT SrcDepthPitch)
+{
+	unsigned int bytes = UploadSize(pDstResource, DstSubresource, pDstBox, SrcRowPitch, SrcDepthPitch);
+	Record("UpdateSubresource", RecordedCommandType::Upload, DstSubresource, 1, 0, bytes, false);
+	if (inner) inner->UpdateSubresource(pDstResource, DstSubresource, pDstBox, pSrcData, SrcRowPitch, SrcDepthPitch);
+}
+
+// --------------------------------------------------------
+// Copies and clears
+// --------------------------------------------------------
+void RecordingContext::CopySubresourceRegion(ID3D11Resource* pDstResource, UINT DstSubresource, UINT DstX, UINT DstY, UINT DstZ,
+	ID3D11Resource* pSrcResource, UINT SrcSubresource, const D3D11_BOX* pSrcBox)
+{
+	Record("CopySubresourceRegion", RecordedCommandType::Copy, DstSubresource, 1, 0, 0, false);
+	if (inner) inner->CopySubresourceRegion(pDstResource, DstSubresource, DstX, DstY, DstZ, pSrcResource, SrcSubresource, pSrcBox);
+}
+
+void RecordingContext::CopyResource(ID3D11Resource* pDstResource, ID3D11Resource* pSrcResource)
+{
+	Record("CopyResource", RecordedCommandType::Copy, 0, 1, 0, 0, false);
+	if (inner) inner->CopyResource(pDstResource, pSrcResource);
+}
+
+void RecordingContext::CopyStructureCount(ID3D11Buffer* pDstBuffer, UINT DstAlignedByteOffset, ID3D11UnorderedAccessView* pSrcView)
+{
+	Record("CopyStructureCount", RecordedCommandType::Copy, 0, 1, 0, 0, false);
+	if (inner) inner->CopyStructureCount(pDstBuffer, DstAlignedByteOffset, pSrcView);
+}
+
+void RecordingContext::ResolveSubresource(ID3D11Resource* pDstResource, UINT DstSubresource, ID3D11Resource* pSrcResource, UINT SrcSubresource, DXGI_FORMAT Format)
+{
+	Record("ResolveSubresource", RecordedCommandType::Copy, DstSubresource, 1, 0, 0, false);
+	if (inner) inner->ResolveSubresource(pDstResource, DstSubresource, pSrcResource, SrcSubresource, Format);
+}
+
+void RecordingContext::GenerateMips(ID3D11ShaderResourceView* pShaderResourceView)
+{
+	Record("GenerateMips", RecordedCommandType::Copy, 0, 1, 0, 0, false);
+	if (inner) inner->GenerateMips(pShaderResourceView);
+}
+
+void RecordingContext::ClearRenderTargetView(ID3D11RenderTargetView* pRenderTargetView, const FLOAT ColorRGBA[4])
+{
+	Record("ClearRenderTargetView", RecordedCommandType::Clear, 0, 1, 0, 0, false);
+	if (inner) inner->ClearRenderTargetView(pRenderTargetView, ColorRGBA);
+}
+
+void RecordingContext::ClearUnorderedAccessViewUint(ID3D11UnorderedAccessView* pUnorderedAccessView, const UINT Values[4])
+{
+	Record("ClearUnorderedAccessViewUint", RecordedCommandType::Clear, 0, 1, 0, 0, false);
+	if (inner) inner->ClearUnorderedAccessViewUint(pUnorderedAccessView, Values);
+}
+
+void RecordingContext::ClearUnorderedAccessViewFloat(ID3D11UnorderedAccessView* pUnorderedAccessView, const FLOAT Values[4])
+{
+	Record("ClearUnorderedAccessViewFloat", RecordedCommandType::Clear, 0, 1, 0, 0, false);
+	if (inner) inner->ClearUnorderedAccessViewFloat(pUnorderedAccessView, Values);
+}
+
+void RecordingContext::ClearDepthStencilView(ID3D11DepthStencilView* pDepthStencilView, UINT ClearFlags, FLOAT Depth, UINT8 Stencil)
+{
+	Record("ClearDepthStencilView", RecordedCommandType::Clear, 0, 1, 0, 0, false);
+	if (inner) inner->ClearDepthStencilView(pDepthStencilView, ClearFlags, Depth, Stencil);
+}
+
+// --------------------------------------------------------
+// Queries, resource settings and everything else
+// --------------------------------------------------------
+void RecordingContext::Begin(ID3D11Asynchronous* pAsync)
+{
+	Record("Begin", RecordedCommandType::Other, 0, 1, 0, 0, false);
+	if (inner) inner->Begin(pAsync);
+}
+
+void RecordingContext::End(ID3D11Asynchronous* pAsync)
+{
+	Record("End", RecordedCommandType::Other, 0, 1, 0, 0, false);
+	if (inner) inner->End(pAsync);
+}
+
+HRESULT RecordingContext::GetData(ID3D11Asynchronous* pAsync, void* pData, UINT DataSize, UINT GetDataFlags)
+{
+	Record("GetData", RecordedCommandType::Other, 0, 1, 0, 0, false);
+	if (inner) return inner->GetData(pAsync, pData, DataSize, GetDataFlags);
+
+	// Nothing ran, so every query is done and counted nothing
+	if (pData)
+		memset(pData, 0, DataSize);
+	return S_OK;
+}
+
+void RecordingContext::SetResourceMinLOD(ID3D11Resource* pResource, FLOAT MinLOD)
+{
+	Record("SetResourceMinLOD", RecordedCommandType::Other, 0, 1, 0, 0, false);
+	if (inner) inner->SetResourceMinLOD(pResource, MinLOD);
+}
+
+FLOAT RecordingContext::GetResourceMinLOD(ID3D11Resource* pResource)
+{
+	if (inner) return inner->GetResourceMinLOD(pResource);
+	return 0.0f;
+}
+
+void RecordingContext::ExecuteCommandList(ID3D11CommandList* pCommandList, BOOL RestoreContextState)
+{
+	// The list's own state changes aren't visible, so forget what's bound
+	Record("ExecuteCommandList", RecordedCommandType::Other, 0, 1, 0, 0, false);
+	ResetState();
+	if (inner) inner->ExecuteCommandList(pCommandList, RestoreContextState);
+}
+
+void RecordingContext::ClearState()
+{
+	Record("ClearState", RecordedCommandType::Other, 0, 1, 0, 0, false);
+	ResetState();
+	if (inner) inner->ClearState();
+}
+
+void RecordingContext::Flush()
+{
+	Record("Flush", RecordedCommandType::Other, 0, 1, 0, 0, false);
+	if (inner) inner->Flush();
+}
+
+D3D11_DEVICE_CONTEXT_TYPE RecordingContext::GetType()
+{
+	return D3D11_DEVICE_CONTEXT_IMMEDIATE;
+}
+
+UINT RecordingContext::GetContextFlags()
+{
+	return 0;
+}
+
+HRESULT RecordingContext::FinishCommandList(BOOL RestoreDeferredContextState, ID3D11CommandList** ppCommandList)
+{
+	// Only deferred contexts record command lists
+	if (ppCommandList)
+		*ppCommandList = 0;
+	return DXGI_ERROR_INVALID_CALL;
+}
+
+// --------------------------------------------------------
+// Getters. These aren't recorded, and with nothing to
+// forward to they report an empty pipeline: the shadow
+// state doesn't hold references, so it can't hand any out.
+// --------------------------------------------------------
+void RecordingContext::VSGetShader(ID3D11VertexShader** ppVertexShader, ID3D11ClassInstance** ppClassInstances, UINT* pNumClassInstances)
+{
+	if (inner) { inner->VSGetShader(ppVertexShader, ppClassInstances, pNumClassInstances); return; }
+	*ppVertexShader = 0;
+	if (pNumClassInstances) *pNumClassInstances = 0;
+}
+
+void RecordingContext::VSGetConstantBuffers(UINT StartSlot, UINT NumBuffers, ID3D11Buffer** ppConstantBuffers)
+{
+	if (inner) { inner->VSGetConstantBuffers(StartSlot, NumBuffers, ppConstantBuffers); return; }
+	ClearOutput(ppConstantBuffers, NumBuffers);
+}
+
+void RecordingContext::VSGetShaderResources(UINT StartSlot, UINT NumViews, ID3D11ShaderResourceView** ppShaderResourceViews)
+{
+	if (inner) { inner->VSGetShaderResources(StartSlot, NumViews, ppShaderResourceViews); return; }
+	ClearOutput(ppShaderResourceViews, NumViews);
+}
+
+void RecordingContext::VSGetSamplers(UINT StartSlot, UINT NumSamplers, ID3D11SamplerState** ppSamplers)
+{
+	if (inner) { inner->VSGetSamplers(StartSlot, NumSamplers, ppSamplers); return; }
+	ClearOutput(ppSamplers, NumSamplers);
+}
+
+void RecordingContext::HSGetShader(ID3D11HullShader** ppHullShader, ID3D11ClassInstance** ppClassInstances, UINT* pNumClassInstances)
+{
+	if (inner) { inner->HSGetShader(ppHullShader, ppClassInstances, pNumClassInstances); return; }
+	*ppHullShader = 0;
+	if (pNumClassInstances) *pNumClassInstances = 0;
+}
+
+void RecordingContext::HSGetConstantBuffers(UINT StartSlot, UINT NumBuffers, ID3D11Buffer** ppConstantBuffers)
+{
+	if (inner) { inner->HSGetConstantBuffers(StartSlot, NumBuffers, ppConstantBuffers); return; }
+	ClearOutput(ppConstantBuffers, NumBuffers);
+}
+
+void RecordingContext::HSGetShaderResources(UINT StartSlot, UINT NumViews, ID3D11ShaderResourceView** ppShaderResourceViews)
+{
+	if (inner) { inner->HSGetShaderResources(StartSlot, NumViews, ppShaderResourceViews); return; }
+	ClearOutput(ppShaderResourceViews, NumViews);
+}
+
+void RecordingContext::HSGetSamplers(UINT StartSlot, UINT NumSamplers, ID3D11SamplerState** ppSamplers)
+{
+	if (inner) { inner->HSGetSamplers(StartSlot, NumSamplers, ppSamplers); return; }
+	ClearOutput(ppSamplers, NumSamplers);
+}
+
+void RecordingContext::DSGetShader(ID3D11DomainShader** ppDomainShader, ID3D11ClassInstance** ppClassInstances, UINT* pNumClassInstances)
+{
+	if (inner) { inner->DSGetShader(ppDomainShader, ppClassInstances, pNumClassInstances); return; }
+	*ppDomainShader = 0;
+	if (pNumClassInstances) *pNumClassInstances = 0;
+}
+
+void RecordingContext::DSGetConstantBuffers(UINT StartSlot, UINT NumBuffers, ID3D11Buffer** ppConstantBuffers)
+{
+	if (inner) { inner->DSGetConstantBuffers(StartSlot, NumBuffers, ppConstantBuffers); return; }
+	ClearOutput(ppConstantBuffers, NumBuffers);
+}
+
+void RecordingContext::DSGetShaderResources(UINT StartSlot, UINT NumViews, ID3D11ShaderResourceView** ppShaderResourceViews)
+{
+	if (inner) { inner->DSGetShaderResources(StartSlot, NumViews, ppShaderResourceViews); return; }
+	ClearOutput(ppShaderResourceViews, NumViews);
+}
+
+void RecordingContext::DSGetSamplers(UINT StartSlot, UINT NumSamplers, ID3D11SamplerState** ppSamplers)
+{
+	if (inner) { inner->DSGetSamplers(StartSlot, NumSamplers, ppSamplers); return; }
+	ClearOutput(ppSamplers, NumSamplers);
+}
+
+void RecordingContext::GSGetShader(ID3D11GeometryShader** ppGeometryShader, ID3D11ClassInstance** ppClassInstances, UINT* pNumClassInstances)
+{
+	if (inner) { inner->GSGetShader(ppGeometryShader, ppClassInstances, pNumClassInstances); return; }
+	*ppGeometryShader = 0;
+	if (pNumClassInstances) *pNumClassInstances = 0;
+}
+
+void RecordingContext::GSGetConstantBuffers(UINT StartSlot, UINT NumBuffers, ID3D11Buffer** ppConstantBuffers)
+{
+	if (inner) { inner->GSGetConstantBuffers(StartSlot, NumBuffers, ppConstantBuffers); return; }
+	ClearOutput(ppConstantBuffers, NumBuffers);
+}
+
+void RecordingContext::GSGetShaderResources(UINT StartSlot, UINT NumViews, ID3D11ShaderResourceView** ppShaderResourceViews)
+{
+	if (inner) { inner->GSGetShaderResources(StartSlot, NumViews, ppShaderResourceViews); return; }
+	ClearOutput(ppShaderResourceViews, NumViews);
+}
+
+void RecordingContext::GSGetSamplers(UINT StartSlot, UINT NumSamplers, ID3D11SamplerState** ppSamplers)
+{
+	if (inner) { inner->GSGetSamplers(StartSlot, NumSamplers, ppSamplers); return; }
+	ClearOutput(ppSamplers, NumSamplers);
+}
+
+void RecordingContext::PSGetShader(ID3D11PixelShader** ppPixelShader, ID3D11ClassInstance** ppClassInstances, UINT* pNumClassInstances)
+{
+	if (inner) { inner->PSGetShader(ppPixelShader, ppClassInstances, pNumClassInstances); return; }
+	*ppPixelShader = 0;
+	if (pNumClassInstances) *pNumClassInstances = 0;
+}
+
+void RecordingContext::PSGetConstantBuffers(UINT StartSlot, UINT NumBuffers, ID3D11Buffer** ppConstantBuffers)
+{
+	if (inner) { inner->PSGetConstantBuffers(StartSlot, NumBuffers, ppConstantBuffers); return; }
+	ClearOutput(ppConstantBuffers, NumBuffers);
+}
+
+void RecordingContext::PSGetShaderResources(UINT StartSlot, UINT NumViews, ID3D11ShaderResourceView** ppShaderResourceViews)
+{
+	if (inner) { inner->PSGetShaderResources(StartSlot, NumViews, ppShaderResourceViews); return; }
+	ClearOutput(ppShaderResourceViews, NumViews);
+}
+
+void RecordingContext::PSGetSamplers(UINT StartSlot, UINT NumSamplers, ID3D11SamplerState** ppSamplers)
+{
+	if (inner) { inner->PSGetSamplers(StartSlot, NumSamplers, ppSamplers); return; }
+	ClearOutput(ppSamplers, NumSamplers);
+}
+
+void RecordingContext::CSGetShader(ID3D11ComputeShader** ppComputeShader, ID3D11ClassInstance** ppClassInstances, UINT* pNumClassInstances)
+{
+	if (inner) { inner->CSGetShader(ppComputeShader, ppClassInstances, pNumClassInstances); return; }
+	*ppComputeShader = 0;
+	if (pNumClassInstances) *pNumClassInstances = 0;
+}
+
+void RecordingContext::CSGetConstantBuffers(UINT StartSlot, UINT NumBuffers, ID3D11Buffer** ppConstantBuffers)
+{
+	if (inner) { inner->CSGetConstantBuffers(StartSlot, NumBuffers, ppConstantBuffers); return; }
+	ClearOutput(ppConstantBuffers, NumBuffers);
+}
+
+void RecordingContext::CSGetShaderResources(UINT StartSlot, UINT NumViews, ID3D11ShaderResourceView** ppShaderResourceViews)
+{
+	if (inner) { inner->CSGetShaderResources(StartSlot, NumViews, ppShaderResourceViews); return; }
+	ClearOutput(ppShaderResourceViews, NumViews);
+}
+
+void RecordingContext::CSGetSamplers(UINT StartSlot, UINT NumSamplers, ID3D11SamplerState** ppSamplers)
+{
+	if (inner) { inner->CSGetSamplers(StartSlot, NumSamplers, ppSamplers); return; }
+	ClearOutput(ppSamplers, NumSamplers);
+}
+
+void RecordingContext::CSGetUnorderedAccessViews(UINT StartSlot, UINT NumUAVs, ID3D11UnorderedAccessView** ppUnorderedAccessViews)
+{
+	if (inner) { inner->CSGetUnorderedAccessViews(StartSlot, NumUAVs, ppUnorderedAccessViews); return; }
+	ClearOutput(ppUnorderedAccessViews, NumUAVs);
+}
+
+void RecordingContext::IAGetInputLayout(ID3D11InputLayout** ppInputLayout)
+{
+	if (inner) { inner->IAGetInputLayout(ppInputLayout); return; }
+	*ppInputLayout = 0;
+}
+
+void RecordingContext::IAGetVertexBuffers(UINT StartSlot, UINT NumBuffers, ID3D11Buffer** ppVertexBuffers, UINT* pStrides, UINT* pOffsets)
+{
+	if (inner) { inner->IAGetVertexBuffers(StartSlot, NumBuffers, ppVertexBuffers, pStrides, pOffsets); return; }
+	ClearOutput(ppVertexBuffers, NumBuffers);
+	if (pStrides) memset(pStrides, 0, sizeof(UINT) * NumBuffers);
+	if (pOffsets) memset(pOffsets, 0, sizeof(UINT) * NumBuffers);
+}
+
+void RecordingContext::IAGetIndexBuffer(ID3D11Buffer** pIndexBuffer, DXGI_FORMAT* Format, UINT* Offset)
+{
+	if (inner) { inner->IAGetIndexBuffer(pIndexBuffer, Format, Offset); return; }
+	if (pIndexBuffer) *pIndexBuffer = 0;
+	if (Format) *Format = DXGI_FORMAT_UNKNOWN;
+	if (Offset) *Offset = 0;
+}
+
+void RecordingContext::IAGetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY* pTopology)
+{
+	if (inner) { inner->IAGetPrimitiveTopology(pTopology); return; }
+	*pTopology = state.Topology;
+}
+
+void RecordingContext::GetPredication(ID3D11Predicate** ppPredicate, BOOL* pPredicateValue)
+{
+	if (inner) { inner->GetPredication(ppPredicate, pPredicateValue); return; }
+	if (ppPredicate) *ppPredicate = 0;
+	if (pPredicateValue) *pPredicateValue = FALSE;
+}
+
+void RecordingContext::OMGetRenderTargets(UINT NumViews, ID3D11RenderTargetView** ppRenderTargetViews, ID3D11DepthStencilView** ppDepthStencilView)
+{
+	if (inner) { inner->OMGetRenderTargets(NumViews, ppRenderTargetViews, ppDepthStencilView); return; }
+	ClearOutput(ppRenderTargetViews, NumViews);
+	if (ppDepthStencilView) *ppDepthStencilView = 0;
+}
+
+void RecordingContext::OMGetRenderTargetsAndUnorderedAccessViews(UINT NumRTVs, ID3D11RenderTargetView** ppRenderTargetViews, ID3D11DepthStencilView** ppDepthStencilView,
+	UINT UAVStartSlot, UINT NumUAVs, ID3D11UnorderedAccessView** ppUnorderedAccessViews)
+{
+	if (inner) { inner->OMGetRenderTargetsAndUnorderedAccessViews(NumRTVs, ppRenderTargetViews, ppDepthStencilView, UAVStartSlot, NumUAVs, ppUnorderedAccessViews); return; }
+	ClearOutput(ppRenderTargetViews, NumRTVs);
+	if (ppDepthStencilView) *ppDepthStencilView = 0;
+	ClearOutput(ppUnorderedAccessViews, NumUAVs);
+}
+
+void RecordingContext::OMGetBlendState(ID3D11BlendState** ppBlendState, FLOAT BlendFactor[4], UINT* pSampleMask)
+{
+	if (inner) { inner->OMGetBlendState(ppBlendState, BlendFactor, pSampleMask); return; }
+	if (ppBlendState) *ppBlendState = 0;
+	if (BlendFactor) memcpy(BlendFactor, state.BlendFactor, sizeof(state.BlendFactor));
+	if (pSampleMask) *pSampleMask = state.SampleMask;
+}
+
+void RecordingContext::OMGetDepthStencilState(ID3D11DepthStencilState** ppDepthStencilState, UINT* pStencilRef)
+{
+	if (inner) { inner->OMGetDepthStencilState(ppDepthStencilState, pStencilRef); return; }
+	if (ppDepthStencilState) *ppDepthStencilState = 0;
+	if (pStencilRef) *pStencilRef = state.StencilRef;
+}
+
+void RecordingContext::SOGetTargets(UINT NumBuffers, ID3D11Buffer** ppSOTargets)
+{
+	if (inner) { inner->SOGetTargets(NumBuffers, ppSOTargets); return; }
+	ClearOutput(ppSOTargets, NumBuffers);
+}
+
+void RecordingContext::RSGetState(ID3D11RasterizerState** ppRasterizerState)
+{
+	if (inner) { inner->RSGetState(ppRasterizerState); return; }
+	*ppRasterizerState = 0;
+}
+
+void RecordingContext::RSGetViewports(UINT* pNumViewports, D3D11_VIEWPORT* pViewports)
+{
+	if (inner) { inner->RSGetViewports(pNumViewports, pViewports); return; }
+
+	// Viewports are plain data, so those can come from the shadow state
+	if (pViewports)
+	{
+		UINT count = *pNumViewports < state.ViewportCount ? *pNumViewports : state.ViewportCount;
+		memcpy(pViewports, state.Viewports, sizeof(D3D11_VIEWPORT) * count);
+		*pNumViewports = count;
+	}
+	else
+	{
+		*pNumViewports = state.ViewportCount;
+	}
+}
+
+void RecordingContext::RSGetScissorRects(UINT* pNumRects, D3D11_RECT* pRects)
+{
+	if (inner) { inner->RSGetScissorRects(pNumRects, pRects); return; }
+	*pNumRects = 0;
+}
@@ -0,0 +1,387 @@
+#include "RenderQueue.h"
+#include "MaterialArray.h"
+#include "Vertex.h"
+#include <cstring>
+
+// Where each field sits in the key
+static const unsigned int PassShift = 60;
+static const unsigned int ShaderShift = 48;
+static const unsigned int MaterialShift = 32;
+static const unsigned int MeshShift = 16;
+
+// What a material's binds are shared by: its material array, if it
+// has one, or just itself
+static void* GetMapGroup(Material* material)
+{
+	std::shared_ptr<MaterialArray> materialArray = material->GetMaterialArray();
+	return materialArray ? (void*)materialArray.get() : (void*)material;
+}
+
+RenderQueue::RenderQueue()
+{
+	instanceCapacity = 0;
+}
+
+void RenderQueue::Clear()
+{
+	packets.clear();
+}
+
+// --------------------------------------------------------
+// Adds one draw of an entity to the queue
+// --------------------------------------------------------
+void RenderQueue::Submit(RenderPass pass, GameEntity* entity, float depth)
+{
+	Material* material = entity->GetMaterial().get();
+
+	// Shaders are ided as a pair, since they're always bound together
+	unsigned int shaderId = 0;
+	unsigned int materialId = 0;
+	if (pass != RenderPass::Shadow)
+	{
+		std::pair<void*, void*> shaders(material->GetVertexShader().get(), material->GetPixelShader().get());
+		auto id = shaderIds.find(shaders);
+		if (id == shaderIds.end())
+			id = shaderIds.insert({ shaders, (unsigned int)shaderIds.size() }).first;
+		shaderId = id->second;
+		materialId = GetId(materialIds, GetMapGroup(material));
+	}
+
+	// Quantize the depth, clamping anything outside the view range
+	if (depth < 0.0f) depth = 0.0f;
+	if (depth > 1.0f) depth = 1.0f;
+
+	DrawPacket packet;
+	packet.Key =
+		((uint64_t)pass << PassShift) |
+		((uint64_t)(shaderId & 0xFFF) << ShaderShift) |
+		((uint64_t)(materialId & 0xFFFF) << MaterialShift) |
+		((uint64_t)(GetId(meshIds, entity->GetMesh().get()) & 0xFFFF) << MeshShift) |
+		(uint64_t)(depth * 65535.0f);
+	packet.Entity = entity;
+	packets.push_back(packet);
+}
+
+void RenderQueue::Sort()
+{
+	RadixSort(packets, scratch);
+}
+
+// --------------------------------------------------------
+// Draws every packet in the given pass. Bound state is
+// forgotten first, since anything may have been bound
+// between passes.
+// --------------------------------------------------------
+void RenderQueue::Execute(
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+	RenderPass pass,
+	DrawCallback setupDraw,
+	std::shared_ptr<SimpleVertexShader> depthOnlyShader,
+	std::shared_ptr<SimpleVertexShader> depthOnlyInstancedShader)
+{
+	bool depthOnly = depthOnlyShader != 0;
+	BuildBatches(pass, depthOnly, !depthOnly || depthOnlyInstancedShader != 0);
+
+	// Without the instance buffer, everything is drawn one at a time
+	if (!UploadInstances(context))
+		BuildBatches(pass, depthOnly, false);
+
+	SimpleVertexShader* boundVS = 0;
+	SimplePixelShader* boundPS = 0;
+	Material* boundMaterial = 0;
+	void* boundMaps = 0;
+	Mesh* boundMesh = 0;
+	bool instanceBufferBound = false;
+
+	if (depthOnly)
+	{
+		context->PSSetShader(0, 0, 0);
+		stats.ShaderBinds++;
+	}
+
+	for (DrawBatch& batch : batches)
+	{
+		GameEntity* entity = packets[batch.First].Entity;
+		Material* material = entity->GetMaterial().get();
+		Mesh* mesh = entity->GetMesh().get();
+		unsigned int changes = batch.Instanced ? Instanced : 0;
+
+		// Shaders, which also bind their constant buffers
+		SimpleVertexShader* vs = 0;
+		if (depthOnly)
+			vs = batch.Instanced ? depthOnlyInstancedShader.get() : depthOnlyShader.get();
+		else
+			vs = batch.Instanced ? material->GetInstancedVertexShader().get() : material->GetVertexShader().get();
+
+		if (vs != boundVS)
+		{
+			vs->SetShader();
+			stats.ShaderBinds++;
+			stats.BufferBinds += vs->GetBufferCount();
+			boundVS = vs;
+			changes |= ShaderChanged;
+		}
+		else stats.SkippedBinds += 1 + vs->GetBufferCount();
+
+		if (!depthOnly)
+		{
+			SimplePixelShader* ps = material->GetPixelShader().get();
+			if (ps != boundPS)
+			{
+				ps->SetShader();
+				stats.ShaderBinds++;
+				stats.BufferBinds += ps->GetBufferCount();
+				boundPS = ps;
+				changes |= ShaderChanged;
+			}
+			else stats.SkippedBinds += 1 + ps->GetBufferCount();
+
+			// Textures and samplers, which a material array's materials share
+			void* maps = GetMapGroup(material);
+			if (maps != boundMaps)
+			{
+				material->SetMaps();
+				stats.SRVBinds += (unsigned int)material->GetTextureSRVCount();
+				stats.SamplerBinds += (unsigned int)material->GetSamplerCount();
+				boundMaps = maps;
+			}
+			else stats.SkippedBinds += (unsigned int)(material->GetTextureSRVCount() + material->GetSamplerCount());
+
+			// Its parameters still change from material to material
+			if (material != boundMaterial)
+			{
+				boundMaterial = material;
+				changes |= MaterialChanged;
+			}
+		}
+
+		// Geometry
+		if (mesh != boundMesh)
+		{
+			UINT stride = sizeof(Vertex);
+			UINT offset = 0;
+			context->IASetVertexBuffers(0, 1, mesh->GetVertexBuffer().GetAddressOf(), &stride, &offset);
+			context->IASetIndexBuffer(mesh->GetIndexBuffer().Get(), DXGI_FORMAT_R32_UINT, 0);
+			stats.BufferBinds += 2;
+			boundMesh = mesh;
+			changes |= MeshChanged;
+		}
+		else stats.SkippedBinds += 2;
+
+		// Instances read their matrices from the second input slot
+		if (batch.Instanced && !instanceBufferBound)
+		{
+			UINT stride = sizeof(InstanceData);
+			UINT offset = 0;
+			context->IASetVertexBuffers(1, 1, instanceBuffer.GetAddressOf(), &stride, &offset);
+			stats.BufferBinds++;
+			instanceBufferBound = true;
+		}
+
+		setupDraw(entity, changes);
+
+		if (batch.Instanced)
+		{
+			context->DrawIndexedInstanced(mesh->GetIndexCount(), (UINT)batch.Count, 0, 0, batch.FirstInstance);
+			stats.Instances += (unsigned int)batch.Count;
+		}
+		else
+			context->DrawIndexed(mesh->GetIndexCount(), 0, 0);
+		stats.DrawCalls++;
+	}
+}
+
+// --------------------------------------------------------
+// Splits a pass's packets into draws. Sorting already put
+// packets with the same mesh and material (or material
+// array) side by side, so each run of them is one instanced
+// draw, when the material has an instanced vertex shader.
+// Depth-only draws just need the same mesh.
+// --------------------------------------------------------
+void RenderQueue::BuildBatches(RenderPass pass, bool depthOnly, bool allowInstancing)
+{
+	batches.clear();
+	instanceData.clear();
+
+	size_t i = 0;
+	while (i < packets.size())
+	{
+		if ((packets[i].Key >> PassShift) != (uint64_t)pass)
+		{
+			i++;
+			continue;
+		}
+
+		Material* material = packets[i].Entity->GetMaterial().get();
+		Mesh* mesh = packets[i].Entity->GetMesh().get();
+		void* maps = GetMapGroup(material);
+
+		// Find the end of the run, comparing the real objects since ids can overflow.
+		// Materials in one array also need the same shaders, which the key can't promise.
+		size_t end = i + 1;
+		while (end < packets.size() &&
+			(packets[end].Key >> PassShift) == (uint64_t)pass &&
+			packets[end].Entity->GetMesh().get() == mesh &&
+			(depthOnly || (
+				GetMapGroup(packets[end].Entity->GetMaterial().get()) == maps &&
+				packets[end].Entity->GetMaterial()->GetVertexShader() == material->GetVertexShader() &&
+				packets[end].Entity->GetMaterial()->GetPixelShader() == material->GetPixelShader())))
+			end++;
+
+		bool instanced =
+			allowInstancing &&
+			end - i >= MinInstanceCount &&
+			(depthOnly || material->GetInstancedVertexShader() != 0);
+
+		if (instanced)
+		{
+			DrawBatch batch = { i, end - i, (unsigned int)instanceData.size(), true };
+			batches.push_back(batch);
+			for (size_t p = i; p < end; p++)
+			{
+				InstanceData data;
+				data.world = packets[p].Entity->GetTransform()->GetWorldMatrix();
+				data.worldInvTranspose = packets[p].Entity->GetTransform()->GetWorldInverseTransposeMatrix();
+				data.materialIndex = packets[p].Entity->GetMaterial()->GetArrayIndex();
+				instanceData.push_back(data);
+			}
+		}
+		else
+		{
+			for (size_t p = i; p < end; p++)
+			{
+				DrawBatch batch = { p, 1, 0, false };
+				batches.push_back(batch);
+			}
+		}
+
+		i = end;
+	}
+}
+
+// --------------------------------------------------------
+// Copies the pass's instance matrices to the GPU in one
+// Map, growing the buffer first if they don't fit. Returns
+// false if there's nowhere to put them.
+// --------------------------------------------------------
+bool RenderQueue::UploadInstances(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+{
+	if (instanceData.empty())
+		return true;
+
+	if (instanceData.size() > instanceCapacity)
+	{
+		// Double up, so a growing scene doesn't remake it every frame
+		size_t capacity = instanceCapacity > 0 ? instanceCapacity : 256;
+		while (capacity < instanceData.size())
+			capacity *= 2;
+
+		Microsoft::WRL::ComPtr<ID3D11Device> device;
+		context->GetDevice(device.GetAddressOf());
+
+		D3D11_BUFFER_DESC desc = {};
+		desc.Usage = D3D11_USAGE_DYNAMIC;
+		desc.ByteWidth = (UINT)(capacity * sizeof(InstanceData));
+		desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+		desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+		instanceBuffer.Reset();
+		instanceCapacity = 0;
+		if (FAILED(device->CreateBuffer(&desc, 0, instanceBuffer.GetAddressOf())))
+			return false;
+		instanceCapacity = capacity;
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	if (FAILED(context->Map(instanceBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+		return false;
+	memcpy(mapped.pData, instanceData.data(), instanceData.size() * sizeof(InstanceData));
+	context->Unmap(instanceBuffer.Get(), 0);
+	return true;
+}
+
+const std::vector<DrawPacket>& RenderQueue::GetPackets() { return packets; }
+RenderStats& RenderQueue::GetStats() { return stats; }
+void RenderQueue::ResetStats() { stats = RenderStats(); }
+
+// --------------------------------------------------------
+// Sorts packets by key, least significant byte first. Each
+// pass is a stable counting sort into the other buffer.
+// Short queues, like this demo's, use an insertion sort.
+// Bytes that are the same in every key (the unused high
+// pass bits, or depth when nothing moves) are skipped.
+// --------------------------------------------------------
+void RenderQueue::RadixSort(std::vector<DrawPacket>& packets, std::vector<DrawPacket>& scratch)
+{
+	size_t count = packets.size();
+	if (count < 2)
+		return;
+
+	// Small queues aren't worth clearing the histograms for
+	if (count <= 64)
+	{
+		for (size_t i = 1; i < count; i++)
+		{
+			DrawPacket packet = packets[i];
+			size_t j = i;
+			for (; j > 0 && packets[j - 1].Key > packet.Key; j--)
+				packets[j] = packets[j - 1];
+			packets[j] = packet;
+		}
+		return;
+	}
+
+	scratch.resize(count);
+
+	// Count every byte of every key in one read of the data
+	size_t histograms[8][256] = {};
+	for (size_t i = 0; i < count; i++)
+	{
+		uint64_t key = packets[i].Key;
+		for (int b = 0; b < 8; b++)
+			histograms[b][(key >> (b * 8)) & 0xFF]++;
+	}
+
+	DrawPacket* source = packets.data();
+	DrawPacket* dest = scratch.data();
+	for (int b = 0; b < 8; b++)
+	{
+		size_t* histogram = histograms[b];
+		unsigned int shift = b * 8;
+
+		// Every key has the same byte here, so this pass would change nothing
+		if (histogram[(source[0].Key >> shift) & 0xFF] == count)
+			continue;
+
+		// Turn counts into starting offsets
+		size_t offset = 0;
+		for (int d = 0; d < 256; d++)
+		{
+			size_t digitCount = histogram[d];
+			histogram[d] = offset;
+			offset += digitCount;
+		}
+
+		for (size_t i = 0; i < count; i++)
+			dest[histogram[(source[i].Key >> shift) & 0xFF]++] = source[i];
+
+		DrawPacket* swap = source;
+		source = dest;
+		dest = swap;
+	}
+
+	// Odd number of passes leaves the results in the scratch buffer
+	if (source != packets.data())
+		packets.swap(scratch);
+}
+
+// --------------------------------------------------------
+// Gets an object's id, handing out the next one if it's new
+// --------------------------------------------------------
+unsigned int RenderQueue::GetId(std::unordered_map<void*, unsigned int>& ids, void* object)
+{
+	auto id = ids.find(object);
+	if (id == ids.end())
+		id = ids.insert({ object, (unsigned int)ids.size() }).first;
+	return id->second;
+}
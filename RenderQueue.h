@@ -0,0 +1,144 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include "BufferStructs.h"
+#include "GameEntity.h"
+
+// The passes a draw can belong to, in the order they sort
+enum class RenderPass : unsigned int
+{
+	Shadow,
+	Opaque,
+	Sky,
+	Post
+};
+
+// One draw, with the key it's sorted by
+struct DrawPacket
+{
+	uint64_t Key;
+	GameEntity* Entity;
+};
+
+// Binds issued (and avoided) by a render queue
+struct RenderStats
+{
+	unsigned int ShaderBinds = 0;
+	unsigned int SRVBinds = 0;
+	unsigned int SamplerBinds = 0;
+	unsigned int BufferBinds = 0;
+	unsigned int SkippedBinds = 0;
+	unsigned int DrawCalls = 0;
+	unsigned int Instances = 0;
+};
+
+// A run of packets drawn with one call. Instanced batches read their
+// matrices (and material indices) from the instance buffer, starting
+// at FirstInstance.
+struct DrawBatch
+{
+	size_t First;
+	size_t Count;
+	unsigned int FirstInstance;
+	bool Instanced;
+};
+
+// --------------------------------------------------------
+// Collects the frame's draws, sorts them so draws sharing
+// state end up next to each other, then submits them while
+// skipping any bind that's already in place
+//
+// Key layout, most significant bits first:
+//   pass (4) | shaders (12) | material (16) | mesh (16) | depth (16)
+//
+// - Shader, material and mesh ids are handed out the first
+//   time each is seen. Ids that overflow their field only
+//   cost grouping, since binds compare the real objects
+// - Depth sorts front to back within a mesh, for early-z
+// - Shadow draws all use one depth-only shader, so they
+//   leave the shader and material fields empty and just
+//   group by mesh
+// - Runs of draws with the same mesh and material (just the
+//   same mesh, for shadows) become one DrawIndexedInstanced,
+//   with every entity's matrices packed into an instance
+//   buffer, when there's an instanced vertex shader for them
+// - Materials in the same MaterialArray bind the same maps,
+//   so they share a material id and batch together, each
+//   instance carrying its own material's index
+// --------------------------------------------------------
+class RenderQueue
+{
+public:
+	RenderQueue();
+
+	// Flags passed to the per-draw callback for whatever was just bound
+	static const unsigned int ShaderChanged = 1;
+	static const unsigned int MaterialChanged = 2;
+	static const unsigned int MeshChanged = 4;
+	static const unsigned int Instanced = 8;
+
+	// Shortest run of matching draws worth instancing
+	static const size_t MinInstanceCount = 2;
+
+	typedef std::function<void(GameEntity* entity, unsigned int changes)> DrawCallback;
+
+	void Clear();
+
+	// depth is the distance to the camera over the far plane, 0 to 1
+	void Submit(RenderPass pass, GameEntity* entity, float depth);
+
+	// Radix sorts the submitted packets by key
+	void Sort();
+
+	// Binds and draws every packet of the given pass, in sorted order.
+	// The callback runs just before each draw to set and upload shader
+	// data; anything it binds itself should be added to GetStats().
+	// With a depth-only shader, that's bound once in place of each
+	// material's shaders and maps, and no pixel shader is bound.
+	// Instanced batches use the material's instanced vertex shader
+	// (or depthOnlyInstancedShader) and get the Instanced flag, with
+	// the first entity of the batch; their matrices are already bound.
+	void Execute(
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		RenderPass pass,
+		DrawCallback setupDraw,
+		std::shared_ptr<SimpleVertexShader> depthOnlyShader = 0,
+		std::shared_ptr<SimpleVertexShader> depthOnlyInstancedShader = 0);
+
+	const std::vector<DrawPacket>& GetPackets();
+
+	// Binds issued since the last reset
+	RenderStats& GetStats();
+	void ResetStats();
+
+	// LSD radix sort on the keys, 8 bits per pass, skipping the
+	// passes where every key has the same byte
+	static void RadixSort(std::vector<DrawPacket>& packets, std::vector<DrawPacket>& scratch);
+
+private:
+	std::vector<DrawPacket> packets;
+	std::vector<DrawPacket> scratch;
+
+	std::map<std::pair<void*, void*>, unsigned int> shaderIds;
+	std::unordered_map<void*, unsigned int> materialIds;
+	std::unordered_map<void*, unsigned int> meshIds;
+
+	RenderStats stats;
+
+	// The current pass's draws, and the matrices of its instanced ones
+	std::vector<DrawBatch> batches;
+	std::vector<InstanceData> instanceData;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> instanceBuffer;
+	size_t instanceCapacity;
+
+	void BuildBatches(RenderPass pass, bool depthOnly, bool allowInstancing);
+	bool UploadInstances(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+
+	static unsigned int GetId(std::unordered_map<void*, unsigned int>& ids, void* object);
+};
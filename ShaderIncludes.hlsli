@@ -5,14 +5,17 @@
 #define LIGHT_TYPE_SPOT			2
 #define MAX_SPECULAR_EXPONENT	256.0f
 
+#include "ConstantBuffers.hlsli"
+
 struct VertexToPixel
 {
 	float4 screenPosition	: SV_POSITION;
 	float2 uv				: TEXCOORD;
 	float3 normal			: NORMAL;
 	float3 worldPosition	: POSITION;
-	float3 tangent			: TANGENT;
+	float4 tangent			: TANGENT;		// w = bitangent sign
 	float4 shadowMapPos		: SHADOWPOS;
+	nointerpolation uint materialIndex : MATERIAL;	// Only read by material array shaders
 };
 
 struct VertexShaderInput
@@ -20,20 +23,34 @@ struct VertexShaderInput
 	float3 localPosition	: POSITION;     // XYZ position
 	float3 normal			: NORMAL;
 	float2 uv				: TEXCOORD;
-	float3 tangent			: TANGENT;
+	float4 tangent			: TANGENT;		// w = bitangent sign
 };
 
-// Struct for all types of lights
-struct Light
+// A vertex plus its instance's matrices and material index, which come
+// from a second vertex buffer (InstanceData on the C++ side). SimpleVertexShader
+// puts semantics ending in _PER_INSTANCE in input slot 1.
+struct VertexShaderInputInstanced
 {
-	int Type;
-	float3 Direction;
-	float Range;
-	float3 Position;
-	float Intensity;
-	float3 Color;
-	float SpotFalloff;
-	float3 Padding;
+	float3 localPosition	: POSITION;     // XYZ position
+	float3 normal			: NORMAL;
+	float2 uv				: TEXCOORD;
+	float4 tangent			: TANGENT;		// w = bitangent sign
+	float4x4 world			: WORLD_PER_INSTANCE;
+	float4x4 worldInvTranspose	: WORLD_INV_TRANSPOSE_PER_INSTANCE;
+	uint materialIndex		: MATERIAL_PER_INSTANCE;
 };
 
+// Vertex inputs fill a matrix row by row, straight from the C++
+// layout, while cbuffer matrices are column major. Transposing
+// gives the same matrix the PerObject cbuffer would.
+matrix InstanceWorld(VertexShaderInputInstanced input)
+{
+	return transpose(input.world);
+}
+
+matrix InstanceWorldInvTranspose(VertexShaderInputInstanced input)
+{
+	return transpose(input.worldInvTranspose);
+}
+
 #endif
\ No newline at end of file
@@ -1,23 +1,28 @@
 #include "ShaderIncludes.hlsli"
 
-cbuffer ExternalData : register(b0)
-{
-	matrix world;
-	matrix view;
-	matrix projection;
-}
+// view and projection (PerPass) are the light's during the shadow pass
 
 struct VertexToPixel_Shadow
 {
 	float4 screenPosition	: SV_POSITION;
 }; 
 
+#ifdef INSTANCED
+VertexToPixel_Shadow main(VertexShaderInputInstanced input)
+#else
 VertexToPixel_Shadow main(VertexShaderInput input)
+#endif
 {
 	// Set up output struct
 	VertexToPixel_Shadow output;
 
-	matrix wvp = mul(mul(projection, view), world);
+#ifdef INSTANCED
+	matrix worldMatrix = InstanceWorld(input);
+#else
+	matrix worldMatrix = world;
+#endif
+
+	matrix wvp = mul(mul(projection, view), worldMatrix);
 	output.screenPosition = mul(wvp, float4(input.localPosition, 1.0f));
 
 	return output;
@@ -0,0 +1,4 @@
+// The same shadow vertex shader, with each instance's world matrix
+// read from the instance buffer rather than the PerObject cbuffer
+#define INSTANCED
+#include "ShadowVertexShader.hlsl"
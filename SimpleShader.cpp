@@ -4,6 +4,13 @@
 bool ISimpleShader::ReportErrors = false;
 bool ISimpleShader::ReportWarnings = false;
 
+// Constant buffer uploads
+bool ISimpleShader::UseDynamicBuffers = true;
+size_t ISimpleShader::UploadedBytes = 0;
+size_t ISimpleShader::ChangedBytes = 0;
+size_t ISimpleShader::SkippedUploads = 0;
+unsigned int ISimpleShader::ExternalBufferSlots = 0;
+
 // To enable error reporting, use either or both 
 // of the following lines somewhere in your program, 
 // preferably before loading/using any shaders.
@@ -196,12 +203,29 @@ bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 		newBuffDesc.CPUAccessFlags = 0;
 		newBuffDesc.MiscFlags = 0;
 		newBuffDesc.StructureByteStride = 0;
-		device->CreateBuffer(&newBuffDesc, 0, constantBuffers[b].ConstantBuffer.GetAddressOf());
 
-		// Set up the data buffer for this constant buffer
+		// Prefer a dynamic buffer, falling back to a default one if that fails
+		if (UseDynamicBuffers)
+		{
+			newBuffDesc.Usage = D3D11_USAGE_DYNAMIC;
+			newBuffDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+			constantBuffers[b].Dynamic = SUCCEEDED(device->CreateBuffer(&newBuffDesc, 0, constantBuffers[b].ConstantBuffer.GetAddressOf()));
+		}
+		if (!constantBuffers[b].Dynamic)
+		{
+			newBuffDesc.Usage = D3D11_USAGE_DEFAULT;
+			newBuffDesc.CPUAccessFlags = 0;
+			device->CreateBuffer(&newBuffDesc, 0, constantBuffers[b].ConstantBuffer.GetAddressOf());
+		}
+
+		// Set up the data buffer for this constant buffer, which
+		// starts out dirty so the first copy always uploads it
 		constantBuffers[b].Size = bufferDesc.Size;
 		constantBuffers[b].LocalDataBuffer = new unsigned char[bufferDesc.Size];
 		ZeroMemory(constantBuffers[b].LocalDataBuffer, bufferDesc.Size);
+		constantBuffers[b].Dirty = true;
+		constantBuffers[b].DirtyStart = 0;
+		constantBuffers[b].DirtyEnd = bufferDesc.Size;
 
 		// Loop through all variables in this buffer
 		for (unsigned int v = 0; v < bufferDesc.Variables; v++)
@@ -345,14 +369,11 @@ void ISimpleShader::CopyAllBufferData()
 	// Ensure the shader is valid
 	if (!shaderValid) return;
 
-	// Loop through the constant buffers and copy all data
+	// Loop through the constant buffers and copy any that changed,
+	// leaving out ones the application fills in itself
 	for (unsigned int i = 0; i < constantBufferCount; i++)
-	{
-		// Copy the entire local data buffer
-		deviceContext->UpdateSubresource(
-			constantBuffers[i].ConstantBuffer.Get(), 0, 0,
-			constantBuffers[i].LocalDataBuffer, 0, 0);
-	}
+		if (!IsExternalBuffer(constantBuffers[i]))
+			UploadBuffer(constantBuffers[i]);
 }
 
 // --------------------------------------------------------
@@ -379,10 +400,8 @@ void ISimpleShader::CopyBufferData(unsigned int index)
 	SimpleConstantBuffer* cb = &this->constantBuffers[index];
 	if (!cb) return;
 
-	// Copy the data and get out
-	deviceContext->UpdateSubresource(
-		cb->ConstantBuffer.Get(), 0, 0, 
-		cb->LocalDataBuffer, 0, 0);
+	// Copy the data (if it changed) and get out
+	UploadBuffer(*cb);
 }
 
 // --------------------------------------------------------
@@ -401,10 +420,42 @@ void ISimpleShader::CopyBufferData(std::string bufferName)
 	SimpleConstantBuffer* cb = this->FindConstantBuffer(bufferName);
 	if (!cb) return;
 
-	// Copy the data and get out
-	deviceContext->UpdateSubresource(
-		cb->ConstantBuffer.Get(), 0, 0, 
-		cb->LocalDataBuffer, 0, 0);
+	// Copy the data (if it changed) and get out
+	UploadBuffer(*cb);
+}
+
+// --------------------------------------------------------
+// Sends a constant buffer's local data to the GPU, but only
+// if a setter has changed it since the last upload
+//
+// Dynamic buffers are mapped with WRITE_DISCARD, so the
+// driver can hand back fresh memory rather than waiting on
+// draws still using the old contents. Discarding means the
+// whole buffer is rewritten; the dirty range is tracked for
+// the stats, since D3D11.0 can't update part of a cbuffer.
+// --------------------------------------------------------
+void ISimpleShader::UploadBuffer(SimpleConstantBuffer& cb)
+{
+	if (!cb.Dirty)
+	{
+		SkippedUploads++;
+		return;
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	if (cb.Dynamic && SUCCEEDED(deviceContext->Map(cb.ConstantBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+	{
+		memcpy(mapped.pData, cb.LocalDataBuffer, cb.Size);
+		deviceContext->Unmap(cb.ConstantBuffer.Get(), 0);
+	}
+	else
+	{
+		deviceContext->UpdateSubresource(cb.ConstantBuffer.Get(), 0, 0, cb.LocalDataBuffer, 0, 0);
+	}
+
+	UploadedBytes += cb.Size;
+	ChangedBytes += cb.DirtyEnd - cb.DirtyStart;
+	cb.Dirty = false;
 }
 
 
@@ -446,15 +497,44 @@ bool ISimpleShader::SetData(std::string name, const void* data, unsigned int siz
 	}
 
 	// Set the data in the local data buffer
-	memcpy(
-		constantBuffers[var->ConstantBufferIndex].LocalDataBuffer + var->ByteOffset,
-		data,
-		size);
+	WriteLocalData(constantBuffers[var->ConstantBufferIndex], var->ByteOffset, data, size);
 
 	// Success
 	return true;
 }
 
+// --------------------------------------------------------
+// Looks up a variable by name and returns a handle to it,
+// which can be used to set it from then on without any
+// further lookups
+//
+// name - The name of the shader variable
+//
+// Returns an invalid handle (Size of 0) if the variable
+// doesn't exist
+// --------------------------------------------------------
+SimpleShaderVariableHandle ISimpleShader::GetVariableHandle(std::string name)
+{
+	SimpleShaderVariableHandle handle;
+
+	SimpleShaderVariable* var = FindVariable(name, -1);
+	if (var == 0)
+	{
+		if (ReportWarnings)
+		{
+			LogWarning("SimpleShader::GetVariableHandle() - Shader variable '");
+			Log(name);
+			LogWarning("' not found. Ensure the name is spelled correctly and that it exists in a constant buffer in the shader.\n");
+		}
+		return handle;
+	}
+
+	handle.ConstantBufferIndex = var->ConstantBufferIndex;
+	handle.ByteOffset = var->ByteOffset;
+	handle.Size = var->Size;
+	return handle;
+}
+
 // --------------------------------------------------------
 // Sets INTEGER data
 // --------------------------------------------------------
@@ -875,8 +955,9 @@ void SimpleVertexShader::SetShaderAndCBs()
 	// Set the constant buffers
 	for (unsigned int i = 0; i < constantBufferCount; i++)
 	{
-		// Skip "buffers" that aren't true constant buffers
-		if (constantBuffers[i].Type != D3D11_CT_CBUFFER)
+		// Skip "buffers" that aren't true constant buffers,
+		// and ones the application binds itself
+		if (constantBuffers[i].Type != D3D11_CT_CBUFFER || IsExternalBuffer(constantBuffers[i]))
 			continue;
 
 		// This is a real constant buffer, so set it
@@ -1017,8 +1098,9 @@ void SimplePixelShader::SetShaderAndCBs()
 	// Set the constant buffers
 	for (unsigned int i = 0; i < constantBufferCount; i++)
 	{
-		// Skip "buffers" that aren't true constant buffers
-		if (constantBuffers[i].Type != D3D11_CT_CBUFFER)
+		// Skip "buffers" that aren't true constant buffers,
+		// and ones the application binds itself
+		if (constantBuffers[i].Type != D3D11_CT_CBUFFER || IsExternalBuffer(constantBuffers[i]))
 			continue;
 
 		// This is a real constant buffer, so set it
@@ -1161,8 +1243,9 @@ void SimpleDomainShader::SetShaderAndCBs()
 	// Set the constant buffers
 	for (unsigned int i = 0; i < constantBufferCount; i++)
 	{
-		// Skip "buffers" that aren't true constant buffers
-		if (constantBuffers[i].Type != D3D11_CT_CBUFFER)
+		// Skip "buffers" that aren't true constant buffers,
+		// and ones the application binds itself
+		if (constantBuffers[i].Type != D3D11_CT_CBUFFER || IsExternalBuffer(constantBuffers[i]))
 			continue;
 
 		// This is a real constant buffer, so set it
@@ -1304,8 +1387,9 @@ void SimpleHullShader::SetShaderAndCBs()
 	// Set the constant buffers?
 	for (unsigned int i = 0; i < constantBufferCount; i++)
 	{
-		// Skip "buffers" that aren't true constant buffers
-		if (constantBuffers[i].Type != D3D11_CT_CBUFFER)
+		// Skip "buffers" that aren't true constant buffers,
+		// and ones the application binds itself
+		if (constantBuffers[i].Type != D3D11_CT_CBUFFER || IsExternalBuffer(constantBuffers[i]))
 			continue;
 
 		// This is a real constant buffer, so set it
@@ -1578,8 +1662,9 @@ void SimpleGeometryShader::SetShaderAndCBs()
 	// Set the constant buffers?
 	for (unsigned int i = 0; i < constantBufferCount; i++)
 	{
-		// Skip "buffers" that aren't true constant buffers
-		if (constantBuffers[i].Type != D3D11_CT_CBUFFER)
+		// Skip "buffers" that aren't true constant buffers,
+		// and ones the application binds itself
+		if (constantBuffers[i].Type != D3D11_CT_CBUFFER || IsExternalBuffer(constantBuffers[i]))
 			continue;
 
 		// This is a real constant buffer, so set it
@@ -1788,8 +1873,9 @@ void SimpleComputeShader::SetShaderAndCBs()
 	// Set the constant buffers?
 	for (unsigned int i = 0; i < constantBufferCount; i++)
 	{
-		// Skip "buffers" that aren't true constant buffers
-		if (constantBuffers[i].Type != D3D11_CT_CBUFFER)
+		// Skip "buffers" that aren't true constant buffers,
+		// and ones the application binds itself
+		if (constantBuffers[i].Type != D3D11_CT_CBUFFER || IsExternalBuffer(constantBuffers[i]))
 			continue;
 
 		// This is a real constant buffer, so set it
@@ -7,6 +7,7 @@
 #include <DirectXMath.h>
 #include <wrl/client.h>
 
+#include <cstring>
 #include <unordered_map>
 #include <vector>
 #include <string>
@@ -23,6 +24,23 @@ struct SimpleShaderVariable
 	unsigned int ConstantBufferIndex;
 };
 
+// --------------------------------------------------------
+// A shader variable looked up once by name, so it can be
+// set later without any string building or hashing
+//
+// - Only valid for the shader that created it
+// - A variable that wasn't found gets a handle with a
+//   Size of 0, which every setter ignores
+// --------------------------------------------------------
+struct SimpleShaderVariableHandle
+{
+	unsigned int ConstantBufferIndex = 0;
+	unsigned int ByteOffset = 0;
+	unsigned int Size = 0;
+
+	bool IsValid() const { return Size > 0; }
+};
+
 // --------------------------------------------------------
 // Contains information about a specific
 // constant buffer in a shader, as well as
@@ -37,6 +55,11 @@ struct SimpleConstantBuffer
 	Microsoft::WRL::ComPtr<ID3D11Buffer> ConstantBuffer = 0;
 	unsigned char* LocalDataBuffer = 0;
 	std::vector<SimpleShaderVariable> Variables;
+
+	bool Dynamic = false;			// Uploaded with Map(WRITE_DISCARD) rather than UpdateSubresource
+	bool Dirty = true;				// Local data has changed since the last upload
+	unsigned int DirtyStart = 0;	// Range of bytes changed since the last upload
+	unsigned int DirtyEnd = 0;
 };
 
 // --------------------------------------------------------
@@ -89,6 +112,30 @@ public:
 	bool SetMatrix4x4(std::string name, const float data[16]);
 	bool SetMatrix4x4(std::string name, const DirectX::XMFLOAT4X4 data);
 
+	// Looks a variable up once, for the handle-based setters below
+	SimpleShaderVariableHandle GetVariableHandle(std::string name);
+
+	// Sets shader data through a handle: just a bounds check and a copy
+	bool SetData(const SimpleShaderVariableHandle& handle, const void* data, unsigned int size)
+	{
+		if (size > handle.Size || handle.ConstantBufferIndex >= constantBufferCount)
+			return false;
+
+		SimpleConstantBuffer& cb = constantBuffers[handle.ConstantBufferIndex];
+		if (handle.ByteOffset + size > cb.Size)
+			return false;
+
+		WriteLocalData(cb, handle.ByteOffset, data, size);
+		return true;
+	}
+
+	bool SetInt(const SimpleShaderVariableHandle& handle, int data) { return SetData(handle, &data, sizeof(int)); }
+	bool SetFloat(const SimpleShaderVariableHandle& handle, float data) { return SetData(handle, &data, sizeof(float)); }
+	bool SetFloat2(const SimpleShaderVariableHandle& handle, const DirectX::XMFLOAT2& data) { return SetData(handle, &data, sizeof(float) * 2); }
+	bool SetFloat3(const SimpleShaderVariableHandle& handle, const DirectX::XMFLOAT3& data) { return SetData(handle, &data, sizeof(float) * 3); }
+	bool SetFloat4(const SimpleShaderVariableHandle& handle, const DirectX::XMFLOAT4& data) { return SetData(handle, &data, sizeof(float) * 4); }
+	bool SetMatrix4x4(const SimpleShaderVariableHandle& handle, const DirectX::XMFLOAT4X4& data) { return SetData(handle, &data, sizeof(float) * 16); }
+
 	// Setting shader resources
 	virtual bool SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv) = 0;
 	virtual bool SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState) = 0;
@@ -122,6 +169,19 @@ public:
 	static bool ReportErrors;
 	static bool ReportWarnings;
 
+	// Create constant buffers as dynamic, uploaded with Map(WRITE_DISCARD).
+	// Only affects shaders created after it's changed.
+	static bool UseDynamicBuffers;
+
+	// Bit mask of constant buffer registers the application binds and
+	// fills in itself; shaders never bind or upload buffers in these
+	static unsigned int ExternalBufferSlots;
+
+	// Upload stats (reset them whenever you like)
+	static size_t UploadedBytes;	// Total bytes copied into constant buffers
+	static size_t ChangedBytes;		// Bytes within the uploaded buffers' dirty ranges
+	static size_t SkippedUploads;	// Copy requests for buffers that hadn't changed
+
 protected:
 	
 	bool shaderValid;
@@ -154,6 +214,35 @@ protected:
 	SimpleShaderVariable* FindVariable(std::string name, int size);
 	SimpleConstantBuffer* FindConstantBuffer(std::string name);
 
+	// Copies data into a buffer's local copy, growing its dirty
+	// range if that actually changed anything
+	static void WriteLocalData(SimpleConstantBuffer& cb, unsigned int offset, const void* data, unsigned int size)
+	{
+		unsigned char* dest = cb.LocalDataBuffer + offset;
+		if (memcmp(dest, data, size) == 0)
+			return;
+		memcpy(dest, data, size);
+
+		unsigned int end = offset + size;
+		if (!cb.Dirty)
+		{
+			cb.Dirty = true;
+			cb.DirtyStart = offset;
+			cb.DirtyEnd = end;
+			return;
+		}
+		if (offset < cb.DirtyStart) cb.DirtyStart = offset;
+		if (end > cb.DirtyEnd) cb.DirtyEnd = end;
+	}
+
+	// Sends a buffer's local data to the GPU if it's dirty
+	void UploadBuffer(SimpleConstantBuffer& cb);
+
+	static bool IsExternalBuffer(const SimpleConstantBuffer& cb)
+	{
+		return cb.BindIndex < 32 && ((ExternalBufferSlots >> cb.BindIndex) & 1);
+	}
+
 	// Error logging
 	void Log(std::string message, WORD color);
 	void LogW(std::wstring message, WORD color);
@@ -18,6 +18,7 @@ Sky::Sky(std::shared_ptr<Mesh> mesh, Microsoft::WRL::ComPtr<ID3D11SamplerState>
 	D3D11_DEPTH_STENCIL_DESC depthDesc = {};
 	depthDesc.DepthEnable = true;
 	depthDesc.DepthFunc = D3D11_COMPARISON_LESS_EQUAL;
+	depthDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
 	device->CreateDepthStencilState(&depthDesc, depthStencil.GetAddressOf());
 
 }
@@ -26,7 +27,7 @@ Sky::~Sky()
 {
 }
 
-void Sky::Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, std::shared_ptr<Camera> camera)
+void Sky::Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
 {
 	// Set rasterizer and depth stencil 
 	context->RSSetState(rasterizerState.Get());
@@ -36,11 +37,7 @@ void Sky::Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, std::shared_
 	vertexShader->SetShader();
 	pixelShader->SetShader();
 
-	// Sets shader variables
-	vertexShader->SetMatrix4x4("viewMatrix", camera->GetViewMatrix());
-	vertexShader->SetMatrix4x4("projectionMatrix", camera->GetProjectionMatrix());
-	vertexShader->CopyAllBufferData();
-
+	// Sets shader resources (the matrices come from the PerPass buffer)
 	pixelShader->SetShaderResourceView("skybox", skyTexture);
 	pixelShader->SetSamplerState("samplerState", samplerState);
 	pixelShader->CopyAllBufferData();
@@ -17,7 +17,8 @@ public:
 		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> texture);	
 	~Sky();	
 
-	void Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, std::shared_ptr<Camera> camera); 
+	// Uses the camera matrices in the shared PerPass constant buffer
+	void Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
 
 private:
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState;
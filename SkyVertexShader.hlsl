@@ -3,7 +3,7 @@ struct VertexShaderInput
 	float3 localPosition	: POSITION;     // XYZ position
 	float3 normal			: NORMAL;
 	float2 uv				: TEXCOORD;
-	float3 tangent			: TANGENT;
+	float4 tangent			: TANGENT;
 };
 
 struct VertexToPixel
@@ -12,23 +12,19 @@ struct VertexToPixel
 	float3 sampleDir		: DIRECTION;
 };
 
-cbuffer ExternalData : register(b0)
-{
-	matrix viewMatrix;
-	matrix projectionMatrix;
-}
+#include "ConstantBuffers.hlsli"
 
 VertexToPixel main(VertexShaderInput input)
 {
 	VertexToPixel output;
 
 	// Remove translation from the view matrix
-	matrix copyView = viewMatrix;
+	matrix copyView = view;
 	copyView._14 = 0;
 	copyView._24 = 0;
 	copyView._34 = 0;
 
-	matrix viewProj = mul(projectionMatrix, copyView);
+	matrix viewProj = mul(projection, copyView);
 	output.position = mul(viewProj, float4(input.localPosition, 1.0f));
 
 	// Set output depth to exactly 1.0f
@@ -0,0 +1,186 @@
+#include "TextureCache.h"
+#include "TextureStreamer.h"
+#include <algorithm>
+#include <cstdio>
+
+TextureCache::TextureCache(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+{
+	this->device = device;
+	this->context = context;
+	this->budget = 0;
+}
+
+TextureCache::~TextureCache()
+{
+}
+
+// --------------------------------------------------------
+// Returns the texture for the given file and parameters,
+// queueing its load only if it isn't already cached (or
+// queued). Its SRV is set once the loader finishes.
+// --------------------------------------------------------
+std::shared_ptr<CachedTexture> TextureCache::Queue(AssetLoader& loader, const std::wstring& path, const TextureParams& params, const std::string& consumer)
+{
+	std::wstring key = MakeKey(path, params);
+	std::shared_ptr<CachedTexture> texture = Find(key, consumer);
+	if (texture)
+		return texture;
+
+	texture = std::make_shared<CachedTexture>();
+	texture->Path = path;
+	texture->Params = params;
+	texture->Consumers.push_back(consumer);
+	textures[key] = texture;
+
+	unsigned int maxSize = params.Streamed ? TextureStreamer::StartSize : 0;
+	if (params.PackedORM)
+		loader.QueuePackedTexture(TextureCooker::FindORMSources(path), texture->SRV, params.Cooked, maxSize);
+	else
+		loader.QueueTexture(path, texture->SRV, params.Cooked, maxSize);
+	return texture;
+}
+
+std::shared_ptr<CachedTexture> TextureCache::Load(const std::wstring& path, const TextureParams& params, const std::string& consumer)
+{
+	std::shared_ptr<CachedTexture> texture = Find(MakeKey(path, params), consumer);
+	if (texture)
+		return texture;
+
+	// Just the one file, so just the one worker
+	AssetLoader loader(device, context, std::shared_ptr<MeshRegistry>(), 1);
+	texture = Queue(loader, path, params, consumer);
+	loader.Finish();
+	return texture;
+}
+
+// --------------------------------------------------------
+// Drops the cache's reference to any texture with no other
+// owners, which releases its video memory
+// --------------------------------------------------------
+int TextureCache::UnloadUnused()
+{
+	int unloaded = 0;
+	for (auto it = textures.begin(); it != textures.end();)
+	{
+		if (it->second.use_count() == 1)
+		{
+			it = textures.erase(it);
+			unloaded++;
+		}
+		else
+		{
+			it++;
+		}
+	}
+
+	return unloaded;
+}
+
+size_t TextureCache::GetResidentBytes()
+{
+	size_t bytes = 0;
+	for (auto& entry : textures)
+		bytes += GetTextureBytes(entry.second->SRV.Get());
+	return bytes;
+}
+
+void TextureCache::SetBudget(size_t bytes)
+{
+	budget = bytes;
+}
+
+bool TextureCache::IsOverBudget()
+{
+	return budget > 0 && GetResidentBytes() > budget;
+}
+
+void TextureCache::ReportResidency()
+{
+	// Largest first, as that's where a budget is won or lost
+	typedef std::pair<size_t, std::shared_ptr<CachedTexture>> SizedTexture;
+	std::vector<SizedTexture> sorted;
+	for (auto& entry : textures)
+		sorted.push_back({ GetTextureBytes(entry.second->SRV.Get()), entry.second });
+	std::sort(sorted.begin(), sorted.end(), [](const SizedTexture& a, const SizedTexture& b) { return a.first > b.first; });
+
+	printf("\n--- Resident textures ---\n");
+	size_t total = 0;
+	for (auto& entry : sorted)
+	{
+		CachedTexture* texture = entry.second.get();
+		std::string name;
+		for (wchar_t c : texture->Path.substr(texture->Path.find_last_of(L"/\\") + 1))
+			name += (char)c;
+
+		std::string consumers;
+		for (std::string& consumer : texture->Consumers)
+			consumers += (consumers.empty() ? "" : ", ") + consumer;
+
+		D3D11_SHADER_RESOURCE_VIEW_DESC desc = {};
+		if (texture->SRV)
+			texture->SRV->GetDesc(&desc);
+		const char* format =
+			!texture->SRV ? "(missing)" :
+			desc.Format == DXGI_FORMAT_BC4_UNORM ? "BC4" :
+			desc.Format == DXGI_FORMAT_BC5_UNORM ? "BC5" :
+			desc.Format == DXGI_FORMAT_BC7_UNORM ? "BC7" : "RGBA8";
+
+		// Don't count the cache's reference or the sorted copy
+		printf("%10.2f MB  %-9s  %3ld users  %-24s %s%s\n",
+			entry.first / (1024.0 * 1024.0), format, entry.second.use_count() - 2,
+			name.c_str(), texture->Params.PackedORM ? "(ORM)  " : "", consumers.c_str());
+		total += entry.first;
+	}
+
+	printf("%10.2f MB in %zu textures", total / (1024.0 * 1024.0), textures.size());
+	if (budget > 0)
+		printf(", %.0f%% of the %.2f MB budget%s", total * 100.0 / budget, budget / (1024.0 * 1024.0), total > budget ? "  (OVER BUDGET)" : "");
+	printf("\n");
+}
+
+size_t TextureCache::GetTextureBytes(ID3D11ShaderResourceView* texture)
+{
+	if (!texture)
+		return 0;
+
+	Microsoft::WRL::ComPtr<ID3D11Resource> resource;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> texture2D;
+	texture->GetResource(resource.GetAddressOf());
+	if (FAILED(resource->QueryInterface(__uuidof(ID3D11Texture2D), reinterpret_cast<void**>(texture2D.GetAddressOf()))))
+		return 0;
+
+	D3D11_TEXTURE2D_DESC desc;
+	texture2D->GetDesc(&desc);
+	size_t blockSize =
+		desc.Format == DXGI_FORMAT_BC4_UNORM ? 8 :
+		desc.Format == DXGI_FORMAT_BC5_UNORM || desc.Format == DXGI_FORMAT_BC7_UNORM ? 16 : 0;
+
+	size_t bytes = 0;
+	for (unsigned int mip = 0; mip < desc.MipLevels; mip++)
+	{
+		size_t width = desc.Width >> mip ? desc.Width >> mip : 1;
+		size_t height = desc.Height >> mip ? desc.Height >> mip : 1;
+		bytes += blockSize ? ((width + 3) / 4) * ((height + 3) / 4) * blockSize : width * height * 4;
+	}
+	return bytes * desc.ArraySize;
+}
+
+std::wstring TextureCache::MakeKey(const std::wstring& path, const TextureParams& params)
+{
+	return path + (params.PackedORM ? L"|orm" : L"") + (params.Cooked ? L"|cooked" : L"|rgba8") + (params.Streamed ? L"|streamed" : L"");
+}
+
+// --------------------------------------------------------
+// Looks up a texture, noting who asked for it
+// --------------------------------------------------------
+std::shared_ptr<CachedTexture> TextureCache::Find(const std::wstring& key, const std::string& consumer)
+{
+	auto existing = textures.find(key);
+	if (existing == textures.end())
+		return 0;
+
+	std::vector<std::string>& consumers = existing->second->Consumers;
+	if (std::find(consumers.begin(), consumers.end(), consumer) == consumers.end())
+		consumers.push_back(consumer);
+	return existing->second;
+}
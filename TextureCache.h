@@ -0,0 +1,82 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "AssetLoader.h"
+
+// How a texture is loaded. Part of its cache key, so the same
+// file loaded two different ways is two different textures.
+struct TextureParams
+{
+	bool PackedORM = false;		// The path is a roughness map, packed with its metalness/AO (see TextureCooker)
+	bool Cooked = true;			// Block compressed DDS, rather than RGBA8 with GPU mips
+	bool Streamed = false;		// Loads only its smallest levels, for a TextureStreamer to stream the rest
+};
+
+// One texture in the cache, shared by everything that uses it
+struct CachedTexture
+{
+	std::wstring Path;
+	TextureParams Params;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> SRV;	// Null until its loader finishes, or if it failed
+	std::vector<std::string> Consumers;						// Who asked for it, for the report
+};
+
+// --------------------------------------------------------
+// Hands out shared handles to textures, keyed by path and
+// load parameters
+//
+// - Each texture is loaded once, however many materials
+//   ask for it
+// - Queue() adds the load to an AssetLoader, so a batch of
+//   textures loads in parallel; handles are filled in by
+//   the loader's Finish()
+// - The cache keeps one reference to every texture, so a
+//   texture whose only reference is the cache's is unused
+//   and can be unloaded with UnloadUnused()
+// - Not thread safe: use it from the thread that owns the
+//   device context, as AssetLoader::Finish() is
+// --------------------------------------------------------
+class TextureCache
+{
+public:
+	TextureCache(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+	~TextureCache();
+
+	// Returns the cached texture, or queues its load on the given loader
+	std::shared_ptr<CachedTexture> Queue(AssetLoader& loader, const std::wstring& path, const TextureParams& params, const std::string& consumer);
+
+	// Returns the cached texture, loading it right away if it isn't cached
+	std::shared_ptr<CachedTexture> Load(const std::wstring& path, const TextureParams& params, const std::string& consumer);
+
+	// Releases every texture that nothing outside the cache is using
+	// - Returns the number of textures that were unloaded
+	int UnloadUnused();
+
+	// Video memory used by every loaded texture, in bytes
+	size_t GetResidentBytes();
+
+	// Bytes the textures should fit in, which the report checks (0 for no limit)
+	void SetBudget(size_t bytes);
+	bool IsOverBudget();
+
+	// Prints each texture's size, format, users and consumers to the console
+	void ReportResidency();
+
+	// Video memory used by a texture's whole mip chain
+	static size_t GetTextureBytes(ID3D11ShaderResourceView* texture);
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	size_t budget;
+
+	std::unordered_map<std::wstring, std::shared_ptr<CachedTexture>> textures;
+
+	static std::wstring MakeKey(const std::wstring& path, const TextureParams& params);
+	std::shared_ptr<CachedTexture> Find(const std::wstring& key, const std::string& consumer);
+};
@@ -0,0 +1,1187 @@
+#include "TextureCooker.h"
+#include "AssetLoader.h"
+#include "MeshCache.h"
+#include "MappedFile.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <cwctype>
+#include <functional>
+
+// --------------------------------------------------------
+// DDS file layout, as DDSTextureLoader reads it:
+//   ["DDS "][DDSHeader][DDSHeaderDX10][every mip's blocks]
+// --------------------------------------------------------
+struct DDSPixelFormat
+{
+	unsigned int Size;
+	unsigned int Flags;
+	unsigned int FourCC;
+	unsigned int RGBBitCount;
+	unsigned int RBitMask;
+	unsigned int GBitMask;
+	unsigned int BBitMask;
+	unsigned int ABitMask;
+};
+
+struct DDSHeader
+{
+	unsigned int Size;
+	unsigned int Flags;
+	unsigned int Height;
+	unsigned int Width;
+	unsigned int PitchOrLinearSize;
+	unsigned int Depth;
+	unsigned int MipMapCount;
+	unsigned int Reserved1[11];		// Ignored by loaders, so the cooker keeps its own header here
+	DDSPixelFormat PixelFormat;
+	unsigned int Caps;
+	unsigned int Caps2;
+	unsigned int Caps3;
+	unsigned int Caps4;
+	unsigned int Reserved2;
+};
+
+struct DDSHeaderDX10
+{
+	unsigned int DXGIFormat;
+	unsigned int ResourceDimension;
+	unsigned int MiscFlag;
+	unsigned int ArraySize;
+	unsigned int MiscFlags2;
+};
+
+static_assert(sizeof(DDSHeader) == 124, "DDSHeader must match the file format");
+static_assert(sizeof(DDSHeaderDX10) == 20, "DDSHeaderDX10 must match the file format");
+
+static const unsigned int DDSMagic = 0x20534444;			// "DDS "
+static const unsigned int DDSFourCCDX10 = 0x30315844;		// "DX10"
+
+// Where the cooker's own fields go in DDSHeader::Reserved1
+enum CookedField
+{
+	CookedMagic,
+	CookedVersion,
+	CookedHashLow,
+	CookedHashHigh,
+	CookedKind
+};
+
+// Half width of the Kaiser filter, in destination pixels, and its shape
+static const float KaiserRadius = 3.0f;
+static const float KaiserAlpha = 4.0f;
+
+// BC7's 4 bit index interpolation weights, out of 64
+static const int BC7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+static float Clamp01(float value)
+{
+	return value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+}
+
+static unsigned char ToByte(float value)
+{
+	return (unsigned char)(Clamp01(value) * 255.0f + 0.5f);
+}
+
+// 8 bit gamma 2.2 values in linear space, matching the pixel shader's pow()
+static const std::vector<float>& GammaToLinear()
+{
+	static const std::vector<float> table = []()
+	{
+		std::vector<float> values(256);
+		for (int i = 0; i < 256; i++)
+			values[i] = powf(i / 255.0f, 2.2f);
+		return values;
+	}();
+	return table;
+}
+
+// --------------------------------------------------------
+// Filtering: images are resampled a direction at a time,
+// with the taps for each destination pixel worked out once
+// per row or column. Textures tile, so taps wrap around.
+// --------------------------------------------------------
+struct FilterTaps
+{
+	std::vector<unsigned int> First;	// Per destination pixel
+	std::vector<unsigned int> Count;
+	std::vector<unsigned int> Source;	// Per tap
+	std::vector<float> Weight;
+};
+
+// Zeroth order modified Bessel function of the first kind, for the Kaiser window
+static float BesselI0(float x)
+{
+	float sum = 1.0f;
+	float term = 1.0f;
+	for (int k = 1; k < 16; k++)
+	{
+		term *= (x * 0.5f / k) * (x * 0.5f / k);
+		sum += term;
+	}
+	return sum;
+}
+
+// The filter's weight at x destination pixels from a destination pixel's center
+static float FilterWeight(MipFilter filter, float x)
+{
+	if (filter == MipFilter::Box)
+		return x > -0.5f && x <= 0.5f ? 1.0f : 0.0f;
+
+	if (x <= -KaiserRadius || x >= KaiserRadius)
+		return 0.0f;
+
+	const float pi = 3.14159265359f;
+	float sinc = fabsf(x) < 0.0001f ? 1.0f : sinf(pi * x) / (pi * x);
+	float ratio = x / KaiserRadius;
+	return sinc * BesselI0(KaiserAlpha * sqrtf(1.0f - ratio * ratio)) / BesselI0(KaiserAlpha);
+}
+
+static void BuildTaps(unsigned int sourceSize, unsigned int destSize, MipFilter filter, FilterTaps& taps)
+{
+	float scale = (float)sourceSize / destSize;
+	float support = scale > 1.0f ? scale : 1.0f;
+	float radius = (filter == MipFilter::Box ? 0.5f : KaiserRadius) * support;
+
+	taps.First.resize(destSize);
+	taps.Count.resize(destSize);
+	taps.Source.clear();
+	taps.Weight.clear();
+
+	for (unsigned int d = 0; d < destSize; d++)
+	{
+		float center = (d + 0.5f) * scale;
+		int first = (int)floorf(center - radius);
+		int last = (int)ceilf(center + radius);
+
+		taps.First[d] = (unsigned int)taps.Source.size();
+		float total = 0.0f;
+		for (int s = first; s <= last; s++)
+		{
+			float weight = FilterWeight(filter, (s + 0.5f - center) / support);
+			if (weight == 0.0f)
+				continue;
+
+			taps.Source.push_back((unsigned int)(((s % (int)sourceSize) + (int)sourceSize) % (int)sourceSize));
+			taps.Weight.push_back(weight);
+			total += weight;
+		}
+
+		// Should never happen, but fall back to the nearest pixel
+		if (total == 0.0f)
+		{
+			taps.Source.push_back((unsigned int)center < sourceSize ? (unsigned int)center : sourceSize - 1);
+			taps.Weight.push_back(1.0f);
+			total = 1.0f;
+		}
+
+		taps.Count[d] = (unsigned int)taps.Source.size() - taps.First[d];
+		for (unsigned int t = taps.First[d]; t < taps.Source.size(); t++)
+			taps.Weight[t] /= total;
+	}
+}
+
+// Resizes a float RGBA image
+static void Resample(const std::vector<float>& source, unsigned int width, unsigned int height,
+	std::vector<float>& dest, unsigned int destWidth, unsigned int destHeight, MipFilter filter)
+{
+	FilterTaps across;
+	FilterTaps down;
+	BuildTaps(width, destWidth, filter, across);
+	BuildTaps(height, destHeight, filter, down);
+
+	// Across every source row first...
+	std::vector<float> rows((size_t)destWidth * height * 4);
+	for (unsigned int y = 0; y < height; y++)
+	{
+		const float* sourceRow = &source[(size_t)y * width * 4];
+		float* out = &rows[(size_t)y * destWidth * 4];
+		for (unsigned int x = 0; x < destWidth; x++, out += 4)
+		{
+			float r = 0.0f, g = 0.0f, b = 0.0f, a = 0.0f;
+			for (unsigned int t = across.First[x]; t < across.First[x] + across.Count[x]; t++)
+			{
+				const float* pixel = sourceRow + across.Source[t] * 4;
+				float weight = across.Weight[t];
+				r += pixel[0] * weight;
+				g += pixel[1] * weight;
+				b += pixel[2] * weight;
+				a += pixel[3] * weight;
+			}
+			out[0] = r;
+			out[1] = g;
+			out[2] = b;
+			out[3] = a;
+		}
+	}
+
+	// ...then down, a whole row at a time
+	size_t rowFloats = (size_t)destWidth * 4;
+	dest.assign(rowFloats * destHeight, 0.0f);
+	for (unsigned int y = 0; y < destHeight; y++)
+	{
+		float* out = &dest[y * rowFloats];
+		for (unsigned int t = down.First[y]; t < down.First[y] + down.Count[y]; t++)
+		{
+			const float* in = &rows[down.Source[t] * rowFloats];
+			float weight = down.Weight[t];
+			for (size_t i = 0; i < rowFloats; i++)
+				out[i] += in[i] * weight;
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Moves pixels in and out of the space they're filtered in:
+// linear for color, unit vectors for normals
+// --------------------------------------------------------
+static void ToFloat(const TextureData& image, TextureKind kind, std::vector<float>& pixels)
+{
+	const std::vector<float>& linear = GammaToLinear();
+	size_t count = (size_t)image.Width * image.Height * 4;
+	pixels.resize(count);
+	for (size_t i = 0; i < count; i += 4)
+	{
+		const unsigned char* in = &image.Pixels[i];
+		float* out = &pixels[i];
+		for (int c = 0; c < 3; c++)
+		{
+			if (kind == TextureKind::Color)
+				out[c] = linear[in[c]];
+			else if (kind == TextureKind::Normal)
+				out[c] = in[c] / 255.0f * 2.0f - 1.0f;
+			else
+				out[c] = in[c] / 255.0f;
+		}
+		out[3] = in[3] / 255.0f;
+	}
+}
+
+static void Renormalize(std::vector<float>& pixels)
+{
+	for (size_t i = 0; i < pixels.size(); i += 4)
+	{
+		float* n = &pixels[i];
+		float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (length > 0.0001f)
+		{
+			n[0] /= length;
+			n[1] /= length;
+			n[2] /= length;
+		}
+		else
+		{
+			n[0] = 0.0f;
+			n[1] = 0.0f;
+			n[2] = 1.0f;
+		}
+	}
+}
+
+static void FromFloat(const std::vector<float>& pixels, unsigned int width, unsigned int height, TextureKind kind, TextureData& image)
+{
+	image.Width = width;
+	image.Height = height;
+	image.Pixels.resize((size_t)width * height * 4);
+	for (size_t i = 0; i < image.Pixels.size(); i += 4)
+	{
+		const float* in = &pixels[i];
+		unsigned char* out = &image.Pixels[i];
+		for (int c = 0; c < 3; c++)
+		{
+			if (kind == TextureKind::Color)
+				out[c] = ToByte(powf(Clamp01(in[c]), 1.0f / 2.2f));
+			else if (kind == TextureKind::Normal)
+				out[c] = ToByte(in[c] * 0.5f + 0.5f);
+			else
+				out[c] = ToByte(in[c]);
+		}
+		out[3] = ToByte(in[3]);
+	}
+}
+
+std::wstring TextureCooker::GetCookedPath(const std::wstring& sourceFile)
+{
+	return sourceFile + L".cooked.dds";
+}
+
+TextureKind TextureCooker::KindFromName(const std::wstring& sourceFile)
+{
+	size_t slash = sourceFile.find_last_of(L"/\\");
+	std::wstring name = slash == std::wstring::npos ? sourceFile : sourceFile.substr(slash + 1);
+	for (wchar_t& c : name)
+		c = (wchar_t)towlower(c);
+
+	if (name.find(L"_normal") != std::wstring::npos)
+		return TextureKind::Normal;
+	if (name.find(L"_orm") != std::wstring::npos)
+		return TextureKind::Packed;
+	if (name.find(L"_rough") != std::wstring::npos ||
+		name.find(L"_metal") != std::wstring::npos ||
+		name.find(L"_ao") != std::wstring::npos)
+		return TextureKind::Single;
+	return TextureKind::Color;
+}
+
+bool TextureCooker::HashSource(const std::wstring& sourceFile, unsigned long long& hash)
+{
+	MappedFile source(sourceFile.c_str());
+	if (!source.IsValid())
+		return false;
+
+	hash = MeshCache::Hash(source.GetData(), source.GetSize());
+	return true;
+}
+
+ORMSources TextureCooker::FindORMSources(const std::wstring& roughnessFile)
+{
+	ORMSources sources;
+	sources.Roughness = roughnessFile;
+
+	size_t slash = roughnessFile.find_last_of(L"/\\");
+	size_t token = roughnessFile.find(L"_rough", slash == std::wstring::npos ? 0 : slash);
+	if (token == std::wstring::npos)
+		return sources;
+
+	// Everything before "_roughness", and the extension after it
+	std::wstring prefix = roughnessFile.substr(0, token);
+	size_t dot = roughnessFile.find_last_of(L'.');
+	std::wstring extension = dot == std::wstring::npos || dot < token ? L"" : roughnessFile.substr(dot);
+
+	const wchar_t* metalNames[] = { L"_metal", L"_metalness", L"_metallic" };
+	for (const wchar_t* name : metalNames)
+	{
+		if (MappedFile(std::wstring(prefix + name + extension).c_str()).IsValid())
+		{
+			sources.Metalness = prefix + name + extension;
+			break;
+		}
+	}
+
+	const wchar_t* occlusionNames[] = { L"_ao", L"_occlusion" };
+	for (const wchar_t* name : occlusionNames)
+	{
+		if (MappedFile(std::wstring(prefix + name + extension).c_str()).IsValid())
+		{
+			sources.Occlusion = prefix + name + extension;
+			break;
+		}
+	}
+	return sources;
+}
+
+std::wstring TextureCooker::GetPackedPath(const ORMSources& sources)
+{
+	size_t slash = sources.Roughness.find_last_of(L"/\\");
+	size_t token = sources.Roughness.find(L"_rough", slash == std::wstring::npos ? 0 : slash);
+	if (token == std::wstring::npos)
+		return sources.Roughness + L".orm.cooked.dds";
+	return sources.Roughness.substr(0, token) + L"_orm.cooked.dds";
+}
+
+bool TextureCooker::HashORM(const ORMSources& sources, unsigned long long& hash)
+{
+	// Occlusion hashes as 0 when there isn't one, so adding one recooks too
+	unsigned long long hashes[3] = {};
+	if (!HashSource(sources.Roughness, hashes[0]) ||
+		!HashSource(sources.Metalness, hashes[1]) ||
+		(!sources.Occlusion.empty() && !HashSource(sources.Occlusion, hashes[2])))
+		return false;
+
+	hash = MeshCache::Hash((const unsigned char*)hashes, sizeof(hashes));
+	return true;
+}
+
+// --------------------------------------------------------
+// Copies the red channel of a decoded map into one channel
+// of the packed image, resizing it first if it's a
+// different size
+// --------------------------------------------------------
+static void PackChannel(const TextureData& source, int channel, TextureData& packed)
+{
+	const TextureData* image = &source;
+	TextureData resized;
+	if (source.Width != packed.Width || source.Height != packed.Height)
+	{
+		std::vector<float> pixels;
+		std::vector<float> scaled;
+		ToFloat(source, TextureKind::Single, pixels);
+		Resample(pixels, source.Width, source.Height, scaled, packed.Width, packed.Height, MipFilter::Kaiser);
+		FromFloat(scaled, packed.Width, packed.Height, TextureKind::Single, resized);
+		image = &resized;
+	}
+
+	size_t count = (size_t)packed.Width * packed.Height;
+	for (size_t i = 0; i < count; i++)
+		packed.Pixels[i * 4 + channel] = image->Pixels[i * 4];
+}
+
+bool TextureCooker::LoadORM(const ORMSources& sources, TextureData& packed)
+{
+	TextureData roughness;
+	TextureData metalness;
+	TextureData occlusion;
+	if (!AssetLoader::DecodeImage(sources.Roughness, roughness) ||
+		!AssetLoader::DecodeImage(sources.Metalness, metalness) ||
+		(!sources.Occlusion.empty() && !AssetLoader::DecodeImage(sources.Occlusion, occlusion)))
+		return false;
+
+	packed.Width = roughness.Width;
+	packed.Height = roughness.Height;
+	packed.Pixels.assign((size_t)packed.Width * packed.Height * 4, 255);
+	PackChannel(roughness, 1, packed);
+	PackChannel(metalness, 2, packed);
+	if (!sources.Occlusion.empty())
+		PackChannel(occlusion, 0, packed);
+	return true;
+}
+
+// --------------------------------------------------------
+// Builds the mip chain in float, each level filtered from
+// the one above it, and rounds each level to bytes
+// --------------------------------------------------------
+void TextureCooker::BuildMips(const TextureData& image, TextureKind kind, MipFilter filter, std::vector<TextureData>& mips)
+{
+	mips.clear();
+	if (image.Width == 0 || image.Height == 0)
+		return;
+
+	unsigned int width = image.Width;
+	unsigned int height = image.Height;
+	std::vector<float> level;
+	std::vector<float> next;
+	ToFloat(image, kind, level);
+
+	// The top level has to be a whole number of blocks
+	unsigned int blockWidth = (width + 3) & ~3u;
+	unsigned int blockHeight = (height + 3) & ~3u;
+	if (blockWidth != width || blockHeight != height)
+	{
+		Resample(level, width, height, next, blockWidth, blockHeight, filter);
+		level.swap(next);
+		width = blockWidth;
+		height = blockHeight;
+		if (kind == TextureKind::Normal)
+			Renormalize(level);
+	}
+
+	while (true)
+	{
+		mips.push_back(TextureData());
+		FromFloat(level, width, height, kind, mips.back());
+		if (width == 1 && height == 1)
+			break;
+
+		unsigned int nextWidth = width > 1 ? width / 2 : 1;
+		unsigned int nextHeight = height > 1 ? height / 2 : 1;
+		Resample(level, width, height, next, nextWidth, nextHeight, filter);
+		level.swap(next);
+		width = nextWidth;
+		height = nextHeight;
+		if (kind == TextureKind::Normal)
+			Renormalize(level);
+	}
+}
+
+// --------------------------------------------------------
+// Compresses a level a row of blocks at a time. Blocks that
+// hang off the edge repeat the edge pixels.
+// --------------------------------------------------------
+void TextureCooker::Compress(const TextureData& level, TextureKind kind, std::vector<unsigned char>& blocks, ThreadPool* pool)
+{
+	unsigned int blocksWide = (level.Width + 3) / 4;
+	unsigned int blocksHigh = (level.Height + 3) / 4;
+	unsigned int blockSize = kind == TextureKind::Single ? 8 : 16;
+	blocks.resize((size_t)blocksWide * blocksHigh * blockSize);
+
+	auto compressRows = [&](unsigned int firstRow, unsigned int lastRow)
+	{
+		unsigned char rgba[64];
+		unsigned char red[16];
+		unsigned char green[16];
+		for (unsigned int by = firstRow; by < lastRow; by++)
+		{
+			for (unsigned int bx = 0; bx < blocksWide; bx++)
+			{
+				for (unsigned int i = 0; i < 16; i++)
+				{
+					unsigned int x = bx * 4 + (i & 3);
+					unsigned int y = by * 4 + (i >> 2);
+					x = x < level.Width ? x : level.Width - 1;
+					y = y < level.Height ? y : level.Height - 1;
+					memcpy(&rgba[i * 4], &level.Pixels[((size_t)y * level.Width + x) * 4], 4);
+					red[i] = rgba[i * 4];
+					green[i] = rgba[i * 4 + 1];
+				}
+
+				unsigned char* block = &blocks[((size_t)by * blocksWide + bx) * blockSize];
+				if (kind == TextureKind::Color || kind == TextureKind::Packed)
+					EncodeBC7(rgba, block);
+				else if (kind == TextureKind::Normal)
+					EncodeBC5(red, green, block);
+				else
+					EncodeBC4(red, block);
+			}
+		}
+	};
+
+	if (!pool || blocksHigh < 2)
+	{
+		compressRows(0, blocksHigh);
+		return;
+	}
+
+	// A few chunks per worker, so they all finish around the same time
+	unsigned int chunks = pool->GetThreadCount() * 4;
+	unsigned int rowsPerChunk = (blocksHigh + chunks - 1) / chunks;
+	for (unsigned int first = 0; first < blocksHigh; first += rowsPerChunk)
+	{
+		unsigned int last = first + rowsPerChunk < blocksHigh ? first + rowsPerChunk : blocksHigh;
+		pool->Enqueue([&compressRows, first, last]() { compressRows(first, last); });
+	}
+	pool->Wait();
+}
+
+void TextureCooker::Cook(const TextureData& image, TextureKind kind, MipFilter filter, unsigned long long sourceHash,
+	std::vector<unsigned char>& dds, ThreadPool* pool)
+{
+	std::vector<TextureData> mips;
+	BuildMips(image, kind, filter, mips);
+	dds.clear();
+	if (mips.empty())
+		return;
+
+	DDSHeader header = {};
+	header.Size = sizeof(DDSHeader);
+	header.Flags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000; // Caps, height, width, pixel format, mip count, linear size
+	header.Width = mips[0].Width;
+	header.Height = mips[0].Height;
+	header.PitchOrLinearSize = ((header.Width + 3) / 4) * ((header.Height + 3) / 4) * (kind == TextureKind::Single ? 8 : 16);
+	header.MipMapCount = (unsigned int)mips.size();
+	header.Reserved1[CookedMagic] = Magic;
+	header.Reserved1[CookedVersion] = Version;
+	header.Reserved1[CookedHashLow] = (unsigned int)sourceHash;
+	header.Reserved1[CookedHashHigh] = (unsigned int)(sourceHash >> 32);
+	header.Reserved1[CookedKind] = (unsigned int)kind;
+	header.PixelFormat.Size = sizeof(DDSPixelFormat);
+	header.PixelFormat.Flags = 0x4; // FourCC
+	header.PixelFormat.FourCC = DDSFourCCDX10;
+	header.Caps = 0x1000 | 0x400000 | 0x8; // Texture, mipmap, complex
+
+	DDSHeaderDX10 extended = {};
+	extended.DXGIFormat =
+		kind == TextureKind::Color || kind == TextureKind::Packed ? DXGI_FORMAT_BC7_UNORM :
+		kind == TextureKind::Normal ? DXGI_FORMAT_BC5_UNORM :
+		DXGI_FORMAT_BC4_UNORM;
+	extended.ResourceDimension = 3; // Texture2D
+	extended.ArraySize = 1;
+
+	dds.resize(sizeof(DDSMagic) + sizeof(DDSHeader) + sizeof(DDSHeaderDX10));
+	memcpy(&dds[0], &DDSMagic, sizeof(DDSMagic));
+	memcpy(&dds[sizeof(DDSMagic)], &header, sizeof(DDSHeader));
+	memcpy(&dds[sizeof(DDSMagic) + sizeof(DDSHeader)], &extended, sizeof(DDSHeaderDX10));
+
+	std::vector<unsigned char> blocks;
+	for (TextureData& level : mips)
+	{
+		Compress(level, kind, blocks, pool);
+		dds.insert(dds.end(), blocks.begin(), blocks.end());
+	}
+}
+
+bool TextureCooker::IsUpToDate(const unsigned char* dds, size_t size, unsigned long long sourceHash)
+{
+	if (!dds || size < sizeof(DDSMagic) + sizeof(DDSHeader) + sizeof(DDSHeaderDX10))
+		return false;
+
+	unsigned int magic;
+	DDSHeader header;
+	memcpy(&magic, dds, sizeof(magic));
+	memcpy(&header, dds + sizeof(DDSMagic), sizeof(DDSHeader));
+	return magic == DDSMagic &&
+		header.Reserved1[CookedMagic] == Magic &&
+		header.Reserved1[CookedVersion] == Version &&
+		header.Reserved1[CookedHashLow] == (unsigned int)sourceHash &&
+		header.Reserved1[CookedHashHigh] == (unsigned int)(sourceHash >> 32);
+}
+
+bool TextureCooker::ReadLayout(const unsigned char* dds, size_t size, CookedLayout& layout)
+{
+	const size_t headerSize = sizeof(DDSMagic) + sizeof(DDSHeader) + sizeof(DDSHeaderDX10);
+	if (!dds || size < headerSize)
+		return false;
+
+	unsigned int magic;
+	DDSHeader header;
+	DDSHeaderDX10 extended;
+	memcpy(&magic, dds, sizeof(magic));
+	memcpy(&header, dds + sizeof(DDSMagic), sizeof(DDSHeader));
+	memcpy(&extended, dds + sizeof(DDSMagic) + sizeof(DDSHeader), sizeof(DDSHeaderDX10));
+	if (magic != DDSMagic || header.Reserved1[CookedMagic] != Magic || header.MipMapCount == 0)
+		return false;
+
+	layout.Width = header.Width;
+	layout.Height = header.Height;
+	layout.MipCount = header.MipMapCount;
+	layout.Format = extended.DXGIFormat;
+	layout.BlockSize = extended.DXGIFormat == DXGI_FORMAT_BC4_UNORM ? 8 : 16;
+	layout.Offsets.resize(layout.MipCount);
+	layout.Sizes.resize(layout.MipCount);
+
+	size_t offset = headerSize;
+	for (unsigned int mip = 0; mip < layout.MipCount; mip++)
+	{
+		unsigned int width = layout.Width >> mip ? layout.Width >> mip : 1;
+		unsigned int height = layout.Height >> mip ? layout.Height >> mip : 1;
+		layout.Offsets[mip] = offset;
+		layout.Sizes[mip] = (size_t)((width + 3) / 4) * ((height + 3) / 4) * layout.BlockSize;
+		offset += layout.Sizes[mip];
+	}
+	return offset <= size;
+}
+
+bool TextureCooker::IsBlockAligned(const CookedLayout& layout, unsigned int mip)
+{
+	unsigned int width = layout.Width >> mip;
+	unsigned int height = layout.Height >> mip;
+	return mip < layout.MipCount && width >= 4 && height >= 4 && width % 4 == 0 && height % 4 == 0;
+}
+
+unsigned int TextureCooker::GetFirstMip(const CookedLayout& layout, unsigned int maxSize)
+{
+	unsigned int firstMip = 0;
+	for (unsigned int mip = 0; mip < layout.MipCount; mip++)
+	{
+		unsigned int width = layout.Width >> mip ? layout.Width >> mip : 1;
+		unsigned int height = layout.Height >> mip ? layout.Height >> mip : 1;
+		if (IsBlockAligned(layout, mip))
+			firstMip = mip;
+		if (width <= maxSize && height <= maxSize)
+			break;
+	}
+	return firstMip;
+}
+
+bool TextureCooker::Write(const std::wstring& path, const std::vector<unsigned char>& dds)
+{
+	HANDLE file = CreateFileW(path.c_str(), GENERIC_WRITE, 0, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	DWORD written = 0;
+	BOOL success = WriteFile(file, dds.data(), (DWORD)dds.size(), &written, 0);
+	CloseHandle(file);
+	return success && written == dds.size();
+}
+
+void TextureCooker::FindImages(const std::wstring& folder, std::vector<std::wstring>& paths)
+{
+	std::wstring prefix = folder;
+	if (!prefix.empty() && prefix.back() != L'/' && prefix.back() != L'\\')
+		prefix += L'/';
+
+	WIN32_FIND_DATAW found;
+	HANDLE search = FindFirstFileW((prefix + L"*.png").c_str(), &found);
+	if (search == INVALID_HANDLE_VALUE)
+		return;
+
+	do
+	{
+		if (!(found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+			paths.push_back(prefix + found.cFileName);
+	} while (FindNextFileW(search, &found));
+	FindClose(search);
+}
+
+unsigned int TextureCooker::CookFolder(const std::wstring& folder, MipFilter filter, bool force)
+{
+	std::vector<std::wstring> images;
+	FindImages(folder, images);
+
+	ThreadPool pool;
+	unsigned int cooked = 0;
+	double sourceMB = 0.0;
+	double cookedMB = 0.0;
+	printf("\n--- Cooking %zu textures (%u threads, %s mips) ---\n",
+		images.size(), pool.GetThreadCount(), filter == MipFilter::Box ? "box" : "Kaiser");
+
+	// Cooks one texture, unless its cooked file is already up to date
+	auto cookOne = [&](const std::wstring& cookedPath, unsigned long long sourceHash, TextureKind kind, const std::function<bool(TextureData&)>& load)
+	{
+		std::string name;
+		for (wchar_t c : cookedPath.substr(cookedPath.find_last_of(L"/\\") + 1))
+			name += (char)c;
+		name = name.substr(0, name.size() - strlen(".cooked.dds"));
+
+		if (!force)
+		{
+			MappedFile existing(cookedPath.c_str());
+			if (IsUpToDate(existing.GetData(), existing.GetSize(), sourceHash))
+				return;
+		}
+
+		auto start = std::chrono::high_resolution_clock::now();
+		TextureData image;
+		if (!load(image))
+		{
+			printf("  FAILED to decode %s\n", name.c_str());
+			return;
+		}
+
+		std::vector<unsigned char> dds;
+		Cook(image, kind, filter, sourceHash, dds, &pool);
+		bool written = Write(cookedPath, dds);
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+		// What it would have taken as RGBA8 with a full mip chain
+		double rgbaMB = image.Width * image.Height * 4.0 * 4.0 / 3.0 / (1024.0 * 1024.0);
+		double ddsMB = dds.size() / (1024.0 * 1024.0);
+		printf("  %8.1f ms  %4ux%-4u  %s  %6.2f MB -> %5.2f MB  %s%s\n",
+			ms, image.Width, image.Height,
+			kind == TextureKind::Normal ? "BC5" : kind == TextureKind::Single ? "BC4" : "BC7",
+			rgbaMB, ddsMB, name.c_str(), written ? "" : "  (FAILED to write)");
+
+		sourceMB += rgbaMB;
+		cookedMB += ddsMB;
+		cooked++;
+	};
+
+	for (std::wstring& path : images)
+	{
+		unsigned long long sourceHash;
+		if (HashSource(path, sourceHash))
+			cookOne(GetCookedPath(path), sourceHash, KindFromName(path), [&](TextureData& image) { return AssetLoader::DecodeImage(path, image); });
+	}
+
+	// Then an ORM texture for every roughness map with a metalness map to go with it
+	for (std::wstring& path : images)
+	{
+		if (KindFromName(path) != TextureKind::Single)
+			continue;
+
+		ORMSources sources = FindORMSources(path);
+		unsigned long long sourceHash;
+		if (!sources.Metalness.empty() && HashORM(sources, sourceHash))
+			cookOne(GetPackedPath(sources), sourceHash, TextureKind::Packed, [&](TextureData& image) { return LoadORM(sources, image); });
+	}
+
+	if (cooked > 0)
+		printf("Cooked %u textures: %.2f MB of RGBA8 became %.2f MB (%.1fx smaller)\n", cooked, sourceMB, cookedMB, sourceMB / cookedMB);
+	else
+		printf("Every texture was already up to date\n");
+	return cooked;
+}
+
+// --------------------------------------------------------
+// BC4: two 8 bit endpoints and a 3 bit index per pixel.
+// With endpoint 0 above endpoint 1 there are 6 colors in
+// between; otherwise 4, plus exact 0 and 255.
+// --------------------------------------------------------
+static void BC4Palette(unsigned char end0, unsigned char end1, unsigned char palette[8])
+{
+	palette[0] = end0;
+	palette[1] = end1;
+	if (end0 > end1)
+	{
+		for (int i = 1; i <= 6; i++)
+			palette[i + 1] = (unsigned char)(((7 - i) * end0 + i * end1 + 3) / 7);
+	}
+	else
+	{
+		for (int i = 1; i <= 4; i++)
+			palette[i + 1] = (unsigned char)(((5 - i) * end0 + i * end1 + 2) / 5);
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+}
+
+// Picks the nearest palette entry for each value, returning the total squared error
+static int FitBC4(const unsigned char values[16], unsigned char end0, unsigned char end1, unsigned char indices[16])
+{
+	unsigned char palette[8];
+	BC4Palette(end0, end1, palette);
+
+	int total = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		int best = 0;
+		int bestError = 256 * 256;
+		for (int p = 0; p < 8; p++)
+		{
+			int difference = values[i] - palette[p];
+			if (difference * difference < bestError)
+			{
+				bestError = difference * difference;
+				best = p;
+			}
+		}
+		indices[i] = (unsigned char)best;
+		total += bestError;
+	}
+	return total;
+}
+
+void TextureCooker::EncodeBC4(const unsigned char values[16], unsigned char block[8])
+{
+	// The full range for the 8 value mode, and the range of
+	// everything but 0 and 255 for the mode that has those
+	unsigned char low = 255, high = 0;
+	unsigned char innerLow = 255, innerHigh = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		low = values[i] < low ? values[i] : low;
+		high = values[i] > high ? values[i] : high;
+		if (values[i] != 0 && values[i] != 255)
+		{
+			innerLow = values[i] < innerLow ? values[i] : innerLow;
+			innerHigh = values[i] > innerHigh ? values[i] : innerHigh;
+		}
+	}
+	if (innerLow > innerHigh)
+		innerLow = innerHigh = 0;
+
+	unsigned char end0 = high, end1 = low;
+	unsigned char indices[16];
+	int error = high > low ? FitBC4(values, high, low, indices) : 256 * 256 * 16;
+
+	unsigned char sixIndices[16];
+	int sixError = FitBC4(values, innerLow, innerHigh, sixIndices);
+	if (sixError < error)
+	{
+		end0 = innerLow;
+		end1 = innerHigh;
+		memcpy(indices, sixIndices, sizeof(indices));
+	}
+
+	block[0] = end0;
+	block[1] = end1;
+	unsigned long long bits = 0;
+	for (int i = 0; i < 16; i++)
+		bits |= (unsigned long long)indices[i] << (3 * i);
+	for (int i = 0; i < 6; i++)
+		block[2 + i] = (unsigned char)(bits >> (8 * i));
+}
+
+void TextureCooker::DecodeBC4(const unsigned char block[8], unsigned char values[16])
+{
+	unsigned char palette[8];
+	BC4Palette(block[0], block[1], palette);
+
+	unsigned long long bits = 0;
+	for (int i = 0; i < 6; i++)
+		bits |= (unsigned long long)block[2 + i] << (8 * i);
+	for (int i = 0; i < 16; i++)
+		values[i] = palette[(bits >> (3 * i)) & 7];
+}
+
+// BC5 is two BC4 blocks, red then green
+void TextureCooker::EncodeBC5(const unsigned char red[16], const unsigned char green[16], unsigned char block[16])
+{
+	EncodeBC4(red, block);
+	EncodeBC4(green, block + 8);
+}
+
+// --------------------------------------------------------
+// BC7 mode 6: one RGBA line through color space, with 7 bit
+// endpoints that share a low bit each (the "p-bits"), and
+// a 4 bit index per pixel along it. A single line suits
+// most albedo blocks; modes with several lines per block
+// would do better on sharp color edges.
+// --------------------------------------------------------
+struct BC7Endpoints
+{
+	unsigned char Quantized[2][4];	// 7 bits each
+	unsigned char PBits[2];
+	unsigned char Indices[16];
+	int Error;
+};
+
+// Packs bits into a block, least significant first
+struct BitWriter
+{
+	unsigned char* Data;
+	unsigned int Position;
+
+	void Write(unsigned int value, unsigned int bits)
+	{
+		for (unsigned int b = 0; b < bits; b++, Position++)
+		{
+			if ((value >> b) & 1)
+				Data[Position >> 3] |= (unsigned char)(1 << (Position & 7));
+		}
+	}
+};
+
+struct BitReader
+{
+	const unsigned char* Data;
+	unsigned int Position;
+
+	unsigned int Read(unsigned int bits)
+	{
+		unsigned int value = 0;
+		for (unsigned int b = 0; b < bits; b++, Position++)
+			value |= ((Data[Position >> 3] >> (Position & 7)) & 1) << b;
+		return value;
+	}
+};
+
+static void BC7Palette(const unsigned char end0[4], const unsigned char end1[4], int palette[16][4])
+{
+	for (int i = 0; i < 16; i++)
+	{
+		for (int c = 0; c < 4; c++)
+			palette[i][c] = ((64 - BC7Weights[i]) * end0[c] + BC7Weights[i] * end1[c] + 32) >> 6;
+	}
+}
+
+// --------------------------------------------------------
+// Quantizes a pair of float endpoints with each of the four
+// p-bit combinations, indexes every pixel against each, and
+// keeps whichever has the least error
+// --------------------------------------------------------
+static void FitBC7(const unsigned char rgba[64], const float start[4], const float end[4], BC7Endpoints& best)
+{
+	for (unsigned char p0 = 0; p0 < 2; p0++)
+	{
+		for (unsigned char p1 = 0; p1 < 2; p1++)
+		{
+			BC7Endpoints candidate;
+			candidate.PBits[0] = p0;
+			candidate.PBits[1] = p1;
+
+			unsigned char end0[4];
+			unsigned char end1[4];
+			for (int c = 0; c < 4; c++)
+			{
+				int q0 = (int)floorf((start[c] - p0) * 0.5f + 0.5f);
+				int q1 = (int)floorf((end[c] - p1) * 0.5f + 0.5f);
+				q0 = q0 < 0 ? 0 : (q0 > 127 ? 127 : q0);
+				q1 = q1 < 0 ? 0 : (q1 > 127 ? 127 : q1);
+				candidate.Quantized[0][c] = (unsigned char)q0;
+				candidate.Quantized[1][c] = (unsigned char)q1;
+				end0[c] = (unsigned char)((q0 << 1) | p0);
+				end1[c] = (unsigned char)((q1 << 1) | p1);
+			}
+
+			int palette[16][4];
+			BC7Palette(end0, end1, palette);
+
+			candidate.Error = 0;
+			for (int i = 0; i < 16 && candidate.Error < best.Error; i++)
+			{
+				const unsigned char* pixel = &rgba[i * 4];
+				int bestIndex = 0;
+				int bestError = 0x7FFFFFFF;
+				for (int p = 0; p < 16; p++)
+				{
+					int dr = pixel[0] - palette[p][0];
+					int dg = pixel[1] - palette[p][1];
+					int db = pixel[2] - palette[p][2];
+					int da = pixel[3] - palette[p][3];
+					int error = dr * dr + dg * dg + db * db + da * da;
+					if (error < bestError)
+					{
+						bestError = error;
+						bestIndex = p;
+					}
+				}
+				candidate.Indices[i] = (unsigned char)bestIndex;
+				candidate.Error += bestError;
+			}
+
+			if (candidate.Error < best.Error)
+				best = candidate;
+		}
+	}
+}
+
+void TextureCooker::EncodeBC7(const unsigned char rgba[64], unsigned char block[16])
+{
+	// The block's mean and the direction it varies most in,
+	// by power iteration on its covariance
+	float mean[4] = {};
+	float low[4] = { 255.0f, 255.0f, 255.0f, 255.0f };
+	float high[4] = {};
+	for (int i = 0; i < 16; i++)
+	{
+		for (int c = 0; c < 4; c++)
+		{
+			float value = rgba[i * 4 + c];
+			mean[c] += value / 16.0f;
+			low[c] = value < low[c] ? value : low[c];
+			high[c] = value > high[c] ? value : high[c];
+		}
+	}
+
+	float covariance[4][4] = {};
+	for (int i = 0; i < 16; i++)
+	{
+		float d[4];
+		for (int c = 0; c < 4; c++)
+			d[c] = rgba[i * 4 + c] - mean[c];
+		for (int r = 0; r < 4; r++)
+		{
+			for (int c = 0; c < 4; c++)
+				covariance[r][c] += d[r] * d[c];
+		}
+	}
+
+	float axis[4];
+	for (int c = 0; c < 4; c++)
+		axis[c] = high[c] - low[c];
+	for (int iteration = 0; iteration < 8; iteration++)
+	{
+		float next[4] = {};
+		float length = 0.0f;
+		for (int r = 0; r < 4; r++)
+		{
+			for (int c = 0; c < 4; c++)
+				next[r] += covariance[r][c] * axis[c];
+			length += next[r] * next[r];
+		}
+		if (length < 1e-12f)
+			break;
+
+		length = sqrtf(length);
+		for (int c = 0; c < 4; c++)
+			axis[c] = next[c] / length;
+	}
+
+	// Endpoints where the pixels' projections onto the axis end
+	float axisLength = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2] + axis[3] * axis[3];
+	float minT = 0.0f, maxT = 0.0f;
+	if (axisLength > 1e-12f)
+	{
+		for (int c = 0; c < 4; c++)
+			axis[c] /= sqrtf(axisLength);
+		minT = maxT = 0.0f;
+		for (int i = 0; i < 16; i++)
+		{
+			float t = 0.0f;
+			for (int c = 0; c < 4; c++)
+				t += (rgba[i * 4 + c] - mean[c]) * axis[c];
+			minT = t < minT ? t : minT;
+			maxT = t > maxT ? t : maxT;
+		}
+	}
+
+	float start[4];
+	float end[4];
+	for (int c = 0; c < 4; c++)
+	{
+		start[c] = mean[c] + axis[c] * minT;
+		end[c] = mean[c] + axis[c] * maxT;
+	}
+
+	BC7Endpoints best;
+	best.Error = 0x7FFFFFFF;
+	FitBC7(rgba, start, end, best);
+
+	// Then a least squares fit of the endpoints to those indices
+	if (best.Error > 0)
+	{
+		float a = 0.0f, b = 0.0f, d = 0.0f;
+		float x[4] = {}, y[4] = {};
+		for (int i = 0; i < 16; i++)
+		{
+			float w = BC7Weights[best.Indices[i]] / 64.0f;
+			a += (1.0f - w) * (1.0f - w);
+			b += (1.0f - w) * w;
+			d += w * w;
+			for (int c = 0; c < 4; c++)
+			{
+				x[c] += (1.0f - w) * rgba[i * 4 + c];
+				y[c] += w * rgba[i * 4 + c];
+			}
+		}
+
+		float determinant = a * d - b * b;
+		if (fabsf(determinant) > 1e-6f)
+		{
+			for (int c = 0; c < 4; c++)
+			{
+				start[c] = (d * x[c] - b * y[c]) / determinant;
+				end[c] = (a * y[c] - b * x[c]) / determinant;
+				start[c] = start[c] < 0.0f ? 0.0f : (start[c] > 255.0f ? 255.0f : start[c]);
+				end[c] = end[c] < 0.0f ? 0.0f : (end[c] > 255.0f ? 255.0f : end[c]);
+			}
+			FitBC7(rgba, start, end, best);
+		}
+	}
+
+	// The first index only has 3 bits, so its top bit must be 0
+	if (best.Indices[0] >= 8)
+	{
+		for (int c = 0; c < 4; c++)
+		{
+			unsigned char swap = best.Quantized[0][c];
+			best.Quantized[0][c] = best.Quantized[1][c];
+			best.Quantized[1][c] = swap;
+		}
+		unsigned char swap = best.PBits[0];
+		best.PBits[0] = best.PBits[1];
+		best.PBits[1] = swap;
+		for (int i = 0; i < 16; i++)
+			best.Indices[i] = 15 - best.Indices[i];
+	}
+
+	memset(block, 0, 16);
+	BitWriter bits = { block, 0 };
+	bits.Write(1 << 6, 7); // Mode 6
+	for (int c = 0; c < 4; c++)
+	{
+		bits.Write(best.Quantized[0][c], 7);
+		bits.Write(best.Quantized[1][c], 7);
+	}
+	bits.Write(best.PBits[0], 1);
+	bits.Write(best.PBits[1], 1);
+	bits.Write(best.Indices[0], 3);
+	for (int i = 1; i < 16; i++)
+		bits.Write(best.Indices[i], 4);
+}
+
+void TextureCooker::DecodeBC7(const unsigned char block[16], unsigned char rgba[64])
+{
+	BitReader bits = { block, 0 };
+	if (bits.Read(7) != (1 << 6))
+	{
+		// Not mode 6; show it as magenta
+		for (int i = 0; i < 16; i++)
+		{
+			rgba[i * 4 + 0] = 255;
+			rgba[i * 4 + 1] = 0;
+			rgba[i * 4 + 2] = 255;
+			rgba[i * 4 + 3] = 255;
+		}
+		return;
+	}
+
+	unsigned char quantized[2][4];
+	for (int c = 0; c < 4; c++)
+	{
+		quantized[0][c] = (unsigned char)bits.Read(7);
+		quantized[1][c] = (unsigned char)bits.Read(7);
+	}
+	unsigned int p0 = bits.Read(1);
+	unsigned int p1 = bits.Read(1);
+
+	unsigned char end0[4];
+	unsigned char end1[4];
+	for (int c = 0; c < 4; c++)
+	{
+		end0[c] = (unsigned char)((quantized[0][c] << 1) | p0);
+		end1[c] = (unsigned char)((quantized[1][c] << 1) | p1);
+	}
+
+	int palette[16][4];
+	BC7Palette(end0, end1, palette);
+	for (int i = 0; i < 16; i++)
+	{
+		unsigned int index = bits.Read(i == 0 ? 3 : 4);
+		for (int c = 0; c < 4; c++)
+			rgba[i * 4 + c] = (unsigned char)palette[index][c];
+	}
+}
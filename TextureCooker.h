@@ -0,0 +1,131 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "ThreadPool.h"
+
+struct TextureData;
+
+// What a texture holds, which decides how its mips are
+// filtered and which block format it's compressed to
+enum class TextureKind
+{
+	Color,		// BC7, filtered in linear space (the shader decodes gamma 2.2)
+	Normal,		// BC5, X and Y only, renormalized at every level
+	Single,		// BC4, red channel only (roughness, metalness, ...)
+	Packed		// BC7, linear channels: R = occlusion, G = roughness, B = metalness
+};
+
+// The single channel maps packed into one ORM texture. Occlusion
+// is optional, and packs as white when there isn't one.
+struct ORMSources
+{
+	std::wstring Occlusion;
+	std::wstring Roughness;
+	std::wstring Metalness;
+};
+
+// Where each level's blocks are in a cooked DDS file
+struct CookedLayout
+{
+	unsigned int Width = 0;
+	unsigned int Height = 0;
+	unsigned int MipCount = 0;
+	unsigned int Format = 0;			// DXGI_FORMAT
+	unsigned int BlockSize = 0;			// Bytes per 4x4 block
+	std::vector<size_t> Offsets;		// Of each level, from the start of the file
+	std::vector<size_t> Sizes;
+};
+
+enum class MipFilter
+{
+	Box,		// Averages each 2x2 footprint
+	Kaiser		// Kaiser windowed sinc, sharper at a little more cost
+};
+
+// --------------------------------------------------------
+// Cooks source images into block compressed DDS files
+// with full mip chains, which DDSTextureLoader can then
+// create straight from memory
+//
+// - Cooked files sit next to their source, with
+//   ".cooked.dds" appended. The DDS header's reserved
+//   space holds a hash of the source, so editing the
+//   source recooks it, like the mesh cache
+// - Images whose size isn't a multiple of 4 are resized
+//   up to one first, as the top level of a BC texture must be
+// - Everything here runs on the CPU, and compression can
+//   be split across a thread pool's workers
+// --------------------------------------------------------
+class TextureCooker
+{
+public:
+	static const unsigned int Magic = 0x4B4F4F43; // "COOK"
+	static const unsigned int Version = 1;
+
+	static std::wstring GetCookedPath(const std::wstring& sourceFile);
+
+	// Guesses the kind from a "_normals", "_roughness", "_metal", "_ao" or "_orm" style name; anything else is color
+	static TextureKind KindFromName(const std::wstring& sourceFile);
+
+	// Hash of a source file's bytes, for IsUpToDate()
+	static bool HashSource(const std::wstring& sourceFile, unsigned long long& hash);
+
+	// Packed maps: given "bronze_roughness.png", finds "bronze_metal.png" and,
+	// if it's there, "bronze_ao.png". Metalness is empty if it's missing.
+	static ORMSources FindORMSources(const std::wstring& roughnessFile);
+
+	// "bronze_orm.cooked.dds", next to the roughness map
+	static std::wstring GetPackedPath(const ORMSources& sources);
+
+	// One hash over every source, so changing any of them recooks
+	static bool HashORM(const ORMSources& sources, unsigned long long& hash);
+
+	// Decodes each source and packs them into one image the size of the
+	// roughness map, resizing the others to match if they differ
+	static bool LoadORM(const ORMSources& sources, TextureData& packed);
+
+	// Every level of the chain, down to 1x1, as RGBA8
+	static void BuildMips(const TextureData& image, TextureKind kind, MipFilter filter, std::vector<TextureData>& mips);
+
+	// Compresses one level into 4x4 blocks. The pool must not be running other
+	// work, as this waits for all of it.
+	static void Compress(const TextureData& level, TextureKind kind, std::vector<unsigned char>& blocks, ThreadPool* pool = 0);
+
+	// Mips, compression and the whole DDS file, in memory
+	static void Cook(const TextureData& image, TextureKind kind, MipFilter filter, unsigned long long sourceHash,
+		std::vector<unsigned char>& dds, ThreadPool* pool = 0);
+
+	// Was this DDS file cooked from the given source by this version of the cooker?
+	static bool IsUpToDate(const unsigned char* dds, size_t size, unsigned long long sourceHash);
+
+	static bool Write(const std::wstring& path, const std::vector<unsigned char>& dds);
+
+	// Reads a cooked file's header. False if it isn't one, or is cut short.
+	static bool ReadLayout(const unsigned char* dds, size_t size, CookedLayout& layout);
+
+	// Can a texture start at this level? A block compressed texture's
+	// top level has to be a whole number of blocks.
+	static bool IsBlockAligned(const CookedLayout& layout, unsigned int mip);
+
+	// The first level no bigger than maxSize a texture can start at, or
+	// the nearest bigger one that it can (0 if only the top level can)
+	static unsigned int GetFirstMip(const CookedLayout& layout, unsigned int maxSize);
+
+	// Full paths of every .png in a folder
+	static void FindImages(const std::wstring& folder, std::vector<std::wstring>& paths);
+
+	// Cooks every .png in a folder that's missing or out of date (or all
+	// of them, if forced), and packs each roughness/metalness(/AO) set into
+	// an ORM texture, logging sizes and timings. Returns the number cooked.
+	static unsigned int CookFolder(const std::wstring& folder, MipFilter filter, bool force);
+
+	// Single block codecs, for 4x4 pixels in row order. The decoders
+	// are for checking the encoders; DecodeBC7 only handles mode 6,
+	// the one EncodeBC7 writes.
+	static void EncodeBC4(const unsigned char values[16], unsigned char block[8]);
+	static void EncodeBC5(const unsigned char red[16], const unsigned char green[16], unsigned char block[16]);
+	static void EncodeBC7(const unsigned char rgba[64], unsigned char block[16]);
+	static void DecodeBC4(const unsigned char block[8], unsigned char values[16]);
+	static void DecodeBC7(const unsigned char block[16], unsigned char rgba[64]);
+};
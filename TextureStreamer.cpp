@@ -0,0 +1,347 @@
+#include "TextureStreamer.h"
+#include "AssetLoader.h"
+#include "BVH.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <unordered_map>
+
+using namespace DirectX;
+
+TextureStreamer::TextureStreamer(Microsoft::WRL::ComPtr<ID3D11Device> device, size_t budget)
+	: worker(1)
+{
+	this->device = device;
+	this->budget = budget;
+	this->loads = 0;
+	this->evictions = 0;
+}
+
+TextureStreamer::~TextureStreamer()
+{
+}
+
+bool TextureStreamer::Add(std::shared_ptr<CachedTexture> texture)
+{
+	if (!texture || !texture->SRV || !texture->Params.Cooked)
+		return false;
+
+	std::wstring cookedPath = texture->Params.PackedORM ?
+		TextureCooker::GetPackedPath(TextureCooker::FindORMSources(texture->Path)) :
+		TextureCooker::GetCookedPath(texture->Path);
+
+	std::shared_ptr<StreamedTexture> record = std::make_shared<StreamedTexture>();
+	record->File = std::make_shared<MappedFile>(cookedPath.c_str());
+	if (!record->File->IsValid() || !TextureCooker::ReadLayout(record->File->GetData(), record->File->GetSize(), record->Layout))
+		return false;
+
+	// Whatever the loader created tells us which levels are resident
+	Microsoft::WRL::ComPtr<ID3D11Resource> resource;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> texture2D;
+	texture->SRV->GetResource(resource.GetAddressOf());
+	if (FAILED(resource->QueryInterface(__uuidof(ID3D11Texture2D), reinterpret_cast<void**>(texture2D.GetAddressOf()))))
+		return false;
+
+	D3D11_TEXTURE2D_DESC desc;
+	texture2D->GetDesc(&desc);
+	while (record->ResidentMip < record->Layout.MipCount && (record->Layout.Width >> record->ResidentMip) > desc.Width)
+		record->ResidentMip++;
+
+	record->BaseMip = TextureCooker::GetFirstMip(record->Layout, StartSize);
+	record->BaseMip = record->ResidentMip > record->BaseMip ? record->ResidentMip : record->BaseMip;
+	record->WantedMip = record->ResidentMip;
+	record->Texture = texture;
+	textures.push_back(record);
+	return true;
+}
+
+void TextureStreamer::Update(Camera* camera, const std::vector<std::shared_ptr<GameEntity>>& entities, float screenHeight)
+{
+	FinishJob();
+
+	// Forget textures the cache has unloaded
+	for (auto it = textures.begin(); it != textures.end();)
+	{
+		if ((*it)->Texture.expired())
+			it = textures.erase(it);
+		else
+			it++;
+	}
+
+	UpdateNeeds(camera, entities, screenHeight);
+	FitBudget();
+	StartNextJob();
+}
+
+void TextureStreamer::Flush()
+{
+	worker.Wait();
+	FinishJob();
+}
+
+void TextureStreamer::SetBudget(size_t bytes)
+{
+	budget = bytes;
+}
+
+size_t TextureStreamer::GetResidentBytes()
+{
+	size_t bytes = 0;
+	for (auto& texture : textures)
+		bytes += GetBytes(*texture, texture->ResidentMip);
+	return bytes;
+}
+
+unsigned int TextureStreamer::GetLoadCount() { return loads; }
+unsigned int TextureStreamer::GetEvictionCount() { return evictions; }
+
+void TextureStreamer::ResetStats()
+{
+	loads = 0;
+	evictions = 0;
+}
+
+void TextureStreamer::Report()
+{
+	printf("\n--- Streamed textures ---\n");
+	printf("%10s  %-9s  %-9s  %-9s  %s\n", "MB", "resident", "wanted", "need", "texture");
+	for (auto& texture : textures)
+	{
+		std::shared_ptr<CachedTexture> cached = texture->Texture.lock();
+		if (!cached)
+			continue;
+
+		std::string name;
+		for (wchar_t c : cached->Path.substr(cached->Path.find_last_of(L"/\\") + 1))
+			name += (char)c;
+
+		printf("%10.2f  %9u  %9u  %9.0f  %s%s\n",
+			GetBytes(*texture, texture->ResidentMip) / (1024.0 * 1024.0),
+			GetSize(*texture, texture->ResidentMip), GetSize(*texture, texture->WantedMip), texture->Need,
+			name.c_str(), cached->Params.PackedORM ? " (ORM)" : "");
+	}
+
+	size_t resident = GetResidentBytes();
+	printf("%10.2f MB in %zu textures", resident / (1024.0 * 1024.0), textures.size());
+	if (budget > 0)
+		printf(", %.0f%% of the %.2f MB budget", resident * 100.0 / budget, budget / (1024.0 * 1024.0));
+	printf(", %u loads and %u evictions%s\n", loads, evictions, job ? ", one in flight" : "");
+}
+
+// --------------------------------------------------------
+// Swaps the worker's new texture in, if it's done
+// --------------------------------------------------------
+void TextureStreamer::FinishJob()
+{
+	if (!job || !job->Done)
+		return;
+
+	std::shared_ptr<CachedTexture> texture = job->Record->Texture.lock();
+	if (texture && job->SRV)
+	{
+		if (job->Mip < job->Record->ResidentMip)
+			loads++;
+		else
+			evictions++;
+
+		// Materials bind the cached SRV every time they're drawn,
+		// so they pick the new one up on their own
+		texture->SRV = job->SRV;
+		job->Record->ResidentMip = job->Mip;
+	}
+	else if (texture)
+	{
+		// Leave it as it is, rather than retrying every frame
+		textures.erase(std::find(textures.begin(), textures.end(), job->Record));
+	}
+	job.reset();
+}
+
+// --------------------------------------------------------
+// Estimates how many texels across each texture needs from
+// the largest on screen size of the entities using it
+//
+// - Every entity counts, not only visible ones, so turning
+//   the camera doesn't stream textures out and back in
+// - An entity's size is its world space bounding sphere's
+//   projected diameter, in pixels
+// - Tiling divides it, as each repeat covers less screen
+// --------------------------------------------------------
+void TextureStreamer::UpdateNeeds(Camera* camera, const std::vector<std::shared_ptr<GameEntity>>& entities, float screenHeight)
+{
+	std::unordered_map<CachedTexture*, StreamedTexture*> streamed;
+	for (auto& texture : textures)
+	{
+		texture->Need = 0.0f;
+		streamed[texture->Texture.lock().get()] = texture.get();
+	}
+
+	XMFLOAT3 eye = camera->GetTransform()->GetPosition();
+	float pixelsPerUnit = camera->GetProjectionMatrix()._22 * screenHeight * 0.5f;
+	for (auto& entity : entities)
+	{
+		std::shared_ptr<Mesh> mesh = entity->GetMesh();
+		XMFLOAT3 boundsMin;
+		XMFLOAT3 boundsMax;
+		BVH::TransformBounds(mesh->GetBoundsMin(), mesh->GetBoundsMax(), entity->GetTransform()->GetWorldMatrix(), boundsMin, boundsMax);
+
+		XMVECTOR low = XMLoadFloat3(&boundsMin);
+		XMVECTOR high = XMLoadFloat3(&boundsMax);
+		float radius = XMVectorGetX(XMVector3Length(high - low)) * 0.5f;
+		float distance = XMVectorGetX(XMVector3Length((low + high) * 0.5f - XMLoadFloat3(&eye)));
+
+		// Close enough to be inside it, so it fills the screen
+		distance = distance > radius ? distance : radius;
+		if (distance <= 0.0f)
+			continue;
+
+		float uvScale = entity->GetMaterial()->GetUvScale();
+		float need = 2.0f * radius / distance * pixelsPerUnit / (uvScale > 0.0f ? uvScale : 1.0f);
+		for (auto& texture : entity->GetMaterial()->GetTextures())
+		{
+			auto found = streamed.find(texture.second.get());
+			if (found != streamed.end() && need > found->second->Need)
+				found->second->Need = need;
+		}
+	}
+
+	for (auto& texture : textures)
+	{
+		texture->WantedMip = GetMipFor(*texture, texture->Need);
+
+		// Keep a level until it's needed half as much, so a
+		// need hovering around a level's size doesn't flip it
+		if (texture->WantedMip > texture->ResidentMip)
+		{
+			unsigned int keep = GetMipFor(*texture, texture->Need * 2.0f);
+			texture->WantedMip = keep > texture->ResidentMip ? keep : texture->ResidentMip;
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Drops the finest wanted level of whichever texture has
+// the most texels to spare for its need, until they fit
+// --------------------------------------------------------
+void TextureStreamer::FitBudget()
+{
+	if (budget == 0)
+		return;
+
+	size_t wanted = 0;
+	for (auto& texture : textures)
+		wanted += GetBytes(*texture, texture->WantedMip);
+
+	while (wanted > budget)
+	{
+		StreamedTexture* leastNeeded = 0;
+		float mostSpare = 0.0f;
+		for (auto& texture : textures)
+		{
+			if (texture->WantedMip >= texture->BaseMip)
+				continue;
+
+			float spare = GetSize(*texture, texture->WantedMip) / (texture->Need > 1.0f ? texture->Need : 1.0f);
+			if (!leastNeeded || spare > mostSpare)
+			{
+				leastNeeded = texture.get();
+				mostSpare = spare;
+			}
+		}
+
+		// Everything's down to its starting levels
+		if (!leastNeeded)
+			break;
+
+		unsigned int coarser = leastNeeded->WantedMip + 1;
+		while (coarser < leastNeeded->BaseMip && !TextureCooker::IsBlockAligned(leastNeeded->Layout, coarser))
+			coarser++;
+
+		wanted -= GetBytes(*leastNeeded, leastNeeded->WantedMip) - GetBytes(*leastNeeded, coarser);
+		leastNeeded->WantedMip = coarser;
+	}
+}
+
+// --------------------------------------------------------
+// Starts creating the texture that's furthest from what it
+// wants. Evictions go first, so loads never push past the
+// budget while there's memory waiting to be freed.
+// --------------------------------------------------------
+void TextureStreamer::StartNextJob()
+{
+	if (job)
+		return;
+
+	std::shared_ptr<StreamedTexture> next;
+	float bestScore = 0.0f;
+	bool evicting = false;
+	for (auto& texture : textures)
+	{
+		if (texture->WantedMip == texture->ResidentMip)
+			continue;
+
+		bool eviction = texture->WantedMip > texture->ResidentMip;
+		float score = eviction ?
+			(float)(GetBytes(*texture, texture->ResidentMip) - GetBytes(*texture, texture->WantedMip)) :
+			texture->Need / GetSize(*texture, texture->ResidentMip);
+		if (eviction && !evicting)
+		{
+			next.reset();
+			evicting = true;
+		}
+		if (eviction != evicting)
+			continue;
+
+		if (!next || score > bestScore)
+		{
+			next = texture;
+			bestScore = score;
+		}
+	}
+
+	if (!next)
+		return;
+
+	job = std::make_shared<StreamJob>();
+	job->Record = next;
+	job->Mip = next->WantedMip;
+	job->Done = false;
+
+	// The record (and its mapped file) lives as long as the job does
+	std::shared_ptr<StreamJob> started = job;
+	Microsoft::WRL::ComPtr<ID3D11Device> creator = device;
+	worker.Enqueue([started, creator]()
+	{
+		std::shared_ptr<MappedFile> file = started->Record->File;
+		AssetLoader::CreateCookedTexture(creator.Get(), file->GetData(), file->GetSize(), started->Mip, started->SRV);
+		started->Done = true;
+	});
+}
+
+size_t TextureStreamer::GetBytes(const StreamedTexture& texture, unsigned int firstMip)
+{
+	size_t bytes = 0;
+	for (unsigned int mip = firstMip; mip < texture.Layout.MipCount; mip++)
+		bytes += texture.Layout.Sizes[mip];
+	return bytes;
+}
+
+unsigned int TextureStreamer::GetMipFor(const StreamedTexture& texture, float need)
+{
+	unsigned int mip = 0;
+	while (mip < texture.BaseMip && GetSize(texture, mip + 1) >= need)
+		mip++;
+
+	// Round to a level a texture can start at, finer if need be
+	while (mip > 0 && !TextureCooker::IsBlockAligned(texture.Layout, mip))
+		mip--;
+	return mip;
+}
+
+unsigned int TextureStreamer::GetSize(const StreamedTexture& texture, unsigned int mip)
+{
+	unsigned int width = texture.Layout.Width >> mip;
+	unsigned int height = texture.Layout.Height >> mip;
+	unsigned int size = width > height ? width : height;
+	return size ? size : 1;
+}
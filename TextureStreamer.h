@@ -0,0 +1,108 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "Camera.h"
+#include "GameEntity.h"
+#include "MappedFile.h"
+#include "TextureCache.h"
+#include "TextureCooker.h"
+#include "ThreadPool.h"
+
+// --------------------------------------------------------
+// Streams the finer mip levels of cooked textures in and
+// out while the game runs, keeping them within a budget
+//
+// - Textures start with only their levels up to StartSize
+//   (see TextureParams::Streamed), so nothing waits on the
+//   full resolution ones
+// - Each frame, every texture's need is estimated from the
+//   on screen size of the entities that use it: their
+//   bounds, scale and distance from the camera
+// - When the wanted levels don't fit the budget, the least
+//   needed textures give up their finest levels first
+// - New textures are created from the mapped cooked file
+//   on a worker thread, one at a time, and swapped into the
+//   cached texture on the main thread by Update()
+// - Not thread safe: use it from the thread that owns the
+//   device context, like the TextureCache
+// --------------------------------------------------------
+class TextureStreamer
+{
+public:
+	// Largest top level a streamed texture starts with
+	static const unsigned int StartSize = 64;
+
+	TextureStreamer(Microsoft::WRL::ComPtr<ID3D11Device> device, size_t budget);
+	~TextureStreamer();
+
+	// Starts streaming a loaded texture. False if it has no cooked file to stream from.
+	bool Add(std::shared_ptr<CachedTexture> texture);
+
+	// Swaps in the last finished load, works out what every texture
+	// needs for this view and starts the next load or eviction
+	void Update(Camera* camera, const std::vector<std::shared_ptr<GameEntity>>& entities, float screenHeight);
+
+	// Blocks until the load in flight (if any) finishes, and swaps it in
+	void Flush();
+
+	// Bytes the streamed textures' levels should fit in (0 for no limit)
+	void SetBudget(size_t bytes);
+	size_t GetResidentBytes();
+
+	// Textures that got finer or coarser since the last ResetStats()
+	unsigned int GetLoadCount();
+	unsigned int GetEvictionCount();
+	void ResetStats();
+
+	// Prints each texture's resident, wanted and needed size to the console
+	void Report();
+
+private:
+	// One texture being streamed
+	struct StreamedTexture
+	{
+		std::weak_ptr<CachedTexture> Texture;	// Not kept alive, so it can still be unloaded
+		std::shared_ptr<MappedFile> File;
+		CookedLayout Layout;
+		unsigned int BaseMip = 0;				// Coarsest first level, the one it started with
+		unsigned int ResidentMip = 0;			// First level in video memory
+		unsigned int WantedMip = 0;
+		float Need = 0.0f;						// Texels across it needs to cover, this frame
+	};
+
+	// A texture being created on the worker
+	struct StreamJob
+	{
+		std::shared_ptr<StreamedTexture> Record;
+		unsigned int Mip = 0;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> SRV;
+		std::atomic<bool> Done;
+	};
+
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	size_t budget;
+	unsigned int loads;
+	unsigned int evictions;
+
+	std::vector<std::shared_ptr<StreamedTexture>> textures;
+	std::shared_ptr<StreamJob> job;
+
+	void FinishJob();
+	void UpdateNeeds(Camera* camera, const std::vector<std::shared_ptr<GameEntity>>& entities, float screenHeight);
+	void FitBudget();
+	void StartNextJob();
+
+	// Bytes of a texture's levels from the given one down
+	static size_t GetBytes(const StreamedTexture& texture, unsigned int firstMip);
+
+	// Coarsest level a texture can start at with at least this many texels across
+	static unsigned int GetMipFor(const StreamedTexture& texture, float need);
+	static unsigned int GetSize(const StreamedTexture& texture, unsigned int mip);
+
+	// Last, so it's destroyed (finishing its job) before anything the job uses
+	ThreadPool worker;
+};
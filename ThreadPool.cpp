@@ -0,0 +1,86 @@
+#include "ThreadPool.h"
+#include "Profiler.h"
+
+ThreadPool::ThreadPool(unsigned int threadCount)
+{
+	busyWorkers = 0;
+	stopping = false;
+
+	if (threadCount == 0)
+	{
+		unsigned int cores = std::thread::hardware_concurrency();
+		threadCount = cores > 1 ? cores - 1 : 1;
+	}
+
+	for (unsigned int i = 0; i < threadCount; i++)
+	{
+		workers.push_back(std::thread(&ThreadPool::WorkerLoop, this));
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	jobAvailable.notify_all();
+
+	for (std::thread& worker : workers)
+	{
+		worker.join();
+	}
+}
+
+void ThreadPool::Enqueue(std::function<void()> job)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.push(std::move(job));
+	}
+	jobAvailable.notify_one();
+}
+
+void ThreadPool::Wait()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	allJobsDone.wait(lock, [this]() { return jobs.empty() && busyWorkers == 0; });
+}
+
+unsigned int ThreadPool::GetThreadCount()
+{
+	return (unsigned int)workers.size();
+}
+
+// --------------------------------------------------------
+// Runs jobs until the pool is being destroyed and there
+// is nothing left in the queue
+// --------------------------------------------------------
+void ThreadPool::WorkerLoop()
+{
+	Profiler::GetInstance().SetThreadName("Worker");
+
+	while (true)
+	{
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			jobAvailable.wait(lock, [this]() { return stopping || !jobs.empty(); });
+			if (jobs.empty())
+				return;
+
+			job = std::move(jobs.front());
+			jobs.pop();
+			busyWorkers++;
+		}
+
+		job();
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			busyWorkers--;
+			if (jobs.empty() && busyWorkers == 0)
+				allJobsDone.notify_all();
+		}
+	}
+}
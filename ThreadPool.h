@@ -0,0 +1,42 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// --------------------------------------------------------
+// A fixed set of worker threads that run queued jobs
+//
+// - Jobs run in the order they were queued, on whichever
+//   worker is free first
+// - Queued jobs are finished before the pool is destroyed
+// --------------------------------------------------------
+class ThreadPool
+{
+public:
+	// threadCount of 0 uses one thread per core, leaving one core for the main thread
+	ThreadPool(unsigned int threadCount = 0);
+	~ThreadPool();
+
+	void Enqueue(std::function<void()> job);
+
+	// Blocks until every queued job has finished
+	void Wait();
+
+	unsigned int GetThreadCount();
+
+private:
+	std::vector<std::thread> workers;
+	std::queue<std::function<void()>> jobs;
+
+	std::mutex mutex;
+	std::condition_variable jobAvailable;
+	std::condition_variable allJobsDone;
+	unsigned int busyWorkers;
+	bool stopping;
+
+	void WorkerLoop();
+};
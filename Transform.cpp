@@ -5,9 +5,10 @@ using namespace DirectX;
 Transform::Transform()
 {
 	// Set up our initial transformation values
-	SetPosition(0, 0, 0);
-	SetRotation(0, 0, 0);
-	SetScale(1, 1, 1);
+	position = XMFLOAT3(0, 0, 0);
+	pitchYawRoll = XMFLOAT3(0, 0, 0);
+	scale = XMFLOAT3(1, 1, 1);
+	vectorDirty = true;
 
 	// Create our initial matrix
 	XMStoreFloat4x4(&worldMatrix, XMMatrixIdentity());
@@ -73,6 +74,10 @@ void Transform::Scale(float x, float y, float z)
 
 void Transform::SetPosition(float x, float y, float z)
 {
+	// Nothing to rebuild if nothing changed
+	if (position.x == x && position.y == y && position.z == z)
+		return;
+
 	position = XMFLOAT3(x, y, z);
 	matrixDirty = true;
 	vectorDirty = true;
@@ -80,12 +85,18 @@ void Transform::SetPosition(float x, float y, float z)
 
 void Transform::SetRotation(float p, float y, float r)
 {
+	if (pitchYawRoll.x == p && pitchYawRoll.y == y && pitchYawRoll.z == r)
+		return;
+
 	pitchYawRoll = XMFLOAT3(p, y, r);
 	matrixDirty = true;
 }
 
 void Transform::SetScale(float x, float y, float z)
 {
+	if (scale.x == x && scale.y == y && scale.z == z)
+		return;
+
 	scale = XMFLOAT3(x, y, z);
 	matrixDirty = true;
 }
@@ -139,12 +150,48 @@ void Transform::UpdateMatrices()
 		// combine them and store the result
 		XMMATRIX worldMat = scaleMat * rotMat * transMat;
 		XMStoreFloat4x4(&worldMatrix, worldMat);
-		XMStoreFloat4x4(&worldInverseTransposeMatrix, XMMatrixInverse(0, XMMatrixTranspose(worldMat)));
+		XMStoreFloat4x4(&worldInverseTransposeMatrix, InverseTranspose(worldMat, &scale));
 
 		matrixDirty = false;
 
 }
 
+// --------------------------------------------------------
+// Builds the inverse-transpose of a world matrix
+//
+// For scale * rotation * translation, world row i is the
+// rotation row scaled by s_i, so the inverse-transpose row
+// is that row / s_i^2 with -dot(t, row) / s_i^2 in w. With a
+// uniform scale the world matrix's 3x3 block is only off by
+// a constant factor, which normalizing in the shader removes,
+// so it's used as is.
+//
+// world - The world matrix
+// scale - Its per-axis scale, or null if it isn't a TRS matrix
+// --------------------------------------------------------
+XMMATRIX Transform::InverseTranspose(FXMMATRIX world, const XMFLOAT3* scale)
+{
+	// No shortcut for general matrices or a zero scale
+	if (!scale || scale->x == 0 || scale->y == 0 || scale->z == 0)
+		return XMMatrixInverse(0, XMMatrixTranspose(world));
+
+	if (scale->x == scale->y && scale->y == scale->z)
+		return world;
+
+	XMVECTOR translation = world.r[3];
+	float scales[3] = { scale->x, scale->y, scale->z };
+
+	XMMATRIX result;
+	for (int i = 0; i < 3; i++)
+	{
+		XMVECTOR row = XMVectorScale(world.r[i], 1.0f / (scales[i] * scales[i]));
+		result.r[i] = XMVectorSetW(row, -XMVectorGetX(XMVector3Dot(translation, row)));
+	}
+	result.r[3] = XMVectorSet(0, 0, 0, 1);
+
+	return result;
+}
+
 void Transform::UpdateVectors()
 {
 	// only update if there has been a change 
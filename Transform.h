@@ -24,6 +24,11 @@ public:
 	DirectX::XMFLOAT4X4 GetWorldMatrix();
 	DirectX::XMFLOAT4X4 GetWorldInverseTransposeMatrix();
 
+	// Inverse-transpose of a world matrix, for transforming normals
+	//  - Pass the matrix's scale if it's a plain scale * rotation * translation
+	//    matrix, so the inverse can be skipped; pass null for anything else
+	static DirectX::XMMATRIX InverseTranspose(DirectX::FXMMATRIX world, const DirectX::XMFLOAT3* scale);
+
 private:
 	// Raw transformation data
 	DirectX::XMFLOAT3 position;
@@ -0,0 +1,544 @@
+#include "TransformSystem.h"
+#include "Transform.h"
+#include <algorithm>
+
+using namespace DirectX;
+
+// Transforms are padded and flagged in blocks of this many (one bitset word)
+static const unsigned int TransformsPerWord = 64;
+
+// Smallest number of bitset words worth handing to another thread
+static const size_t MinWordsPerJob = 4;
+
+static unsigned int CountBits(uint64_t bits)
+{
+	unsigned int count = 0;
+	for (; bits; bits &= bits - 1)
+		count++;
+	return count;
+}
+
+// --------------------------------------------------------
+// Handle - simply forwards to the owning system
+// --------------------------------------------------------
+TransformHandle::TransformHandle(TransformSystem* system, unsigned int index)
+{
+	this->system = system;
+	this->index = index;
+}
+
+void TransformHandle::MoveAbsolute(float x, float y, float z) { system->MoveAbsolute(index, x, y, z); }
+void TransformHandle::MoveRelative(float x, float y, float z) { system->MoveRelative(index, x, y, z); }
+void TransformHandle::Rotate(float p, float y, float r) { system->Rotate(index, p, y, r); }
+void TransformHandle::Scale(float x, float y, float z) { system->Scale(index, x, y, z); }
+
+void TransformHandle::SetPosition(float x, float y, float z) { system->SetPosition(index, x, y, z); }
+void TransformHandle::SetRotation(float p, float y, float r) { system->SetRotation(index, p, y, r); }
+void TransformHandle::SetScale(float x, float y, float z) { system->SetScale(index, x, y, z); }
+
+XMFLOAT3 TransformHandle::GetPosition() { return system->GetPosition(index); }
+XMFLOAT3 TransformHandle::GetRotation() { return system->GetRotation(index); }
+XMFLOAT3 TransformHandle::GetScale() { return system->GetScale(index); }
+XMFLOAT4X4 TransformHandle::GetWorldMatrix() { return system->GetWorldMatrix(index); }
+XMFLOAT4X4 TransformHandle::GetWorldInverseTransposeMatrix() { return system->GetWorldInverseTransposeMatrix(index); }
+
+bool TransformHandle::SetParent(TransformHandle* parent) { return system->SetParent(index, parent ? parent->index : TransformSystem::NoParent); }
+TransformHandle TransformHandle::GetParent() { return TransformHandle(system, system->GetParent(index)); }
+bool TransformHandle::HasParent() { return system->GetParent(index) != TransformSystem::NoParent; }
+
+unsigned int TransformHandle::GetIndex() { return index; }
+
+
+const unsigned int TransformSystem::NoParent;
+
+TransformSystem::TransformSystem()
+{
+	count = 0;
+	hierarchyChanged = false;
+	rebuiltMatrices = 0;
+}
+
+// --------------------------------------------------------
+// Adds a new transform at the origin with no rotation and
+// a scale of one, growing the arrays a block at a time
+// --------------------------------------------------------
+unsigned int TransformSystem::Create()
+{
+	if (count == positionX.size())
+	{
+		size_t capacity = positionX.size() + TransformsPerWord;
+
+		positionX.resize(capacity, 0.0f);
+		positionY.resize(capacity, 0.0f);
+		positionZ.resize(capacity, 0.0f);
+		pitch.resize(capacity, 0.0f);
+		yaw.resize(capacity, 0.0f);
+		roll.resize(capacity, 0.0f);
+		scaleX.resize(capacity, 1.0f);
+		scaleY.resize(capacity, 1.0f);
+		scaleZ.resize(capacity, 1.0f);
+
+		XMFLOAT4X4A identity;
+		XMStoreFloat4x4A(&identity, XMMatrixIdentity());
+		localMatrices.resize(capacity, identity);
+		localInverseTransposeMatrices.resize(capacity, identity);
+
+		parents.resize(capacity, NoParent);
+		hierarchyPositions.resize(capacity, NoParent);
+
+		dirty.push_back(0);
+	}
+
+	return count++;
+}
+
+unsigned int TransformSystem::GetCount() { return count; }
+
+void TransformSystem::MoveAbsolute(unsigned int index, float x, float y, float z)
+{
+	if (x == 0 && y == 0 && z == 0)
+		return;
+
+	positionX[index] += x;
+	positionY[index] += y;
+	positionZ[index] += z;
+	MarkDirty(index);
+}
+
+void TransformSystem::MoveRelative(unsigned int index, float x, float y, float z)
+{
+	// rotate the movement vector by this transform's orientation
+	XMVECTOR rotatedVec = XMVector3Rotate(
+		XMVectorSet(x, y, z, 0),
+		XMQuaternionRotationRollPitchYaw(pitch[index], yaw[index], roll[index]));
+
+	XMFLOAT3 offset;
+	XMStoreFloat3(&offset, rotatedVec);
+	MoveAbsolute(index, offset.x, offset.y, offset.z);
+}
+
+void TransformSystem::Rotate(unsigned int index, float p, float y, float r)
+{
+	if (p == 0 && y == 0 && r == 0)
+		return;
+
+	pitch[index] += p;
+	yaw[index] += y;
+	roll[index] += r;
+	MarkDirty(index);
+}
+
+void TransformSystem::Scale(unsigned int index, float x, float y, float z)
+{
+	if (x == 1 && y == 1 && z == 1)
+		return;
+
+	scaleX[index] *= x;
+	scaleY[index] *= y;
+	scaleZ[index] *= z;
+	MarkDirty(index);
+}
+
+// --------------------------------------------------------
+// The setters only flag a transform when its values really
+// change, so re-setting constant values each frame is free
+// --------------------------------------------------------
+void TransformSystem::SetPosition(unsigned int index, float x, float y, float z)
+{
+	if (positionX[index] == x && positionY[index] == y && positionZ[index] == z)
+		return;
+
+	positionX[index] = x;
+	positionY[index] = y;
+	positionZ[index] = z;
+	MarkDirty(index);
+}
+
+void TransformSystem::SetRotation(unsigned int index, float p, float y, float r)
+{
+	if (pitch[index] == p && yaw[index] == y && roll[index] == r)
+		return;
+
+	pitch[index] = p;
+	yaw[index] = y;
+	roll[index] = r;
+	MarkDirty(index);
+}
+
+void TransformSystem::SetScale(unsigned int index, float x, float y, float z)
+{
+	if (scaleX[index] == x && scaleY[index] == y && scaleZ[index] == z)
+		return;
+
+	scaleX[index] = x;
+	scaleY[index] = y;
+	scaleZ[index] = z;
+	MarkDirty(index);
+}
+
+XMFLOAT3 TransformSystem::GetPosition(unsigned int index) { return XMFLOAT3(positionX[index], positionY[index], positionZ[index]); }
+XMFLOAT3 TransformSystem::GetRotation(unsigned int index) { return XMFLOAT3(pitch[index], yaw[index], roll[index]); }
+XMFLOAT3 TransformSystem::GetScale(unsigned int index) { return XMFLOAT3(scaleX[index], scaleY[index], scaleZ[index]); }
+
+XMFLOAT4X4 TransformSystem::GetWorldMatrix(unsigned int index)
+{
+	if (hierarchyChanged || (hierarchyPositions[index] != NoParent && !changedSubtrees.empty()))
+		UpdateMatrices();
+
+	if (hierarchyPositions[index] != NoParent)
+		return hierarchyWorldMatrices[hierarchyPositions[index]];
+
+	if (dirty[index / TransformsPerWord] & (1ull << (index % TransformsPerWord)))
+		RebuildGroup(index & ~3u);
+
+	return localMatrices[index];
+}
+
+XMFLOAT4X4 TransformSystem::GetWorldInverseTransposeMatrix(unsigned int index)
+{
+	if (hierarchyChanged || (hierarchyPositions[index] != NoParent && !changedSubtrees.empty()))
+		UpdateMatrices();
+
+	if (hierarchyPositions[index] != NoParent)
+		return hierarchyInverseTransposeMatrices[hierarchyPositions[index]];
+
+	if (dirty[index / TransformsPerWord] & (1ull << (index % TransformsPerWord)))
+		RebuildGroup(index & ~3u);
+
+	return localInverseTransposeMatrices[index];
+}
+
+bool TransformSystem::SetParent(unsigned int index, unsigned int parent)
+{
+	// Walking up from the new parent must never reach this transform
+	for (unsigned int p = parent; p != NoParent; p = parents[p])
+	{
+		if (p == index)
+			return false;
+	}
+
+	if (parents[index] != parent)
+	{
+		parents[index] = parent;
+		hierarchyChanged = true;
+	}
+	return true;
+}
+
+unsigned int TransformSystem::GetParent(unsigned int index) { return parents[index]; }
+
+unsigned int TransformSystem::GetRebuiltMatrixCount() { return rebuiltMatrices; }
+void TransformSystem::ResetStats() { rebuiltMatrices = 0; }
+
+// --------------------------------------------------------
+// Rebuilds every dirty transform
+//
+// With a thread pool, the bitset is cut into one range per
+// worker plus one for this thread, so no two threads ever
+// touch the same bitset word or matrix
+// --------------------------------------------------------
+void TransformSystem::UpdateMatrices(ThreadPool* threadPool)
+{
+	size_t words = dirty.size();
+	size_t jobs = threadPool ? threadPool->GetThreadCount() + 1 : 1;
+	if (jobs > words / MinWordsPerJob)
+		jobs = words / MinWordsPerJob;
+
+	if (jobs <= 1)
+	{
+		RebuildWords(0, words);
+	}
+	else
+	{
+		for (size_t i = 1; i < jobs; i++)
+		{
+			size_t first = words * i / jobs;
+			size_t last = words * (i + 1) / jobs;
+			threadPool->Enqueue([this, first, last]() { RebuildWords(first, last); });
+		}
+
+		RebuildWords(0, words / jobs);
+		threadPool->Wait();
+	}
+
+	// Parented transforms need their local matrices, so they go last
+	if (hierarchyChanged)
+		RebuildHierarchy();
+	PropagateHierarchy();
+}
+
+// --------------------------------------------------------
+// Flags a transform's local matrices as out of date, and
+// remembers its subtree if it's part of a hierarchy
+// --------------------------------------------------------
+void TransformSystem::MarkDirty(unsigned int index)
+{
+	uint64_t bit = 1ull << (index % TransformsPerWord);
+	uint64_t& word = dirty[index / TransformsPerWord];
+	if (!(word & bit) && hierarchyPositions[index] != NoParent)
+		changedSubtrees.push_back(hierarchyPositions[index]);
+
+	word |= bit;
+}
+
+// --------------------------------------------------------
+// Lays every transform that has a parent or children out
+// in depth-first order, so each subtree becomes a single
+// contiguous range that starts at its root
+//
+// Only needed after parents change; the whole hierarchy is
+// swept once afterwards
+// --------------------------------------------------------
+void TransformSystem::RebuildHierarchy()
+{
+	// Bucket the children of each transform (in index order)
+	std::vector<unsigned int> childStart(count + 1, 0);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (parents[i] != NoParent)
+			childStart[parents[i] + 1]++;
+	}
+	for (unsigned int i = 0; i < count; i++)
+		childStart[i + 1] += childStart[i];
+
+	std::vector<unsigned int> children(childStart[count]);
+	std::vector<unsigned int> filled(childStart.begin(), childStart.end() - 1);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (parents[i] != NoParent)
+			children[filled[parents[i]]++] = i;
+	}
+
+	// Depth-first walk from every root that has children
+	hierarchy.clear();
+	changedSubtrees.clear();
+	std::fill(hierarchyPositions.begin(), hierarchyPositions.end(), NoParent);
+	std::vector<unsigned int> stack;
+	for (unsigned int root = 0; root < count; root++)
+	{
+		if (parents[root] != NoParent || childStart[root] == childStart[root + 1])
+			continue;
+
+		changedSubtrees.push_back((unsigned int)hierarchy.size());
+		stack.push_back(root);
+		while (!stack.empty())
+		{
+			unsigned int index = stack.back();
+			stack.pop_back();
+
+			HierarchyNode node;
+			node.Index = index;
+			node.Parent = parents[index] == NoParent ? NoParent : hierarchyPositions[parents[index]];
+			node.SubtreeSize = 1;
+			hierarchyPositions[index] = (unsigned int)hierarchy.size();
+			hierarchy.push_back(node);
+
+			// Reversed, so the first child comes off the stack first
+			for (unsigned int c = childStart[index + 1]; c > childStart[index]; c--)
+				stack.push_back(children[c - 1]);
+		}
+	}
+
+	// Children always come after their parent, so sizes can be summed backwards
+	for (size_t i = hierarchy.size(); i-- > 0;)
+	{
+		if (hierarchy[i].Parent != NoParent)
+			hierarchy[hierarchy[i].Parent].SubtreeSize += hierarchy[i].SubtreeSize;
+	}
+
+	hierarchyWorldMatrices.resize(hierarchy.size());
+	hierarchyInverseTransposeMatrices.resize(hierarchy.size());
+	hierarchyChanged = false;
+}
+
+// --------------------------------------------------------
+// Recomputes the final matrices of every changed subtree
+//
+// Each subtree is a contiguous range in depth-first order,
+// with parents before their children, so it's a single
+// linear sweep. Subtrees inside one already swept are
+// skipped, so the cost follows what actually changed.
+// --------------------------------------------------------
+void TransformSystem::PropagateHierarchy()
+{
+	if (changedSubtrees.empty())
+		return;
+
+	std::sort(changedSubtrees.begin(), changedSubtrees.end());
+
+	XMVECTOR identityRow = XMVectorSet(0, 0, 0, 1);
+	unsigned int sweptUntil = 0;
+	for (unsigned int start : changedSubtrees)
+	{
+		if (start < sweptUntil)
+			continue;
+
+		unsigned int end = start + hierarchy[start].SubtreeSize;
+		for (unsigned int i = start; i < end; i++)
+		{
+			const HierarchyNode& node = hierarchy[i];
+			XMMATRIX world = XMLoadFloat4x4A(&localMatrices[node.Index]);
+			XMMATRIX inverseTranspose = XMLoadFloat4x4A(&localInverseTransposeMatrices[node.Index]);
+
+			if (node.Parent != NoParent)
+			{
+				world = XMMatrixMultiply(world, XMLoadFloat4x4A(&hierarchyWorldMatrices[node.Parent]));
+
+				// The inverse-transpose of a product is the product of the inverse-transposes.
+				// Only their 3x3 blocks are used for normals, so translations are dropped first.
+				XMMATRIX parentInverseTranspose = XMLoadFloat4x4A(&hierarchyInverseTransposeMatrices[node.Parent]);
+				inverseTranspose.r[3] = identityRow;
+				parentInverseTranspose.r[3] = identityRow;
+				inverseTranspose = XMMatrixMultiply(inverseTranspose, parentInverseTranspose);
+			}
+
+			XMStoreFloat4x4A(&hierarchyWorldMatrices[i], world);
+			XMStoreFloat4x4A(&hierarchyInverseTransposeMatrices[i], inverseTranspose);
+		}
+
+		rebuiltMatrices += end - start;
+		sweptUntil = end;
+	}
+
+	changedSubtrees.clear();
+}
+
+// --------------------------------------------------------
+// Clears a range of bitset words, rebuilding the dirty
+// groups of four they flagged
+// --------------------------------------------------------
+void TransformSystem::RebuildWords(size_t firstWord, size_t lastWord)
+{
+	unsigned int rebuilt = 0;
+	for (size_t w = firstWord; w < lastWord; w++)
+	{
+		uint64_t bits = dirty[w];
+		if (!bits)
+			continue;
+
+		// Cleared up front, so RebuildGroup() has nothing left to count
+		dirty[w] = 0;
+		rebuilt += CountBits(bits);
+
+		for (unsigned int group = 0; group < TransformsPerWord; group += 4)
+		{
+			if ((bits >> group) & 0xF)
+				RebuildGroup((unsigned int)(w * TransformsPerWord) + group);
+		}
+	}
+
+	rebuiltMatrices += rebuilt;
+}
+
+// --------------------------------------------------------
+// Rebuilds the local matrices of four consecutive transforms
+//
+// The matrices are built with each SIMD lane holding a
+// different transform (one vector per matrix element), then
+// transposed back into one matrix per transform. The
+// rotation matches XMMatrixRotationRollPitchYaw, which
+// applies roll, then pitch, then yaw.
+//
+// Since every transform is scale * rotation * translation,
+// row i of the inverse-transpose is simply rotation row i
+// divided by scale i, with -dot(t, rotation row i) / scale i
+// in w. Uniformly scaled transforms reuse the world matrix.
+//
+// first - Index of the first transform, a multiple of 4
+// --------------------------------------------------------
+void TransformSystem::RebuildGroup(unsigned int first)
+{
+	XMVECTOR sinP, cosP, sinY, cosY, sinR, cosR;
+	XMVectorSinCos(&sinP, &cosP, XMLoadFloat4((const XMFLOAT4*)&pitch[first]));
+	XMVectorSinCos(&sinY, &cosY, XMLoadFloat4((const XMFLOAT4*)&yaw[first]));
+	XMVectorSinCos(&sinR, &cosR, XMLoadFloat4((const XMFLOAT4*)&roll[first]));
+
+	XMVECTOR sinPsinY = XMVectorMultiply(sinP, sinY);
+	XMVECTOR sinPcosY = XMVectorMultiply(sinP, cosY);
+
+	// Rotation matrix, one element per vector
+	XMVECTOR r00 = XMVectorMultiplyAdd(sinR, sinPsinY, XMVectorMultiply(cosR, cosY));
+	XMVECTOR r01 = XMVectorMultiply(sinR, cosP);
+	XMVECTOR r02 = XMVectorNegativeMultiplySubtract(cosR, sinY, XMVectorMultiply(sinR, sinPcosY));
+	XMVECTOR r10 = XMVectorNegativeMultiplySubtract(sinR, cosY, XMVectorMultiply(cosR, sinPsinY));
+	XMVECTOR r11 = XMVectorMultiply(cosR, cosP);
+	XMVECTOR r12 = XMVectorMultiplyAdd(cosR, sinPcosY, XMVectorMultiply(sinR, sinY));
+	XMVECTOR r20 = XMVectorMultiply(cosP, sinY);
+	XMVECTOR r21 = XMVectorNegate(sinP);
+	XMVECTOR r22 = XMVectorMultiply(cosP, cosY);
+
+	XMVECTOR sx = XMLoadFloat4((const XMFLOAT4*)&scaleX[first]);
+	XMVECTOR sy = XMLoadFloat4((const XMFLOAT4*)&scaleY[first]);
+	XMVECTOR sz = XMLoadFloat4((const XMFLOAT4*)&scaleZ[first]);
+	XMVECTOR tx = XMLoadFloat4((const XMFLOAT4*)&positionX[first]);
+	XMVECTOR ty = XMLoadFloat4((const XMFLOAT4*)&positionY[first]);
+	XMVECTOR tz = XMLoadFloat4((const XMFLOAT4*)&positionZ[first]);
+	XMVECTOR zero = XMVectorZero();
+	XMVECTOR one = XMVectorSplatOne();
+
+	// World rows are the rotation rows scaled by their axis
+	XMMATRIX world[4] =
+	{
+		XMMATRIX(XMVectorMultiply(r00, sx), XMVectorMultiply(r01, sx), XMVectorMultiply(r02, sx), zero),
+		XMMATRIX(XMVectorMultiply(r10, sy), XMVectorMultiply(r11, sy), XMVectorMultiply(r12, sy), zero),
+		XMMATRIX(XMVectorMultiply(r20, sz), XMVectorMultiply(r21, sz), XMVectorMultiply(r22, sz), zero),
+		XMMATRIX(tx, ty, tz, one)
+	};
+
+	// Inverse-transpose rows are the rotation rows divided by their axis
+	XMVECTOR invSx = XMVectorReciprocal(sx);
+	XMVECTOR invSy = XMVectorReciprocal(sy);
+	XMVECTOR invSz = XMVectorReciprocal(sz);
+	XMVECTOR dot0 = XMVectorMultiplyAdd(tz, r02, XMVectorMultiplyAdd(ty, r01, XMVectorMultiply(tx, r00)));
+	XMVECTOR dot1 = XMVectorMultiplyAdd(tz, r12, XMVectorMultiplyAdd(ty, r11, XMVectorMultiply(tx, r10)));
+	XMVECTOR dot2 = XMVectorMultiplyAdd(tz, r22, XMVectorMultiplyAdd(ty, r21, XMVectorMultiply(tx, r20)));
+	XMMATRIX inverseTranspose[4] =
+	{
+		XMMATRIX(XMVectorMultiply(r00, invSx), XMVectorMultiply(r01, invSx), XMVectorMultiply(r02, invSx), XMVectorNegate(XMVectorMultiply(dot0, invSx))),
+		XMMATRIX(XMVectorMultiply(r10, invSy), XMVectorMultiply(r11, invSy), XMVectorMultiply(r12, invSy), XMVectorNegate(XMVectorMultiply(dot1, invSy))),
+		XMMATRIX(XMVectorMultiply(r20, invSz), XMVectorMultiply(r21, invSz), XMVectorMultiply(r22, invSz), XMVectorNegate(XMVectorMultiply(dot2, invSz))),
+		XMMATRIX(zero, zero, zero, one)
+	};
+
+	// Uniformly scaled lanes keep the world matrix instead
+	XMVECTOR uniform = XMVectorAndInt(XMVectorEqual(sx, sy), XMVectorEqual(sy, sz));
+	for (int row = 0; row < 4; row++)
+	{
+		for (int e = 0; e < 4; e++)
+			inverseTranspose[row].r[e] = XMVectorSelect(inverseTranspose[row].r[e], world[row].r[e], uniform);
+	}
+
+	// Back to one matrix per transform: row i of each is now in .r[i]
+	for (int row = 0; row < 4; row++)
+	{
+		world[row] = XMMatrixTranspose(world[row]);
+		inverseTranspose[row] = XMMatrixTranspose(inverseTranspose[row]);
+	}
+
+	// A zero scale has no inverse to build directly
+	XMVECTOR zeroScale = XMVectorOrInt(XMVectorOrInt(XMVectorEqual(sx, zero), XMVectorEqual(sy, zero)), XMVectorEqual(sz, zero));
+	XMFLOAT4A fallback;
+	XMStoreFloat4A(&fallback, zeroScale);
+	const float* needsFallback = &fallback.x;
+
+	for (unsigned int i = 0; i < 4; i++)
+	{
+		XMMATRIX worldMat(world[0].r[i], world[1].r[i], world[2].r[i], world[3].r[i]);
+		XMStoreFloat4x4A(&localMatrices[first + i], worldMat);
+
+		if (needsFallback[i] != 0)
+			XMStoreFloat4x4A(&localInverseTransposeMatrices[first + i], Transform::InverseTranspose(worldMat, 0));
+		else
+			XMStoreFloat4x4A(&localInverseTransposeMatrices[first + i],
+				XMMATRIX(inverseTranspose[0].r[i], inverseTranspose[1].r[i], inverseTranspose[2].r[i], inverseTranspose[3].r[i]));
+	}
+
+	// GetWorldMatrix() can rebuild a group on its own, so clear its bits here too
+	uint64_t& word = dirty[first / TransformsPerWord];
+	uint64_t groupBits = word & (0xFull << (first % TransformsPerWord));
+	if (groupBits)
+	{
+		word &= ~groupBits;
+		rebuiltMatrices += CountBits(groupBits);
+	}
+}
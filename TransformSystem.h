@@ -0,0 +1,153 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include "ThreadPool.h"
+
+class TransformSystem;
+
+// --------------------------------------------------------
+// A reference to one transform inside a TransformSystem,
+// with the same interface as Transform
+// --------------------------------------------------------
+class TransformHandle
+{
+public:
+	TransformHandle(TransformSystem* system, unsigned int index);
+
+	void MoveAbsolute(float x, float y, float z);
+	void MoveRelative(float x, float y, float z);
+	void Rotate(float p, float y, float r);
+	void Scale(float x, float y, float z);
+
+	void SetPosition(float x, float y, float z);
+	void SetRotation(float p, float y, float r);
+	void SetScale(float x, float y, float z);
+
+	DirectX::XMFLOAT3 GetPosition();
+	DirectX::XMFLOAT3 GetRotation();
+	DirectX::XMFLOAT3 GetScale();
+	DirectX::XMFLOAT4X4 GetWorldMatrix();
+	DirectX::XMFLOAT4X4 GetWorldInverseTransposeMatrix();
+
+	bool SetParent(TransformHandle* parent);
+	TransformHandle GetParent();
+	bool HasParent();
+
+	unsigned int GetIndex();
+
+private:
+	TransformSystem* system;
+	unsigned int index;
+};
+
+// --------------------------------------------------------
+// Stores many transforms as structure-of-arrays data and
+// rebuilds their matrices in bulk
+//
+// - Setters only flag the transform in a dirty bitset;
+//   UpdateMatrices() rebuilds every flagged transform at
+//   once, four at a time with SIMD
+// - The work can be split across a ThreadPool, in blocks
+//   of 64 transforms (one word of the bitset)
+// - Transforms can be parented to each other; world
+//   matrices are then local * parent world. Parented
+//   transforms are kept in depth-first order, so only the
+//   subtrees under changed transforms are swept, linearly
+// - Getting a matrix of a dirty transform brings it up to
+//   date first, so results are never stale
+// - Not thread safe: change transforms from one thread,
+//   then call UpdateMatrices()
+// --------------------------------------------------------
+class TransformSystem
+{
+public:
+	TransformSystem();
+
+	// Adds an identity transform and returns its index
+	unsigned int Create();
+	unsigned int GetCount();
+
+	void MoveAbsolute(unsigned int index, float x, float y, float z);
+	void MoveRelative(unsigned int index, float x, float y, float z);
+	void Rotate(unsigned int index, float p, float y, float r);
+	void Scale(unsigned int index, float x, float y, float z);
+
+	void SetPosition(unsigned int index, float x, float y, float z);
+	void SetRotation(unsigned int index, float p, float y, float r);
+	void SetScale(unsigned int index, float x, float y, float z);
+
+	DirectX::XMFLOAT3 GetPosition(unsigned int index);
+	DirectX::XMFLOAT3 GetRotation(unsigned int index);
+	DirectX::XMFLOAT3 GetScale(unsigned int index);
+	DirectX::XMFLOAT4X4 GetWorldMatrix(unsigned int index);
+	DirectX::XMFLOAT4X4 GetWorldInverseTransposeMatrix(unsigned int index);
+
+	// Attaches a transform to a parent (or detaches it, with NoParent).
+	// Returns false, changing nothing, if that would create a cycle.
+	bool SetParent(unsigned int index, unsigned int parent);
+	unsigned int GetParent(unsigned int index);
+
+	static const unsigned int NoParent = 0xFFFFFFFF;
+
+	// Rebuilds the matrices of every dirty transform, optionally
+	// sharing the work with the given pool's threads
+	void UpdateMatrices(ThreadPool* threadPool = 0);
+
+	// Matrices rebuilt (local or propagated) since the last reset
+	unsigned int GetRebuiltMatrixCount();
+	void ResetStats();
+
+private:
+	unsigned int count;
+
+	// Raw transformation data, one array per component, padded
+	// to a multiple of 64 transforms so groups of 4 never overrun
+	std::vector<float> positionX, positionY, positionZ;
+	std::vector<float> pitch, yaw, roll;
+	std::vector<float> scaleX, scaleY, scaleZ;
+
+	// Matrices built from each transform's own data, which are
+	// also the final matrices of transforms outside a hierarchy
+	std::vector<DirectX::XMFLOAT4X4A> localMatrices;
+	std::vector<DirectX::XMFLOAT4X4A> localInverseTransposeMatrices;
+
+	// One bit per transform whose local matrices are out of date
+	std::vector<uint64_t> dirty;
+
+	// Parent of each transform, or NoParent
+	std::vector<unsigned int> parents;
+
+	// A transform with a parent or children, in depth-first order
+	struct HierarchyNode
+	{
+		unsigned int Index;			// Transform index
+		unsigned int Parent;		// Position of the parent in the hierarchy, or NoParent
+		unsigned int SubtreeSize;	// This node plus all of its descendants
+	};
+
+	// Every parented transform in depth-first order, so each subtree is
+	// one contiguous range, with their final matrices in the same order
+	std::vector<HierarchyNode> hierarchy;
+	std::vector<DirectX::XMFLOAT4X4A> hierarchyWorldMatrices;
+	std::vector<DirectX::XMFLOAT4X4A> hierarchyInverseTransposeMatrices;
+
+	// Position of each transform in the hierarchy, or NoParent if it's not in one
+	std::vector<unsigned int> hierarchyPositions;
+
+	// Hierarchy positions whose subtrees need sweeping, and whether
+	// the depth-first order itself has to be rebuilt
+	std::vector<unsigned int> changedSubtrees;
+	bool hierarchyChanged;
+
+	// Stats - added to by every thread doing rebuilds
+	std::atomic<unsigned int> rebuiltMatrices;
+
+	void MarkDirty(unsigned int index);
+	void RebuildGroup(unsigned int first);
+	void RebuildWords(size_t firstWord, size_t lastWord);
+	void RebuildHierarchy();
+	void PropagateHierarchy();
+};
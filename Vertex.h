@@ -12,5 +12,5 @@ struct Vertex
 	DirectX::XMFLOAT3 Position;	    // The local position of the vertex
 	DirectX::XMFLOAT3 Normal;
 	DirectX::XMFLOAT2 UV;
-	DirectX::XMFLOAT3 Tangent;
+	DirectX::XMFLOAT4 Tangent;		// xyz = tangent, w = bitangent sign (+1 or -1)
 };
\ No newline at end of file
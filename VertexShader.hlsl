@@ -1,38 +1,44 @@
 #include "ShaderIncludes.hlsli"
 
-cbuffer ExternalData : register(b0)
-{
-	matrix world;
-	matrix worldInvTranspose;
-	matrix view;
-	matrix projection;
-	matrix lightView;
-	matrix lightProj;
-}
-
 // --------------------------------------------------------
 // The entry point (main method) for our vertex shader
 // 
 // - Input is exactly one vertex worth of data (defined by a struct)
 // - Output is a single struct of data to pass down the pipeline
 // - Named "main" because that's the default the shader compiler looks for
+// - Built a second time with INSTANCED defined (see
+//   VertexShaderInstanced.hlsl), taking the matrices per instance
 // --------------------------------------------------------
+#ifdef INSTANCED
+VertexToPixel main( VertexShaderInputInstanced input )
+#else
 VertexToPixel main( VertexShaderInput input )
+#endif
 {
 	// Set up output struct
 	VertexToPixel output;
 
-	matrix shadowWVP = mul(lightProj, mul(lightView, world));
+#ifdef INSTANCED
+	matrix worldMatrix = InstanceWorld(input);
+	matrix worldInvTransposeMatrix = InstanceWorldInvTranspose(input);
+	output.materialIndex = input.materialIndex;
+#else
+	matrix worldMatrix = world;
+	matrix worldInvTransposeMatrix = worldInvTranspose;
+	output.materialIndex = materialIndex;
+#endif
+
+	matrix shadowWVP = mul(lightProj, mul(lightView, worldMatrix));
 	output.shadowMapPos = mul(shadowWVP, float4(input.localPosition, 1));
 
-	matrix wvp = mul(mul(projection, view), world);
+	matrix wvp = mul(mul(projection, view), worldMatrix);
 	output.screenPosition = mul(wvp, float4(input.localPosition, 1.0f));
 
 	output.uv = input.uv;
 
-	output.normal = mul((float3x3)worldInvTranspose, input.normal);
-	output.tangent = mul((float3x3)worldInvTranspose, input.tangent);
-	output.worldPosition = mul(world, float4(input.localPosition, 1)).xyz;
+	output.normal = mul((float3x3)worldInvTransposeMatrix, input.normal);
+	output.tangent = float4(mul((float3x3)worldInvTransposeMatrix, input.tangent.xyz), input.tangent.w);
+	output.worldPosition = mul(worldMatrix, float4(input.localPosition, 1)).xyz;
 
 	// Whatever we return will make its way through the pipeline to the
 	// next programmable stage we're using (the pixel shader for now)
@@ -0,0 +1,4 @@
+// The same vertex shader, with each instance's matrices read from
+// the instance buffer rather than the PerObject cbuffer
+#define INSTANCED
+#include "VertexShader.hlsl"